@@ -0,0 +1,108 @@
+//
+//  FITSbackground.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSbackground_
+#define _DSL_FITSbackground_
+
+#include <vector>
+#include <cstddef>
+
+#include "FITSexception.h"
+
+namespace DSL
+{
+#pragma region - FITSbackground class definition
+    /**
+     *  @class FITSbackground
+     *  @brief Mesh based sky background estimator
+     *  @details The plane is divided in cells of meshx*meshy pixels. In each cell the valid pixels are sigma-clipped around their median
+     *  and the background is estimated as the clipped median or, as in SExtractor, as the mode \f$2.5\,\mathrm{med}-1.5\,\mathrm{mean}\f$
+     *  (the median being kept when the distribution is too skewed, i.e. \f$|\mathrm{mean}-\mathrm{med}| > 0.3\,\sigma\f$).
+     *  Cells with less than half of their pixels valid are filled from their neighbours. The background and RMS meshes are then median filtered
+     *  and interpolated back to full resolution with a bicubic kernel.
+     *  The estimator keeps the meshes of the last processed plane.
+     */
+    class FITSbackground
+    {
+    public:
+        enum class estimator {median, mode};   //!< Cell background estimator
+
+    protected:
+#pragma region * Protected member
+        size_t fmeshx;                  //!< Cell size along the x axis [pix]
+        size_t fmeshy;                  //!< Cell size along the y axis [pix]
+        size_t ffilter;                 //!< Size of the median filter applied to the meshes [cells]
+        double fclip;                   //!< Sigma clipping threshold
+        size_t fmaxIter;                //!< Maximum number of clipping iterations
+        estimator festimator;           //!< Cell background estimator
+
+        size_t fnx;                     //!< Number of columns of the last processed plane
+        size_t fny;                     //!< Number of rows of the last processed plane
+        size_t fcx;                     //!< Number of cells along the x axis
+        size_t fcy;                     //!< Number of cells along the y axis
+        std::vector<double> fbkg;       //!< Background mesh, fcy rows of fcx cells
+        std::vector<double> frms;       //!< RMS mesh, fcy rows of fcx cells
+
+#pragma endregion
+#pragma region * Protected member function
+        bool CellStatistic(const std::vector<double>& values, double& bkg, double& rms) const;
+        void FillInvalidCells(std::vector<double>& mesh, std::vector<bool>& valid) const;
+        void MedianFilter(std::vector<double>& mesh) const;
+        void Upsample(const std::vector<double>& mesh, double* out) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build a background estimator
+         *  @param meshx: Cell size along the x axis [pix]
+         *  @param meshy: Cell size along the y axis [pix]
+         *  @param filter: Size of the median filter applied to the meshes [cells], 1 to disable
+         *  @param est: Cell background estimator
+         *  @param clip: Sigma clipping threshold
+         *  @param maxIter: Maximum number of clipping iterations
+         */
+        FITSbackground(const size_t& meshx = 64, const size_t& meshy = 64, const size_t& filter = 3,
+                       const estimator& est = estimator::mode, const double& clip = 3., const size_t& maxIter = 10);
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t MeshX() const {return fmeshx;}                         //!< Cell size along the x axis [pix]
+        inline size_t MeshY() const {return fmeshy;}                         //!< Cell size along the y axis [pix]
+        inline size_t CellsX() const {return fcx;}                           //!< Number of cells along the x axis
+        inline size_t CellsY() const {return fcy;}                           //!< Number of cells along the y axis
+        inline estimator Estimator() const {return festimator;}              //!< Cell background estimator
+        inline const std::vector<double>& MeshBackground() const {return fbkg;}  //!< Filtered background mesh
+        inline const std::vector<double>& MeshRMS() const {return frms;}         //!< Filtered RMS mesh
+
+        double GlobalBackground() const;                                     //!< Median of the background mesh
+        double GlobalRMS() const;                                            //!< Median of the RMS mesh
+
+#pragma endregion
+#pragma region * Estimation
+        /**
+         *  @brief Estimate the background and RMS meshes of a 2D plane
+         *  @param in: nx*ny input values
+         *  @param msk: nx*ny input mask (true for masked pixels), may be nullptr
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         */
+        void Estimate(const double* in, const bool* msk, const size_t& nx, const size_t& ny);
+
+        void Background(double* out) const;  //!< Full resolution background of the last processed plane (nx*ny values)
+        void RMS(double* out) const;         //!< Full resolution RMS of the last processed plane (nx*ny values)
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -0,0 +1,190 @@
+//
+//  FITScalibration.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITScalibration_
+#define _DSL_FITScalibration_
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <fitsio.h>
+
+#include "FITSexception.h"
+#include "FITSparallel.h"
+
+namespace DSL
+{
+    class FITScube;
+
+#pragma region - FITScalibration class definition
+    /**
+     *  @class FITScalibration
+     *  @brief CCD calibration with master bias, dark, flat and bad pixel frames
+     *  @details The calibrated value of a pixel is \f$(raw - bias - dark\,t_{exp}/t_{dark}) / flat\f$, computed in a single pass over the raw frame.
+     *  The master frames are converted once when they are set: the bias, the dark current per second and the inverse of the normalized flat
+     *  are kept in single precision, together with a bad pixel map gathering the bad pixel frame, the masked or non finite pixels of the masters
+     *  and the pixels with a non positive flat. Missing masters are stored as neutral frames (0 bias and dark, unit flat).
+     *  Setting a master again keeps the bad pixels flagged by the previous masters. Apply does not modify the calibration, so the same object can be shared across calls and threads.
+     *  @note Only the first plane of the master frames is used, and it is applied to every plane of the raw frames.
+     */
+    class FITScalibration
+    {
+    protected:
+#pragma region * Protected member
+        size_t fnx;                     //!< Number of columns of the master frames
+        size_t fny;                     //!< Number of rows of the master frames
+
+        std::vector<float>   fbias;     //!< Master bias
+        std::vector<float>   fdark;     //!< Master dark current [per second]
+        std::vector<float>   fgain;     //!< Inverse of the normalized master flat
+        std::vector<uint8_t> fbad;      //!< Bad pixel map, 1 for bad pixels
+
+        double fdarkTime;               //!< Exposure time of the master dark
+        double fflatNorm;               //!< Normalization of the master flat
+
+        std::string fbiasName;          //!< Provenance of the master bias
+        std::string fdarkName;          //!< Provenance of the master dark
+        std::string fflatName;          //!< Provenance of the master flat
+        std::string fbadName;           //!< Provenance of the bad pixel frame
+
+#pragma endregion
+#pragma region * Protected member function
+        void Reshape(const FITScube& master, const std::string& what);
+        std::vector<double> Plane(const FITScube& master, const std::string& what);
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        FITScalibration();      //!< Calibration without master frame
+
+#pragma endregion
+#pragma region * Master frames
+        /**
+         *  @brief Set the master bias
+         *  @param bias: Master bias frame
+         *  @param name: Provenance written in the CALBIAS keyword of the calibrated frames, EXTNAME of the master if empty
+         */
+        void SetBias(const FITScube& bias, const std::string& name = "");
+
+        /**
+         *  @brief Set the master dark, bias subtracted
+         *  @param dark: Master dark frame
+         *  @param darkTime: Exposure time of the master dark, EXPTIME keyword of the master if not strictly positive
+         *  @param name: Provenance written in the CALDARK keyword of the calibrated frames, EXTNAME of the master if empty
+         */
+        void SetDark(const FITScube& dark, const double& darkTime = 0., const std::string& name = "");
+
+        /**
+         *  @brief Set the master flat
+         *  @param flat: Master flat frame
+         *  @param normalize: Divide the flat by the median of its valid pixels
+         *  @param name: Provenance written in the CALFLAT keyword of the calibrated frames, EXTNAME of the master if empty
+         */
+        void SetFlat(const FITScube& flat, const bool& normalize = true, const std::string& name = "");
+
+        /**
+         *  @brief Set the bad pixel frame
+         *  @param bpm: Bad pixel frame, non zero or masked pixels are bad
+         *  @param name: Provenance written in the CALBPM keyword of the calibrated frames, EXTNAME of the frame if empty
+         */
+        void SetBadPixels(const FITScube& bpm, const std::string& name = "");
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t Nx() const {return fnx;}                                     //!< Number of columns of the master frames
+        inline size_t Ny() const {return fny;}                                     //!< Number of rows of the master frames
+        inline bool HasBias() const {return !fbiasName.empty();}                   //!< True if a master bias is set
+        inline bool HasDark() const {return !fdarkName.empty();}                   //!< True if a master dark is set
+        inline bool HasFlat() const {return !fflatName.empty();}                   //!< True if a master flat is set
+        inline bool HasBadPixels() const {return !fbadName.empty();}               //!< True if a bad pixel frame is set
+        inline double DarkTime() const {return fdarkTime;}                         //!< Exposure time of the master dark
+        inline double FlatNorm() const {return fflatNorm;}                         //!< Normalization of the master flat
+        inline const std::string& BiasName() const {return fbiasName;}             //!< Provenance of the master bias
+        inline const std::string& DarkName() const {return fdarkName;}             //!< Provenance of the master dark
+        inline const std::string& FlatName() const {return fflatName;}             //!< Provenance of the master flat
+        inline const std::string& BadPixelsName() const {return fbadName;}         //!< Provenance of the bad pixel frame
+        size_t NumberOfBadPixels() const;                                          //!< Number of pixels flagged by the bad pixel map
+
+#pragma endregion
+#pragma region * Calibration
+        /**
+         *  @brief Calibrate a raw plane
+         *  @param raw: Nx()*Ny() raw values
+         *  @param msk: Nx()*Ny() input mask (true for masked pixels), may be nullptr
+         *  @param exptime: Exposure time of the raw frame, used to scale the dark
+         *  @param out: Nx()*Ny() calibrated values, 0 for bad pixels
+         *  @param omsk: Nx()*Ny() output mask, true for masked, bad or non finite pixels
+         */
+        template<typename T>
+        void Apply(const T* raw, const bool* msk, const double& exptime, float* out, bool* omsk) const;
+
+#pragma endregion
+    };
+
+#pragma endregion
+#pragma region - FITScalibration template implementation
+
+    template<typename T>
+    void FITScalibration::Apply(const T* raw, const bool* msk, const double& exptime, float* out, bool* omsk) const
+    {
+        if(fnx*fny == 0)
+            throw FITSexception(BAD_DIMEN,"FITScalibration","Apply","no master frame");
+
+        if(raw == nullptr || out == nullptr || omsk == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITScalibration","Apply","missing data or output buffer");
+
+        if(HasDark() && !(exptime >= 0.) )
+            throw FITSexception(BAD_OPTION,"FITScalibration","Apply","exposure time must be positive");
+
+        // Values exactly representable in single precision are calibrated in single precision
+        using acc_t = std::conditional_t<(sizeof(T) <= 2 || std::is_same_v<T,float>), float, double>;
+
+        const float*   bias = fbias.data();
+        const float*   dark = fdark.data();
+        const float*   gain = fgain.data();
+        const uint8_t* flag = fbad.data();
+        const acc_t    t    = static_cast<acc_t>(exptime);
+        const acc_t    vmax = static_cast<acc_t>(std::numeric_limits<float>::max());
+
+        // Branch free loop on copies of the pointers, so that it vectorizes
+        auto kernel = [=](size_t begin, size_t end, auto useMask)
+        {
+            for(size_t k = begin; k < end; k++)
+            {
+                const acc_t v = (static_cast<acc_t>(raw[k]) - bias[k] - dark[k]*t) * gain[k];
+
+                bool bad = flag[k] | !(std::abs(v) <= vmax);
+                if constexpr (decltype(useMask)::value)
+                    bad |= msk[k];
+
+                out[k]  = bad ? 0.f : static_cast<float>(v);
+                omsk[k] = bad;
+            }
+        };
+
+        detail::parallel_chunks(fnx*fny, 16, [&](size_t begin, size_t end)
+        {
+            if(msk != nullptr)
+                kernel(begin, end, std::true_type{});
+            else
+                kernel(begin, end, std::false_type{});
+        });
+    }
+
+#pragma endregion
+}
+
+#endif
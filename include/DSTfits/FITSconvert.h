@@ -0,0 +1,183 @@
+//
+//  FITSconvert.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSconvert_
+#define _DSL_FITSconvert_
+
+#include <cmath>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "FITSparallel.h"
+
+namespace DSL
+{
+    namespace detail
+    {
+        /**
+         *  @brief True if every value of V is exactly in the range of the integral type U
+         */
+        template<typename V, typename U>
+        constexpr bool integral_range_contains()
+        {
+            return static_cast<long double>(std::numeric_limits<V>::lowest()) >= static_cast<long double>(std::numeric_limits<U>::lowest()) &&
+                   static_cast<long double>(std::numeric_limits<V>::max())    <= static_cast<long double>(std::numeric_limits<U>::max());
+        }
+
+        /**
+         *  @brief Saturating conversion of a value of type V to type U
+         *  @details The range tests are selected at compile time for each (V,U) pair and written without branches, so that the loops calling
+         *  this function vectorize:
+         *  - integral to wider integral, integral to floating point and float to double are plain casts;
+         *  - integral to narrower integral is clamped to the range of U;
+         *  - floating point to integral is rounded half away from zero and clamped, NaN and infinities give 0;
+         *  - double to float is clamped to the float range, NaN and infinities give NaN.
+         *  @param x: Value to convert
+         *  @param overflow: Set to true if x is not finite or out of the range of U
+         *  @return Converted value
+         */
+        template<typename U, typename V>
+        inline U saturate_convert(const V& x, bool& overflow) noexcept
+        {
+            if constexpr (std::is_floating_point_v<V>)
+            {
+                const bool finite = std::abs(x) <= std::numeric_limits<V>::max();
+
+                if constexpr (std::is_floating_point_v<U>)
+                {
+                    if constexpr (sizeof(U) < sizeof(V))
+                    {
+                        const V    umax = static_cast<V>(std::numeric_limits<U>::max());
+                        const bool over = finite & (std::abs(x) > umax);
+                        const V    c    = std::min(std::max(x, -umax), umax);
+
+                        overflow = !finite | over;
+                        return finite ? static_cast<U>(c) : std::numeric_limits<U>::quiet_NaN();
+                    }
+                    else
+                    {
+                        overflow = !finite;
+                        return finite ? static_cast<U>(x) : std::numeric_limits<U>::quiet_NaN();
+                    }
+                }
+                else
+                {
+                    // Exclusive bounds of the rounded value: the lowest bound of 64 bits types is not representable and is replaced by the next double below
+                    const double lo = static_cast<double>(std::numeric_limits<U>::lowest());
+                    const double hi = static_cast<double>(std::numeric_limits<U>::max()) + 1.;
+                    const double lx = (lo - 1. < lo) ? lo - 1. : std::nextafter(lo, -std::numeric_limits<double>::infinity());
+
+                    const double r  = std::round(static_cast<double>(x));
+                    const bool   below = finite & !(r > lx);
+                    const bool   above = finite & !(r < hi);
+                    const double c  = (finite & !below & !above) ? r : 0.;
+
+                    overflow = !finite | below | above;
+                    return below ? std::numeric_limits<U>::lowest() : (above ? std::numeric_limits<U>::max() : static_cast<U>(c));
+                }
+            }
+            else if constexpr (std::is_floating_point_v<U> || integral_range_contains<V,U>())
+            {
+                overflow = false;
+                return static_cast<U>(x);
+            }
+            else
+            {
+                bool below = false;
+                bool above = false;
+
+                if constexpr (static_cast<long double>(std::numeric_limits<V>::lowest()) < static_cast<long double>(std::numeric_limits<U>::lowest()))
+                    below = x < static_cast<V>(std::numeric_limits<U>::lowest());
+                if constexpr (static_cast<long double>(std::numeric_limits<V>::max()) > static_cast<long double>(std::numeric_limits<U>::max()))
+                    above = x > static_cast<V>(std::numeric_limits<U>::max());
+
+                overflow = below | above;
+                return below ? std::numeric_limits<U>::lowest() : (above ? std::numeric_limits<U>::max() : static_cast<U>(x));
+            }
+        }
+
+        /**
+         *  @brief Convert n values of type V to type U by chunks processed concurrently
+         *  @details Each chunk of values is converted by saturate_convert and the output mask is the input mask, ORed with the overflow flags
+         *  if requested. No buffer proportional to n is allocated. If src and dst are the same buffer (which requires sizeof(V) == sizeof(U)),
+         *  each chunk is converted to a local buffer and copied back, so that the conversion is done in place.
+         *  @param src: n input values
+         *  @param dst: n output values, may be src if sizeof(V) == sizeof(U)
+         *  @param imsk: n input mask values, may be nullptr
+         *  @param omsk: n output mask values, may be nullptr
+         *  @param n: Number of values
+         *  @param maskOverflow: Mask the values that are not finite or out of the range of U
+         *  @return Number of values that are not finite or out of the range of U
+         */
+        template<typename V, typename U>
+        size_t convert_array(const V* src, U* dst, const bool* imsk, bool* omsk, const size_t& n, const bool& maskOverflow = true)
+        {
+            constexpr size_t block = 4096;
+
+            const bool inplace = static_cast<const void*>(src) == static_cast<const void*>(dst);
+            if(inplace && sizeof(V) != sizeof(U))
+                throw std::invalid_argument("convert_array: in place conversion requires types of the same size");
+
+            const size_t nblock = (n + block - 1) / block;
+            std::vector<size_t> noverflow(nblock, 0);
+
+            parallel_chunks(nblock, block, [&](size_t begin, size_t end)
+            {
+                U    tmp[block];
+                bool ovf[block];
+
+                for(size_t b = begin; b < end; b++)
+                {
+                    const size_t k0 = b*block;
+                    const size_t m  = std::min(block, n - k0);
+                    const V*     s  = src + k0;
+                    U*           d  = inplace ? tmp : dst + k0;
+
+                    for(size_t i = 0; i < m; i++)
+                        d[i] = saturate_convert<U>(s[i], ovf[i]);
+
+                    if(inplace)
+                        std::memcpy(static_cast<void*>(dst + k0), tmp, m*sizeof(U));
+
+                    size_t count = 0;
+                    for(size_t i = 0; i < m; i++)
+                        count += ovf[i];
+                    noverflow[b] = count;
+
+                    if(omsk == nullptr)
+                        continue;
+
+                    bool* o = omsk + k0;
+                    if(imsk != nullptr)
+                        for(size_t i = 0; i < m; i++)
+                            o[i] = imsk[k0 + i] | (ovf[i] & maskOverflow);
+                    else
+                        for(size_t i = 0; i < m; i++)
+                            o[i] = ovf[i] & maskOverflow;
+                }
+            });
+
+            size_t total = 0;
+            for(const size_t& c : noverflow)
+                total += c;
+
+            return total;
+        }
+    }
+}
+
+#endif
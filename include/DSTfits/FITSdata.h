@@ -150,56 +150,91 @@ namespace DSL
 #include <memory>
 #include <functional>
 #include <typeindex>
+#include <variant>
 #include <cstddef>
 #include <type_traits>
 
 namespace DSL {
 
-    // forward declaration of template derived class used by applyIfType
-    template<typename T>
-    struct FitsArray;
-
     /*!
-     * \brief Polymorphic base for typed FITS array storage.
+     * \brief Variant of the typed valarrays that can back a FITS array.
      *
-     * Provides a uniform interface for accessing and modifying array elements
-     * as doubles, querying size, and retrieving the concrete storage type via
-     * std::type_index. Derived classes wrap std::valarray<T>.
+     * One alternative per supported storage type; size_t is a distinct type
+     * from uint64_t only on Darwin.
+     */
+    using FitsArrayVariant = std::variant<
+        std::valarray< uint8_t>, std::valarray<  int8_t>,
+        std::valarray<uint16_t>, std::valarray< int16_t>,
+        std::valarray<uint32_t>, std::valarray< int32_t>,
+        std::valarray<uint64_t>, std::valarray< int64_t>,
+#if defined(__APPLE__)
+        std::valarray<  size_t>,
+#endif
+        std::valarray<   float>, std::valarray<  double> >;
+
+    /*!
+     * \brief Typed FITS array storage.
      *
-     * \note Only interface is declared here; inline helper applyIfType is implemented below.
+     * Holds the pixel values in a std::variant of std::valarray<T>, so that the
+     * storage type is known through the index of the active alternative.
+     * visit() dispatches a generic callable on the typed valarray with a single
+     * jump: the callable is instantiated, and can be fully inlined, for every
+     * storage type. Element-wise get/set as double are kept for generic code
+     * that does not depend on the storage type.
      */
-    struct FitsArrayBase
+    struct FitsArray
     {
-        virtual ~FitsArrayBase() = default;
+        FitsArrayVariant arr;
+
         /*!
-         * \brief Get number of elements in the array.
-         * \return Element count.
+         * \brief Default-construct an empty uint8_t array.
          */
-        virtual size_t size() const = 0;
+        FitsArray() = default;
         /*!
-         * \brief Read an element as double.
-         * \param idx Zero-based index.
-         * \return Value converted to double.
+         * \brief Construct from an existing valarray.
+         * \param v Source valarray, moved into the storage.
          */
-        virtual double get(const size_t& idx) const = 0;
+        template<typename T>
+        explicit FitsArray(std::valarray<T> v) : arr(std::in_place_type< std::valarray<T> >, std::move(v)) {}
+
         /*!
-         * \brief Write an element from double.
-         * \param idx Zero-based index.
-         * \param v Value to store (cast to underlying type).
+         * \brief Allocate an array of n zero-initialized values of type T.
+         * \tparam T Element type of the storage.
+         * \param n Number of elements.
          */
-        virtual void   set(const size_t& idx, double v) = 0;
+        template<typename T>
+        static std::unique_ptr<FitsArray> Make(const size_t& n) { return std::make_unique<FitsArray>( std::valarray<T>(static_cast<std::size_t>(n)) ); }
+
         /*!
-         * \brief Return the concrete storage type of the array.
-         * \return std::type_index of the underlying T.
+         * \brief Call fn with a reference to the typed valarray.
+         * \tparam Fn Callable taking std::valarray<T>& for every storage type T.
+         * \return Result of fn.
+         */
+        template<typename Fn>
+        decltype(auto) visit(Fn&& fn) { return std::visit(std::forward<Fn>(fn), arr); }
+        /*!
+         * \brief Call fn with a const reference to the typed valarray.
+         * \tparam Fn Callable taking const std::valarray<T>& for every storage type T.
+         * \return Result of fn.
+         */
+        template<typename Fn>
+        decltype(auto) visit(Fn&& fn) const { return std::visit(std::forward<Fn>(fn), arr); }
+
+        /*!
+         * \brief Typed valarray if the storage type is T.
+         * \return Pointer to the valarray, nullptr if the storage type is not T.
          */
-        virtual std::type_index type() const = 0;
-        
+        template<typename T>
+        std::valarray<T>* get_if() noexcept { return std::get_if< std::valarray<T> >(&arr); }
+        /*!
+         * \brief Typed valarray if the storage type is T.
+         * \return Pointer to the valarray, nullptr if the storage type is not T.
+         */
+        template<typename T>
+        const std::valarray<T>* get_if() const noexcept { return std::get_if< std::valarray<T> >(&arr); }
+
         /*!
          * \brief Apply a functor if the underlying type matches T.
-         *
-         * Attempts a downcast to FitsArray<T> and, if successful, invokes the
-         * provided callable with a reference to the internal std::valarray<T>.
-         *
          * \tparam T Expected element type.
          * \tparam Fn Callable taking std::valarray<T>&.
          * \param fn Function to execute on the typed storage.
@@ -208,72 +243,34 @@ namespace DSL {
         template<typename T, typename Fn>
         bool applyIfType(Fn &&fn)
         {
-            if(type() != std::type_index(typeid(T))) return false;
-            auto *d = static_cast< FitsArray<T>* >(this);
-            fn(d->ref());
+            std::valarray<T>* v = get_if<T>();
+            if(v == nullptr) return false;
+            fn(*v);
             return true;
         }
-    };
 
-    /*!
-     * \brief Typed FITS array wrapper.
-     *
-     * Holds a std::valarray<T> and provides virtual overrides for size/get/set/type,
-     * along with direct accessors to the underlying valarray via ref().
-     *
-     * \tparam T Element type of the storage.
-     */
-    template<typename T>
-    struct FitsArray : FitsArrayBase
-    {
-        std::valarray<T> arr;
-        /*!
-         * \brief Default-construct an empty array.
-         */
-        FitsArray() = default;
         /*!
-         * \brief Construct with a fixed size.
-         * \param n Number of elements.
-         */
-        FitsArray(size_t n) : arr(static_cast<std::size_t>(n)) {}
-        /*!
-         * \brief Construct from an existing valarray.
-         * \param v Source valarray to copy.
-         */
-        FitsArray(const std::valarray<T>& v) : arr(v) {}
-        
-        /*!
-         * \brief Number of elements.
-         * \return Size of valarray.
+         * \brief Get number of elements in the array.
+         * \return Element count.
          */
-        size_t size() const override { return arr.size(); }
+        size_t size() const { return visit([](const auto& v) -> size_t { return v.size(); }); }
         /*!
-         * \brief Read element at index as double.
+         * \brief Read an element as double.
          * \param idx Zero-based index.
          * \return Value converted to double.
          */
-        double get(const size_t& idx) const override { return static_cast<double>( arr[ idx ] ); }
+        double get(const size_t& idx) const { return visit([&](const auto& v) -> double { return static_cast<double>( v[ idx ] ); }); }
         /*!
-         * \brief Write element at index from double.
+         * \brief Write an element from double.
          * \param idx Zero-based index.
-         * \param v Value to assign after casting to T.
-         */
-        void   set(const size_t& idx, double v) override { arr[ idx ] = static_cast<T>( v ); }
-        /*!
-         * \brief Report the underlying storage type.
-         * \return std::type_index of T.
+         * \param val Value to store (cast to underlying type).
          */
-        std::type_index type() const override { return std::type_index(typeid(T)); }
+        void   set(const size_t& idx, double val) { visit([&](auto& v){ v[ idx ] = static_cast< typename std::decay_t<decltype(v)>::value_type >( val ); }); }
         /*!
-         * \brief Access the underlying valarray.
-         * \return Mutable reference to std::valarray<T>.
-         */
-        std::valarray<T>& ref() { return arr; }
-        /*!
-         * \brief Access the underlying valarray.
-         * \return Const reference to std::valarray<T>.
+         * \brief Return the concrete storage type of the array.
+         * \return std::type_index of the underlying T.
          */
-        const std::valarray<T>& ref() const { return arr; }
+        std::type_index type() const { return visit([](const auto& v) { return std::type_index(typeid(typename std::decay_t<decltype(v)>::value_type)); }); }
     };
 
     /*!
@@ -369,6 +366,38 @@ namespace DSL {
         return true;
     }
 
+    /*!
+     * \brief Convert a double precision value to storage type T.
+     *
+     * Integral targets are rounded to the nearest integer and saturated to the
+     * range of T; NaN is mapped to 0. Floating point targets are a plain cast.
+     * Used to write back results of processing done in double precision.
+     *
+     * \tparam T Target storage type.
+     * \param v Value to convert.
+     * \return Value converted to T.
+     */
+    template<typename T>
+    inline T saturate_cast(const double& v) noexcept
+    {
+        if constexpr (std::is_floating_point_v<T>)
+            return static_cast<T>(v);
+        else
+        {
+            if (std::isnan(v))
+                return T{};
+
+            const double r = std::nearbyint(v);
+
+            if (r <= static_cast<double>(std::numeric_limits<T>::lowest()))
+                return std::numeric_limits<T>::lowest();
+            if (r >= static_cast<double>(std::numeric_limits<T>::max()))
+                return std::numeric_limits<T>::max();
+
+            return static_cast<T>(r);
+        }
+    }
+
     /*!
      * \brief Helper variable template for static_assert in templates.
      *
@@ -0,0 +1,159 @@
+//
+//  FITSdetection.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSdetection_
+#define _DSL_FITSdetection_
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "FITSexception.h"
+#include "FITStable.h"
+
+namespace DSL
+{
+#pragma region - FITSdetection class definition
+    /**
+     *  @class FITSdetection
+     *  @brief Threshold based source detection on a 2D plane
+     *  @details A pixel is detected if its value exceeds the background by more than nsigma times the background RMS.
+     *  Detected pixels are grouped in connected segments (4 or 8 connectivity) and segments smaller than the minimum area are discarded.
+     *  @details The plane is split in stripes of rows labelled concurrently: each stripe is encoded as runs of detected pixels which are
+     *  merged with the runs of the previous row by union-find, while the flux, first moments, bounding box and peak of each run are accumulated.
+     *  The runs across stripe boundaries are then merged and the segment statistics are reduced over the runs of each segment,
+     *  so the pixels are only read once.
+     *  Segments are numbered in raster order of their first pixel. Pixel coordinates follow the convention of FITScube::WorldCoordinates.
+     */
+    class FITSdetection
+    {
+    public:
+        /**
+         *  @struct segment
+         *  @brief Detected segment
+         */
+        struct segment
+        {
+            size_t plane;       //!< Index of the plane the segment belongs to
+            size_t npix;        //!< Number of pixels
+            double flux;        //!< Sum of the background subtracted values
+            double x;           //!< Flux weighted centroid along the first axis [pix]
+            double y;           //!< Flux weighted centroid along the second axis [pix]
+            double peak;        //!< Largest background subtracted value
+            size_t xpeak;       //!< Position of the peak along the first axis [pix]
+            size_t ypeak;       //!< Position of the peak along the second axis [pix]
+            size_t xmin;        //!< Bounding box [pix]
+            size_t xmax;        //!< Bounding box [pix]
+            size_t ymin;        //!< Bounding box [pix]
+            size_t ymax;        //!< Bounding box [pix]
+        };
+
+    protected:
+        /**
+         *  @struct run
+         *  @brief Horizontal run of detected pixels and its partial statistics
+         */
+        struct run
+        {
+            uint32_t y;         //!< Row
+            uint32_t x0;        //!< First column
+            uint32_t x1;        //!< Last column (included)
+            uint32_t xpeak;     //!< Column of the peak
+            double   flux;      //!< Sum of the values
+            double   sx;        //!< Sum of the values times column
+            double   peak;      //!< Largest value
+        };
+
+#pragma region * Protected member
+        double fnsigma;                     //!< Detection threshold [RMS]
+        size_t fminArea;                    //!< Minimum number of pixels of a segment
+        bool   fdiagonal;                   //!< Use 8 connectivity if true, 4 connectivity otherwise
+        size_t fstripe;                     //!< Number of rows of the stripes labelled concurrently
+
+        size_t fnx;                         //!< Number of columns of the last processed plane
+        size_t fny;                         //!< Number of rows of the last processed plane
+        std::vector< std::vector<run> > fruns;  //!< Runs of each stripe of the last processed plane, in raster order
+        std::vector<size_t>   foffset;      //!< Index of the first run of each stripe
+        std::vector<uint32_t> fsegIndex;    //!< Index in fsegments of the segment of each run, UINT32_MAX if the segment was discarded
+        std::vector<segment>  fsegments;    //!< Segments of the last processed plane
+
+#pragma endregion
+#pragma region * Protected member function
+        void Label(const double* in, const bool* msk, const double* bkg, const double* rms, const double& bkgLevel, const double& rmsLevel);
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build a source detector
+         *  @param nsigma: Detection threshold in unit of the background RMS
+         *  @param minArea: Minimum number of pixels of a segment
+         *  @param diagonal: Connect diagonal neighbours (8 connectivity) if true, 4 connectivity otherwise
+         *  @param stripe: Number of rows of the stripes labelled concurrently
+         */
+        FITSdetection(const double& nsigma = 1.5, const size_t& minArea = 5, const bool& diagonal = true, const size_t& stripe = 64);
+
+#pragma endregion
+#pragma region * Accessor
+        inline double NSigma() const {return fnsigma;}                              //!< Detection threshold [RMS]
+        inline size_t MinArea() const {return fminArea;}                            //!< Minimum number of pixels of a segment
+        inline bool   Diagonal() const {return fdiagonal;}                          //!< 8 connectivity if true, 4 connectivity otherwise
+        inline size_t NumberOfSegments() const {return fsegments.size();}           //!< Number of segments of the last processed plane
+        inline const std::vector<segment>& Segments() const {return fsegments;}     //!< Segments of the last processed plane
+
+#pragma endregion
+#pragma region * Detection
+        /**
+         *  @brief Detect the segments of a 2D plane over a constant background
+         *  @param in: nx*ny input values
+         *  @param msk: nx*ny input mask (true for masked pixels), may be nullptr
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         *  @param bkg: Background level
+         *  @param rms: Background RMS
+         *  @param plane: Plane index reported in the segments
+         *  @return Number of segments
+         */
+        size_t Detect(const double* in, const bool* msk, const size_t& nx, const size_t& ny, const double& bkg, const double& rms, const size_t& plane = 0);
+
+        /**
+         *  @brief Detect the segments of a 2D plane over a background map
+         *  @param in: nx*ny input values
+         *  @param msk: nx*ny input mask (true for masked pixels), may be nullptr
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         *  @param bkg: nx*ny background values
+         *  @param rms: nx*ny background RMS values
+         *  @param plane: Plane index reported in the segments
+         *  @return Number of segments
+         */
+        size_t Detect(const double* in, const bool* msk, const size_t& nx, const size_t& ny, const double* bkg, const double* rms, const size_t& plane = 0);
+
+        /**
+         *  @brief Segmentation map of the last processed plane
+         *  @param out: nx*ny values set to the segment number (index in Segments() plus one), 0 for undetected pixels
+         */
+        void Segmentation(uint32_t* out) const;
+
+        /**
+         *  @brief Catalogue of segments
+         *  @param segments: Segments to be listed
+         *  @return Binary table with one row per segment (NUMBER, PLANE, X, Y, FLUX, PEAK, XPEAK, YPEAK, XMIN, XMAX, YMIN, YMAX, NPIX)
+         */
+        static std::shared_ptr<FITStable> Catalog(const std::vector<segment>& segments);
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
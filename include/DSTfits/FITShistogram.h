@@ -0,0 +1,269 @@
+//
+//  FITShistogram.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITShistogram_
+#define _DSL_FITShistogram_
+
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <fitsio.h>
+
+#include "FITSexception.h"
+#include "FITSparallel.h"
+
+namespace DSL
+{
+#pragma region - FITShistogram class definition
+    /**
+     *  @class FITShistogram
+     *  @brief Histogram of pixel or column values with uniform bins
+     *  @details The range [low,high] is split in nbins bins of equal width, the upper edge being included in the last bin. Values out of the
+     *  range are counted in the underflow and overflow bins, masked and NaN values are ignored.
+     *  Values are filled concurrently: each thread counts in private bins, merged once at the end of its chunk.
+     *  Integer values of 8 and 16 bits are first counted exactly, one counter per possible value, and the counters are then distributed
+     *  to the bins, so that these histograms are exact and do not depend on the floating point binning of each pixel.
+     */
+    class FITShistogram
+    {
+    protected:
+#pragma region * Protected member
+        double flow;                        //!< Lower edge of the first bin
+        double fhigh;                       //!< Upper edge of the last bin
+        double fscale;                      //!< Number of bins per unit
+        std::vector<uint64_t> fcounts;      //!< Counts per bin
+        uint64_t funder;                    //!< Number of values below the range
+        uint64_t fover;                     //!< Number of values above the range
+
+#pragma endregion
+#pragma region * Protected member function
+        /**
+         *  @brief Add a value to a set of bins
+         */
+        inline void Bin(const double& v, uint64_t* counts, uint64_t& under, uint64_t& over, const uint64_t& weight = 1) const
+        {
+            const double x = (v - flow) * fscale;
+
+            if(x < 0.)
+                under += weight;
+            else if(x < static_cast<double>(fcounts.size()))
+                counts[static_cast<size_t>(x)] += weight;
+            else if(v <= fhigh)
+                counts[fcounts.size()-1] += weight;
+            else if(v > fhigh)
+                over += weight;
+        }
+
+        template<typename T>
+        static constexpr bool exact_v = std::is_integral_v<T> && sizeof(T) <= 2;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Empty histogram
+         *  @param nbins: Number of bins
+         *  @param range: Lower and upper edges of the histogram
+         */
+        FITShistogram(const size_t& nbins, const std::pair<double,double>& range);
+
+        /**
+         *  @brief Exact histogram of 8 or 16 bits integer values, one bin per possible value
+         *  @param values: n values
+         *  @param mask: n mask values (true for masked values), may be nullptr
+         *  @param n: Number of values
+         */
+        template<typename T>
+        static FITShistogram Exact(const T* values, const bool* mask, const size_t& n);
+
+#pragma endregion
+#pragma region * Filling
+        /**
+         *  @brief Add values to the histogram
+         *  @param values: n values
+         *  @param mask: n mask values (true for masked values), may be nullptr
+         *  @param n: Number of values
+         */
+        template<typename T>
+        void Fill(const T* values, const bool* mask, const size_t& n);
+
+        /**
+         *  @brief Range of the unmasked finite values
+         *  @return Minimum and maximum values, (0,0) if there is no such value
+         */
+        template<typename T>
+        static std::pair<double,double> Extent(const T* values, const bool* mask, const size_t& n);
+
+        void Reset();                                   //!< Set all the counts to 0
+        FITShistogram& operator+=(const FITShistogram&); //!< Add the counts of an histogram with the same binning
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t NumberOfBins() const {return fcounts.size();}                                   //!< Number of bins
+        inline double Low() const {return flow;}                                                      //!< Lower edge of the first bin
+        inline double High() const {return fhigh;}                                                    //!< Upper edge of the last bin
+        inline double BinWidth() const {return 1. / fscale;}                                          //!< Width of the bins
+        inline double BinLowEdge(const size_t& i) const {return flow + static_cast<double>(i) / fscale;}      //!< Lower edge of bin i
+        inline double BinCenter(const size_t& i) const {return flow + (static_cast<double>(i) + 0.5) / fscale;} //!< Center of bin i
+        inline const std::vector<uint64_t>& Counts() const {return fcounts;}                           //!< Counts per bin
+        inline uint64_t operator[](const size_t& i) const {return fcounts[i];}                        //!< Counts of bin i
+        inline uint64_t Underflow() const {return funder;}                                            //!< Number of values below the range
+        inline uint64_t Overflow() const {return fover;}                                              //!< Number of values above the range
+        uint64_t Entries() const;                                                                     //!< Number of values in the range
+        double Mode() const;                                                                          //!< Center of the most populated bin
+
+#pragma endregion
+    };
+
+#pragma endregion
+#pragma region - FITShistogram template implementation
+
+    template<typename T>
+    FITShistogram FITShistogram::Exact(const T* values, const bool* mask, const size_t& n)
+    {
+        static_assert(exact_v<T>, "FITShistogram::Exact requires 8 or 16 bits integer values");
+
+        const double lo = static_cast<double>(std::numeric_limits<T>::lowest());
+        const double hi = static_cast<double>(std::numeric_limits<T>::max());
+
+        FITShistogram h(static_cast<size_t>(hi - lo) + 1, {lo - 0.5, hi + 0.5});
+        h.Fill(values, mask, n);
+
+        return h;
+    }
+
+    template<typename T>
+    void FITShistogram::Fill(const T* values, const bool* mask, const size_t& n)
+    {
+        if(values == nullptr || n == 0)
+            return;
+
+        std::mutex merge;
+
+        if constexpr (exact_v<T>)
+        {
+            constexpr int64_t lowest  = static_cast<int64_t>(std::numeric_limits<T>::lowest());
+            constexpr size_t  nvalues = static_cast<size_t>(static_cast<int64_t>(std::numeric_limits<T>::max()) - lowest + 1);
+
+            // Exact counts per possible value, then distributed once to the bins
+            std::vector<uint64_t> exact(nvalues, 0);
+
+            // 8 bits values are counted in 4 interleaved tables, so that runs of equal values do not serialize the increments
+            constexpr size_t ntables = (nvalues <= 256) ? 4 : 1;
+
+            detail::parallel_chunks(n, 2, [&](size_t begin, size_t end)
+            {
+                std::vector<uint64_t> local(ntables*nvalues, 0);
+
+                for(size_t k = begin; k < end; k++)
+                {
+                    const size_t key = (k % ntables)*nvalues + static_cast<size_t>(static_cast<int64_t>(values[k]) - lowest);
+                    local[key] += (mask != nullptr) ? !mask[k] : 1;
+                }
+
+                std::lock_guard<std::mutex> lock(merge);
+                for(size_t t = 0; t < ntables; t++)
+                    for(size_t v = 0; v < nvalues; v++)
+                        exact[v] += local[t*nvalues + v];
+            });
+
+            for(size_t v = 0; v < nvalues; v++)
+                if(exact[v] > 0)
+                    Bin(static_cast<double>(static_cast<int64_t>(v) + lowest), fcounts.data(), funder, fover, exact[v]);
+        }
+        else
+        {
+            const size_t  nb  = fcounts.size();
+            const int64_t inb = static_cast<int64_t>(nb);
+            const double  dnb = static_cast<double>(nb);
+
+            // Small histograms are counted in 4 interleaved tables, as the exact counts
+            const size_t  ntables = (nb <= 4096) ? 4 : 1;
+            const size_t  stride  = nb + 2;
+
+            detail::parallel_chunks(n, 4, [&](size_t begin, size_t end)
+            {
+                // Private bins, with the underflow in front and the overflow at the back
+                std::vector<uint64_t> local(ntables*stride, 0);
+                uint64_t* counts = local.data();
+
+                for(size_t k = begin; k < end; k++)
+                {
+                    const double v = static_cast<double>(values[k]);
+                    const double x = (v - flow) * fscale;
+                    if(std::isnan(x))
+                        continue;
+
+                    // x in [-1,nb] gives the bins [0,nb+1], the upper edge of the range going to the last bin
+                    const int64_t b = static_cast<int64_t>(std::min(std::max(x, -1.), dnb) + 1.);
+                    counts[(k % ntables)*stride + static_cast<size_t>(b - ((b == inb + 1) & (v <= fhigh)))] += (mask != nullptr) ? !mask[k] : 1;
+                }
+
+                std::lock_guard<std::mutex> lock(merge);
+                for(size_t t = 0; t < ntables; t++)
+                {
+                    const uint64_t* c = counts + t*stride;
+                    for(size_t b = 0; b < nb; b++)
+                        fcounts[b] += c[b+1];
+                    funder += c[0];
+                    fover  += c[nb+1];
+                }
+            });
+        }
+    }
+
+    template<typename T>
+    std::pair<double,double> FITShistogram::Extent(const T* values, const bool* mask, const size_t& n)
+    {
+        double vmin =  std::numeric_limits<double>::infinity();
+        double vmax = -std::numeric_limits<double>::infinity();
+
+        if(values != nullptr)
+        {
+            std::mutex merge;
+
+            detail::parallel_chunks(n, 1, [&](size_t begin, size_t end)
+            {
+                double lmin =  std::numeric_limits<double>::infinity();
+                double lmax = -std::numeric_limits<double>::infinity();
+
+                for(size_t k = begin; k < end; k++)
+                {
+                    const double v = static_cast<double>(values[k]);
+                    if((mask != nullptr && mask[k]) || !std::isfinite(v))
+                        continue;
+
+                    lmin = std::min(lmin, v);
+                    lmax = std::max(lmax, v);
+                }
+
+                std::lock_guard<std::mutex> lock(merge);
+                vmin = std::min(vmin, lmin);
+                vmax = std::max(vmax, lmax);
+            });
+        }
+
+        if(vmin > vmax)
+            return {0., 0.};
+
+        return {vmin, vmax};
+    }
+
+#pragma endregion
+}
+
+#endif
@@ -18,6 +18,8 @@
 #include <map>
 #include <vector>
 #include <valarray>
+#include <array>
+#include <optional>
 #include <limits>
 #include <stdexcept>
 #include <functional>
@@ -26,17 +28,22 @@
 
 #include <thread>
 #include <mutex>
-#include <future>
 
 #include "FITShdu.h"
 #include "FITSexception.h"
 #include "FITSstatistic.h"
-#include "FITSdata.h" // <- add include for FitsArrayBase / FitsArray
+#include "FITSdata.h"
+#include "FITSconvert.h"
 #include "FITSwcs.h"
+#include "FITSwcsGrid.h"
+#include "FITSkernel.h"
+#include "FITSinterpolator.h"
+#include "FITSbackground.h"
+#include "FITSdetection.h"
+#include "FITSmorphology.h"
+#include "FITScalibration.h"
+#include "FITShistogram.h"
 #include "DSF_version.h"
-#if __cplusplus >= 201703L && defined(__cpp_lib_execution) && !defined(_LIBCPP_VERSION)
-#include <execution>
-#endif
 
 
 namespace DSL
@@ -58,7 +65,7 @@ namespace DSL
 #pragma region * Protected member
         pxMask mask;
         FITShdu hdu;                              //!< Header of the image
-        std::unique_ptr<DSL::FitsArrayBase> data; // Polymorphic valarray wrapper
+        std::unique_ptr<DSL::FitsArray> data;     //!< Typed pixel values
         
         std::vector<size_t> Naxis;                //!< Dimenssion of the image axis
         int eqBITPIX, BITPIX;                 //!< Type of data contained into the image
@@ -67,6 +74,15 @@ namespace DSL
 
         FITSwcs fwcs;
 
+        mutable std::mutex fmomentsLock;                //!< Guard of the cached moments
+        mutable std::optional<stat::Moments> fmoments;  //!< Moments of the unmasked pixels, computed on demand
+
+        mutable std::mutex fgridLock;                                   //!< Guard of the world coordinate grids
+        mutable std::vector<std::shared_ptr<const FITSwcsGrid>> fgrids; //!< Interpolated world coordinates of each WCS, built on demand
+        mutable std::vector<size_t> fgridCalls;                         //!< Exact conversions since the last invalidation, per WCS
+        size_t fgridStep = 8;                                           //!< Distance between two nodes of the grids [pix], 0 disables them
+        double fgridTolerance = 1e-4;                                   //!< Largest interpolation error of the grids [pix]
+
         // helper: call fn with std::valarray<T>& when underlying storage is T; returns true if matched
         template<typename U, typename Fn>
         bool WithTypedData(Fn&& fn) const
@@ -74,16 +90,20 @@ namespace DSL
             if(!data)
                 return false;
             
-            // DataArrayBase::applyIfType is non-const; cast away constness only for type check + const ref route
-            auto *mutable_ptr = const_cast<DSL::FitsArrayBase*>( data.get() );
-            
-            return mutable_ptr->template applyIfType<U>([&](std::valarray<U>& arr){fn(arr);});
+            // The const overload keeps its historical contract of handing a non-const reference to fn
+            std::valarray<U>* arr = const_cast<DSL::FitsArray*>( data.get() )->template get_if<U>();
+            if(arr == nullptr)
+                return false;
+
+            fn(*arr);
+            return true;
         }
 
         template<typename U, typename Fn>
         bool WithTypedData(Fn&& fn)
         {
             if(!data) return false;
+            InvalidateMoments();
             return data->template applyIfType<U>([&](std::valarray<U>& arr){fn(arr);});
         }
 
@@ -103,6 +123,11 @@ namespace DSL
         virtual void img_init() =0;      //!< Child class initialization
 
         std::vector<std::string> makeAlphaSequence(std::size_t n) const;
+        void AffineWCS(FITShdu& out, const std::array<double,4>& matrix, const std::pair<double,double>& offset) const;
+        void CopyHeader(FITShdu& out) const;
+        void MorphMask(const FITSmorphology::operation& op, const FITSmorphology& element);
+        size_t UnmaskedValues(std::vector<double>& out, const bool& finiteOnly) const;
+        std::shared_ptr<const FITSwcsGrid> WorldGrid(const int& wcsIndex) const;
         
 #pragma endregion
 #pragma region * ctor/dtor
@@ -152,6 +177,117 @@ namespace DSL
         enum class overlay {mean, median, min, max, sum};  //!< Overlay method enumeration
         virtual std::shared_ptr<FITScube> Overlay(const overlay& method = overlay::mean, const std::pair<double,double>& clip=std::pair<double,double>(-1.,-1.)) const = 0;
 
+        enum class reduction {sum, mean, median, min, max, stddev, clippedMean};  //!< Axis collapse method enumeration
+
+        /**
+         * @brief Collapse one axis of the datacube
+         * @details Each output pixel reduces the unmasked non NaN values along the collapsed axis, e.g. a moment-0 map when summing
+         * a spectral cube along NAXIS3, or a profile when collapsing NAXIS1 of an image. The output is NaN free: pixels without any
+         * valid value are set to 0 and masked. The standard deviation is the sample standard deviation and the clipped mean is the
+         * mean left by an iterative sigma clipping around the median (stat::SigmaClip).
+         *
+         * @param axis Collapsed axis, starting at 1 (NAXISn)
+         * @param op Reduction method
+         * @param kappa Clipping threshold of the clipped mean, in units of standard deviation
+         * @param maxIter Maximum number of clipping passes of the clipped mean
+         * @return New double precision FITScube with one axis less, the WCS of the remaining axes and the other keywords of this header
+         */
+        std::shared_ptr<FITScube> Reduce(const size_t& axis, const reduction& op, const double& kappa = 3., const size_t& maxIter = 5) const;
+
+        /**
+         * @brief Convolve each 2D plane of the datacube with a kernel
+         *
+         * @param kernel Convolution kernel
+         * @param method Convolution algorithm (direct, separable, FFT or automatic choice)
+         * @return New FITScube of the same type and shape holding the convolved data
+         */
+        virtual std::shared_ptr<FITScube> Convolve(const FITSkernel& kernel, const FITSkernel::method& method = FITSkernel::method::automatic) const = 0;
+
+        /**
+         * @brief Resample the datacube onto the grid defined by another WCS
+         *
+         * @param target WCS of the output grid (primary WCS is used). It must have the same number of axis as the WCS of this datacube.
+         * @param shape Number of pixels of the output grid along the first two axis
+         * @param method Interpolation kernel
+         * @param wcsIndex Index of the WCS of this datacube used to map the output grid
+         * @return New FITScube of the same type holding the resampled data, with the target WCS
+         */
+        virtual std::shared_ptr<FITScube> Reproject(const FITSwcs& target, const std::pair<size_t,size_t>& shape, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear, const size_t& wcsIndex = 0) const = 0;
+
+        /**
+         * @brief Estimate the sky background of each 2D plane of the datacube
+         *
+         * @param bkg Background estimator (mesh size, filter, clipping). It holds the background and RMS meshes of the last plane on return.
+         * @return New FITScube of the same type and shape holding the full resolution background
+         */
+        virtual std::shared_ptr<FITScube> Background(FITSbackground& bkg) const = 0;
+
+        /**
+         * @brief Estimate and subtract in place the sky background of each 2D plane of the datacube
+         *
+         * @param bkg Background estimator (mesh size, filter, clipping). It holds the background and RMS meshes of the last plane on return.
+         */
+        virtual void SubtractBackground(FITSbackground& bkg) = 0;
+
+        /**
+         * @brief Detect the sources of each 2D plane of the datacube over its estimated sky background
+         *
+         * @param det Source detector (threshold, minimum area, connectivity). It holds the segments of the last plane on return.
+         * @param bkg Background estimator used to build the background and RMS maps of each plane
+         * @return Table of the segments of all the planes
+         */
+        virtual std::shared_ptr<FITStable> Detect(FITSdetection& det, FITSbackground& bkg) const = 0;
+
+        /**
+         * @brief Detect the sources of each 2D plane of the datacube over a constant sky background
+         *
+         * @param det Source detector (threshold, minimum area, connectivity). It holds the segments of the last plane on return.
+         * @param background Background level, 0 for background subtracted data
+         * @param rms Background RMS
+         * @return Table of the segments of all the planes
+         */
+        virtual std::shared_ptr<FITStable> Detect(FITSdetection& det, const double& background, const double& rms) const = 0;
+
+        /**
+         * @brief Apply an affine transform to each 2D plane of the datacube
+         *
+         * @param matrix Linear part {m11, m12, m21, m22} of the transform
+         * @param offset Translation [pix]: the pixel (x,y) of this datacube lands at (m11*x + m12*y + offset.first, m21*x + m22*y + offset.second)
+         * @param method Interpolation kernel
+         * @return New FITScube of the same type and shape holding the transformed data, with CRPIX and PC (or CD) updated accordingly
+         */
+        virtual std::shared_ptr<FITScube> AffineWarp(const std::array<double,4>& matrix, const std::pair<double,double>& offset, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear) const = 0;
+
+        /**
+         * @brief Translate each 2D plane of the datacube by a sub-pixel amount
+         *
+         * @param dx Shift along the first axis [pix]
+         * @param dy Shift along the second axis [pix]
+         * @param method Interpolation kernel
+         * @return New FITScube of the same type and shape holding the shifted data
+         */
+        std::shared_ptr<FITScube> Shift(const double& dx, const double& dy, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear) const;
+
+        /**
+         * @brief Rotate each 2D plane of the datacube counter-clockwise around a pixel
+         *
+         * @param angle Rotation angle [deg]
+         * @param center Pixel coordinates of the rotation centre
+         * @param method Interpolation kernel
+         * @return New FITScube of the same type and shape holding the rotated data
+         */
+        std::shared_ptr<FITScube> Rotate(const double& angle, const std::pair<double,double>& center, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear) const;
+        std::shared_ptr<FITScube> Rotate(const double& angle, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear) const; //!< Rotate around the centre of the planes
+
+        /**
+         * @brief Calibrate each 2D plane of the datacube with master bias, dark, flat and bad pixel frames
+         *
+         * @param cal Master frames, converted once and shareable across calls
+         * @param exptime Exposure time used to scale the master dark, read from the EXPTIME keyword if negative
+         * @return New single precision FITScube holding (raw - bias - dark*exptime/darktime)/flat, with bad pixels masked and the calibration keywords written
+         */
+        virtual std::shared_ptr<FITScube> Calibrate(const FITScalibration& cal, const double& exptime = -1.) const = 0;
+
 #pragma region * Accessor
         size_t Size(const size_t& i = 0) const ;                       //!< Get number of pixel of the axe
         size_t           Nelements() const;                            //!< Get total number of pixel
@@ -179,10 +315,56 @@ namespace DSL
         virtual pixelCoords World2Pixel( const worldCoords&, const int& wcsIndex=0) const; //!< Get pixel coordinates based on WCS
         virtual std::valarray<size_t> World2PixelArray( const worldVectors&, const int& wcsIndex=0) const; //!< Get pixel coordinates based on WCS
         virtual pixelVectors World2PixelVector( const worldVectors&, const int& wcsIndex=0) const; //!< Get pixel coordinates based on WCS
+
+        /**
+         * @brief Pixel coordinates, in this datacube, of the pixels of a window of a target grid
+         *
+         * @param target WCS of the target grid (primary WCS is used)
+         * @param origin Target pixel of the first corner of the window
+         * @param shape Number of columns and rows of the window
+         * @param xs Output pixel coordinates along the first axis of this datacube, row by row (NaN where the mapping is undefined)
+         * @param ys Output pixel coordinates along the second axis of this datacube, row by row (NaN where the mapping is undefined)
+         * @param wcsIndex Index of the WCS of this datacube
+         */
+        void ReprojectionMap(const FITSwcs& target, const std::pair<size_t,size_t>& origin, const std::pair<size_t,size_t>& shape,
+                             std::vector<double>& xs, std::vector<double>& ys, const size_t& wcsIndex=0) const;
+
+        /**
+         * @brief Project the celestial positions of a catalogue onto the pixels of this datacube
+         * @details The positions of all the rows are converted by FITSwcs::world2pixel on spans, in blocks processed in parallel, and the
+         * results are written straight into three new columns appended to the table: the pixel coordinates along the first two axes
+         * (NaN where the conversion fails) and a flag set for the sources whose nearest pixel lies in the image. Other world axes of the
+         * WCS, if any, are held at the world coordinates of the first pixel.
+         *
+         * @param catalog Table receiving the new columns
+         * @param raColumn Name of the longitude column (float or double) [deg]
+         * @param decColumn Name of the latitude column (float or double) [deg]
+         * @param xColumn Name of the new pixel coordinate column along the first axis
+         * @param yColumn Name of the new pixel coordinate column along the second axis
+         * @param flagColumn Name of the new in-footprint flag column
+         * @param wcsIndex Index of the WCS of this datacube
+         * @return Number of sources in the footprint
+         */
+        size_t ProjectCatalog(FITStable& catalog, const std::string& raColumn, const std::string& decColumn,
+                              const std::string& xColumn = "X_IMAGE", const std::string& yColumn = "Y_IMAGE", const std::string& flagColumn = "IN_IMAGE",
+                              const size_t& wcsIndex=0) const;
+
+        /**
+         * @brief Configure the interpolated world coordinate grids
+         * @details Once a WCS has been evaluated exactly by WorldCoordinates and World2Pixel about as many times as building its grid costs,
+         * a FITSwcsGrid covering the first two axes is built and serves the next single pixel conversions, the cells where the interpolation
+         * error exceeds the tolerance staying exact. Grids are used for 2D images and for cubes whose other axes have a single pixel.
+         * They are dropped by reLoadWCS() and by this method.
+         *
+         * @param step Distance between two nodes [pix], 0 to always use the exact transform
+         * @param tolerance Largest interpolation error [pix]
+         */
+        void SetWorldGrid(const size_t& step, const double& tolerance = 1e-4);
+        inline void InvalidateWorldGrid() {std::lock_guard<std::mutex> lk(fgridLock); fgrids.clear(); fgridCalls.clear();} //!< Drop the world coordinate grids
 #pragma endregion
 #pragma region * Pixel index/coordinates
 
-        inline void reLoadWCS() { FITSwcs tmp(hdu); FITSwcs::swap(fwcs,tmp);} //!< Reload WCS from HDU
+        inline void reLoadWCS() { FITSwcs tmp(hdu); FITSwcs::swap(fwcs,tmp); InvalidateWorldGrid();} //!< Reload WCS from HDU
 
         virtual std::vector<size_t> PixelCoordinates(const size_t&) const; //!< Get pixel coordinates
         
@@ -243,7 +425,91 @@ namespace DSL
         virtual double Get95thpercentil()          const =0;
         virtual double GetKurtosis()               const =0;
         virtual double GetSkewness()               const =0;
-        
+
+        /**
+         *  @brief Histogram of the unmasked pixel values
+         *  @param nbins: Number of bins
+         *  @param range: Lower and upper edges of the histogram, range of the unmasked finite values if empty
+         *  @return Histogram with nbins uniform bins
+         */
+        FITShistogram Histogram(const size_t& nbins, const std::pair<double,double>& range = {0.,0.}) const;
+
+        /**
+         *  @brief Exact histogram of the unmasked pixel values, one bin per possible value
+         *  @return Histogram of 256 or 65536 bins centered on the integer values
+         *  @throws FITSexception if pixels are not 8 or 16 bits integers
+         */
+        FITShistogram ExactHistogram() const;
+
+        /**
+         *  @brief Quantiles of the unmasked pixel values
+         *  @param probs: Probabilities in [0,1]
+         *  @return Quantiles in the order of probs, linearly interpolated between order statistics, 0 if there is no unmasked value
+         */
+        std::vector<double> GetQuantiles(const std::vector<double>& probs) const;
+
+        /**
+         *  @brief Quantile sketch of the unmasked pixel values
+         *  @details The sketch is built concurrently (stat::QuantileSketch::Build) and can be merged with the sketches of other images
+         *  to estimate the quantiles of a whole survey without keeping the pixels in memory.
+         *  @param k: Accuracy parameter of the sketch
+         *  @return Sketch of the unmasked non NaN pixel values
+         */
+        stat::QuantileSketch Sketch(const uint16_t& k = 200) const;
+
+        /**
+         *  @brief Moments of the unmasked pixel values
+         *  @details Count, sum, mean, central moments up to the fourth order, minimum and maximum are computed in a single parallel pass
+         *  and cached. The cache is cleared by every non-const access to the pixels or to the mask.
+         *  @return Moments of the unmasked pixel values
+         */
+        stat::Moments GetMoments() const;
+
+        /**
+         *  @brief Clear the cached moments
+         *  @note Only needed after writing pixels through a pointer obtained before the moments were computed.
+         */
+        inline void InvalidateMoments() {fmoments.reset();}
+
+        /**
+         *  @brief Sigma clipped statistics of the unmasked finite pixel values
+         *  @param kLow: Lower clipping threshold, in units of standard deviation
+         *  @param kHigh: Upper clipping threshold, in units of standard deviation
+         *  @param maxIter: Maximum number of clipping passes
+         *  @param center: Center of the clipping window
+         *  @return Mean, median and standard deviation of the kept values, number of rejected values and of clipping passes (see stat::SigmaClip)
+         */
+        stat::ClippedStats GetClippedStats(const double& kLow = 3., const double& kHigh = 3., const size_t& maxIter = 10,
+                                           const stat::clipCenter& center = stat::clipCenter::median) const;
+
+        /**
+         *  @brief Sigma clipped statistics of the unmasked finite pixel values
+         *  @param scratch: Working buffer, its memory being reused when clipping several images
+         *  @see GetClippedStats
+         */
+        stat::ClippedStats GetClippedStats(std::vector<double>& scratch, const double& kLow = 3., const double& kHigh = 3., const size_t& maxIter = 10,
+                                           const stat::clipCenter& center = stat::clipCenter::median) const;
+
+        /**
+         *  @brief Robust estimates of the unmasked finite pixel values
+         *  @param cLocation: Tuning constant of the biweight location, in units of MAD
+         *  @param cScale: Tuning constant of the biweight scale, in units of MAD
+         *  @return Median, MAD, biweight location and scale and histogram mode (see stat::RobustStatistics), 0 if there is no such value
+         */
+        stat::RobustStats GetRobustStats(const double& cLocation = 6., const double& cScale = 9.) const;
+
+        /**
+         *  @brief Robust estimates of the unmasked finite pixel values
+         *  @param scratch: Working buffer, its memory being reused when processing several images
+         *  @see GetRobustStats
+         */
+        stat::RobustStats GetRobustStats(std::vector<double>& scratch, const double& cLocation = 6., const double& cScale = 9.) const;
+
+        double GetMAD() const;                                          //!< Median absolute deviation of the unmasked finite pixel values
+        double GetBiweightLocation(const double& c = 6.) const;         //!< Tukey biweight location of the unmasked finite pixel values
+        double GetBiweightScale(const double& c = 9.) const;            //!< Tukey biweight scale of the unmasked finite pixel values
+        double GetMode() const;                                         //!< Histogram mode of the unmasked finite pixel values
+
         inline std::valarray<bool> GetMask() const {return mask;}
         
         virtual uint8_t  UInt8ValueAtPixel    (const size_t&) const =0;
@@ -286,7 +552,7 @@ namespace DSL
         virtual double   DoubleValueAtPixel    (const std::initializer_list<size_t>&) const = 0;
         
 
-        // Typed accessors: return pointer to the internal typed valarray<T> managed by FitsArray<T>.
+        // Typed accessors: return pointer to the internal typed valarray<T> managed by FitsArray.
         // Returns nullptr if data is not present or the stored type doesn't match T.
         template<typename T>
         const std::valarray<T>* GetData() const
@@ -330,14 +596,50 @@ namespace DSL
             return (mask.size() > 0) ? &mask[0] : nullptr;
         }
 
+        /**
+         * @brief Call fn with the typed pixel values, whatever the storage type
+         * @details The storage type is resolved with a single dispatch and fn is instantiated for each storage type,
+         * so that generic algorithms written once run as fully typed kernels.
+         * @param fn: Callable taking a const std::valarray<V>& for every storage type V
+         * @return Result of fn
+         * @throws FITSexception if there is no data in memory
+         */
+        template<typename Fn>
+        decltype(auto) Visit(Fn&& fn) const
+        {
+            if(!data)
+                throw FITSexception(SHARED_NULPTR,"FITScube","Visit","no data in memory");
+
+            return static_cast<const DSL::FitsArray&>(*data).visit(std::forward<Fn>(fn));
+        }
+
+        bool CopyAsDouble(std::vector<double>& out, const size_t& nelem) const;   //!< Copy the first nelem pixel values, whatever the storage type, to double precision
+
+        /**
+         * @brief Call fn with the typed pixel values, whatever the storage type
+         * @param fn: Callable taking a std::valarray<V>& for every storage type V
+         * @return Result of fn
+         * @throws FITSexception if there is no data in memory
+         */
+        template<typename Fn>
+        decltype(auto) Visit(Fn&& fn)
+        {
+            if(!data)
+                throw FITSexception(SHARED_NULPTR,"FITScube","Visit","no data in memory");
+
+            InvalidateMoments();
+            return data->visit(std::forward<Fn>(fn));
+        }
+
         /**
          * @brief Cast this image cube to a different storage type U.
          * @tparam U Destination pixel type.
+         * @param maskOverflow Mask the pixels that are not finite or out of the range of U (their values are saturated in any case).
          * @return New FITScube holding a copy converted to U.
          * @throws FITSexception if underlying storage is already U or unsupported.
          */
         template<typename U>
-        std::shared_ptr<FITScube> cast() const;
+        std::shared_ptr<FITScube> cast(const bool& maskOverflow = true) const;
 
 #pragma endregion
 #pragma region * I/O
@@ -575,6 +877,17 @@ namespace DSL
         inline bool isMasked(const std::initializer_list<size_t>& i) const {return Masked(i);}
         inline bool isMasked(const std::vector<size_t>& xyz) const {return Masked(xyz);}
         inline bool isMasked(size_t i) const {return Masked(i);}
+
+        /**
+         *  @brief Morphological operations on the pixel mask, applied to each plane
+         *  @param element: Structuring element
+         *  @note Pixels outside of the plane are unmasked for the dilation and masked for the erosion, see FITSmorphology.
+         */
+        inline void DilateMask(const FITSmorphology& element) {MorphMask(FITSmorphology::operation::dilate, element);}
+        inline void ErodeMask (const FITSmorphology& element) {MorphMask(FITSmorphology::operation::erode,  element);}   //!< @see DilateMask
+        inline void OpenMask  (const FITSmorphology& element) {MorphMask(FITSmorphology::operation::open,   element);}   //!< Erosion followed by a dilation, @see DilateMask
+        inline void CloseMask (const FITSmorphology& element) {MorphMask(FITSmorphology::operation::close,  element);}   //!< Dilation followed by an erosion, @see DilateMask
+        void FillMaskHoles();   //!< Mask the unmasked pixels of each plane which are not 4-connected to its border
         
         
         
@@ -708,6 +1021,14 @@ namespace DSL
 
 #pragma region * array manipulation
         std::shared_ptr<FITScube> Overlay(const overlay& method = overlay::mean, const std::pair<double,double>& clip=std::pair<double,double>(-1.,-1.)) const override;
+        std::shared_ptr<FITScube> Convolve(const FITSkernel& kernel, const FITSkernel::method& method = FITSkernel::method::automatic) const override;
+        std::shared_ptr<FITScube> Reproject(const FITSwcs& target, const std::pair<size_t,size_t>& shape, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear, const size_t& wcsIndex = 0) const override;
+        std::shared_ptr<FITScube> Background(FITSbackground& bkg) const override;
+        void SubtractBackground(FITSbackground& bkg) override;
+        std::shared_ptr<FITStable> Detect(FITSdetection& det, FITSbackground& bkg) const override;
+        std::shared_ptr<FITStable> Detect(FITSdetection& det, const double& background, const double& rms) const override;
+        std::shared_ptr<FITScube> AffineWarp(const std::array<double,4>& matrix, const std::pair<double,double>& offset, const FITSinterpolator::method& method = FITSinterpolator::method::bilinear) const override;
+        std::shared_ptr<FITScube> Calibrate(const FITScalibration& cal, const double& exptime = -1.) const override;
 
 #pragma endregion
 #pragma region * data operation
@@ -999,15 +1320,13 @@ namespace DSL
 #pragma region - FITScube class implementation
 
     template<typename U>
-    std::shared_ptr<FITScube> FITScube::cast() const
+    std::shared_ptr<FITScube> FITScube::cast(const bool& maskOverflow) const
     {
         if(!data)
             throw FITSexception(SHARED_NULPTR, "FITScube","cast", "no data in memory");
     
         // 1) Reject no-op cast (already stored as U)
-        bool alreadyU = false;
-        alreadyU = WithTypedData<U>([&](std::valarray<U>&){ /* matched */ });
-        if(alreadyU)
+        if(data->template get_if<U>() != nullptr)
             throw FITSexception(SHARED_BADARG, "FITScube::cast", "source already has the requested storage type");
     
         // 2) Create destination image with same axes
@@ -1039,108 +1358,26 @@ namespace DSL
         }
     
         // 4) Convert array from actual source type to U
-        bool copied = false;
-    
-        auto copyFrom = [&](auto tag)->bool
-        {
-            using V = std::decay_t<decltype(tag)>;
-
-            // source must match V
-            const std::valarray<V>* srcArr = this->GetData<V>();
-            if (!srcArr)
-                return false;
-
-            // destination must be U (FITSimg<U> already allocates typed storage)
-            std::valarray<U>* dstArr = dst->template GetData<U>();
-            if (!dstArr)
-                throw FITSexception(SHARED_NULPTR, "FITScube","cast", "destination typed storage missing");
+        std::valarray<U>* dstArr = dst->template GetData<U>();
+        if (!dstArr)
+            throw FITSexception(SHARED_NULPTR, "FITScube","cast", "destination typed storage missing");
 
-            if( dstArr->size() != srcArr->size() )
+        Visit([&](const auto& srcArr)
+        {
+            if( dstArr->size() != srcArr.size() )
                 throw FITSexception(SHARED_BADARG, "FITScube","cast", "source and destination size mismatch");
 
-            // clamp helper to convert V -> U safely
-            auto clamp_to_U = [](auto x, bool& overflow)->U
-            {
-                using V = std::decay_t<decltype(x)>;
-                overflow = false;
-
-                // handle NaN/Inf for floating sources
-                if constexpr (std::is_floating_point_v<V>)
-                {
-                    if (!std::isfinite(static_cast<long double>(x)))
-                    {
-                        overflow = true;
-                        if constexpr (std::is_floating_point_v<U>)
-                            return std::numeric_limits<U>::quiet_NaN();
-                        else
-                            return U{}; // 0 for integers
-                    }
-                }
-
-                long double vld = static_cast<long double>(x);
-
-                // if U is integral and source is float, round before clamping
-                if constexpr (std::is_integral_v<U> && std::is_floating_point_v<V>)
-                    vld = std::llround(vld);
-
-                const long double umax = static_cast<long double>(std::numeric_limits<U>::max());
-                const long double umin = static_cast<long double>(std::numeric_limits<U>::lowest());
-
-                if (vld > umax) { vld = umax; overflow = true; }
-                if (vld < umin) { vld = umin; overflow = true; }
-
-                return static_cast<U>(vld);
-            };
-
-            const size_t n = srcArr->size();
+            if(srcArr.size() == 0)
+                return;
 
-#if __cplusplus >= 201703L && defined(__cpp_lib_execution) && !defined(_LIBCPP_VERSION)
-            std::vector<size_t> idx(n);
-            std::iota(idx.begin(), idx.end(), size_t{0});
+            // Chunked conversion straight into the destination storage
+            const size_t noverflow = detail::convert_array(&srcArr[0], &(*dstArr)[0], this->raw_mask(),
+                                                           (dst->mask.size() == srcArr.size()) ? &(dst->mask[0]) : nullptr,
+                                                           srcArr.size(), maskOverflow);
 
-            std::for_each(std::execution::par, idx.begin(), idx.end(), [&](size_t i)
-            {
-                bool ov = false;
-                (*dstArr)[i] = clamp_to_U((*srcArr)[i], ov);
-                dst->mask[i] = this->mask[i] || ov;
-            });
-#else
-            // Fallback: portable std::async chunking
-            const size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
-            const size_t chunks = hw;
-            const size_t chunkSize = (n + chunks - 1) / chunks;
-
-            std::vector<std::future<void>> futs;
-            futs.reserve(chunks);
-
-            for (size_t c = 0; c < chunks; ++c) {
-                const size_t begin = c * chunkSize;
-                const size_t end   = std::min(n, begin + chunkSize);
-
-                futs.emplace_back(std::async(std::launch::async, [&, begin, end]{
-                    for (size_t i = begin; i < end; ++i) {
-                        bool ov = false;
-                        (*dstArr)[i] = clamp_to_U((*srcArr)[i], ov);
-                        dst->mask[i] = this->mask[i] || ov;
-                    }
-                }));
-            }
-            for (auto& f : futs) f.get();
-#endif
-            return true;
-        };
-    
-        copied = copyFrom(uint8_t{} ) || copyFrom(int8_t{} )  ||
-                 copyFrom(uint16_t{}) || copyFrom(int16_t{})  ||
-                 copyFrom(uint32_t{}) || copyFrom(int32_t{})  ||
-                 copyFrom(uint64_t{}) || copyFrom(int64_t{})  ||
-#if defined(__APPLE__)
-                 copyFrom(size_t{})   ||
-#endif
-                 copyFrom(float{})    || copyFrom(double{});
-    
-        if(!copied)
-            throw FITSexception(SHARED_BADARG, "FITScube::cast", "unsupported or unknown source storage type");
+            if(noverflow > 0 && (verbose & verboseLevel::VERBOSE_DETAIL) == verboseLevel::VERBOSE_DETAIL)
+                std::cout<<"\033[31m[FITScube::cast]\033[0m "<<noverflow<<" pixels are not finite or out of the range of the destination type"<<std::endl;
+        });
     
         // 6) Reload WCS on the destination (uses copied header)
         dst->reLoadWCS();
@@ -1241,7 +1478,7 @@ namespace DSL
     void FITSimg<T>::img_init()
     {
         // create typed storage via polymorphic wrapper
-        this->data = std::make_unique< DSL::FitsArray<T> >( Nelements() );
+        this->data = DSL::FitsArray::Make<T>( Nelements() );
         this->mask = pxMask( Nelements() );
     }
     
@@ -1687,7 +1924,7 @@ namespace DSL
         {
             auto p = img.template GetData<T>();
             if(p)
-                this->data = std::make_unique< DSL::FitsArray<T> >(*p); // copy underlying valarray<T>
+                this->data = std::make_unique< DSL::FitsArray >(*p); // copy underlying valarray<T>
             else
                 this->data.reset();
         }
@@ -2139,32 +2376,14 @@ namespace DSL
 #pragma endregion
 #pragma region * Image Statistic
 
-/**
+    /**
      *  @details Compute the sum of all unmasked pixel values
      *  @return Sum of all unmasked pixel values
      */
     template< typename T >
     double FITSimg<T>::GetSum() const
     {
-        if(!data)
-            return 0.0;
-    
-        double sum = 0.0;
-        bool handled = false;
-
-        // fast typed paths (add the types you commonly use)
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(!mask[i])
-                        sum += static_cast<double>(arr[i]);
-                }
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetSum]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        return sum;
+        return GetMoments().sum;
     }
 
     /**
@@ -2174,13 +2393,7 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetMean() const
     {
-        if(!data)
-            return 0.0;
-    
-        double sum = GetSum();
-        size_t nPix = mask[!mask].size();
-
-        return (nPix > 0) ? sum /= static_cast<double>(nPix) : 0;
+        return GetMoments().Mean();
     }
 
     /**
@@ -2190,24 +2403,7 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetQuadraticMean() const
     {
-        if(!data)
-            return 0.0;
-    
-        size_t nPix = mask[!mask].size();
-        double sum=0;
-
-        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(!mask[i])
-                        sum += static_cast<double>(arr[i]*arr[i]);
-                }
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetQuadraticMean]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        return (nPix > 0) ? std::sqrt(sum /= static_cast<double>(nPix)) : 0;
+        return GetMoments().QuadraticMean();
     }
 
     /**
@@ -2217,26 +2413,7 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetVariance() const
     {
-        if(!data)
-            return 0.0;
-    
-        size_t nPix = mask[!mask].size();
-        double mean = GetMean();
-        double var  = 0.0;
-        bool handled = false;
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(!mask[i])
-                        var += (static_cast<double>(arr[i]) - mean) * (static_cast<double>(arr[i]) - mean);
-                }
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetVariance]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        return (nPix > 1) ? var /= static_cast<double>(nPix-1) : 0;
+        return GetMoments().Variance();
     }
 
     /**
@@ -2246,10 +2423,7 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetStdDev() const
     {
-        if(!data)
-            return 0.0;
-
-        return std::sqrt( GetVariance() );
+        return GetMoments().StdDev();
     }
 
     /**
@@ -2269,13 +2443,7 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetRMSE() const
     {
-        if(!data)
-            return 0.0;
-
-        double var = GetVariance();
-        size_t nPix = mask[!mask].size();
-        
-        return sqrt(var*static_cast<double>(nPix-1)/static_cast<double>(nPix));
+        return GetMoments().RMSE();
     }
 
     template< typename T >
@@ -2284,36 +2452,7 @@ namespace DSL
         if(fpp < 0. || fpp > 1.)
             throw FITSexception(BAD_OPTION,"FITScube","Getpercentil","fpp should be in the range [0,1]");
 
-        if(!data)
-            return 0.0;
-
-        std::vector<double> sorted;
-        bool handled = false;
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(!mask[i])
-                        sorted.push_back( static_cast<double>(arr[i]) );
-                }
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::Getpercentil]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        std::sort(sorted.begin(), sorted.end());
-        double pos = fpp * static_cast<double>(sorted.size()-1);
-        size_t idx = static_cast<size_t>( pos + 0.5 );
-        double dpos= pos - static_cast<double>(idx);
-
-        double pp_value = 0.0;
-
-        if(idx +1 < sorted.size())
-            pp_value = sorted[idx] + dpos * (sorted[idx+1] - sorted[idx]);
-        else if(idx < sorted.size())
-            pp_value = sorted[idx];
-
-        return pp_value;
+        return GetQuantiles({fpp}).front();
     }
 
     template< typename T >
@@ -2349,106 +2488,27 @@ namespace DSL
     template< typename T >
     double FITSimg<T>::GetKurtosis() const
     {
-        if(!data)
-            return 0.0;
-    
-        size_t nPix = mask[!mask].size();
-        double mean = GetMean();
-        double var  = GetVariance();
-        double kurt = 0.0;
-        bool handled = false;
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                double m4 = 0.0;
-
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(mask[i])
-                        continue;
-                    
-                    double d = static_cast<double>(arr[i]) - mean;
-                    double d2 = d*d;
-                    m4 += d2*d2;
-                }
-                
-                double s4 = var*var;
-                double n = static_cast<double>(nPix);
-
-                double term1 = (n*(n+1)*m4)/( (n-1)*(n-2)*(n-3)*s4 );
-                double term2 = (3.*(n-1)*(n-1))/((n-2)*(n-3));
-                    
-                kurt = term1 - term2;
-                
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetKurtosis]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        return kurt;
+        return GetMoments().Kurtosis();
     }
 
     template< typename T >
     double FITSimg<T>::GetSkewness() const
     {
-        if(!data)
-            return 0.0;
-
-        size_t nPix = mask[!mask].size();
-        double mean = GetMean();
-        double var  = GetVariance();
-        double skew = 0.0;
-        bool handled = false;
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                for(size_t i = 0; i < arr.size(); i++)
-                {
-                    if(!mask[i])
-                        skew += (static_cast<double>(arr[i]) - mean) * (static_cast<double>(arr[i]) - mean) * (static_cast<double>(arr[i]) - mean);
-                }
-            });
-        if(!handled)
-            throw std::runtime_error("\033[31m[FITSimg::GetSkewness]\033[0m unsupported data type " + demangle(typeid(T).name()));
-
-        return (nPix > 2 && var > 0.) ? (skew /= static_cast<double>(nPix) ) / (var * std::sqrt(var)) : 0;
+        return GetMoments().Skewness();
     }
 
     template< typename T >
     double FITSimg<T>::GetMinimum() const
     {
-        if(!data)
-            return 0.0;
-        
-        bool handled = false;
-        double minVal = std::numeric_limits<double>::max();
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                minVal = static_cast<double>( ((typename std::valarray<T>) arr[!mask]).min() );
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetMin]\033[0m unsupported data type " + demangle(typeid(T).name()));
-        
-        return minVal;
+        const stat::Moments m = GetMoments();
+        return (m.count > 0) ? m.min : 0.;
     }
 
     template< typename T >
     double FITSimg<T>::GetMaximum() const
     {
-        if(!data)
-            return 0.0;
-        
-        bool handled = false;
-        double maxVal = -1*std::numeric_limits<double>::max();
-
-        handled = WithTypedData<T>([&](const std::valarray<T>& arr)
-            {
-                maxVal = static_cast<double>( ((typename std::valarray<T>) arr[!mask]).max() );
-            });
-        if(!handled) 
-            throw std::runtime_error("\033[31m[FITSimg::GetMin]\033[0m unsupported data type " + demangle(typeid(T).name()));
-        
-        return maxVal;
+        const stat::Moments m = GetMoments();
+        return (m.count > 0) ? m.max : 0.;
     }
 
 
@@ -2566,6 +2626,518 @@ namespace DSL
 
         return std::make_shared< FITSimg<T> >(result);
     }
+
+    /**
+     *  @brief Convolve the image with a kernel
+     *  @details Each plane spanned by the first two axes is converted to double precision and convolved independently by FITSkernel::Apply.
+     *  Masked pixels are handled by normalized convolution: they do not contribute to their neighbours and receive an estimate from the valid pixels under the kernel.
+     *  The output mask is the input mask extended to pixels that have no valid pixel under the kernel. Integer images are rounded and saturated on write back.
+     *  @param kernel Convolution kernel
+     *  @param method Convolution algorithm
+     *  @return New FITSimg<T> with the same header, WCS and shape as this.
+     */
+    template< typename T >
+    std::shared_ptr<FITScube> FITSimg<T>::Convolve(const FITSkernel& kernel, const FITSkernel::method& method) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Convolve","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        std::shared_ptr< FITSimg<T> > copy = std::make_shared< FITSimg<T> >(*this);
+
+        if((verbose & verboseLevel::VERBOSE_DETAIL) == verboseLevel::VERBOSE_DETAIL)
+            std::cout<<"\033[31m[FITSimg::Convolve]\033[0m"<<std::endl
+                     << "    \033[31m|- KERNEL :\033[0m "<<kernel.Name()<<" ("<<kernel.Nx()<<"x"<<kernel.Ny()<<")"<<std::endl
+                     << "    \033[31m`- PLANES :\033[0m "<<nlayer<<" of "<<nx<<"x"<<ny<<" [pix]"<<std::endl;
+
+        std::vector<double> plane(nplane);
+
+        bool handled = copy->template WithTypedData<T>([&](std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+
+                for(size_t k = 0; k < nplane; k++)
+                    plane[k] = static_cast<double>(arr[offset + k]);
+
+                kernel.Apply(plane.data(), &(copy->mask[offset]), plane.data(), &(copy->mask[offset]), nx, ny, method);
+
+                for(size_t k = 0; k < nplane; k++)
+                    arr[offset + k] = saturate_cast<T>(plane[k]);
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Convolve","missing data");
+
+        copy->HDU().ValueForKey("CONVKERN",kernel.Name(),fChar,"Convolution kernel");
+        copy->HDU().ValueForKey("CONVSIZE",std::to_string(kernel.Nx())+"x"+std::to_string(kernel.Ny()),fChar,"Convolution kernel size [pix]");
+
+        return copy;
+    }
+
+    /**
+     *  @brief Resample the image onto the grid of another WCS
+     *  @details The pixel coordinates in this image of every pixel of the output grid are computed once through the world coordinates
+     *  (FITScube::ReprojectionMap), then each plane spanned by the first two axis is converted to double precision and interpolated by FITSinterpolator::Resample.
+     *  Higher axis are kept unchanged. Output pixels falling outside this image, on undefined world coordinates or on masked data are set to 0 and masked.
+     *  Integer images are rounded and saturated on write back.
+     *  @param target WCS of the output grid (primary WCS is used)
+     *  @param shape Number of pixels of the output grid along the first two axis
+     *  @param method Interpolation kernel
+     *  @param wcsIndex Index of the WCS of this image used to map the output grid
+     *  @return New FITSimg<T> with the target WCS and the other keywords of this header.
+     */
+    template< typename T >
+    std::shared_ptr<FITScube> FITSimg<T>::Reproject(const FITSwcs& target, const std::pair<size_t,size_t>& shape, const FITSinterpolator::method& method, const size_t& wcsIndex) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Reproject","missing data");
+
+        if(Naxis.size() < 2)
+            throw FITSexception(BAD_DIMEN,"FITSimg<T>","Reproject","reprojection requires at least 2 axis");
+
+        if(shape.first == 0 || shape.second == 0)
+            throw FITSexception(BAD_DIMEN,"FITSimg<T>","Reproject","empty output grid");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = Size(2);
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+        const size_t oplane = shape.first*shape.second;
+
+        std::vector<double> xs, ys;
+        ReprojectionMap(target, {0,0}, shape, xs, ys, wcsIndex);
+
+        std::vector<size_t> naxis = Naxis;
+        naxis[0] = shape.first;
+        naxis[1] = shape.second;
+
+        std::shared_ptr< FITSimg<T> > copy = std::make_shared< FITSimg<T> >(naxis);
+        copy->Bscale(BSCALE);
+        copy->Bzero (BZERO);
+        copy->Blank (BLANK);
+
+        if((verbose & verboseLevel::VERBOSE_DETAIL) == verboseLevel::VERBOSE_DETAIL)
+            std::cout<<"\033[31m[FITSimg::Reproject]\033[0m"<<std::endl
+                     << "    \033[31m|- METHOD :\033[0m "<<FITSinterpolator::Name(method)<<std::endl
+                     << "    \033[31m|- INPUT  :\033[0m "<<nlayer<<" of "<<nx<<"x"<<ny<<" [pix]"<<std::endl
+                     << "    \033[31m`- OUTPUT :\033[0m "<<shape.first<<"x"<<shape.second<<" [pix]"<<std::endl;
+
+        std::vector<double> plane(nplane);
+        std::vector<double> resampled(oplane);
+
+        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
+        {
+            copy->template WithTypedData<T>([&](std::valarray<T>& out)
+            {
+                for(size_t l = 0; l < nlayer; l++)
+                {
+                    for(size_t k = 0; k < nplane; k++)
+                        plane[k] = static_cast<double>(arr[l*nplane + k]);
+
+                    FITSinterpolator interp(plane.data(), &(mask[l*nplane]), nx, ny, method);
+                    interp.Resample(xs.data(), ys.data(), oplane, resampled.data(), &(copy->mask[l*oplane]));
+
+                    for(size_t k = 0; k < oplane; k++)
+                        out[l*oplane + k] = saturate_cast<T>(resampled[k]);
+                }
+            });
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Reproject","missing data");
+
+        CopyHeader(copy->HDU());
+
+        FITShdu wcs_hdu = target.asFITShdu(0);
+        for(FITSDictionary::const_iterator it = wcs_hdu.begin(); it != wcs_hdu.end(); it++)
+            copy->HDU().ValueForKey(it->first,it->second.value(),it->second.type(),it->second.comment());
+
+        copy->HDU().ValueForKey("REPROJ",FITSinterpolator::Name(method),fChar,"Reprojection interpolation kernel");
+        copy->reLoadWCS();
+
+        return copy;
+    }
+
+    /**
+     *  @brief Sky background of the image
+     *  @details Each plane spanned by the first two axis is converted to double precision and processed by FITSbackground::Estimate.
+     *  Masked pixels are ignored. Integer images are rounded and saturated on write back.
+     *  @param bkg Background estimator, holding the meshes of the last plane on return
+     *  @return New FITSimg<T> with the same header, WCS and shape as this holding the background map.
+     */
+    template< typename T >
+    std::shared_ptr<FITScube> FITSimg<T>::Background(FITSbackground& bkg) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Background","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        std::shared_ptr< FITSimg<T> > copy = std::make_shared< FITSimg<T> >(*this);
+
+        std::vector<double> plane(nplane);
+
+        bool handled = copy->template WithTypedData<T>([&](std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+
+                for(size_t k = 0; k < nplane; k++)
+                    plane[k] = static_cast<double>(arr[offset + k]);
+
+                bkg.Estimate(plane.data(), &(mask[offset]), nx, ny);
+                bkg.Background(plane.data());
+
+                for(size_t k = 0; k < nplane; k++)
+                    arr[offset + k] = saturate_cast<T>(plane[k]);
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Background","missing data");
+
+        copy->HDU().ValueForKey("BKGMESH",std::to_string(bkg.MeshX())+"x"+std::to_string(bkg.MeshY()),fChar,"Background mesh size [pix]");
+        copy->HDU().ValueForKey("BKGEST",(bkg.Estimator() == FITSbackground::estimator::mode)?"MODE":"MEDIAN",fChar,"Background cell estimator");
+
+        return copy;
+    }
+
+    /**
+     *  @brief Subtract the sky background of the image in place
+     *  @details The background of each plane spanned by the first two axis is estimated as in FITSimg<T>::Background and subtracted.
+     *  Integer images are rounded and saturated on write back. The median background and RMS of the last plane are recorded in the header.
+     *  @param bkg Background estimator, holding the meshes of the last plane on return
+     */
+    template< typename T >
+    void FITSimg<T>::SubtractBackground(FITSbackground& bkg)
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","SubtractBackground","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        std::vector<double> plane(nplane);
+        std::vector<double> back(nplane);
+
+        bool handled = WithTypedData<T>([&](std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+
+                for(size_t k = 0; k < nplane; k++)
+                    plane[k] = static_cast<double>(arr[offset + k]);
+
+                bkg.Estimate(plane.data(), &(mask[offset]), nx, ny);
+                bkg.Background(back.data());
+
+                for(size_t k = 0; k < nplane; k++)
+                    arr[offset + k] = saturate_cast<T>(plane[k] - back[k]);
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","SubtractBackground","missing data");
+
+        hdu.ValueForKey("BKGMESH",std::to_string(bkg.MeshX())+"x"+std::to_string(bkg.MeshY()),fChar,"Background mesh size [pix]");
+        hdu.ValueForKey("SKYLEVEL",bkg.GlobalBackground(),"Subtracted median sky background");
+        hdu.ValueForKey("SKYRMS",bkg.GlobalRMS(),"Median sky background RMS");
+    }
+
+    /**
+     *  @brief Source detection over the sky background
+     *  @details The background and RMS maps of each plane spanned by the first two axis are estimated by FITSbackground, then the pixels above
+     *  the detection threshold are labelled by FITSdetection. Masked pixels are neither used for the background nor detected.
+     *  @param det Source detector, holding the segments of the last plane on return
+     *  @param bkg Background estimator, holding the meshes of the last plane on return
+     *  @return Table of the segments, the PLANE column giving the plane each segment belongs to.
+     */
+    template< typename T >
+    std::shared_ptr<FITStable> FITSimg<T>::Detect(FITSdetection& det, FITSbackground& bkg) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Detect","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        std::vector<double> plane(nplane);
+        std::vector<double> back(nplane);
+        std::vector<double> rms(nplane);
+        std::vector<FITSdetection::segment> segments;
+
+        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+
+                for(size_t k = 0; k < nplane; k++)
+                    plane[k] = static_cast<double>(arr[offset + k]);
+
+                bkg.Estimate(plane.data(), &(mask[offset]), nx, ny);
+                bkg.Background(back.data());
+                bkg.RMS(rms.data());
+
+                det.Detect(plane.data(), &(mask[offset]), nx, ny, back.data(), rms.data(), l);
+                segments.insert(segments.end(), det.Segments().begin(), det.Segments().end());
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Detect","missing data");
+
+        std::shared_ptr<FITStable> table = FITSdetection::Catalog(segments);
+        table->HDU().ValueForKey("DETSIG",det.NSigma(),"Detection threshold [RMS]");
+        table->HDU().ValueForKey("DETAREA",static_cast<uint32_t>(det.MinArea()),"Minimum segment area [pix]");
+        table->HDU().ValueForKey("BKGMESH",std::to_string(bkg.MeshX())+"x"+std::to_string(bkg.MeshY()),fChar,"Background mesh size [pix]");
+
+        return table;
+    }
+
+    /**
+     *  @brief Source detection over a constant sky background
+     *  @details Each plane spanned by the first two axis is labelled by FITSdetection. Double precision images are processed without copy,
+     *  which makes this the fast path for background subtracted frames.
+     *  @param det Source detector, holding the segments of the last plane on return
+     *  @param background Background level
+     *  @param rms Background RMS
+     *  @return Table of the segments, the PLANE column giving the plane each segment belongs to.
+     */
+    template< typename T >
+    std::shared_ptr<FITStable> FITSimg<T>::Detect(FITSdetection& det, const double& background, const double& rms) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Detect","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        std::vector<double> plane;
+        std::vector<FITSdetection::segment> segments;
+
+        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+                const double* values = nullptr;
+
+                if constexpr(std::is_same_v<T,double>)
+                    values = &(arr[offset]);
+                else
+                {
+                    plane.resize(nplane);
+                    for(size_t k = 0; k < nplane; k++)
+                        plane[k] = static_cast<double>(arr[offset + k]);
+                    values = plane.data();
+                }
+
+                det.Detect(values, &(mask[offset]), nx, ny, background, rms, l);
+                segments.insert(segments.end(), det.Segments().begin(), det.Segments().end());
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Detect","missing data");
+
+        std::shared_ptr<FITStable> table = FITSdetection::Catalog(segments);
+        table->HDU().ValueForKey("DETSIG",det.NSigma(),"Detection threshold [RMS]");
+        table->HDU().ValueForKey("DETAREA",static_cast<uint32_t>(det.MinArea()),"Minimum segment area [pix]");
+        table->HDU().ValueForKey("SKYLEVEL",background,"Background level");
+        table->HDU().ValueForKey("SKYRMS",rms,"Background RMS");
+
+        return table;
+    }
+
+    /**
+     *  @brief Affine transform of the image
+     *  @details Each plane spanned by the first two axis is converted to double precision and resampled by FITSinterpolator::Warp through the
+     *  inverse transform, so that every output pixel is interpolated once. Masked input pixels are excluded from the interpolation,
+     *  output pixels falling outside of the input plane or without enough valid samples are set to 0 and masked.
+     *  Integer images are rounded and saturated on write back. The reference pixel and linear transformation matrix of every WCS are updated.
+     *  @param matrix Linear part {m11, m12, m21, m22} of the transform
+     *  @param offset Translation [pix]
+     *  @param method Interpolation kernel
+     *  @return New FITSimg<T> with the same header and shape as this holding the transformed data.
+     */
+    template< typename T >
+    std::shared_ptr<FITScube> FITSimg<T>::AffineWarp(const std::array<double,4>& matrix, const std::pair<double,double>& offset, const FITSinterpolator::method& method) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","AffineWarp","missing data");
+
+        if(Naxis.size() < 2)
+            throw FITSexception(BAD_DIMEN,"FITSimg<T>","AffineWarp","affine transform requires at least 2 axis");
+
+        const double det = matrix[0]*matrix[3] - matrix[1]*matrix[2];
+        if(!std::isfinite(det) || std::abs(det) < 1e-12 || !std::isfinite(offset.first) || !std::isfinite(offset.second))
+            throw FITSexception(BAD_OPTION,"FITSimg<T>","AffineWarp","singular or non finite transform");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = Size(2);
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        // Output to input pixel coordinates: p_in = M^-1 (p_out - offset)
+        const double i11 =  matrix[3]/det;
+        const double i12 = -matrix[1]/det;
+        const double i21 = -matrix[2]/det;
+        const double i22 =  matrix[0]/det;
+        const std::array<double,6> coeffs = { -(i11*offset.first + i12*offset.second), i11, i12,
+                                              -(i21*offset.first + i22*offset.second), i21, i22 };
+
+        std::shared_ptr< FITSimg<T> > copy = std::make_shared< FITSimg<T> >(*this);
+
+        if((verbose & verboseLevel::VERBOSE_DETAIL) == verboseLevel::VERBOSE_DETAIL)
+            std::cout<<"\033[31m[FITSimg::AffineWarp]\033[0m"<<std::endl
+                     << "    \033[31m|- METHOD :\033[0m "<<FITSinterpolator::Name(method)<<std::endl
+                     << "    \033[31m|- MATRIX :\033[0m "<<matrix[0]<<" "<<matrix[1]<<" "<<matrix[2]<<" "<<matrix[3]<<std::endl
+                     << "    \033[31m`- OFFSET :\033[0m "<<offset.first<<" "<<offset.second<<" [pix]"<<std::endl;
+
+        std::vector<double> plane(nplane);
+        std::vector<double> warped(nplane);
+
+        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
+        {
+            copy->template WithTypedData<T>([&](std::valarray<T>& out)
+            {
+                for(size_t l = 0; l < nlayer; l++)
+                {
+                    const size_t offset_l = l*nplane;
+
+                    for(size_t k = 0; k < nplane; k++)
+                        plane[k] = static_cast<double>(arr[offset_l + k]);
+
+                    FITSinterpolator interp(plane.data(), &(mask[offset_l]), nx, ny, method);
+                    interp.Warp(coeffs, nx, ny, warped.data(), &(copy->mask[offset_l]));
+
+                    for(size_t k = 0; k < nplane; k++)
+                        out[offset_l + k] = saturate_cast<T>(warped[k]);
+                }
+            });
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","AffineWarp","missing data");
+
+        copy->HDU().ValueForKey("WARP",FITSinterpolator::Name(method),fChar,"Geometric transform interpolation kernel");
+
+        if(getNumberOfWCS() > 0)
+        {
+            AffineWCS(copy->HDU(), matrix, offset);
+
+            try
+            {
+                copy->reLoadWCS();
+            }
+            catch(WCSexception& e)
+            {
+                std::cerr<<"\033[33m[WARNING]\033[0m WCS couldn't be updated after the affine transform. Image require new WCS calibration."<<std::endl;
+                std::cerr<<"          Original exception message: "<<e.what()<<std::endl;
+            }
+        }
+
+        return copy;
+    }
+
+    /**
+     *  @details Every plane is calibrated by FITScalibration::Apply in a single multithreaded pass, reading the raw values in their storage type
+     *  and writing single precision values. Pixels masked in this datacube or flagged by the calibration are set to 0 and masked.
+     *  The header is copied, except for the storage keywords, and the calibration keywords are added:
+     *  CALBIAS, CALDARK, DARKSCAL, CALFLAT, FLATNORM and CALBPM for the masters that are set.
+     *  @param cal Master frames
+     *  @param exptime Exposure time used to scale the master dark, read from the EXPTIME keyword if negative
+     *  @return New FITSimg<float> with the same shape as this holding the calibrated data.
+     */
+    template< typename T >
+    std::shared_ptr<FITScube> FITSimg<T>::Calibrate(const FITScalibration& cal, const double& exptime) const
+    {
+        if(data == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Calibrate","missing data");
+
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+        const size_t nlayer = (nplane > 0) ? Nelements()/nplane : 0;
+
+        if(nx != cal.Nx() || ny != cal.Ny())
+            throw FITSexception(BAD_DIMEN,"FITSimg<T>","Calibrate","master frames and image planes have different sizes");
+
+        double texp = exptime;
+        if(texp < 0.)
+        {
+            if(hdu.Exists("EXPTIME"))
+                texp = hdu.GetDoubleValueForKey("EXPTIME");
+            else if(cal.HasDark())
+                throw FITSexception(BAD_OPTION,"FITSimg<T>","Calibrate","missing EXPTIME keyword to scale the master dark");
+            else
+                texp = 0.;
+        }
+
+        std::shared_ptr< FITSimg<float> > calibrated = std::make_shared< FITSimg<float> >(Naxis);
+
+        for(FITSDictionary::const_iterator it = hdu.begin(); it != hdu.end(); ++it)
+        {
+            if(it->first == "BITPIX" ||
+               it->first == "BSCALE" ||
+               it->first == "BZERO"  ||
+               it->first == "BLANK"  ||
+               it->first.find("NAXIS") != std::string::npos)
+                continue;
+
+            calibrated->HDU().ValueForKey(it->first, it->second.value(), it->second.type(), it->second.comment());
+        }
+
+        std::valarray<float>* out = calibrated->template GetData<float>();
+        if(out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Calibrate","missing output data");
+
+        std::valarray<bool> bad(false, out->size());
+
+        bool handled = WithTypedData<T>([&](const std::valarray<T>& arr)
+        {
+            for(size_t l = 0; l < nlayer; l++)
+            {
+                const size_t offset = l*nplane;
+                cal.Apply(&(arr[offset]), &(mask[offset]), texp, &((*out)[offset]), &(bad[offset]));
+            }
+        });
+        if(!handled)
+            throw FITSexception(SHARED_NULPTR,"FITSimg<T>","Calibrate","missing data");
+
+        calibrated->MaskPixels(bad);
+
+        if(cal.HasBias())
+            calibrated->HDU().ValueForKey("CALBIAS",cal.BiasName(),fChar,"Master bias");
+        if(cal.HasDark())
+        {
+            calibrated->HDU().ValueForKey("CALDARK",cal.DarkName(),fChar,"Master dark");
+            calibrated->HDU().ValueForKey("DARKSCAL",texp/cal.DarkTime(),"Dark scaling EXPTIME/DARKTIME");
+        }
+        if(cal.HasFlat())
+        {
+            calibrated->HDU().ValueForKey("CALFLAT",cal.FlatName(),fChar,"Master flat");
+            calibrated->HDU().ValueForKey("FLATNORM",cal.FlatNorm(),"Master flat normalization");
+        }
+        if(cal.HasBadPixels())
+            calibrated->HDU().ValueForKey("CALBPM",cal.BadPixelsName(),fChar,"Bad pixel map");
+
+        calibrated->reLoadWCS();
+
+        return calibrated;
+    }
     
 #pragma endregion
 #pragma region * data operation
@@ -2583,6 +3155,8 @@ namespace DSL
         if(this == &img)
             return *this;
         
+        InvalidateMoments();
+
         // copy base FITScube members
         this->hdu        = img.hdu;
         this->Naxis      = img.Naxis;
@@ -2607,16 +3181,18 @@ namespace DSL
             if(src_arr)
             {
                 // direct copy of underlying typed array
-                this->data = std::make_unique< FitsArray<T> >(*src_arr);
+                this->data = std::make_unique< FitsArray >(*src_arr);
             }
             else
             {
-                // fallback: allocate and fill using generic get()
-                size_t n = img.data->size();
-                auto dst = std::make_unique< FitsArray<T> >(n);
-                for(size_t i = 0; i < n; ++i)
-                    dst->ref()[i] = static_cast<T>( img.data->get(i) );
-                this->data = std::move(dst);
+                // fallback: convert from the source storage type
+                std::valarray<T> dst(img.data->size());
+                img.data->visit([&](const auto& src)
+                {
+                    for(size_t i = 0; i < src.size(); ++i)
+                        dst[i] = static_cast<T>( src[i] );
+                });
+                this->data = std::make_unique< FitsArray >(std::move(dst));
             }
         }
         else
@@ -3284,23 +3860,20 @@ namespace DSL
     template< typename T >
     void FITSimg<T>::operator*= (const FITScube& img)
     {
-        // try typed-paths, invoke templated operator*= for the matching concrete FITSimg<U>
-        if (const auto *p_u8  = dynamic_cast<const FITSimg< uint8_t> *>(&img)) { this->template operator*=(*p_u8);  return; }
-        if (const auto *p_i8  = dynamic_cast<const FITSimg<  int8_t> *>(&img)) { this->template operator*=(*p_i8);  return; }
-        if (const auto *p_u16 = dynamic_cast<const FITSimg<uint16_t> *>(&img)) { this->template operator*=(*p_u16); return; }
-        if (const auto *p_i16 = dynamic_cast<const FITSimg< int16_t> *>(&img)) { this->template operator*=(*p_i16); return; }
-        if (const auto *p_u32 = dynamic_cast<const FITSimg<uint32_t> *>(&img)) { this->template operator*=(*p_u32); return; }
-        if (const auto *p_i32 = dynamic_cast<const FITSimg< int32_t> *>(&img)) { this->template operator*=(*p_i32); return; }
-        if (const auto *p_u64 = dynamic_cast<const FITSimg<uint64_t> *>(&img)) { this->template operator*=(*p_u64); return; }
-        if (const auto *p_i64 = dynamic_cast<const FITSimg< int64_t> *>(&img)) { this->template operator*=(*p_i64); return; }
-#if defined(__APPLE__)
-        if (const auto *p_sz  = dynamic_cast<const FITSimg<  size_t> *>(&img)) { this->template operator*=(*p_sz);  return; }
-#endif
-        if (const auto *p_f   = dynamic_cast<const FITSimg<   float> *>(&img)) { this->template operator*=(*p_f);   return; }
-        if (const auto *p_d   = dynamic_cast<const FITSimg<  double> *>(&img)) { this->template operator*=(*p_d);   return; }
+        // single dispatch on the storage type of img, then the typed operator on its values
+        img.Visit([&](const auto& other)
+        {
+            using S = typename std::decay_t<decltype(other)>::value_type;
+
+            if(data == nullptr || mask.size() == 0 || img.GetMask().size() == 0)
+                throw FITSexception(SHARED_NULPTR,"FITSimg<T>::operator*=","missing data");
 
-        // unsupported/unknown concrete type
-        throw FITSexception(SHARED_BADARG, "FITSimg<T>::operator*=", "unsupported FITScube concrete type");
+            if(mask.size() != img.GetMask().size() || data->size() != other.size())
+                throw FITSexception(SHARED_BADARG,"FITSimg<T>::operator*=","mask/data size mismatch");
+
+            mask |= img.GetMask();
+            this->template operator*=<S>(other);
+        });
     }
 
     /**
@@ -3311,23 +3884,21 @@ namespace DSL
     template< typename T >
     void FITSimg<T>::operator/= (const FITScube& img)
     {
-        // try typed-paths, invoke templated operator*= for the matching concrete FITSimg<U>
-        if (const auto *p_u8  = dynamic_cast<const FITSimg< uint8_t> *>(&img)) { this->template operator/=(*p_u8);  return; }
-        if (const auto *p_i8  = dynamic_cast<const FITSimg<  int8_t> *>(&img)) { this->template operator/=(*p_i8);  return; }
-        if (const auto *p_u16 = dynamic_cast<const FITSimg<uint16_t> *>(&img)) { this->template operator/=(*p_u16); return; }
-        if (const auto *p_i16 = dynamic_cast<const FITSimg< int16_t> *>(&img)) { this->template operator/=(*p_i16); return; }
-        if (const auto *p_u32 = dynamic_cast<const FITSimg<uint32_t> *>(&img)) { this->template operator/=(*p_u32); return; }
-        if (const auto *p_i32 = dynamic_cast<const FITSimg< int32_t> *>(&img)) { this->template operator/=(*p_i32); return; }
-        if (const auto *p_u64 = dynamic_cast<const FITSimg<uint64_t> *>(&img)) { this->template operator/=(*p_u64); return; }
-        if (const auto *p_i64 = dynamic_cast<const FITSimg< int64_t> *>(&img)) { this->template operator/=(*p_i64); return; }
-#if defined(__APPLE__)
-        if (const auto *p_sz  = dynamic_cast<const FITSimg<  size_t> *>(&img)) { this->template operator/=(*p_sz);  return; }
-#endif
-        if (const auto *p_f   = dynamic_cast<const FITSimg<   float> *>(&img)) { this->template operator/=(*p_f);   return; }
-        if (const auto *p_d   = dynamic_cast<const FITSimg<  double> *>(&img)) { this->template operator/=(*p_d);   return; }
+        // single dispatch on the storage type of img, then the typed operator on its values
+        img.Visit([&](const auto& other)
+        {
+            using S = typename std::decay_t<decltype(other)>::value_type;
+
+            if(data == nullptr || mask.size() == 0 || img.GetMask().size() == 0)
+                throw FITSexception(SHARED_NULPTR,"FITSimg<T>::operator/=","missing data");
 
-        // unsupported/unknown concrete type
-        throw FITSexception(SHARED_BADARG, "FITSimg<T>::operator*=", "unsupported FITScube concrete type");
+            if(mask.size() != img.GetMask().size() || data->size() != other.size())
+                throw FITSexception(SHARED_BADARG,"FITSimg<T>::operator/=","mask/data size mismatch");
+
+            mask |= img.GetMask();
+            mask |= ( other == static_cast<S>(0) ); // also mask where divisor is zero
+            this->template operator/=<S>(other);
+        });
     }
 
     /**
@@ -3338,23 +3909,20 @@ namespace DSL
     template< typename T >
     void FITSimg<T>::operator+= (const FITScube& img)
     {
-        // try typed-paths, invoke templated operator*= for the matching concrete FITSimg<U>
-        if (const auto *p_u8  = dynamic_cast<const FITSimg< uint8_t> *>(&img)) { this->template operator+=(*p_u8);  return; }
-        if (const auto *p_i8  = dynamic_cast<const FITSimg<  int8_t> *>(&img)) { this->template operator+=(*p_i8);  return; }
-        if (const auto *p_u16 = dynamic_cast<const FITSimg<uint16_t> *>(&img)) { this->template operator+=(*p_u16); return; }
-        if (const auto *p_i16 = dynamic_cast<const FITSimg< int16_t> *>(&img)) { this->template operator+=(*p_i16); return; }
-        if (const auto *p_u32 = dynamic_cast<const FITSimg<uint32_t> *>(&img)) { this->template operator+=(*p_u32); return; }
-        if (const auto *p_i32 = dynamic_cast<const FITSimg< int32_t> *>(&img)) { this->template operator+=(*p_i32); return; }
-        if (const auto *p_u64 = dynamic_cast<const FITSimg<uint64_t> *>(&img)) { this->template operator+=(*p_u64); return; }
-        if (const auto *p_i64 = dynamic_cast<const FITSimg< int64_t> *>(&img)) { this->template operator+=(*p_i64); return; }
-#if defined(__APPLE__)
-        if (const auto *p_sz  = dynamic_cast<const FITSimg<  size_t> *>(&img)) { this->template operator+=(*p_sz);  return; }
-#endif
-        if (const auto *p_f   = dynamic_cast<const FITSimg<   float> *>(&img)) { this->template operator+=(*p_f);   return; }
-        if (const auto *p_d   = dynamic_cast<const FITSimg<  double> *>(&img)) { this->template operator+=(*p_d);   return; }
+        // single dispatch on the storage type of img, then the typed operator on its values
+        img.Visit([&](const auto& other)
+        {
+            using S = typename std::decay_t<decltype(other)>::value_type;
+
+            if(data == nullptr || mask.size() == 0 || img.GetMask().size() == 0)
+                throw FITSexception(SHARED_NULPTR,"FITSimg<T>::operator+=","missing data");
 
-        // unsupported/unknown concrete type
-        throw FITSexception(SHARED_BADARG, "FITSimg<T>::operator*=", "unsupported FITScube concrete type");
+            if(mask.size() != img.GetMask().size() || data->size() != other.size())
+                throw FITSexception(SHARED_BADARG,"FITSimg<T>::operator+=","mask/data size mismatch");
+
+            mask |= img.GetMask();
+            this->template operator+=<S>(other);
+        });
     }
 
     /**
@@ -3365,23 +3933,20 @@ namespace DSL
     template< typename T >
     void FITSimg<T>::operator-= (const FITScube& img)
     {
-        // try typed-paths, invoke templated operator*= for the matching concrete FITSimg<U>
-        if (const auto *p_u8  = dynamic_cast<const FITSimg< uint8_t> *>(&img)) { this->template operator-=(*p_u8);  return; }
-        if (const auto *p_i8  = dynamic_cast<const FITSimg<  int8_t> *>(&img)) { this->template operator-=(*p_i8);  return; }
-        if (const auto *p_u16 = dynamic_cast<const FITSimg<uint16_t> *>(&img)) { this->template operator-=(*p_u16); return; }
-        if (const auto *p_i16 = dynamic_cast<const FITSimg< int16_t> *>(&img)) { this->template operator-=(*p_i16); return; }
-        if (const auto *p_u32 = dynamic_cast<const FITSimg<uint32_t> *>(&img)) { this->template operator-=(*p_u32); return; }
-        if (const auto *p_i32 = dynamic_cast<const FITSimg< int32_t> *>(&img)) { this->template operator-=(*p_i32); return; }
-        if (const auto *p_u64 = dynamic_cast<const FITSimg<uint64_t> *>(&img)) { this->template operator-=(*p_u64); return; }
-        if (const auto *p_i64 = dynamic_cast<const FITSimg< int64_t> *>(&img)) { this->template operator-=(*p_i64); return; }
-#if defined(__APPLE__)
-        if (const auto *p_sz  = dynamic_cast<const FITSimg<  size_t> *>(&img)) { this->template operator-=(*p_sz);  return; }
-#endif
-        if (const auto *p_f   = dynamic_cast<const FITSimg<   float> *>(&img)) { this->template operator-=(*p_f);   return; }
-        if (const auto *p_d   = dynamic_cast<const FITSimg<  double> *>(&img)) { this->template operator-=(*p_d);   return; }
+        // single dispatch on the storage type of img, then the typed operator on its values
+        img.Visit([&](const auto& other)
+        {
+            using S = typename std::decay_t<decltype(other)>::value_type;
+
+            if(data == nullptr || mask.size() == 0 || img.GetMask().size() == 0)
+                throw FITSexception(SHARED_NULPTR,"FITSimg<T>::operator-=","missing data");
 
-        // unsupported/unknown concrete type
-        throw FITSexception(SHARED_BADARG, "FITSimg<T>::operator*=", "unsupported FITScube concrete type");
+            if(mask.size() != img.GetMask().size() || data->size() != other.size())
+                throw FITSexception(SHARED_BADARG,"FITSimg<T>::operator-=","mask/data size mismatch");
+
+            mask |= img.GetMask();
+            this->template operator-=<S>(other);
+        });
     }
     
     template< typename T >
@@ -3708,6 +4273,7 @@ namespace DSL
 
         FITSwcs new_wcs(hdu);
         FITSwcs::swap(fwcs, new_wcs);
+        InvalidateWorldGrid();
     }
     
     /**
@@ -0,0 +1,111 @@
+//
+//  FITSinterpolator.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSinterpolator_
+#define _DSL_FITSinterpolator_
+
+#include <array>
+#include <string>
+#include <cstddef>
+
+#include "FITSexception.h"
+
+namespace DSL
+{
+#pragma region - FITSinterpolator class definition
+    /**
+     *  @class FITSinterpolator
+     *  @brief Sub-pixel interpolation of a 2D plane
+     *  @details A FITSinterpolator evaluates a 2D plane, stored row by row, at real pixel coordinates.
+     *  Pixel coordinates follow the convention of FITScube::WorldCoordinates: the centre of pixel (i,j) is at (i,j), the first pixel being (0,0).
+     *  All methods but nearest are separable convolutions of the samples with an interpolation kernel (linear, Keys cubic with a=-0.5, Lanczos with a=3).
+     *  Samples beyond the edges are replicated from the closest edge pixel. Masked or non finite samples are excluded and the remaining weights are renormalized;
+     *  the interpolated value is rejected if the valid samples hold less than half of the kernel weight.
+     *  @note The interpolator does not own the plane; the plane and the mask must outlive it.
+     */
+    class FITSinterpolator
+    {
+    public:
+        enum class method {nearest, bilinear, bicubic, lanczos};  //!< Interpolation kernel
+
+    protected:
+#pragma region * Protected member
+        const double* fdata;    //!< Plane values, fny rows of fnx values
+        const bool*   fmask;    //!< Plane mask (true for masked pixels), may be nullptr
+        size_t fnx;             //!< Number of columns
+        size_t fny;             //!< Number of rows
+        method fmethod;         //!< Interpolation kernel
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build an interpolator on a 2D plane
+         *  @param data: nx*ny plane values
+         *  @param msk: nx*ny plane mask (true for masked pixels), may be nullptr
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         *  @param m: Interpolation kernel
+         */
+        FITSinterpolator(const double* data, const bool* msk, const size_t& nx, const size_t& ny, const method& m = method::bilinear);
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t Nx() const {return fnx;}                  //!< Number of columns of the plane
+        inline size_t Ny() const {return fny;}                  //!< Number of rows of the plane
+        inline method Method() const {return fmethod;}          //!< Interpolation kernel
+        inline size_t Support() const {return Support(fmethod);} //!< Number of samples used along each axis
+
+        static size_t Support(const method&);                   //!< Number of samples used along each axis by an interpolation kernel
+        static std::string Name(const method&);                 //!< Interpolation kernel name used for provenance
+        static double Kernel(const method&, const double& t);   //!< Weight of a sample at distance t [pix] (separable kernels only, 0 for nearest)
+
+#pragma endregion
+#pragma region * Interpolation
+        /**
+         *  @brief Interpolate the plane at pixel coordinates (x,y)
+         *  @param x: Pixel coordinate along the first axis
+         *  @param y: Pixel coordinate along the second axis
+         *  @param value: Interpolated value, left untouched if the function returns false
+         *  @return false if (x,y) is outside the plane, is not finite or has not enough valid samples around it
+         */
+        bool operator()(const double& x, const double& y, double& value) const;
+
+        /**
+         *  @brief Interpolate the plane on a list of pixel coordinates
+         *  @details The list is split in chunks processed concurrently. Rejected points are set to 0 and flagged in the output mask.
+         *  @param xs: n pixel coordinates along the first axis
+         *  @param ys: n pixel coordinates along the second axis
+         *  @param n: Number of points
+         *  @param out: n interpolated values
+         *  @param omsk: n output mask values, may be nullptr
+         */
+        void Resample(const double* xs, const double* ys, const size_t& n, double* out, bool* omsk) const;
+
+        /**
+         *  @brief Interpolate the plane on a grid related to the plane by an affine map
+         *  @details The output pixel (i,j) is interpolated at (x,y) = (c[0] + c[1]*i + c[2]*j, c[3] + c[4]*i + c[5]*j).
+         *  The output grid is split in blocks of 64x64 pixels processed concurrently, which keeps the samples read by a block in cache
+         *  whatever the rotation. Rejected points are set to 0 and flagged in the output mask.
+         *  @param c: Affine map from output to input pixel coordinates
+         *  @param ox: Number of columns of the output grid
+         *  @param oy: Number of rows of the output grid
+         *  @param out: ox*oy interpolated values
+         *  @param omsk: ox*oy output mask values, may be nullptr
+         */
+        void Warp(const std::array<double,6>& c, const size_t& ox, const size_t& oy, double* out, bool* omsk) const;
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -0,0 +1,115 @@
+//
+//  FITSkernel.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSkernel_
+#define _DSL_FITSkernel_
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "FITSexception.h"
+
+namespace DSL
+{
+#pragma region - FITSkernel class definition
+    /**
+     *  @class FITSkernel
+     *  @brief 2D convolution kernel and mask-aware convolution engine
+     *  @details A FITSkernel holds the weights of an odd sized 2D kernel, stored row by row (x is the fastest axis, as for FITS images).
+     *  Kernels built from two 1D profiles are flagged as separable and are applied as two 1D passes.
+     *  Large non separable kernels are applied in Fourier space with the GSL mixed-radix FFT.
+     *  Masked pixels are handled by normalized convolution: the convolution of the masked data is divided by the convolution of the validity map,
+     *  so that masked pixels and pixels outside the image do not contribute to the result.
+     */
+    class FITSkernel
+    {
+    public:
+        enum class method {automatic, direct, separable, fft};  //!< Convolution algorithm
+
+    protected:
+#pragma region * Protected member
+        size_t fnx;                     //!< Kernel size along the x axis
+        size_t fny;                     //!< Kernel size along the y axis
+        std::vector<double> fweights;   //!< Kernel weights, fny rows of fnx values
+        std::vector<double> fkx;        //!< x profile of separable kernel (empty if not separable)
+        std::vector<double> fky;        //!< y profile of separable kernel (empty if not separable)
+        std::string fname;              //!< Kernel name used for provenance
+
+#pragma endregion
+#pragma region * Protected member function
+        void CheckSize() const;
+
+        void ApplyDirect   (const double*, const double*, double*, double*, const size_t&, const size_t&) const;
+        void ApplySeparable(const double*, const double*, double*, double*, const size_t&, const size_t&) const;
+        void ApplyFFT      (const double*, const double*, double*, double*, const size_t&, const size_t&) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build a kernel from its weights
+         *  @param nx: Kernel size along the x axis (odd)
+         *  @param ny: Kernel size along the y axis (odd)
+         *  @param weights: nx*ny kernel weights, row by row
+         */
+        FITSkernel(const size_t& nx, const size_t& ny, const std::vector<double>& weights);
+
+        /**
+         *  @brief Build a separable kernel from two 1D profiles
+         *  @param kx: Profile along the x axis (odd size)
+         *  @param ky: Profile along the y axis (odd size)
+         */
+        FITSkernel(const std::vector<double>& kx, const std::vector<double>& ky);
+
+        static FITSkernel Gaussian(const double& sigma_x, const double& sigma_y, const double& truncate = 4.);   //!< Normalized separable Gaussian kernel truncated at truncate*sigma
+        static FITSkernel Gaussian(const double& sigma) {return Gaussian(sigma, sigma);}                          //!< Normalized circular Gaussian kernel truncated at 4 sigma
+        static FITSkernel Box(const size_t& nx, const size_t& ny);                                               //!< Normalized separable box (mean) kernel
+        static FITSkernel Box(const size_t& n) {return Box(n, n);}
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t Nx() const {return fnx;}                                   //!< Kernel size along the x axis
+        inline size_t Ny() const {return fny;}                                   //!< Kernel size along the y axis
+        inline bool isSeparable() const {return !fkx.empty() && !fky.empty();}   //!< Either the kernel is applied as two 1D passes
+        inline const std::vector<double>& Weights() const {return fweights;}     //!< Kernel weights, row by row
+        inline const std::string& Name() const {return fname;}                   //!< Kernel name
+
+        double Sum() const;                                                      //!< Sum of the kernel weights
+        double operator()(const size_t& i, const size_t& j) const;               //!< Weight at column i and row j
+
+        method Resolve(const method& m, const size_t& nx, const size_t& ny) const; //!< Algorithm actually used for the requested method on a nx*ny plane
+
+#pragma endregion
+#pragma region * Modifier
+        void Normalize();                                                        //!< Scale the kernel so that its weights sum to 1
+        inline void SetName(const std::string& name) {fname = name;}
+
+#pragma endregion
+#pragma region * Convolution
+        /**
+         *  @brief Convolve a 2D plane
+         *  @param in: nx*ny input values
+         *  @param msk: nx*ny input mask (true for masked pixels), may be nullptr
+         *  @param out: nx*ny output values
+         *  @param omsk: nx*ny output mask, may be nullptr. Set for pixels masked in input or without any valid pixel under the kernel.
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         *  @param m: Convolution algorithm
+         */
+        void Apply(const double* in, const bool* msk, double* out, bool* omsk, const size_t& nx, const size_t& ny, const method& m = method::automatic) const;
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -0,0 +1,131 @@
+//
+//  FITSmorphology.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSmorphology_
+#define _DSL_FITSmorphology_
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "FITSexception.h"
+
+namespace DSL
+{
+#pragma region - FITSmorphology class definition
+    /**
+     *  @class FITSmorphology
+     *  @brief Binary morphology of 2D masks with a structuring element
+     *  @details The masks are packed in rows of 64 bits words (bit i of word w holds column 64w+i) and the structuring element is stored
+     *  as horizontal spans, one per row offset. A dilation ORs, for every span, the input row shifted by the span: the OR over a span of width w
+     *  is built with log2(w) word shifts, and the shifted rows of the spans sharing the same extent are only computed once.
+     *  The erosion is computed as the dual of the dilation by the reflected element, \f$A\ominus B = \overline{\bar{A}\oplus\check{B}}\f$,
+     *  so that pixels outside of the plane are considered unmasked by the dilation and masked by the erosion: the borders of the plane do not erode the mask.
+     *  Rows are processed concurrently.
+     */
+    class FITSmorphology
+    {
+    public:
+        enum class shape {box, cross, disk};                     //!< Predefined structuring elements
+        enum class operation {dilate, erode, open, close};      //!< Morphological operations
+
+    protected:
+        /**
+         *  @struct span
+         *  @brief Horizontal span of the structuring element
+         */
+        struct span
+        {
+            long dy;    //!< Row offset
+            long x0;    //!< First column offset
+            long x1;    //!< Last column offset (included)
+        };
+
+#pragma region * Protected member
+        std::vector<span> fspans;       //!< Spans of the structuring element, sorted by extent
+
+#pragma endregion
+#pragma region * Protected member function
+        void AddSpans(const std::vector<bool>& footprint, const size_t& width, const size_t& height);
+        void Dilate(const std::vector<uint64_t>& in, std::vector<uint64_t>& out, const size_t& nx, const size_t& ny, const bool& reflect) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build a predefined structuring element
+         *  @param s: Shape of the element: (2r+1)x(2r+1) box, cross of half length r or disk of radius r
+         *  @param radius: Half size r of the element [pix]
+         */
+        FITSmorphology(const shape& s = shape::box, const size_t& radius = 1);
+
+        /**
+         *  @brief Build a structuring element from a footprint
+         *  @param footprint: width*height values, true for the pixels of the element
+         *  @param width: Number of columns of the footprint, must be odd
+         *  @param height: Number of rows of the footprint, must be odd
+         *  @note The origin of the element is the central pixel of the footprint.
+         */
+        FITSmorphology(const std::vector<bool>& footprint, const size_t& width, const size_t& height);
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t NumberOfSpans() const {return fspans.size();}      //!< Number of rows of the structuring element
+        size_t Area() const;                                            //!< Number of pixels of the structuring element
+
+#pragma endregion
+#pragma region * Packed masks
+        static size_t Words(const size_t& nx) {return (nx + 63) / 64;}  //!< Number of words of a packed row
+
+        /**
+         *  @brief Pack a nx*ny mask in rows of Words(nx) words
+         */
+        static void Pack(const bool* in, const size_t& nx, const size_t& ny, std::vector<uint64_t>& out);
+
+        /**
+         *  @brief Unpack rows of Words(nx) words in a nx*ny mask
+         */
+        static void Unpack(const std::vector<uint64_t>& in, const size_t& nx, const size_t& ny, bool* out);
+
+        /**
+         *  @brief Apply a morphological operation to a packed mask
+         *  @param op: Operation
+         *  @param in: Packed input mask
+         *  @param out: Packed output mask, resized if needed
+         *  @param nx: Number of columns of the plane
+         *  @param ny: Number of rows of the plane
+         */
+        void Apply(const operation& op, const std::vector<uint64_t>& in, std::vector<uint64_t>& out, const size_t& nx, const size_t& ny) const;
+
+        /**
+         *  @brief Fill the holes of a packed mask
+         *  @details Unmasked pixels which are not 4-connected to the border of the plane are masked. Unmasked runs of each row are labelled by union-find.
+         */
+        static void FillHoles(std::vector<uint64_t>& bits, const size_t& nx, const size_t& ny);
+
+#pragma endregion
+#pragma region * Masks
+        /**
+         *  @brief Apply a morphological operation to a nx*ny mask in place
+         */
+        void Apply(const operation& op, bool* msk, const size_t& nx, const size_t& ny) const;
+
+        /**
+         *  @brief Fill the holes of a nx*ny mask in place
+         */
+        static void FillHoles(bool* msk, const size_t& nx, const size_t& ny);
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -0,0 +1,110 @@
+//
+//  FITSmosaic.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSmosaic_
+#define _DSL_FITSmosaic_
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+#include "FITSwcs.h"
+#include "FITSinterpolator.h"
+#include "FITSexception.h"
+
+namespace DSL
+{
+    class FITScube;
+
+#pragma region - FITSmosaic class definition
+    /**
+     *  @class FITSmosaic
+     *  @brief Streaming weighted co-addition of images onto a common WCS grid
+     *  @details A FITSmosaic holds the weighted sum and the sum of weights of every pixel of a target grid.
+     *  Images are added one at a time: the footprint of each input on the target grid is estimated from its boundary, and only the
+     *  output tiles it overlaps are resampled (FITScube::ReprojectionMap and FITSinterpolator) and accumulated.
+     *  Memory is therefore bounded by the size of the target grid, whatever the number of inputs.
+     *  The science image is the weighted mean \f$\sum_i w_i v_i / \sum_i w_i\f$ and the weight image is \f$\sum_i w_i\f$.
+     *  @note Only the first plane of the inputs is used. Add is not meant to be called concurrently on the same mosaic.
+     */
+    class FITSmosaic
+    {
+    protected:
+#pragma region * Protected member
+        FITSwcs fwcs;                       //!< WCS of the target grid
+        size_t fnx;                         //!< Number of columns of the target grid
+        size_t fny;                         //!< Number of rows of the target grid
+        size_t ftile;                       //!< Tile size [pix]
+        FITSinterpolator::method fmethod;   //!< Interpolation kernel
+        std::vector<double> fsum;           //!< Weighted sum of the inputs, row by row
+        std::vector<double> fweight;        //!< Sum of the weights, row by row
+        size_t fninput;                     //!< Number of inputs that overlapped the target grid
+
+#pragma endregion
+#pragma region * Protected member function
+        std::pair<std::pair<size_t,size_t>,std::pair<size_t,size_t>> Footprint(const FITScube& img, const size_t& wcsIndex) const;
+        size_t Accumulate(const FITScube& img, const FITScube* weightMap, const double& weight, const size_t& wcsIndex);
+        std::shared_ptr<FITScube> MakeImage(const std::vector<double>& values, const std::string& content) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Build an empty mosaic
+         *  @param target WCS of the target grid (primary WCS is used)
+         *  @param shape Number of columns and rows of the target grid
+         *  @param method Interpolation kernel used to resample the inputs
+         *  @param tile Size of the tiles the target grid is processed by [pix]
+         */
+        FITSmosaic(const FITSwcs& target, const std::pair<size_t,size_t>& shape,
+                   const FITSinterpolator::method& method = FITSinterpolator::method::bilinear, const size_t& tile = 256);
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t Nx() const {return fnx;}                                    //!< Number of columns of the target grid
+        inline size_t Ny() const {return fny;}                                    //!< Number of rows of the target grid
+        inline size_t NumberOfInputs() const {return fninput;}                    //!< Number of inputs that overlapped the target grid
+        inline const FITSwcs& getWCS() const {return fwcs;}                       //!< WCS of the target grid
+        inline const std::vector<double>& WeightedSum() const {return fsum;}      //!< Weighted sum of the inputs
+        inline const std::vector<double>& WeightSum() const {return fweight;}     //!< Sum of the weights
+
+#pragma endregion
+#pragma region * Co-addition
+        /**
+         *  @brief Add an image with a uniform weight
+         *  @param img Input image with a valid WCS. Masked pixels are ignored.
+         *  @param weight Weight of every pixel of the input (e.g. inverse variance)
+         *  @param wcsIndex Index of the WCS of the input
+         *  @return Number of target pixels that received a contribution
+         */
+        size_t Add(const FITScube& img, const double& weight = 1., const size_t& wcsIndex = 0);
+
+        /**
+         *  @brief Add an image with a per pixel weight map
+         *  @param img Input image with a valid WCS. Masked pixels are ignored.
+         *  @param weightMap Weight of each pixel of the input, same shape as img. Masked, negative or non finite weights are ignored.
+         *  @param wcsIndex Index of the WCS of the input
+         *  @return Number of target pixels that received a contribution
+         */
+        size_t Add(const FITScube& img, const FITScube& weightMap, const size_t& wcsIndex = 0);
+
+        void Reset();                               //!< Clear the accumulated data
+
+        std::shared_ptr<FITScube> Science() const;  //!< Weighted mean image (float), pixels without data are masked
+        std::shared_ptr<FITScube> Weight() const;   //!< Sum of weights image (float)
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
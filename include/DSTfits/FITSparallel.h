@@ -0,0 +1,299 @@
+//
+//  FITSparallel.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSparallel_
+#define _DSL_FITSparallel_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DSL
+{
+#pragma region - CancelToken class definition
+    /**
+     *  @class CancelToken
+     *  @brief Cooperative cancellation flag of parallel loops
+     *  @details The chunks of a loop that have not started when the token is cancelled are skipped. Long chunks may also poll
+     *  Cancelled() to stop early.
+     */
+    class CancelToken
+    {
+    private:
+        std::atomic<bool> fcancelled{false};
+
+    public:
+        inline void Cancel() {fcancelled.store(true, std::memory_order_relaxed);}                   //!< Request the cancellation
+        inline void Reset() {fcancelled.store(false, std::memory_order_relaxed);}                   //!< Clear the cancellation request
+        inline bool Cancelled() const {return fcancelled.load(std::memory_order_relaxed);}          //!< True if the cancellation was requested
+    };
+
+#pragma endregion
+#pragma region - ThreadPool class definition
+    /**
+     *  @class ThreadPool
+     *  @brief Library-wide work-stealing thread pool
+     *  @details A single pool is shared by all the parallel algorithms of the library, so that nested or concurrent loops do not
+     *  spawn threads nor oversubscribe the machine. Each worker owns a queue: it runs its own tasks last in first out and steals
+     *  the oldest tasks of the other workers when its queue is empty. A thread waiting for the end of a loop runs pending tasks
+     *  meanwhile, so that loops can be nested at any depth without deadlock.
+     *  The number of threads, calling thread included, is read from the DSL_NUM_THREADS environment variable at first use and
+     *  defaults to the hardware concurrency.
+     */
+    class ThreadPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+    private:
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> fqueues;    //!< One queue per worker
+        std::vector<std::thread> fworkers;              //!< Worker threads
+        std::atomic<size_t> fpending;                   //!< Number of queued tasks
+        std::atomic<size_t> fnext;                      //!< Round robin index of the queues fed by external threads
+        std::mutex fsleep;                              //!< Lock of the idle workers
+        std::condition_variable fwake;                  //!< Wakes the idle workers up
+        bool fstop;                                     //!< Stops the workers
+        std::mutex fconfig;                             //!< Serializes the changes of the number of threads
+
+        ThreadPool();
+
+        void Start(const size_t& nthreads);             //!< Start nthreads-1 workers
+        void Stop();                                    //!< Join the workers
+        void Work(const size_t& index);                 //!< Worker loop
+        bool Pop(const size_t& index, Task& task);      //!< Own task of a worker or task stolen from the other queues
+
+    public:
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        static ThreadPool& Instance();                  //!< Shared pool, started at first use
+
+        /**
+         *  @brief Number of threads running parallel loops, calling thread included
+         */
+        inline size_t NumberOfThreads() const {return fworkers.size() + 1;}
+
+        /**
+         *  @brief Restart the pool with nthreads threads, calling thread included
+         *  @param nthreads: Number of threads, the hardware concurrency if 0. 1 runs every loop on the calling thread.
+         *  @note Must not be called while parallel loops are running.
+         */
+        void SetNumberOfThreads(const size_t& nthreads);
+
+        void Submit(Task task);                         //!< Queue a task, on the queue of the calling worker if any
+
+        /**
+         *  @brief Run one pending task on the calling thread
+         *  @return false if there was no pending task
+         */
+        bool RunPendingTask();
+    };
+
+    inline size_t GetNumberOfThreads() {return ThreadPool::Instance().NumberOfThreads();}                  //!< Number of threads of the shared pool
+    inline void SetNumberOfThreads(const size_t& n) {ThreadPool::Instance().SetNumberOfThreads(n);}          //!< Number of threads of the shared pool, hardware concurrency if 0
+
+#pragma endregion
+#pragma region - Parallel loops
+
+    namespace detail
+    {
+        /**
+         *  @brief Run fn(chunk,begin,end) on nchunks contiguous chunks of [begin,end) on the shared pool
+         *  @details The calling thread runs the first chunk and then helps with the pending tasks until all the chunks are done.
+         *  The first exception thrown by a chunk cancels the chunks not yet started and is rethrown on the calling thread.
+         */
+        template<typename Fn>
+        void run_chunks(const size_t& begin, const size_t& end, const size_t& nchunks, Fn& fn, const CancelToken* cancel)
+        {
+            const size_t n     = end - begin;
+            const size_t chunk = (n + nchunks - 1) / nchunks;
+
+            struct State
+            {
+                std::atomic<size_t>     remaining;
+                std::atomic<bool>       failed{false};
+                std::exception_ptr      error;
+                std::mutex              lock;
+                std::condition_variable done;
+            } state;
+            state.remaining.store(nchunks);
+
+            auto run = [&state, &fn, cancel, begin, end, chunk](const size_t& c)
+            {
+                const size_t b = begin + c*chunk;
+                const size_t e = std::min(end, b + chunk);
+
+                if(b < e && !state.failed.load(std::memory_order_relaxed) && (cancel == nullptr || !cancel->Cancelled()))
+                {
+                    try
+                    {
+                        fn(c, b, e);
+                    }
+                    catch(...)
+                    {
+                        std::lock_guard<std::mutex> lk(state.lock);
+                        if(!state.failed.exchange(true))
+                            state.error = std::current_exception();
+                    }
+                }
+
+                // The state lives on the stack of the calling thread: it is not touched after the lock is released
+                std::lock_guard<std::mutex> lk(state.lock);
+                if(state.remaining.fetch_sub(1) == 1)
+                    state.done.notify_all();
+            };
+
+            ThreadPool& pool = ThreadPool::Instance();
+            for(size_t c = 1; c < nchunks; c++)
+                pool.Submit([&run, c]{ run(c); });
+
+            run(0);
+
+            while(state.remaining.load() > 0)
+            {
+                if(pool.RunPendingTask())
+                    continue;
+
+                std::unique_lock<std::mutex> lk(state.lock);
+                state.done.wait_for(lk, std::chrono::microseconds(200), [&state]{ return state.remaining.load() == 0; });
+            }
+
+            // Wait for the last chunk to release the lock
+            std::lock_guard<std::mutex> lk(state.lock);
+
+            if(state.error)
+                std::rethrow_exception(state.error);
+        }
+
+        /**
+         *  @brief Number of chunks of a loop of n items with at least grain items per chunk
+         */
+        inline size_t loop_chunks(const size_t& n, const size_t& grain, const size_t& maxChunks)
+        {
+            const size_t byGrain = (n + std::max<size_t>(1, grain) - 1) / std::max<size_t>(1, grain);
+            return std::max<size_t>(1, std::min(byGrain, maxChunks));
+        }
+    }
+
+    /**
+     *  @brief Parallel loop on the shared pool
+     *  @details [begin,end) is split in contiguous chunks of at least grain items, up to 4 chunks per thread so that the workers
+     *  balance the load by stealing. Loops small enough for a single chunk run inline on the calling thread. Loops may be nested.
+     *  @param begin: First item
+     *  @param end: Past the end item
+     *  @param grain: Minimum number of items per chunk
+     *  @param fn: Callable invoked as fn(begin,end) on each chunk
+     *  @param cancel: Optional cancellation token, the chunks not yet started when it is cancelled are skipped
+     */
+    template<typename Fn>
+    void parallel_for(const size_t& begin, const size_t& end, const size_t& grain, Fn&& fn, const CancelToken* cancel = nullptr)
+    {
+        if(end <= begin || (cancel != nullptr && cancel->Cancelled()))
+            return;
+
+        const size_t nchunks = detail::loop_chunks(end - begin, grain, 4*GetNumberOfThreads());
+        if(nchunks == 1)
+        {
+            fn(begin, end);
+            return;
+        }
+
+        auto body = [&fn](const size_t&, const size_t& b, const size_t& e){ fn(b, e); };
+        detail::run_chunks(begin, end, nchunks, body, cancel);
+    }
+
+    /**
+     *  @brief Parallel reduction on the shared pool
+     *  @details Each chunk is mapped to a partial result and the partial results are reduced in the order of the chunks, so that
+     *  the result only depends on the number of threads through the chunk boundaries.
+     *  @param begin: First item
+     *  @param end: Past the end item
+     *  @param grain: Minimum number of items per chunk
+     *  @param identity: Result of an empty range
+     *  @param map: Callable invoked as map(begin,end) and returning the partial result of a chunk
+     *  @param reduce: Callable invoked as reduce(a,b) and returning the reduction of two partial results
+     *  @param cancel: Optional cancellation token, the chunks skipped after a cancellation contribute identity
+     *  @return Reduction of the partial results
+     */
+    template<typename T, typename Map, typename Reduce>
+    T parallel_reduce(const size_t& begin, const size_t& end, const size_t& grain, const T& identity, Map&& map, Reduce&& reduce, const CancelToken* cancel = nullptr)
+    {
+        if(end <= begin || (cancel != nullptr && cancel->Cancelled()))
+            return identity;
+
+        const size_t nchunks = detail::loop_chunks(end - begin, grain, 4*GetNumberOfThreads());
+        if(nchunks == 1)
+            return reduce(identity, map(begin, end));
+
+        std::vector<T> partial(nchunks, identity);
+
+        auto body = [&partial, &map](const size_t& c, const size_t& b, const size_t& e){ partial[c] = map(b, e); };
+        detail::run_chunks(begin, end, nchunks, body, cancel);
+
+        T result = identity;
+        for(const T& p : partial)
+            result = reduce(result, p);
+
+        return result;
+    }
+
+    namespace detail
+    {
+        /**
+         *  @brief Split [0,n) in at most one contiguous chunk per thread of the shared pool
+         *  @details The number of chunks is bounded by the number of threads and by the amount of work, so that small problems run
+         *  inline on the calling thread. Callers keeping per-chunk buffers rely on this bound. Exceptions thrown by a chunk are
+         *  rethrown on the calling thread.
+         *  @param n: Number of items (rows, blocks, ...)
+         *  @param itemCost: Approximate number of elementary operations per item
+         *  @param fn: Callable invoked as fn(begin,end)
+         */
+        template<typename Fn>
+        void parallel_chunks(const size_t& n, const size_t& itemCost, Fn&& fn)
+        {
+            if(n == 0)
+                return;
+
+            const size_t work   = std::max<size_t>(1, (n * std::max<size_t>(1,itemCost)) / 32768);
+            const size_t chunks = std::min({GetNumberOfThreads(), n, work});
+
+            if(chunks <= 1)
+            {
+                fn(size_t{0}, n);
+                return;
+            }
+
+            auto body = [&fn](const size_t&, const size_t& b, const size_t& e){ fn(b, e); };
+            run_chunks(size_t{0}, n, chunks, body, nullptr);
+        }
+    }
+
+#pragma endregion
+}
+
+#endif
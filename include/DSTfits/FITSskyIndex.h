@@ -0,0 +1,132 @@
+//
+//  FITSskyIndex.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSskyIndex_
+#define _DSL_FITSskyIndex_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FITStable.h"
+
+namespace DSL
+{
+#pragma region - FITSskyIndex class definition
+    /**
+     *  @class FITSskyIndex
+     *  @brief HEALPix spatial index of the celestial positions of a table
+     *  @details The NESTED HEALPix pixel of every row is computed in parallel from the longitude and latitude columns [deg], then the rows
+     *  are sorted by pixel. In the NESTED scheme the pixels of a coarser order cover contiguous ranges of the finer pixels, so that a query
+     *  descends the HEALPix hierarchy from the 12 base pixels: the pixels outside of the searched region are pruned, the rows of the
+     *  pixels entirely inside are taken as a whole, and only the rows of the pixels crossing the border are tested on their coordinates.
+     *  Rows with an undefined position are never returned.
+     *  @note The index refers to the table it was built on, which must outlive it and keep its rows; queries check the number of rows.
+     */
+    class FITSskyIndex
+    {
+    public:
+        /**
+         *  @brief Row of the table and its pixel
+         */
+        struct entry
+        {
+            uint64_t pixel;
+            size_t   row;
+        };
+
+    protected:
+#pragma region * Protected member
+        const FITStable* ftable;            //!< Indexed table
+        std::string      fra;               //!< Name of the longitude column
+        std::string      fdec;              //!< Name of the latitude column
+        int              forder;            //!< HEALPix order, nside = 2^order
+        std::vector<entry> fentries;        //!< Rows sorted by pixel, the rows with an undefined position at the end
+        size_t           fvalid;            //!< Number of rows with a defined position
+
+#pragma endregion
+#pragma region * Protected member function
+        FITSskyIndex(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const int& order, const std::vector<uint64_t>& pixels);
+
+        void Sort(const std::vector<uint64_t>& pixels);
+        std::pair<size_t,size_t> Rows(const int& order, const uint64_t& pixel) const;
+
+        template<typename Inside, typename Classify>
+        RowSet Query(Inside&& inside, Classify&& classify) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Compute the pixels of the rows of a table and sort them
+         *  @param table: Table to index
+         *  @param raColumn: Name of the longitude column (float or double) [deg]
+         *  @param decColumn: Name of the latitude column (float or double) [deg]
+         *  @param order: HEALPix order, from 0 to 29 (nside = 2^order)
+         */
+        FITSskyIndex(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const int& order = 10);
+
+        /**
+         *  @brief Rebuild an index from the companion column written by Save, without computing the pixels again
+         *  @param table: Indexed table, holding the companion column and the HPXORDER keyword
+         *  @param raColumn: Name of the longitude column (float or double) [deg]
+         *  @param decColumn: Name of the latitude column (float or double) [deg]
+         *  @param column: Name of the companion column
+         */
+        static FITSskyIndex FromColumn(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const std::string& column = "HPX_NEST");
+
+#pragma endregion
+#pragma region * Accessor
+        inline int      Order() const {return forder;}                                   //!< HEALPix order
+        inline uint64_t Nside() const {return uint64_t(1) << forder;}                    //!< Number of pixels along the side of a base pixel
+        inline size_t   size() const {return fentries.size();}                            //!< Number of rows of the indexed table
+        inline size_t   NumberOfIndexedRows() const {return fvalid;}                     //!< Number of rows with a defined position
+        inline const std::vector<entry>& Entries() const {return fentries;}               //!< Rows sorted by pixel
+
+#pragma endregion
+#pragma region * Query
+        /**
+         *  @brief Rows within a given angular distance of a position
+         *  @param ra: Longitude of the centre [deg]
+         *  @param dec: Latitude of the centre [deg]
+         *  @param radius: Radius of the cone [deg]
+         */
+        RowSet Cone(const double& ra, const double& dec, const double& radius) const;
+
+        /**
+         *  @brief Rows inside a convex spherical polygon
+         *  @param vertices: (longitude, latitude) of the vertices [deg], at least 3, in either orientation, joined by great circles
+         */
+        RowSet Polygon(const std::vector<std::pair<double,double>>& vertices) const;
+
+#pragma endregion
+#pragma region * Persistence
+        /**
+         *  @brief Append the pixel of every row to a table, -1 for the undefined positions, and the order to its HPXORDER keyword
+         *  @param table: Table receiving the companion column, normally the indexed one
+         *  @param column: Name of the companion column
+         */
+        void Save(FITStable& table, const std::string& column = "HPX_NEST") const;
+
+#pragma endregion
+#pragma region * HEALPix
+        static uint64_t Ang2Pix(const int& order, const double& ra, const double& dec);         //!< NESTED pixel of a position [deg]
+        static void     Pix2Ang(const int& order, const uint64_t& pixel, double& ra, double& dec); //!< Centre of a NESTED pixel [deg]
+        static double   MaxPixelRadius(const int& order);                                         //!< Largest distance between the centre and a corner of a pixel [rad]
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -13,10 +13,12 @@
 #include <valarray>
 #include <functional>
 #include <algorithm> // <-- added for std::min
-
-#include <thread>
-#include <mutex>
-#include <future>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
 
 #include <Minuit2/FCNBase.h>
 #include <Minuit2/MinimumBuilder.h>
@@ -29,130 +31,345 @@
 #include <Minuit2/MnPlot.h>
 #include <Minuit2/MnPrint.h>
 
+#include "FITSparallel.h"
+
 namespace DSL
 {
     namespace stat
     {
+        /**
+         *  @brief Quantiles of a set of values, by selection
+         *  @details Quantiles are linearly interpolated between the order statistics bracketing the position \f$p\,(n-1)\f$.
+         *  All the requested quantiles are obtained from a single recursive partition of the values (introselect on the median
+         *  requested rank, then on each side), in \f$O(n \log q)\f$ for q quantiles instead of a full sort.
+         *  @param values: n values, reordered in place
+         *  @param n: Number of values
+         *  @param probs: Probabilities in [0,1]
+         *  @return Quantiles, in the order of probs
+         */
+        std::vector<double> Quantiles(double* values, const size_t& n, const std::vector<double>& probs);
+
+        /**
+         *  @brief Quantiles of a set of values, by selection
+         *  @param values: Values, reordered in place
+         *  @param probs: Probabilities in [0,1]
+         *  @return Quantiles, in the order of probs
+         */
+        inline std::vector<double> Quantiles(std::vector<double>& values, const std::vector<double>& probs) {return Quantiles(values.data(), values.size(), probs);}
+
+        /**
+         *  @brief Weighted quantiles of a set of values, by selection
+         *  @details Each value covers a segment of the cumulated weights of the sorted values and is placed at the middle of its segment;
+         *  the quantile of probability p is linearly interpolated between the values bracketing \f$p\,W\f$, W being the total weight, and
+         *  is the minimum or maximum value outside of the range of the middle points. Equal values are merged in a single value with the sum
+         *  of their weights, so that the result does not depend on the order of the values. With equal weights, the median is the usual median.
+         *  As for Quantiles, only the values bracketing the requested quantiles are put at their sorted position, by a recursive partition.
+         *  @param values: n values, NaN values are ignored
+         *  @param weights: n weights, positive or null
+         *  @param n: Number of values
+         *  @param probs: Probabilities in [0,1]
+         *  @return Quantiles, in the order of probs
+         */
+        std::vector<double> WeightedQuantiles(const double* values, const double* weights, const size_t& n, const std::vector<double>& probs);
+
+        /**
+         *  @brief Exact percentiles of a container of values
+         *  @details The non NaN values are copied to a working buffer and the percentiles are obtained by selection (Quantiles),
+         *  the container being left untouched.
+         *  @param values: std::vector or std::valarray of arithmetic values
+         *  @param probs: Probabilities in [0,1]
+         *  @return Percentiles, in the order of probs
+         */
+        template<typename C>
+        std::vector<double> Percentiles(const C& values, const std::vector<double>& probs);
+
+        /**
+         *  @brief Exact weighted percentiles of a container of values
+         *  @param values: std::vector or std::valarray of arithmetic values
+         *  @param weights: Weights of the values, same size as values
+         *  @param probs: Probabilities in [0,1]
+         *  @return Percentiles, in the order of probs
+         *  @see WeightedQuantiles
+         */
+        template<typename C, typename W>
+        std::vector<double> Percentiles(const C& values, const W& weights, const std::vector<double>& probs);
+
+        /**
+         *  @brief Moments of a set of values, up to the fourth order
+         *  @details The central moments are accumulated as sums of powers of the deviations to the mean, so that partial results computed
+         *  on separate blocks of values can be merged exactly (Chan et al. and Pébay pairwise update) without a second pass over the values.
+         *  The variance is the sample variance and the kurtosis is the sample excess kurtosis.
+         */
+        struct Moments
+        {
+            size_t count = 0;                                           //!< Number of values
+            double sum   = 0.;                                          //!< Sum of the values
+            double mean  = 0.;                                          //!< Mean of the values
+            double M2    = 0.;                                          //!< Sum of the squared deviations to the mean
+            double M3    = 0.;                                          //!< Sum of the cubed deviations to the mean
+            double M4    = 0.;                                          //!< Sum of the deviations to the mean to the power 4
+            double min   =  std::numeric_limits<double>::infinity();    //!< Minimum of the non NaN values
+            double max   = -std::numeric_limits<double>::infinity();    //!< Maximum of the non NaN values
+
+            Moments& operator+=(const Moments&);                        //!< Merge the moments of another set of values
+
+            double Mean() const;                                        //!< Mean, 0 if there is no value
+            double QuadraticMean() const;                               //!< Square root of the mean of the squared values
+            double Variance() const;                                    //!< Sample variance, 0 if there are less than 2 values
+            double StdDev() const;                                      //!< Square root of the sample variance
+            double RMSE() const;                                        //!< Square root of the population variance
+            double Skewness() const;                                    //!< Skewness, 0 if there are less than 3 values or no dispersion
+            double Kurtosis() const;                                    //!< Sample excess kurtosis, 0 if there are less than 4 values or no dispersion
+        };
+
+        /**
+         *  @brief Moments of a set of values, accumulated by blocks processed concurrently
+         *  @details Each block of 4096 values is reduced in two passes (sum, then powers of the deviations to the block mean) and the
+         *  blocks are merged in their order, so that the result does not depend on the number of threads.
+         *  @param values: n values
+         *  @param n: Number of values
+         *  @param mask: Optional mask of n flags, values flagged true are skipped
+         *  @return Moments of the values
+         */
+        template<typename V>
+        Moments ComputeMoments(const V* values, const size_t& n, const bool* mask = nullptr);
+
+        enum class clipCenter {median, mean};  //!< Center of the sigma clipping window
+
+        /**
+         *  @brief Statistics of a set of values after sigma clipping
+         */
+        struct ClippedStats
+        {
+            double mean       = 0.;     //!< Mean of the kept values
+            double median     = 0.;     //!< Median of the kept values
+            double stddev     = 0.;     //!< Standard deviation of the kept values
+            size_t count      = 0;      //!< Number of kept values
+            size_t rejected   = 0;      //!< Number of rejected values
+            size_t iterations = 0;      //!< Number of clipping passes
+        };
+
+        /**
+         *  @brief Iterative sigma clipping
+         *  @details At each pass the values out of \f$[c - k_{low}\,\sigma, c + k_{high}\,\sigma]\f$ are rejected, c being the median or
+         *  the mean and \f$\sigma\f$ the standard deviation of the values kept so far. The kept values are moved in front of the buffer by
+         *  an in-place partition, so that no memory is allocated across the passes. The mean and standard deviation of each pass are
+         *  reduced concurrently (ComputeMoments). The clipping stops after the first pass rejecting no value, or after maxIter passes.
+         *  @param values: n finite values, reordered in place, the kept values being the first count values on exit
+         *  @param n: Number of values
+         *  @param kLow: Lower clipping threshold, in units of standard deviation
+         *  @param kHigh: Upper clipping threshold, in units of standard deviation
+         *  @param maxIter: Maximum number of clipping passes
+         *  @param center: Center of the clipping window
+         *  @return Statistics of the kept values
+         */
+        ClippedStats SigmaClip(double* values, const size_t& n, const double& kLow, const double& kHigh, const size_t& maxIter, const clipCenter& center = clipCenter::median);
+
+        /**
+         *  @brief Robust location and scale estimates of a set of values
+         */
+        struct RobustStats
+        {
+            double median   = 0.;       //!< Median
+            double mad      = 0.;       //!< Median absolute deviation to the median (1.4826 mad estimates the standard deviation of a gaussian)
+            double location = 0.;       //!< Tukey biweight location
+            double scale    = 0.;       //!< Tukey biweight scale
+            double mode     = 0.;       //!< Mode of the values, from an histogram
+            size_t count    = 0;        //!< Number of values
+        };
+
+        /**
+         *  @brief Median absolute deviation to the median, by selection
+         *  @details The median is selected, the values are replaced by their deviations to the median in parallel and the median of the
+         *  absolute deviations is selected in the same buffer.
+         *  @param values: n finite values, overwritten by their deviations to the median
+         *  @param n: Number of values
+         *  @return Median of the absolute deviations to the median
+         */
+        double MedianAbsoluteDeviation(double* values, const size_t& n);
+
+        /**
+         *  @brief Tukey biweight location
+         *  @details \f$M + \sum_{|u_i|<1} (x_i - M)(1-u_i^2)^2 / \sum_{|u_i|<1} (1-u_i^2)^2\f$ with \f$u_i = (x_i - M)/(c\,MAD)\f$, M being
+         *  the median. The sums are reduced concurrently. The median is returned if the MAD is null.
+         *  @param values: n finite values, overwritten by their deviations to the median
+         *  @param n: Number of values
+         *  @param c: Tuning constant, in units of MAD
+         *  @return Biweight location
+         */
+        double BiweightLocation(double* values, const size_t& n, const double& c = 6.);
+
+        /**
+         *  @brief Tukey biweight scale
+         *  @details Square root of the biweight midvariance \f$n \sum_{|u_i|<1} (x_i - M)^2(1-u_i^2)^4 / \left(\sum_{|u_i|<1} (1-u_i^2)(1-5u_i^2)\right)^2\f$
+         *  with \f$u_i = (x_i - M)/(c\,MAD)\f$, M being the median. The sums are reduced concurrently. 0 if the MAD is null.
+         *  @param values: n finite values, overwritten by their deviations to the median
+         *  @param n: Number of values
+         *  @param c: Tuning constant, in units of MAD
+         *  @return Biweight scale, close to the standard deviation for gaussian values
+         */
+        double BiweightScale(double* values, const size_t& n, const double& c = 9.);
+
+        /**
+         *  @brief Mode of a set of values, from an histogram
+         *  @details The quartiles are selected in one pass and the values within two interquartile ranges of the quartiles are binned
+         *  concurrently (FITShistogram) with the Freedman-Diaconis width \f$2\,IQR\,n^{-1/3}\f$. Integer values are binned on whole
+         *  bins centered on integers. The histogram is smoothed by an Epanechnikov kernel of half width \f$IQR\,n^{-1/7}\f$ and its
+         *  peak is refined by a parabola through the neighbouring bins. If the interquartile range is null, half of the values at least
+         *  are equal to the median, which is returned.
+         *  @param values: n finite values, reordered in place
+         *  @param n: Number of values
+         *  @return Mode of the values
+         */
+        double Mode(double* values, const size_t& n);
+
+        /**
+         *  @brief Median, MAD, biweight location and scale and mode of a set of values
+         *  @details All the estimates share the selections of the quartiles and of the MAD, made in the input buffer, so that no copy
+         *  of the values is made.
+         *  @param values: n finite values, overwritten by their deviations to the median
+         *  @param n: Number of values
+         *  @param cLocation: Tuning constant of the biweight location, in units of MAD
+         *  @param cScale: Tuning constant of the biweight scale, in units of MAD
+         *  @return Robust estimates of the values
+         */
+        RobustStats RobustStatistics(double* values, const size_t& n, const double& cLocation = 6., const double& cScale = 9.);
+
+        /**
+         *  @class QuantileSketch
+         *  @brief Mergeable streaming quantile sketch (KLL, Karnin, Lang & Liberty 2016)
+         *  @details Values are kept in a hierarchy of compactors, a value of level h standing for \f$2^h\f$ input values. When the sketch
+         *  is full, the lowest full level is sorted and one value out of two, starting at a random offset, is promoted to the next level.
+         *  The top level holds k values and the capacity of the lower levels decreases by a factor 2/3 per level, so that the memory is
+         *  bounded by about 3k values whatever the number of input values. The rank of any value is estimated with a normalized error
+         *  below NormalizedRankError() with a probability of 99% (about 1.3% for k = 200), and sketches built on separate chunks,
+         *  threads or files are merged with the same guarantee. The minimum and maximum values are kept exactly.
+         */
+        class QuantileSketch
+        {
+        private:
+            uint16_t fk;                                //!< Capacity of the top level
+            uint64_t fcount;                            //!< Number of input values
+            uint64_t fstate;                            //!< State of the random generator of the compaction offsets
+            double fmin;                                //!< Minimum input value
+            double fmax;                                //!< Maximum input value
+            size_t fretained;                           //!< Number of values kept in the levels
+            size_t fcapacity;                           //!< Capacity of all the levels
+            std::vector<std::vector<double>> flevels;   //!< Values of each level, a value of level h weighting 2^h
+            std::vector<size_t> fcapacities;            //!< Capacity of each level
+
+            void SetCapacities();                       //!< Capacities of the levels, which depend on their depth below the top level
+            void Compress();                            //!< Compact the lowest full levels until the sketch fits its capacity
+            std::vector<std::pair<double,uint64_t>> Sorted() const;    //!< Kept values sorted, with their cumulated weights
+
+        public:
+            /**
+             *  @brief Empty sketch
+             *  @param k: Capacity of the top level, controlling the accuracy (k >= 8)
+             *  @param seed: Seed of the random compaction offsets
+             */
+            explicit QuantileSketch(const uint16_t& k = 200, const uint64_t& seed = 0x9E3779B97F4A7C15ULL);
+
+            /**
+             *  @brief Sketch of n values, built by chunks processed concurrently
+             *  @details The values are split in at most 256 chunks, independently of the number of threads, and the sketches of the
+             *  chunks are merged in their order so that the result is reproducible.
+             *  @param values: n values, NaN values are ignored
+             *  @param mask: n mask values (true for masked values), may be nullptr
+             *  @param n: Number of values
+             *  @param k: Capacity of the top level
+             */
+            template<typename T>
+            static QuantileSketch Build(const T* values, const bool* mask, const size_t& n, const uint16_t& k = 200);
+
+            void Update(const double& v);               //!< Add a value, NaN values are ignored
+
+            /**
+             *  @brief Add a chunk of values, typically a tile or a row range read from a file
+             *  @param values: n values, NaN values are ignored
+             *  @param mask: n mask values (true for masked values), may be nullptr
+             *  @param n: Number of values
+             */
+            template<typename T>
+            void Update(const T* values, const bool* mask, const size_t& n);
+
+            /**
+             *  @brief Merge the values of another sketch with the same k
+             */
+            QuantileSketch& operator+=(const QuantileSketch&);
+
+            inline uint16_t K() const {return fk;}                          //!< Capacity of the top level
+            inline uint64_t Count() const {return fcount;}                  //!< Number of input values
+            inline size_t Retained() const {return fretained;}              //!< Number of values kept in the sketch
+            inline bool Empty() const {return fcount == 0;}                 //!< True if no value was added
+            inline double Min() const {return fmin;}                        //!< Minimum input value
+            inline double Max() const {return fmax;}                        //!< Maximum input value
+            double NormalizedRankError() const;                             //!< Bound of the rank error, as a fraction of Count(), at 99% confidence
+
+            /**
+             *  @brief Estimated fraction of the input values lower or equal to v
+             */
+            double Rank(const double& v) const;
+
+            /**
+             *  @brief Estimated quantile
+             *  @param p: Probability in [0,1]
+             *  @return Smallest kept value whose estimated rank reaches p, the exact minimum and maximum for p = 0 and p = 1
+             */
+            double Quantile(const double& p) const;
+
+            /**
+             *  @brief Estimated quantiles, sorting the kept values once
+             *  @param probs: Probabilities in [0,1]
+             *  @return Quantiles, in the order of probs
+             */
+            std::vector<double> Quantiles(const std::vector<double>& probs) const;
+        };
+
         class Percentil: public ROOT::Minuit2::FCNBase
         {
         private:
 
             std::size_t lower_bound(const double& v) const;
 
+            /**
+             *  @brief Sorted copy of n values, converted to double precision
+             *  @details Large arrays are converted by chunks with detail::parallel_chunks, which runs small arrays on the calling thread.
+             */
             template<typename Src>
-            static std::valarray<double> to_valarray(const std::vector<Src>& v)
+            static std::valarray<double> sorted_copy(const Src* src, const size_t& n)
             {
-                const size_t n = v.size();
                 std::valarray<double> out(n);
                 if (n == 0) return out;
 
-                const Src* src = v.data();
-                double* dst    = &out[0];
-
-                // fast-path when already double: use valarray pointer constructor (single memcpy-like copy)
-                if (std::is_same<Src, double>::value)
-                {
-                    out= std::valarray<double>(reinterpret_cast<const double*>(src), n);
-                    std::sort(&out[0], &out[0] + out.size());
-                    return out;
-                }
-
-                unsigned int hw_threads = std::thread::hardware_concurrency();
-                unsigned int nthreads = (hw_threads == 0) ? 1 : hw_threads;
-                if (static_cast<size_t>(nthreads) > n) nthreads = static_cast<unsigned int>(n);
-
-                // single thread -> simple loop (avoid async overhead)
-                if (nthreads <= 1)
-                {
-                    for (size_t k = 0; k < n; ++k) dst[k] = static_cast<double>(src[k]);
-                    std::sort(&out[0], &out[0] + out.size());
-                    return out;
-                }
-
-                const size_t chunk = (n + nthreads - 1) / nthreads;
-                std::vector< std::future<void> > futs;
-                futs.reserve(nthreads);
+                double* dst = &out[0];
 
-                for (unsigned int ti = 0; ti < nthreads; ++ti)
+                detail::parallel_chunks(n, 1, [src, dst](size_t start, size_t end)
                 {
-                    const size_t start = ti * chunk;
-                    const size_t end = std::min(n, start + chunk);
-                    if (start >= end) continue;
-
-                    // capture raw pointers and bounds by value
-                    futs.emplace_back(std::async(std::launch::async,
-                        [src, dst, start, end]() {
-                            for (size_t k = start; k < end; ++k)
-                                dst[k] = static_cast<double>(src[k]);
-                        }));
-                }
-
-                for (auto &f : futs) f.get();
-                std::sort(&out[0], &out[0] + out.size());
+                    for (size_t k = start; k < end; ++k)
+                        dst[k] = static_cast<double>(src[k]);
+                });
 
+                std::sort(dst, dst + n);
                 return out;
             }
 
             template<typename Src>
-            static std::valarray<double> to_valarray(const std::valarray<Src>& v)
+            static std::valarray<double> to_valarray(const std::vector<Src>& v)
             {
-                const size_t n = v.size();
-                std::valarray<double> out(n);
-                if (n == 0) return out;
-
-                const Src* src = &v[0];
-                double* dst    = &out[0];
-
-                // fast-path when already double: use valarray pointer constructor (single memcpy-like copy)
-                if (std::is_same<Src, double>::value)
-                {
-                    out = std::valarray<double>(reinterpret_cast<const double*>(src), n);
-                    std::sort(&out[0], &out[0] + out.size());
-                    return out;
-                }
-
-                unsigned int hw_threads = std::thread::hardware_concurrency();
-                unsigned int nthreads = (hw_threads == 0) ? 1 : hw_threads;
-                if (static_cast<size_t>(nthreads) > n) nthreads = static_cast<unsigned int>(n);
-
-                // single thread -> simple loop (avoid async overhead)
-                if (nthreads <= 1)
-                {
-                    for (size_t k = 0; k < n; ++k) dst[k] = static_cast<double>(src[k]);
-                    std::sort(&out[0], &out[0] + out.size());
-                    return out;
-                }
-
-                const size_t chunk = (n + nthreads - 1) / nthreads;
-                std::vector<std::future<void>> futs;
-                futs.reserve(nthreads);
-
-                for (unsigned int ti = 0; ti < nthreads; ++ti)
-                {
-                    const size_t start = ti * chunk;
-                    const size_t end = std::min(n, start + chunk);
-                    if (start >= end) continue;
-
-                    // capture pointers and bounds by value
-                    futs.emplace_back(std::async(std::launch::async,
-                        [src, dst, start, end]() {
-                            for (size_t k = start; k < end; ++k)
-                                dst[k] = static_cast<double>(src[k]);
-                        }));
-                }
+                return sorted_copy(v.data(), v.size());
+            }
 
-                for (auto &f : futs) f.get();
-                std::sort(&out[0], &out[0] + out.size());
-                return out;
+            template<typename Src>
+            static std::valarray<double> to_valarray(const std::valarray<Src>& v)
+            {
+                return sorted_copy((v.size() > 0) ? &v[0] : nullptr, v.size());
             }
 
             const std::valarray<double> val;
             double fpp;
             double sum;
 
-            // helper: sequential sum for a range
-            static double partial_sum(const std::valarray<double>& v, size_t start, size_t end);
-
             void Summation();
 
         public:
@@ -233,8 +450,188 @@ namespace DSL
 
             double Eval(double th) const;
 
+            /**
+             *  @brief Exact percentile of the values, without minimization
+             *  @details The percentile is linearly interpolated between the sorted values bracketing the position \f$pp\,(n-1)\f$, which is the
+             *  inverse of Eval: Eval(Value(pp)) == pp for distinct values.
+             *  @param pp: Percentile in [0,1]
+             *  @return Value of the percentile
+             */
+            double Value(const double& pp) const;
+            inline double Value() const {return Value(fpp);}   //!< Exact value of the current percentile, @see SetPercentil
+
+            /**
+             *  @brief Exact values of several percentiles
+             *  @param pps: Percentiles in [0,1]
+             *  @return Values of the percentiles, in the order of pps
+             */
+            std::vector<double> Values(const std::vector<double>& pps) const;
+
             virtual double Up() const;
         };
+
+#pragma region - Quantile sketch template implementation
+
+        template<typename T>
+        void QuantileSketch::Update(const T* values, const bool* mask, const size_t& n)
+        {
+            if(values == nullptr)
+                return;
+
+            for(size_t k = 0; k < n; k++)
+                if(mask == nullptr || !mask[k])
+                    Update(static_cast<double>(values[k]));
+        }
+
+        template<typename T>
+        QuantileSketch QuantileSketch::Build(const T* values, const bool* mask, const size_t& n, const uint16_t& k)
+        {
+            constexpr size_t minChunk = 65536;
+
+            QuantileSketch sketch(k);
+            if(values == nullptr || n == 0)
+                return sketch;
+
+            const size_t nchunk = std::min<size_t>(256, (n + minChunk - 1) / minChunk);
+            const size_t chunk  = (n + nchunk - 1) / nchunk;
+
+            std::vector<QuantileSketch> partial;
+            partial.reserve(nchunk);
+            for(size_t c = 0; c < nchunk; c++)
+                partial.emplace_back(k, 0x9E3779B97F4A7C15ULL + c);
+
+            detail::parallel_chunks(nchunk, chunk, [&](size_t begin, size_t end)
+            {
+                for(size_t c = begin; c < end; c++)
+                {
+                    const size_t first = c*chunk;
+                    const size_t last  = std::min(n, first + chunk);
+                    if(first < last)
+                        partial[c].Update(values + first, (mask != nullptr) ? mask + first : nullptr, last - first);
+                }
+            });
+
+            for(const QuantileSketch& p : partial)
+                sketch += p;
+
+            return sketch;
+        }
+
+#pragma endregion
+#pragma region - Moments template implementation
+
+        template<typename V>
+        Moments ComputeMoments(const V* values, const size_t& n, const bool* mask)
+        {
+            constexpr size_t block = 4096;
+            constexpr double inf   = std::numeric_limits<double>::infinity();
+
+            const size_t nblock = (n + block - 1) / block;
+            std::vector<Moments> partial(nblock);
+
+            // Branch free loops on copies of the pointers, so that they vectorize
+            auto kernel = [=](const size_t& b, Moments& out, auto useMask)
+            {
+                const size_t k0 = b*block;
+                const size_t m  = std::min(block, n - k0);
+                const V*     v  = values + k0;
+
+                size_t count = 0;
+                double sum   = 0.;
+                double vmin  =  inf;
+                double vmax  = -inf;
+
+                for(size_t i = 0; i < m; i++)
+                {
+                    bool keep = true;
+                    if constexpr (decltype(useMask)::value)
+                        keep = !mask[k0 + i];
+
+                    const double x = static_cast<double>(v[i]);
+                    count += keep;
+                    sum   += keep ? x : 0.;
+                    vmin   = std::min(vmin, keep ? x :  inf);
+                    vmax   = std::max(vmax, keep ? x : -inf);
+                }
+
+                if(count == 0)
+                    return;
+
+                const double mean = sum / static_cast<double>(count);
+                double M2 = 0., M3 = 0., M4 = 0.;
+
+                for(size_t i = 0; i < m; i++)
+                {
+                    bool keep = true;
+                    if constexpr (decltype(useMask)::value)
+                        keep = !mask[k0 + i];
+
+                    const double d  = keep ? static_cast<double>(v[i]) - mean : 0.;
+                    const double d2 = d*d;
+                    M2 += d2;
+                    M3 += d2*d;
+                    M4 += d2*d2;
+                }
+
+                out = Moments{count, sum, mean, M2, M3, M4, vmin, vmax};
+            };
+
+            detail::parallel_chunks(nblock, 4*block, [&](size_t begin, size_t end)
+            {
+                for(size_t b = begin; b < end; b++)
+                {
+                    if(mask != nullptr)
+                        kernel(b, partial[b], std::true_type{});
+                    else
+                        kernel(b, partial[b], std::false_type{});
+                }
+            });
+
+            Moments total;
+            for(const Moments& p : partial)
+                total += p;
+
+            return total;
+        }
+
+#pragma endregion
+#pragma region - Exact percentiles template implementation
+
+        template<typename C>
+        std::vector<double> Percentiles(const C& values, const std::vector<double>& probs)
+        {
+            std::vector<double> buffer;
+            buffer.reserve(values.size());
+
+            for(size_t k = 0; k < values.size(); k++)
+            {
+                const double v = static_cast<double>(values[k]);
+                if(!std::isnan(v))
+                    buffer.push_back(v);
+            }
+
+            return Quantiles(buffer, probs);
+        }
+
+        template<typename C, typename W>
+        std::vector<double> Percentiles(const C& values, const W& weights, const std::vector<double>& probs)
+        {
+            if(values.size() != weights.size())
+                throw std::invalid_argument("Values and weights should have the same size");
+
+            std::vector<double> v(values.size());
+            std::vector<double> w(values.size());
+
+            for(size_t k = 0; k < values.size(); k++)
+            {
+                v[k] = static_cast<double>(values[k]);
+                w[k] = static_cast<double>(weights[k]);
+            }
+
+            return WeightedQuantiles(v.data(), w.data(), v.size(), probs);
+        }
+
+#pragma endregion
     }
 }
 
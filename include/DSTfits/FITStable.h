@@ -31,7 +31,6 @@
 #include <cstdint>
 #include <type_traits>
 #include <numeric>
-#include <execution>
 #include <shared_mutex>
 #include <unordered_map> 
 
@@ -39,6 +38,9 @@
 #include "FITShdu.h"
 #include "FITSdata.h"
 #include "FITSexception.h"
+#include "FITShistogram.h"
+#include "FITSparallel.h"
+#include "FITSstatistic.h"
 
 #include <fitsio.h>
 
@@ -1089,6 +1091,7 @@ template<> void FITScolumn<FITSform::boolVector>      ::write(const std::shared_
          */
         void InsertColumn(const std::string& cname, const dtype& type, const std::string& tunit);
         void InsertColumn( std::shared_ptr<FITSform> col );
+        void InsertColumn( std::unique_ptr<FITSform> col );    //!< Append a column filled by the caller, taking ownership of its storage
         
 #pragma endregion
 #pragma region 2- Inseting value to an existing column
@@ -2584,30 +2587,29 @@ class RowIterator
         {
             if constexpr (!std::is_arithmetic<T>::value)
                 throw std::logic_error("ColumnView::sum requires arithmetic scalar type T");
-#if __cpp_lib_execution
-            return std::reduce(std::execution::par_unseq, vec.begin(), vec.end(), T{});
-#else
-            T total{};
-            for(const auto& v : vec) total += v;
-            return total;
-#endif
+            return parallel_reduce(size_t{0}, vec.size(), 32768, T{},
+                                   [&vec](size_t begin, size_t end)
+                                   {
+                                       T total{};
+                                       for(size_t k = begin; k < end; k++) total += vec[k];
+                                       return total;
+                                   },
+                                   std::plus<T>());
         }
 
-        // Helper: parallel-capable sum of squares over a contiguous buffer (no locks)
+        // Helper: parallel sum of squares over a contiguous buffer (no locks), on the shared pool
         static T computeSumsquareBuffer(const std::vector<T>& vec)
         {
             if constexpr (!std::is_arithmetic<T>::value)
                 throw std::logic_error("ColumnView::sumsquare requires arithmetic scalar type T");
-#if __cpp_lib_execution
-            return std::transform_reduce(std::execution::par_unseq,
-                                         vec.begin(), vec.end(),
-                                         T{}, std::plus<T>(),
-                                         [](const T& v){ return v*v; });
-#else
-            T total{};
-            for(const auto& v : vec) total += v*v;
-            return total;
-#endif
+            return parallel_reduce(size_t{0}, vec.size(), 32768, T{},
+                                   [&vec](size_t begin, size_t end)
+                                   {
+                                       T total{};
+                                       for(size_t k = begin; k < end; k++) total += vec[k]*vec[k];
+                                       return total;
+                                   },
+                                   std::plus<T>());
         }
 
         static double computeVarianceBuffer(const std::vector<T>& vec)
@@ -2617,17 +2619,10 @@ class RowIterator
             const size_t count = vec.size();
             if(count == 0) return 0.0;
 
-#if __cpp_lib_execution
             // Parallel sum and sum of squares
-            const T s  = std::reduce(std::execution::par_unseq, vec.begin(), vec.end(), T{});
-            const T ss = std::transform_reduce(std::execution::par_unseq,
-                                               vec.begin(), vec.end(),
-                                               T{}, std::plus<T>(),
-                                               [](const T& v){ return v * v; });
-#else
-            T s = T{}, ss = T{};
-            for(const auto& v : vec) { s += v; ss += v * v; }
-#endif
+            const T s  = computeSumBuffer(vec);
+            const T ss = computeSumsquareBuffer(vec);
+
             const double m  = static_cast<double>(s)  / static_cast<double>(count);
             const double m2 = static_cast<double>(ss) / static_cast<double>(count);
             return m2 - m*m;
@@ -2641,6 +2636,34 @@ class RowIterator
             for(size_t idx : selection_) tmp.push_back(src[idx]);
         }
 
+        // Helper: copy the selected finite values, as double, in parallel under a lock into out buffer
+        void finiteSelection(std::vector<double>& out, const char* caller) const
+        {
+            ensureOwner();
+            if constexpr (!std::is_arithmetic<T>::value || std::is_same_v<T,bool>)
+                throw std::logic_error(std::string("ColumnView::") + caller + " requires numeric scalar type T");
+            else
+            {
+                {
+                    std::shared_lock<std::shared_mutex> lk(column_->data_mtx);
+                    const auto& vec = *values_;
+
+                    out.resize(hasSelection_ ? selection_.size() : vec.size());
+                    parallel_for(0, out.size(), 32768, [&](size_t begin, size_t end)
+                    {
+                        for(size_t k = begin; k < end; k++)
+                            out[k] = static_cast<double>(vec[hasSelection_ ? selection_[k] : k]);
+                    });
+                }
+
+                if constexpr (std::is_floating_point_v<T>)
+                    out.erase(std::remove_if(out.begin(), out.end(), [](const double& v){return !std::isfinite(v);}), out.end());
+
+                if(out.empty())
+                    throw std::logic_error(std::string("ColumnView::") + caller + " on empty selection");
+            }
+        }
+
         void ensureScalar()
         {
             static_assert(!detail::is_std_vector<T>::value,
@@ -3019,6 +3042,116 @@ class RowIterator
             return std::sqrt(m2 - m*m);
         }
 
+        /*!
+         * \brief Histogram of the selected values.
+         * \param nbins Number of bins.
+         * \param range Lower and upper edges, range of the finite values if empty.
+         * \return Histogram with nbins uniform bins; 8 and 16 bits integer columns are counted exactly.
+         */
+        FITShistogram histogram(const size_t& nbins, const std::pair<double,double>& range = {0.,0.}) const
+        {
+            ensureOwner();
+            if constexpr (!std::is_arithmetic<T>::value || std::is_same_v<T,bool>)
+                throw std::logic_error("ColumnView::histogram requires numeric scalar type T");
+            else
+            {
+                std::shared_lock<std::shared_mutex> lk(column_->data_mtx);
+                const auto& vec = *values_;
+
+                std::vector<T> tmp;
+                if(hasSelection_)
+                    snapshotSelection(vec, tmp);
+                const std::vector<T>& src = hasSelection_ ? tmp : vec;
+
+                std::pair<double,double> r = range;
+                if(!(r.first < r.second))
+                {
+                    r = FITShistogram::Extent(src.data(), nullptr, src.size());
+                    if(!(r.first < r.second))
+                        r = {r.first - 0.5, r.first + 0.5};
+                }
+
+                FITShistogram h(nbins, r);
+                h.Fill(src.data(), nullptr, src.size());
+                return h;
+            }
+        }
+
+        /*!
+         * \brief Quantile sketch of the selected values.
+         * \param k Accuracy parameter of the sketch.
+         * \return Mergeable sketch of the non NaN values, built concurrently (stat::QuantileSketch::Build).
+         */
+        stat::QuantileSketch sketch(const uint16_t& k = 200) const
+        {
+            ensureOwner();
+            if constexpr (!std::is_arithmetic<T>::value || std::is_same_v<T,bool>)
+                throw std::logic_error("ColumnView::sketch requires numeric scalar type T");
+            else
+            {
+                std::shared_lock<std::shared_mutex> lk(column_->data_mtx);
+                const auto& vec = *values_;
+
+                std::vector<T> tmp;
+                if(hasSelection_)
+                    snapshotSelection(vec, tmp);
+                const std::vector<T>& src = hasSelection_ ? tmp : vec;
+
+                return stat::QuantileSketch::Build(src.data(), nullptr, src.size(), k);
+            }
+        }
+
+        /*!
+         * \brief Robust estimates of the selected finite values.
+         * \param cLocation Tuning constant of the biweight location, in units of MAD.
+         * \param cScale Tuning constant of the biweight scale, in units of MAD.
+         * \return Median, MAD, biweight location and scale and histogram mode (stat::RobustStatistics).
+         */
+        stat::RobustStats robust(const double& cLocation = 6., const double& cScale = 9.) const
+        {
+            std::vector<double> scratch;
+            return robust(scratch, cLocation, cScale);
+        }
+
+        /*!
+         * \brief Robust estimates of the selected finite values.
+         * \param scratch Working buffer, its memory being reused across columns.
+         * \see robust
+         */
+        stat::RobustStats robust(std::vector<double>& scratch, const double& cLocation = 6., const double& cScale = 9.) const
+        {
+            finiteSelection(scratch, "robust");
+            return stat::RobustStatistics(scratch.data(), scratch.size(), cLocation, cScale);
+        }
+
+        double mad() const
+        {
+            std::vector<double> tmp;
+            finiteSelection(tmp, "mad");
+            return stat::MedianAbsoluteDeviation(tmp.data(), tmp.size());
+        }
+
+        double biweightLocation(const double& c = 6.) const
+        {
+            std::vector<double> tmp;
+            finiteSelection(tmp, "biweightLocation");
+            return stat::BiweightLocation(tmp.data(), tmp.size(), c);
+        }
+
+        double biweightScale(const double& c = 9.) const
+        {
+            std::vector<double> tmp;
+            finiteSelection(tmp, "biweightScale");
+            return stat::BiweightScale(tmp.data(), tmp.size(), c);
+        }
+
+        double mode() const
+        {
+            std::vector<double> tmp;
+            finiteSelection(tmp, "mode");
+            return stat::Mode(tmp.data(), tmp.size());
+        }
+
         double skewness() const
         {
             ensureOwner();
@@ -3032,75 +3165,30 @@ class RowIterator
             if(count == 0)
                 throw std::logic_error("ColumnView::skewness on empty selection");
 
-            // Compute mean and variance under the same lock using buffer helpers
-            double meanValue;
-            double var;
-
-            if(!hasSelection_)
-            {
-                // mean via sum; variance via helper
-                const T s  = computeSumBuffer(vec);
-                meanValue  = static_cast<double>(s) / static_cast<double>(count);
-                var        = computeVarianceBuffer(vec);
-            }
-            else
-            {
-                std::vector<T> tmp;
+            std::vector<T> tmp;
+            if(hasSelection_)
                 snapshotSelection(vec, tmp);
-                const T s  = computeSumBuffer(tmp);
-                meanValue  = static_cast<double>(s) / static_cast<double>(count);
-                var        = computeVarianceBuffer(tmp);
-            }
+            const std::vector<T>& src = hasSelection_ ? tmp : vec;
+
+            // Compute mean and variance under the same lock using buffer helpers
+            const double meanValue = static_cast<double>(computeSumBuffer(src)) / static_cast<double>(count);
+            const double var       = computeVarianceBuffer(src);
 
             if(var <= std::numeric_limits<double>::min())
                 throw std::logic_error("ColumnView::skewness on empty or zero-variance selection");
 
-#if __cpp_lib_execution
-            double m3;
-            if(!hasSelection_)
-            {
-                m3 = std::transform_reduce(std::execution::par_unseq,
-                                           vec.begin(), vec.end(),
-                                           0.0, std::plus<double>(),
-                                           [meanValue](const T& v) {
-                                               const double d = static_cast<double>(v) - meanValue;
-                                               return d * d * d;
-                                           }) / static_cast<double>(count);
-            }
-            else
-            {
-                std::vector<T> tmp;
-                tmp.reserve(selection_.size());
-                for(size_t idx : selection_) tmp.push_back(vec[idx]);
-
-                m3 = std::transform_reduce(std::execution::par_unseq,
-                                           tmp.begin(), tmp.end(),
-                                           0.0, std::plus<double>(),
-                                           [meanValue](const T& v) {
-                                               const double d = static_cast<double>(v) - meanValue;
-                                               return d * d * d;
-                                           }) / static_cast<double>(count);
-            }
-#else
-            double m3 = 0.0;
-            if(hasSelection_)
-            {
-                for(size_t idx : selection_)
-                {
-                    const double d = static_cast<double>(vec[idx]) - meanValue;
-                    m3 += d * d * d;
-                }
-            }
-            else
-            {
-                for(const auto& v : vec)
-                {
-                    const double d = static_cast<double>(v) - meanValue;
-                    m3 += d * d * d;
-                }
-            }
-            m3 /= static_cast<double>(count);
-#endif
+            const double m3 = parallel_reduce(size_t{0}, src.size(), 32768, 0.0,
+                                              [&src, meanValue](size_t begin, size_t end)
+                                              {
+                                                  double acc = 0.0;
+                                                  for(size_t k = begin; k < end; k++)
+                                                  {
+                                                      const double d = static_cast<double>(src[k]) - meanValue;
+                                                      acc += d * d * d;
+                                                  }
+                                                  return acc;
+                                              },
+                                              std::plus<double>()) / static_cast<double>(count);
             // Skewness = m3 / (sigma^3), with sigma^2 = var
             return m3 / (var * std::sqrt(var));
         }
@@ -12,7 +12,9 @@
 #define _FITSwcs_
 
 #include <memory>
+#include <span>
 #include <string>
+#include <vector>
 
 // WCSLIB includes
 #include <wcslib/wcs.h>
@@ -31,15 +33,26 @@ namespace DSL
      *  @class FITSwcs
      *  @brief Class to handle WCS information in FITS files
      *  @details This class is used to handle WCS information in FITS files. It is C++ wrapper to the WCSLIB library it depend to.
+     *  @note The const methods may be called concurrently on the same object. The WCSLIB structures are set once when they are built or
+     *  modified and the const methods never write to them: conversions run on per-thread copies and report their status through the
+     *  returned values or the thrown WCSexception, getStatus() being the status of the last construction or modification.
      */
     class FITSwcs
     {
         protected:
 
             std::shared_ptr<struct wcsprm> fwcs;  //!< Pointer to the WCS structure from WCSLIB
-            mutable int fwcs_status;                      //!< Status of the WCS structure
+            int fwcs_status;                       //!< Status of the last construction or modification of the WCS structures
             int fnwcs;                             //!< Number of WCS in the WCSLIB structures
+
+            struct wcsCopies;                                   //!< Pool of deep copies of the WCS structures
+            std::shared_ptr<wcsCopies> fcopies;                 //!< Copies used by the concurrent conversions, created with fwcs and shared along with it
 #pragma region * protected member function
+
+        /**
+         * @brief Pool of deep copies of the WCS structures, created along with them
+         */
+        std::shared_ptr<wcsCopies> copies() const;
         
         /**
          * @brief Initialize WCS from a FITS image HDU
@@ -149,6 +162,8 @@ namespace DSL
             inline int getNumberOfWCS() const { return fnwcs; }    //!< Get the number of WCS structures
             size_t getNumberOfAxis(const size_t&) const;              //!< Get the number of WCS structures
             const std::string getSuffix(const size_t&) const;        //!< Get the WCS suffix for a given WCS index
+            int getLongitudeAxis(const size_t&) const;              //!< Get the index of the celestial longitude axis, -1 if none
+            int getLatitudeAxis(const size_t&) const;               //!< Get the index of the celestial latitude axis, -1 if none
             
             double CRPIX(const size_t&) const; //!< Get the CRPIX value for a given WCS index and axis
             double CRPIX(const size_t&, const size_t&) const; //!< Get the CRPIX value for a given WCS index and axis
@@ -166,6 +181,19 @@ namespace DSL
 
 #pragma region * Conversion
 
+            /**
+             * @brief WCS of the image obtained by collapsing one pixel axis
+             * @details The remaining axes keep their reference pixel and their coordinates (wcssub). When one of the two celestial axes is
+             * removed, the other one becomes a linear axis (CTYPE without projection code, e.g. DEC) with the same reference value and
+             * scale: it gives the coordinate along the pixel line through the reference pixel of the removed axis, to first order
+             * in the distance to the reference point.
+             * 
+             * @param wcsIndex World Coordinate System index
+             * @param axis Pixel axis removed, starting at 1
+             * @return Single WCS with one axis less
+             */
+            FITSwcs Collapse(const size_t& wcsIndex, const size_t& axis) const;
+
             /**
              * @brief Change the celestial coordinate system to new references
              * 
@@ -220,6 +248,61 @@ namespace DSL
              */
             pixelVectors world2pixel(const size_t& wcsIndex, const worldVectors&) const;
 
+            /**
+             * @brief Convert pixel coordinates to world coordinates, losing only the points rejected by WCSLIB
+             * @param wcsIndex World Coordinate System index
+             * @param px Pixel coordinates
+             * @return World coordinates, empty for the rejected points
+             */
+            worldVectors safePixel2world(const size_t& wcsIndex, const pixelVectors& px) const;
+
+            /**
+             * @brief Convert world coordinates to pixel coordinates, losing only the points rejected by WCSLIB
+             * @param wcsIndex World Coordinate System index
+             * @param wc World coordinates
+             * @return Pixel coordinates, empty for the rejected points
+             */
+            pixelVectors safeWorld2pixel(const size_t& wcsIndex, const worldVectors& wc) const;
+
+            /**
+             * @brief Convert pixel coordinates to world coordinates, structure of arrays
+             * @details The coordinates are read from and written to caller buffers, one buffer per axis, without any allocation per point.
+             * Large batches are split in chunks converted concurrently on the shared thread pool, each thread using its own deep copy
+             * of the wcsprm structure, which WCSLIB does not allow to share between threads. The copies are kept for the next calls.
+             * A linear WCS, or a TAN or SIN projection without distortion, is evaluated in closed form without WCSLIB, within 1e-10 deg.
+             * 
+             * @param wcsIndex World Coordinate System index
+             * @param pixel One span per pixel axis, each holding the coordinates of the n points (first pixel at 1)
+             * @param world One span per world axis, each receiving the coordinates of the n points, NaN for the invalid points
+             * @param status Optional span receiving the WCSLIB status of each point, 0 for the valid points
+             * @return Number of invalid points
+             */
+            size_t pixel2world(const size_t& wcsIndex, std::span<const std::span<const double>> pixel, std::span<const std::span<double>> world, std::span<int> status = {}) const;
+
+            /**
+             * @brief Convert the pixel coordinates of a 2D image to world coordinates, structure of arrays
+             * @see pixel2world
+             */
+            size_t pixel2world(const size_t& wcsIndex, std::span<const double> x, std::span<const double> y, std::span<double> lon, std::span<double> lat, std::span<int> status = {}) const;
+
+            /**
+             * @brief Convert world coordinates to pixel coordinates, structure of arrays
+             * @details Counterpart of the structure of arrays pixel2world, with the same threading.
+             * 
+             * @param wcsIndex World Coordinate System index
+             * @param world One span per world axis, each holding the coordinates of the n points
+             * @param pixel One span per pixel axis, each receiving the coordinates of the n points, NaN for the invalid points
+             * @param status Optional span receiving the WCSLIB status of each point, 0 for the valid points
+             * @return Number of invalid points
+             */
+            size_t world2pixel(const size_t& wcsIndex, std::span<const std::span<const double>> world, std::span<const std::span<double>> pixel, std::span<int> status = {}) const;
+
+            /**
+             * @brief Convert world coordinates to the pixel coordinates of a 2D image, structure of arrays
+             * @see world2pixel
+             */
+            size_t world2pixel(const size_t& wcsIndex, std::span<const double> lon, std::span<const double> lat, std::span<double> x, std::span<double> y, std::span<int> status = {}) const;
+
             /**
              * @brief Convert wcs to header string
              * 
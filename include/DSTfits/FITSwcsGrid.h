@@ -0,0 +1,106 @@
+//
+//  FITSwcsGrid.h
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+
+#ifndef _DSL_FITSwcsGrid_
+#define _DSL_FITSwcsGrid_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FITSwcs.h"
+
+namespace DSL
+{
+#pragma region - FITSwcsGrid class definition
+    /**
+     *  @class FITSwcsGrid
+     *  @brief World coordinates of a 2D image interpolated on a coarse grid
+     *  @details The exact transform of a WCS is evaluated once on the nodes of a grid of step \c step pixels covering the image, then
+     *  world coordinates are bilinearly interpolated from the four nodes of a cell. The interpolation error is measured against the exact
+     *  transform at the centre and at the middle of the edges of every cell, and converted to pixels with the local Jacobian: the cells
+     *  where it exceeds the tolerance, or with an undefined node, are left to the exact transform, which the caller is told by a false return.
+     *  Pixel coordinates follow the convention of FITScube::WorldCoordinates; axes beyond the second are at pixel coordinate 0.
+     *  Longitudes are interpolated across the 0/360 cut and returned in the range used by WCSLIB at the first node of the cell.
+     *  @note A grid is immutable once built and may be shared by several threads.
+     */
+    class FITSwcsGrid
+    {
+    protected:
+#pragma region * Protected member
+        size_t fnaxis;                  //!< Number of world axes
+        int    flng;                    //!< Index of the longitude axis, -1 if none
+        size_t fstep;                   //!< Distance between two nodes [pix]
+        size_t fgx;                     //!< Number of nodes along the first axis
+        size_t fgy;                     //!< Number of nodes along the second axis
+        double ftolerance;              //!< Largest interpolation error accepted in a cell [pix]
+        double fmaxError;               //!< Largest interpolation error measured on the accepted cells [pix]
+        size_t fexact;                  //!< Number of cells left to the exact transform
+        long long fseed;                //!< Cell where the inversion starts, -1 if none
+        std::vector<double>  fworld;    //!< World coordinates of the nodes, row by row, fnaxis values per node
+        std::vector<uint8_t> fcells;    //!< 1 for the cells served by interpolation, row by row
+
+#pragma endregion
+#pragma region * Protected member function
+        void Interpolate(const size_t& i, const size_t& j, const double& u, const double& v, double* world, double* jacobian = nullptr) const;
+        double PixelError(const size_t& i, const size_t& j, const double& u, const double& v, const double* exact, double* scratch) const;
+
+#pragma endregion
+    public:
+#pragma region * ctor/dtor
+        /**
+         *  @brief Evaluate a WCS on the grid covering an image
+         *  @param wcs: World coordinate systems of the image
+         *  @param wcsIndex: Index of the WCS to interpolate
+         *  @param nx: Number of pixels along the first axis of the image
+         *  @param ny: Number of pixels along the second axis of the image
+         *  @param step: Distance between two nodes [pix]
+         *  @param tolerance: Largest interpolation error accepted in a cell [pix]
+         */
+        FITSwcsGrid(const FITSwcs& wcs, const size_t& wcsIndex, const size_t& nx, const size_t& ny, const size_t& step = 8, const double& tolerance = 1e-4);
+
+#pragma endregion
+#pragma region * Accessor
+        inline size_t Step() const {return fstep;}                            //!< Distance between two nodes [pix]
+        inline double Tolerance() const {return ftolerance;}                  //!< Largest interpolation error accepted in a cell [pix]
+        inline double MaxError() const {return fmaxError;}                    //!< Largest interpolation error measured on the accepted cells [pix]
+        inline size_t NumberOfAxis() const {return fnaxis;}                   //!< Number of world axes
+        inline size_t NumberOfCells() const {return fcells.size();}           //!< Number of cells of the grid
+        inline size_t NumberOfExactCells() const {return fexact;}             //!< Number of cells left to the exact transform
+        inline bool   Empty() const {return fexact == fcells.size();}        //!< True if no cell is served by interpolation
+
+#pragma endregion
+#pragma region * Conversion
+        /**
+         *  @brief Interpolated world coordinates of a pixel
+         *  @param x: Pixel coordinate along the first axis
+         *  @param y: Pixel coordinate along the second axis
+         *  @param world: NumberOfAxis() world coordinates, left untouched if the function returns false
+         *  @return false if (x,y) is outside the grid or in a cell left to the exact transform
+         */
+        bool pixel2world(const double& x, const double& y, double* world) const;
+
+        /**
+         *  @brief Pixel coordinates of a world position, by Newton iterations on the interpolated transform
+         *  @details Only available for two world axes. The result is consistent with pixel2world within the tolerance.
+         *  @param world: The two world coordinates
+         *  @param x: Pixel coordinate along the first axis, left untouched if the function returns false
+         *  @param y: Pixel coordinate along the second axis, left untouched if the function returns false
+         *  @return false if the iterations leave the grid, reach a cell left to the exact transform or don't converge
+         */
+        bool world2pixel(const double* world, double& x, double& y) const;
+
+#pragma endregion
+    };
+#pragma endregion
+}
+
+#endif
@@ -0,0 +1,407 @@
+//
+//  FITSbackground.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <algorithm>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSbackground.h>
+#include <DSTfits/FITSinterpolator.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        /**
+         *  @brief Median of the first n values, partially reordered in place (no full sort)
+         */
+        double select_median(double* v, const size_t& n)
+        {
+            const size_t h = n/2;
+            std::nth_element(v, v + h, v + n);
+            const double upper = v[h];
+
+            if(n%2)
+                return upper;
+
+            return 0.5 * (upper + *std::max_element(v, v + h));
+        }
+    }
+
+#pragma region - FITSbackground class implementation
+#pragma region * ctor/dtor
+
+    FITSbackground::FITSbackground(const size_t& meshx, const size_t& meshy, const size_t& filter, const estimator& est, const double& clip, const size_t& maxIter):
+    fmeshx(meshx), fmeshy(meshy), ffilter(filter), fclip(clip), fmaxIter(maxIter), festimator(est),
+    fnx(0), fny(0), fcx(0), fcy(0), fbkg(), frms()
+    {
+        if(fmeshx == 0 || fmeshy == 0)
+            throw FITSexception(BAD_DIMEN,"FITSbackground","FITSbackground","mesh size should be strictly positive");
+
+        if(ffilter == 0 || ffilter%2 == 0)
+            throw FITSexception(BAD_DIMEN,"FITSbackground","FITSbackground","median filter size should be odd, got "+std::to_string(ffilter));
+
+        if(!(fclip > 0.))
+            throw FITSexception(BAD_OPTION,"FITSbackground","FITSbackground","clipping threshold should be strictly positive");
+    }
+
+#pragma endregion
+#pragma region * protected member function
+
+    /**
+     *  @details As in SExtractor, the clipping works on a histogram of the cell rather than on the sorted values.
+     *  The histogram spans mean +/- 5 sigma of the raw cell; the median, mean and sigma of the values inside the clipping window are computed
+     *  from the bins and the window is moved to median +/- clip*sigma until sigma changes by less than 1%.
+     *  If the converged sigma spans less than 16 bins (cells dominated by a few very bright pixels), the histogram is rebuilt around the converged median.
+     */
+    bool FITSbackground::CellStatistic(const std::vector<double>& values, double& bkg, double& rms) const
+    {
+        const size_t n = values.size();
+        if(n == 0)
+            return false;
+
+        // shifted single pass moments, the shift (first value) keeps the sum of squares well conditioned
+        const double shift = values[0];
+        double s1 = 0., s2 = 0.;
+        for(const double& v : values)
+        {
+            const double d = v - shift;
+            s1 += d;
+            s2 += d*d;
+        }
+
+        const double dn = static_cast<double>(n);
+        double mean  = shift + s1/dn;
+        double sigma = (n > 1) ? std::sqrt(std::max(0., (s2 - s1*s1/dn) / (dn - 1.))) : 0.;
+        double med   = mean;
+
+        if(!(sigma > 0.))
+        {
+            bkg = mean;
+            rms = 0.;
+            return true;
+        }
+
+        constexpr size_t nbins = 1024;
+        std::vector<double> hist(nbins);
+
+        double lo = mean - 5.*sigma;
+        double hi = mean + 5.*sigma;
+
+        for(size_t pass = 0; pass < 3; pass++)
+        {
+            const double width = (hi - lo) / static_cast<double>(nbins);
+
+            std::fill(hist.begin(), hist.end(), 0.);
+            for(const double& v : values)
+            {
+                const double b = (v - lo) / width;
+                if(b >= 0. && b < static_cast<double>(nbins))
+                    hist[static_cast<size_t>(b)] += 1.;
+            }
+
+            size_t b0 = 0, b1 = nbins;
+            double previous = -1.;
+
+            for(size_t iter = 0; iter <= fmaxIter; iter++)
+            {
+                double cnt = 0., m1 = 0., m2 = 0.;
+                for(size_t b = b0; b < b1; b++)
+                {
+                    const double c = static_cast<double>(b) + 0.5;
+                    cnt += hist[b];
+                    m1  += hist[b] * c;
+                    m2  += hist[b] * c * c;
+                }
+
+                if(cnt < 1.)
+                    break;
+
+                const double bmean = m1 / cnt;
+                const double bsig  = (cnt > 1.) ? std::sqrt(std::max(0., (m2 - m1*m1/cnt) / (cnt - 1.))) : 0.;
+
+                double cum = 0., bmed = static_cast<double>(b0);
+                for(size_t b = b0; b < b1; b++)
+                {
+                    if(cum + hist[b] >= 0.5*cnt)
+                    {
+                        bmed = static_cast<double>(b) + (0.5*cnt - cum) / hist[b];
+                        break;
+                    }
+                    cum += hist[b];
+                }
+
+                mean  = lo + bmean * width;
+                sigma = bsig  * width;
+                med   = lo + bmed  * width;
+
+                if(!(bsig > 0.) || std::abs(previous - bsig) < 0.01 * bsig || iter == fmaxIter)
+                    break;
+
+                previous = bsig;
+
+                const size_t nb0 = static_cast<size_t>(std::clamp(std::floor(bmed - fclip*bsig), 0., static_cast<double>(nbins)));
+                const size_t nb1 = static_cast<size_t>(std::clamp(std::ceil (bmed + fclip*bsig), 0., static_cast<double>(nbins)));
+                if(nb0 >= nb1 || (nb0 == b0 && nb1 == b1))
+                    break;
+
+                b0 = nb0;
+                b1 = nb1;
+            }
+
+            if(sigma >= 16.*width)
+                break;
+
+            const double half = std::max((fclip + 2.)*sigma, 8.*width);
+            lo = med - half;
+            hi = med + half;
+        }
+
+        bkg = med;
+        if(festimator == estimator::mode && sigma > 0. && std::abs(mean - med) < 0.3 * sigma)
+            bkg = 2.5 * med - 1.5 * mean;
+
+        rms = sigma;
+
+        return true;
+    }
+
+    /**
+     *  @details Invalid cells are replaced, ring after ring, by the mean of their valid neighbours.
+     */
+    void FITSbackground::FillInvalidCells(std::vector<double>& mesh, std::vector<bool>& valid) const
+    {
+        if(std::none_of(valid.begin(), valid.end(), [](bool b){ return b; }))
+        {
+            std::fill(mesh.begin(), mesh.end(), 0.);
+            return;
+        }
+
+        std::vector<bool> next = valid;
+        while(std::find(valid.begin(), valid.end(), false) != valid.end())
+        {
+            for(size_t j = 0; j < fcy; j++)
+            for(size_t i = 0; i < fcx; i++)
+            {
+                if(valid[j*fcx + i])
+                    continue;
+
+                double sum = 0.;
+                size_t n   = 0;
+                for(size_t jj = (j > 0 ? j-1 : 0); jj <= std::min(fcy-1, j+1); jj++)
+                for(size_t ii = (i > 0 ? i-1 : 0); ii <= std::min(fcx-1, i+1); ii++)
+                {
+                    if(!valid[jj*fcx + ii])
+                        continue;
+                    sum += mesh[jj*fcx + ii];
+                    n++;
+                }
+
+                if(n > 0)
+                {
+                    mesh[j*fcx + i] = sum / static_cast<double>(n);
+                    next[j*fcx + i] = true;
+                }
+            }
+
+            valid = next;
+        }
+    }
+
+    void FITSbackground::MedianFilter(std::vector<double>& mesh) const
+    {
+        if(ffilter < 2 || mesh.size() < 2)
+            return;
+
+        const size_t half = ffilter/2;
+        const std::vector<double> src = mesh;
+        std::vector<double> window;
+        window.reserve(ffilter*ffilter);
+
+        for(size_t j = 0; j < fcy; j++)
+        for(size_t i = 0; i < fcx; i++)
+        {
+            window.clear();
+            for(size_t jj = (j > half ? j-half : 0); jj <= std::min(fcy-1, j+half); jj++)
+            for(size_t ii = (i > half ? i-half : 0); ii <= std::min(fcx-1, i+half); ii++)
+                window.push_back(src[jj*fcx + ii]);
+
+            mesh[j*fcx + i] = select_median(window.data(), window.size());
+        }
+    }
+
+    /**
+     *  @details The value of a cell is attached to its centre: pixel x lies at mesh coordinate (x+0.5)/meshx-0.5. The mesh is interpolated with the
+     *  bicubic kernel of FITSinterpolator, edge cells being replicated beyond the first and last cell centres. As the kernel is separable, each
+     *  output row first interpolates the mesh along y, then along x with column weights computed once.
+     */
+    void FITSbackground::Upsample(const std::vector<double>& mesh, double* out) const
+    {
+        if(out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSbackground","Upsample","missing output buffer");
+
+        if(mesh.empty())
+            throw FITSexception(SHARED_NULPTR,"FITSbackground","Upsample","no background estimated");
+
+        constexpr size_t ntap = 4;
+
+        // Tap indices and weights along one axis for n pixels of a mesh of nc cells of size m
+        auto taps = [&](const size_t& n, const size_t& nc, const size_t& m, std::vector<size_t>& idx, std::vector<double>& w)
+        {
+            idx.resize(n*ntap);
+            w.resize(n*ntap);
+
+            for(size_t p = 0; p < n; p++)
+            {
+                const double u  = (static_cast<double>(p) + 0.5) / static_cast<double>(m) - 0.5;
+                const long long c0 = static_cast<long long>(std::floor(u)) - 1;
+
+                double sum = 0.;
+                for(size_t a = 0; a < ntap; a++)
+                {
+                    const long long c = c0 + static_cast<long long>(a);
+                    idx[p*ntap + a] = static_cast<size_t>(std::clamp(c, 0LL, static_cast<long long>(nc) - 1));
+                    w  [p*ntap + a] = FITSinterpolator::Kernel(FITSinterpolator::method::bicubic, u - static_cast<double>(c));
+                    sum += w[p*ntap + a];
+                }
+
+                for(size_t a = 0; a < ntap; a++)
+                    w[p*ntap + a] /= sum;
+            }
+        };
+
+        std::vector<size_t> ix, iy;
+        std::vector<double> wx, wy;
+        taps(fnx, fcx, fmeshx, ix, wx);
+        taps(fny, fcy, fmeshy, iy, wy);
+
+        detail::parallel_chunks(fny, 8*fnx, [&](size_t y0, size_t y1)
+        {
+            std::vector<double> line(fcx);
+
+            for(size_t y = y0; y < y1; y++)
+            {
+                for(size_t c = 0; c < fcx; c++)
+                {
+                    double v = 0.;
+                    for(size_t a = 0; a < ntap; a++)
+                        v += wy[y*ntap + a] * mesh[iy[y*ntap + a]*fcx + c];
+                    line[c] = v;
+                }
+
+                double* row = out + y*fnx;
+                for(size_t x = 0; x < fnx; x++)
+                {
+                    const size_t* i = &ix[x*ntap];
+                    const double* w = &wx[x*ntap];
+                    row[x] = w[0]*line[i[0]] + w[1]*line[i[1]] + w[2]*line[i[2]] + w[3]*line[i[3]];
+                }
+            }
+        });
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    double FITSbackground::GlobalBackground() const
+    {
+        if(fbkg.empty())
+            throw FITSexception(SHARED_NULPTR,"FITSbackground","GlobalBackground","no background estimated");
+
+        std::vector<double> tmp = fbkg;
+        return select_median(tmp.data(), tmp.size());
+    }
+
+    double FITSbackground::GlobalRMS() const
+    {
+        if(frms.empty())
+            throw FITSexception(SHARED_NULPTR,"FITSbackground","GlobalRMS","no background estimated");
+
+        std::vector<double> tmp = frms;
+        return select_median(tmp.data(), tmp.size());
+    }
+
+#pragma endregion
+#pragma region * Estimation
+
+    void FITSbackground::Estimate(const double* in, const bool* msk, const size_t& nx, const size_t& ny)
+    {
+        if(in == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSbackground","Estimate","missing data");
+
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSbackground","Estimate","empty plane");
+
+        fnx = nx;
+        fny = ny;
+        fcx = (nx + fmeshx - 1) / fmeshx;
+        fcy = (ny + fmeshy - 1) / fmeshy;
+
+        const size_t ncell = fcx*fcy;
+        fbkg.assign(ncell, 0.);
+        frms.assign(ncell, 0.);
+
+        // std::vector<bool> is not safe for concurrent writes to distinct elements
+        std::vector<char> good(ncell, 0);
+
+        detail::parallel_chunks(ncell, 8*fmeshx*fmeshy, [&](size_t c0, size_t c1)
+        {
+            std::vector<double> values;
+            values.reserve(fmeshx*fmeshy);
+
+            for(size_t c = c0; c < c1; c++)
+            {
+                const size_t xs = (c % fcx) * fmeshx;
+                const size_t ys = (c / fcx) * fmeshy;
+                const size_t xe = std::min(nx, xs + fmeshx);
+                const size_t ye = std::min(ny, ys + fmeshy);
+
+                values.clear();
+                for(size_t y = ys; y < ye; y++)
+                for(size_t x = xs; x < xe; x++)
+                {
+                    const size_t k = y*nx + x;
+                    if((msk != nullptr && msk[k]) || !std::isfinite(in[k]))
+                        continue;
+                    values.push_back(in[k]);
+                }
+
+                if(2*values.size() < (xe - xs)*(ye - ys))
+                    continue;
+
+                good[c] = CellStatistic(values, fbkg[c], frms[c]) ? 1 : 0;
+            }
+        });
+
+        std::vector<bool> valid(good.begin(), good.end());
+        std::vector<bool> rvalid = valid;
+        FillInvalidCells(fbkg, valid);
+        FillInvalidCells(frms, rvalid);
+
+        MedianFilter(fbkg);
+        MedianFilter(frms);
+    }
+
+    void FITSbackground::Background(double* out) const
+    {
+        Upsample(fbkg, out);
+    }
+
+    void FITSbackground::RMS(double* out) const
+    {
+        Upsample(frms, out);
+    }
+
+#pragma endregion
+#pragma endregion
+}
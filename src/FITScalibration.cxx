@@ -0,0 +1,181 @@
+//
+//  FITScalibration.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <algorithm>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITScalibration.h>
+#include <DSTfits/FITSimg.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        std::string provenance(const FITScube& master, const std::string& name)
+        {
+            if(!name.empty())
+                return name;
+
+            if(master.HDU().Exists("EXTNAME"))
+                return master.HDU().GetValueForKey("EXTNAME");
+
+            return "MASTER";
+        }
+    }
+
+#pragma region - FITScalibration class implementation
+#pragma region * ctor/dtor
+
+    FITScalibration::FITScalibration():
+    fnx(0), fny(0), fdarkTime(0.), fflatNorm(1.)
+    {}
+
+#pragma endregion
+#pragma region * Protected member function
+
+    void FITScalibration::Reshape(const FITScube& master, const std::string& what)
+    {
+        const size_t nx = master.Size(1);
+        const size_t ny = (master.GetDimension() > 1) ? master.Size(2) : 1;
+
+        if(nx*ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITScalibration",what,"empty master frame");
+
+        if(fnx*fny == 0)
+        {
+            fnx = nx;
+            fny = ny;
+            fbias.assign(nx*ny, 0.f);
+            fdark.assign(nx*ny, 0.f);
+            fgain.assign(nx*ny, 1.f);
+            fbad.assign(nx*ny, 0);
+            return;
+        }
+
+        if(nx != fnx || ny != fny)
+            throw FITSexception(BAD_DIMEN,"FITScalibration",what,"master frames should have the same size");
+    }
+
+    /**
+     *  @details The masked and non finite pixels of the master are flagged in the bad pixel map.
+     */
+    std::vector<double> FITScalibration::Plane(const FITScube& master, const std::string& what)
+    {
+        Reshape(master, what);
+
+        const size_t n = fnx*fny;
+
+        std::vector<double> plane;
+        if(!master.CopyAsDouble(plane, n))
+            throw FITSexception(SHARED_NULPTR,"FITScalibration",what,"missing master data");
+
+        const bool* msk = master.raw_mask();
+
+        for(size_t k = 0; k < n; k++)
+            if((msk != nullptr && msk[k]) || !std::isfinite(plane[k]))
+            {
+                fbad[k]  = 1;
+                plane[k] = 0.;
+            }
+
+        return plane;
+    }
+
+#pragma endregion
+#pragma region * Master frames
+
+    void FITScalibration::SetBias(const FITScube& bias, const std::string& name)
+    {
+        const std::vector<double> plane = Plane(bias, "SetBias");
+
+        fbias.assign(plane.begin(), plane.end());
+        fbiasName = provenance(bias, name);
+    }
+
+    void FITScalibration::SetDark(const FITScube& dark, const double& darkTime, const std::string& name)
+    {
+        double t = darkTime;
+        if(!(t > 0.) && dark.HDU().Exists("EXPTIME"))
+            t = dark.HDU().GetDoubleValueForKey("EXPTIME");
+
+        if(!(t > 0.) || !std::isfinite(t))
+            throw FITSexception(BAD_OPTION,"FITScalibration","SetDark","dark exposure time should be strictly positive");
+
+        const std::vector<double> plane = Plane(dark, "SetDark");
+
+        fdark.resize(plane.size());
+        for(size_t k = 0; k < plane.size(); k++)
+            fdark[k] = static_cast<float>(plane[k] / t);
+
+        fdarkTime = t;
+        fdarkName = provenance(dark, name);
+    }
+
+    void FITScalibration::SetFlat(const FITScube& flat, const bool& normalize, const std::string& name)
+    {
+        const std::vector<double> plane = Plane(flat, "SetFlat");
+
+        double norm = 1.;
+        if(normalize)
+        {
+            std::vector<double> valid;
+            valid.reserve(plane.size());
+            for(size_t k = 0; k < plane.size(); k++)
+                if(!fbad[k] && plane[k] > 0.)
+                    valid.push_back(plane[k]);
+
+            if(valid.empty())
+                throw FITSexception(BAD_OPTION,"FITScalibration","SetFlat","master flat has no valid pixel");
+
+            std::nth_element(valid.begin(), valid.begin() + valid.size()/2, valid.end());
+            norm = valid[valid.size()/2];
+        }
+
+        fgain.resize(plane.size());
+        for(size_t k = 0; k < plane.size(); k++)
+        {
+            if(plane[k] > 0.)
+                fgain[k] = static_cast<float>(norm / plane[k]);
+            else
+            {
+                fgain[k] = 0.f;
+                fbad[k]  = 1;
+            }
+        }
+
+        fflatNorm = norm;
+        fflatName = provenance(flat, name);
+    }
+
+    void FITScalibration::SetBadPixels(const FITScube& bpm, const std::string& name)
+    {
+        const std::vector<double> plane = Plane(bpm, "SetBadPixels");
+
+        for(size_t k = 0; k < plane.size(); k++)
+            if(plane[k] != 0.)
+                fbad[k] = 1;
+
+        fbadName = provenance(bpm, name);
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    size_t FITScalibration::NumberOfBadPixels() const
+    {
+        return static_cast<size_t>(std::count(fbad.begin(), fbad.end(), uint8_t{1}));
+    }
+
+#pragma endregion
+#pragma endregion
+}
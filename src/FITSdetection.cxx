@@ -0,0 +1,456 @@
+//
+//  FITSdetection.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <bit>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSdetection.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        constexpr uint32_t kDiscarded = std::numeric_limits<uint32_t>::max();
+
+        inline uint32_t find_root(std::vector<uint32_t>& parent, uint32_t i)
+        {
+            while(parent[i] != i)
+            {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        /**
+         *  @brief Merge the sets of a and b, the root being the earliest run so that segments keep the raster order of their first pixel
+         */
+        inline void unite(std::vector<uint32_t>& parent, uint32_t a, uint32_t b)
+        {
+            a = find_root(parent, a);
+            b = find_root(parent, b);
+
+            if(a < b)
+                parent[b] = a;
+            else if(b < a)
+                parent[a] = b;
+        }
+
+        /**
+         *  @brief Merge the overlapping runs of two consecutive rows
+         *  @details Both ranges are sorted by column, so a single sweep finds all the overlapping pairs.
+         */
+        template<typename Run>
+        void merge_rows(const std::vector<Run>& runs, std::vector<uint32_t>& parent,
+                        size_t a, const size_t& aEnd, size_t b, const size_t& bEnd, const uint32_t& reach)
+        {
+            while(a < aEnd && b < bEnd)
+            {
+                const Run& ra = runs[a];
+                const Run& rb = runs[b];
+
+                if(ra.x0 <= rb.x1 + reach && rb.x0 <= ra.x1 + reach)
+                    unite(parent, static_cast<uint32_t>(a), static_cast<uint32_t>(b));
+
+                if(ra.x1 < rb.x1)
+                    a++;
+                else
+                    b++;
+            }
+        }
+        /**
+         *  @brief Position of the first bit of a row bitmap equal to value at or after x, nx if none
+         */
+        inline size_t next_bit(const std::vector<uint64_t>& bits, size_t x, const size_t& nx, const bool& value)
+        {
+            while(x < nx)
+            {
+                const size_t   w    = x >> 6;
+                const uint64_t word = (value ? bits[w] : ~bits[w]) >> (x & 63);
+
+                if(word != 0)
+                    return std::min(nx, x + static_cast<size_t>(std::countr_zero(word)));
+
+                x = (w + 1) << 6;
+            }
+
+            return nx;
+        }
+
+        /**
+         *  @brief Encode the detected pixels of a stripe as runs, merged row by row with a stripe local union-find
+         *  @details Each row is first thresholded into a bitmap without branching, the runs are then read from the bitmap word by word,
+         *  so that the cost of a row depends on its number of runs rather than on the fraction of detected pixels.
+         *  Map selects per pixel background and RMS maps instead of constant levels.
+         */
+        template<bool Map, typename Run>
+        void scan_stripe(const double* in, const bool* msk, const double* bkg, const double* rms, const double& bkgLevel, const double& nsigma, const double& thres,
+                         const size_t& nx, const size_t& y0, const size_t& y1, const uint32_t& reach, std::vector<Run>& runs, std::vector<uint32_t>& parent)
+        {
+            constexpr double inf = std::numeric_limits<double>::infinity();
+
+            std::vector<uint64_t> bits((nx + 63) / 64);
+
+            size_t prevBegin = 0;
+            size_t prevEnd   = 0;
+
+            for(size_t y = y0; y < y1; y++)
+            {
+                const double* row  = in + y*nx;
+                const bool*   mrow = (msk != nullptr) ? msk + y*nx : nullptr;
+                const double* brow = Map ? bkg + y*nx : nullptr;
+                const double* rrow = Map ? rms + y*nx : nullptr;
+
+                // NaN values fail the comparisons
+                for(size_t w = 0; w < bits.size(); w++)
+                {
+                    const size_t x0 = w << 6;
+                    const size_t x1 = std::min(nx, x0 + 64);
+
+                    uint64_t word = 0;
+                    for(size_t x = x0; x < x1; x++)
+                    {
+                        const double v = row[x] - (Map ? brow[x] : bkgLevel);
+                        const double t = Map ? nsigma * rrow[x] : thres;
+
+                        word |= static_cast<uint64_t>((v > t) & (v < inf)) << (x - x0);
+                    }
+
+                    if(mrow != nullptr)
+                        for(size_t x = x0; x < x1; x++)
+                            word &= ~(static_cast<uint64_t>(mrow[x]) << (x - x0));
+
+                    bits[w] = word;
+                }
+
+                const size_t curBegin = runs.size();
+
+                for(size_t x = next_bit(bits, 0, nx, true); x < nx; x = next_bit(bits, x, nx, true))
+                {
+                    const size_t end = next_bit(bits, x, nx, false);
+
+                    Run r{static_cast<uint32_t>(y), static_cast<uint32_t>(x), static_cast<uint32_t>(end - 1), static_cast<uint32_t>(x), 0., 0., -inf};
+
+                    for(; x < end; x++)
+                    {
+                        const double v = row[x] - (Map ? brow[x] : bkgLevel);
+
+                        r.flux += v;
+                        r.sx   += v * static_cast<double>(x);
+                        if(v > r.peak)
+                        {
+                            r.peak  = v;
+                            r.xpeak = static_cast<uint32_t>(x);
+                        }
+                    }
+
+                    runs.push_back(r);
+                    parent.push_back(static_cast<uint32_t>(runs.size() - 1));
+                }
+
+                if(y > y0)
+                    merge_rows(runs, parent, prevBegin, prevEnd, curBegin, runs.size(), reach);
+
+                prevBegin = curBegin;
+                prevEnd   = runs.size();
+            }
+        }
+    }
+
+#pragma region - FITSdetection class implementation
+#pragma region * ctor/dtor
+
+    FITSdetection::FITSdetection(const double& nsigma, const size_t& minArea, const bool& diagonal, const size_t& stripe):
+    fnsigma(nsigma), fminArea(std::max<size_t>(1,minArea)), fdiagonal(diagonal), fstripe(stripe), fnx(0), fny(0), fruns(), foffset(), fsegIndex(), fsegments()
+    {
+        if(!std::isfinite(fnsigma) || fnsigma < 0.)
+            throw FITSexception(BAD_OPTION,"FITSdetection","FITSdetection","detection threshold must be a positive number of sigma");
+
+        if(fstripe == 0)
+            throw FITSexception(BAD_OPTION,"FITSdetection","FITSdetection","stripe height must be at least one row");
+    }
+
+#pragma endregion
+#pragma region * Detection
+
+    void FITSdetection::Label(const double* in, const bool* msk, const double* bkg, const double* rms, const double& bkgLevel, const double& rmsLevel)
+    {
+        const size_t   nstripe = (fny + fstripe - 1) / fstripe;
+        const uint32_t reach   = fdiagonal ? 1 : 0;
+        const double   thres   = fnsigma * rmsLevel;
+
+        // Run buffers are kept from one plane to the next to avoid reallocating them
+        fruns.resize(nstripe);
+        std::vector< std::vector<uint32_t> > sparent(nstripe);
+
+        // First pass: runs of each stripe, merged row by row with a stripe local union-find
+        detail::parallel_chunks(nstripe, fstripe*fnx, [&](size_t begin, size_t end)
+        {
+            for(size_t s = begin; s < end; s++)
+            {
+                const size_t y0 = s * fstripe;
+                const size_t y1 = std::min(fny, y0 + fstripe);
+
+                fruns[s].clear();
+                sparent[s].reserve(fruns[s].capacity());
+
+                if(bkg != nullptr)
+                    scan_stripe<true> (in, msk, bkg, rms, bkgLevel, fnsigma, thres, fnx, y0, y1, reach, fruns[s], sparent[s]);
+                else
+                    scan_stripe<false>(in, msk, bkg, rms, bkgLevel, fnsigma, thres, fnx, y0, y1, reach, fruns[s], sparent[s]);
+            }
+        });
+
+        // Global run index: runs of stripe s start at foffset[s]
+        foffset.assign(nstripe + 1, 0);
+        for(size_t s = 0; s < nstripe; s++)
+            foffset[s + 1] = foffset[s] + fruns[s].size();
+
+        const size_t total = foffset[nstripe];
+        if(total >= static_cast<size_t>(kDiscarded))
+            throw FITSexception(MEMORY_ALLOCATION,"FITSdetection","Detect","too many runs of detected pixels");
+
+        std::vector<uint32_t> parent(total);
+        for(size_t s = 0; s < nstripe; s++)
+        {
+            const uint32_t off = static_cast<uint32_t>(foffset[s]);
+            std::transform(sparent[s].begin(), sparent[s].end(), parent.begin() + static_cast<std::ptrdiff_t>(off), [off](const uint32_t& p){ return p + off; });
+        }
+        sparent.clear();
+
+        // Boundary merging: last row of each stripe against the first row of the next one
+        for(size_t s = 1; s < nstripe; s++)
+        {
+            const std::vector<run>& above = fruns[s - 1];
+            const std::vector<run>& below = fruns[s];
+            const uint32_t y0 = static_cast<uint32_t>(s * fstripe);
+
+            size_t aBegin = above.size();
+            while(aBegin > 0 && above[aBegin - 1].y + 1 == y0)
+                aBegin--;
+
+            size_t bEnd = 0;
+            while(bEnd < below.size() && below[bEnd].y == y0)
+                bEnd++;
+
+            const uint32_t aoff = static_cast<uint32_t>(foffset[s - 1]);
+            const uint32_t boff = static_cast<uint32_t>(foffset[s]);
+
+            for(size_t a = aBegin, b = 0; a < above.size() && b < bEnd; )
+            {
+                if(above[a].x0 <= below[b].x1 + reach && below[b].x0 <= above[a].x1 + reach)
+                    unite(parent, static_cast<uint32_t>(a) + aoff, static_cast<uint32_t>(b) + boff);
+
+                if(above[a].x1 < below[b].x1)
+                    a++;
+                else
+                    b++;
+            }
+        }
+
+        // Second pass: resolve the roots and measure the segment areas.
+        // A run never points to a later run, so the parent of run i is already resolved when i is reached.
+        std::vector<size_t> area(total, 0);
+        for(size_t s = 0, i = 0; s < nstripe; s++)
+        {
+            for(const run& r : fruns[s])
+            {
+                parent[i]   = parent[parent[i]];
+                area[parent[i]] += static_cast<size_t>(r.x1 - r.x0 + 1);
+                i++;
+            }
+        }
+
+        // Reduce the run statistics over the segments large enough
+        fsegments.clear();
+        fsegIndex.assign(total, kDiscarded);
+
+        for(size_t s = 0, i = 0; s < nstripe; s++)
+        {
+            for(const run& r : fruns[s])
+            {
+                const uint32_t root = parent[i];
+
+                if(area[root] < fminArea)
+                {
+                    i++;
+                    continue;
+                }
+
+                if(root == i)
+                {
+                    fsegIndex[i] = static_cast<uint32_t>(fsegments.size());
+                    fsegments.push_back({0, area[root], 0., 0., 0., r.peak, r.xpeak, r.y, r.x0, r.x1, r.y, r.y});
+                }
+
+                const uint32_t c = fsegIndex[root];
+                fsegIndex[i] = c;
+
+                segment& seg = fsegments[c];
+                seg.flux += r.flux;
+                seg.x    += r.sx;
+                seg.y    += r.flux * static_cast<double>(r.y);
+                seg.xmin  = std::min<size_t>(seg.xmin, r.x0);
+                seg.xmax  = std::max<size_t>(seg.xmax, r.x1);
+                seg.ymax  = std::max<size_t>(seg.ymax, r.y);
+
+                if(r.peak > seg.peak)
+                {
+                    seg.peak  = r.peak;
+                    seg.xpeak = r.xpeak;
+                    seg.ypeak = r.y;
+                }
+
+                i++;
+            }
+        }
+
+        for(segment& seg : fsegments)
+        {
+            seg.x /= seg.flux;
+            seg.y /= seg.flux;
+        }
+    }
+
+    size_t FITSdetection::Detect(const double* in, const bool* msk, const size_t& nx, const size_t& ny, const double& bkg, const double& rms, const size_t& plane)
+    {
+        if(in == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSdetection","Detect","missing data");
+
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSdetection","Detect","empty plane");
+
+        if(nx >= static_cast<size_t>(kDiscarded) || ny >= static_cast<size_t>(kDiscarded))
+            throw FITSexception(BAD_DIMEN,"FITSdetection","Detect","plane too large");
+
+        if(!std::isfinite(bkg) || !std::isfinite(rms) || rms < 0.)
+            throw FITSexception(BAD_OPTION,"FITSdetection","Detect","background level and RMS must be finite, RMS must be positive");
+
+        fnx = nx;
+        fny = ny;
+
+        Label(in, msk, nullptr, nullptr, bkg, rms);
+
+        for(segment& seg : fsegments)
+            seg.plane = plane;
+
+        return fsegments.size();
+    }
+
+    size_t FITSdetection::Detect(const double* in, const bool* msk, const size_t& nx, const size_t& ny, const double* bkg, const double* rms, const size_t& plane)
+    {
+        if(in == nullptr || bkg == nullptr || rms == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSdetection","Detect","missing data, background or RMS map");
+
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSdetection","Detect","empty plane");
+
+        if(nx >= static_cast<size_t>(kDiscarded) || ny >= static_cast<size_t>(kDiscarded))
+            throw FITSexception(BAD_DIMEN,"FITSdetection","Detect","plane too large");
+
+        fnx = nx;
+        fny = ny;
+
+        Label(in, msk, bkg, rms, 0., 0.);
+
+        for(segment& seg : fsegments)
+            seg.plane = plane;
+
+        return fsegments.size();
+    }
+
+    void FITSdetection::Segmentation(uint32_t* out) const
+    {
+        if(out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSdetection","Segmentation","missing output buffer");
+
+        std::fill(out, out + fnx*fny, uint32_t{0});
+
+        // Runs are disjoint, so the stripes can be painted concurrently
+        detail::parallel_chunks(fruns.size(), fstripe*16, [&](size_t begin, size_t end)
+        {
+            for(size_t s = begin; s < end; s++)
+            {
+                for(size_t i = 0; i < fruns[s].size(); i++)
+                {
+                    const uint32_t c = fsegIndex[foffset[s] + i];
+                    if(c == kDiscarded)
+                        continue;
+
+                    const run& r = fruns[s][i];
+                    std::fill(out + r.y*fnx + r.x0, out + r.y*fnx + r.x1 + 1, c + 1);
+                }
+            }
+        });
+    }
+
+    std::shared_ptr<FITStable> FITSdetection::Catalog(const std::vector<segment>& segments)
+    {
+        FITScolumn<int32_t> number("NUMBER", tint,    "");
+        FITScolumn<int32_t> plane ("PLANE",  tint,    "");
+        FITScolumn<double>  x     ("X",      tdouble, "pix");
+        FITScolumn<double>  y     ("Y",      tdouble, "pix");
+        FITScolumn<double>  flux  ("FLUX",   tdouble, "");
+        FITScolumn<double>  peak  ("PEAK",   tdouble, "");
+        FITScolumn<int32_t> xpeak ("XPEAK",  tint,    "pix");
+        FITScolumn<int32_t> ypeak ("YPEAK",  tint,    "pix");
+        FITScolumn<int32_t> xmin  ("XMIN",   tint,    "pix");
+        FITScolumn<int32_t> xmax  ("XMAX",   tint,    "pix");
+        FITScolumn<int32_t> ymin  ("YMIN",   tint,    "pix");
+        FITScolumn<int32_t> ymax  ("YMAX",   tint,    "pix");
+        FITScolumn<int32_t> npix  ("NPIX",   tint,    "");
+
+        for(size_t k = 0; k < segments.size(); k++)
+        {
+            const segment& seg = segments[k];
+
+            number.push_back(static_cast<int32_t>(k + 1));
+            plane .push_back(static_cast<int32_t>(seg.plane));
+            x     .push_back(seg.x);
+            y     .push_back(seg.y);
+            flux  .push_back(seg.flux);
+            peak  .push_back(seg.peak);
+            xpeak .push_back(static_cast<int32_t>(seg.xpeak));
+            ypeak .push_back(static_cast<int32_t>(seg.ypeak));
+            xmin  .push_back(static_cast<int32_t>(seg.xmin));
+            xmax  .push_back(static_cast<int32_t>(seg.xmax));
+            ymin  .push_back(static_cast<int32_t>(seg.ymin));
+            ymax  .push_back(static_cast<int32_t>(seg.ymax));
+            npix  .push_back(static_cast<int32_t>(seg.npix));
+        }
+
+        std::shared_ptr<FITStable> table = std::make_shared<FITStable>("SEGMENTS");
+
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(number));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(plane));
+        table->InsertColumn(std::make_shared< FITScolumn<double>  >(x));
+        table->InsertColumn(std::make_shared< FITScolumn<double>  >(y));
+        table->InsertColumn(std::make_shared< FITScolumn<double>  >(flux));
+        table->InsertColumn(std::make_shared< FITScolumn<double>  >(peak));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(xpeak));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(ypeak));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(xmin));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(xmax));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(ymin));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(ymax));
+        table->InsertColumn(std::make_shared< FITScolumn<int32_t> >(npix));
+
+        return table;
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -0,0 +1,83 @@
+//
+//  FITShistogram.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <algorithm>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITShistogram.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+#pragma region - FITShistogram class implementation
+#pragma region * ctor/dtor
+
+    FITShistogram::FITShistogram(const size_t& nbins, const std::pair<double,double>& range):
+    flow(range.first), fhigh(range.second), fscale(1.), funder(0), fover(0)
+    {
+        if(nbins == 0)
+            throw FITSexception(BAD_OPTION,"FITShistogram","ctor","number of bins should be strictly positive");
+
+        if(!std::isfinite(range.first) || !std::isfinite(range.second) || !(range.first < range.second))
+            throw FITSexception(BAD_OPTION,"FITShistogram","ctor","histogram range should be finite and increasing");
+
+        fcounts.assign(nbins, 0);
+        fscale = static_cast<double>(nbins) / (fhigh - flow);
+    }
+
+#pragma endregion
+#pragma region * Filling
+
+    void FITShistogram::Reset()
+    {
+        std::fill(fcounts.begin(), fcounts.end(), uint64_t{0});
+        funder = 0;
+        fover  = 0;
+    }
+
+    FITShistogram& FITShistogram::operator+=(const FITShistogram& h)
+    {
+        if(h.fcounts.size() != fcounts.size() || h.flow != flow || h.fhigh != fhigh)
+            throw FITSexception(BAD_OPTION,"FITShistogram","operator+=","histograms should have the same binning");
+
+        for(size_t b = 0; b < fcounts.size(); b++)
+            fcounts[b] += h.fcounts[b];
+
+        funder += h.funder;
+        fover  += h.fover;
+
+        return *this;
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    uint64_t FITShistogram::Entries() const
+    {
+        uint64_t total = 0;
+        for(const uint64_t& c : fcounts)
+            total += c;
+
+        return total;
+    }
+
+    /**
+     *  @details The first bin is returned if several bins have the highest count.
+     */
+    double FITShistogram::Mode() const
+    {
+        const size_t imax = static_cast<size_t>(std::max_element(fcounts.begin(), fcounts.end()) - fcounts.begin());
+        return BinCenter(imax);
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -14,11 +14,14 @@
 #include <valarray>
 #include <limits>
 #include <cstdint>
+#include <cmath>
 #include <stdexcept>
+#include <regex>
 
 #include <fitsio.h>
 
 #include <DSTfits/FITSimg.h>
+#include <DSTfits/FITSparallel.h>
 
 
 
@@ -51,7 +54,90 @@ class FITSmanager;
         }
         return out;
     }
+
+    /**
+     *  @brief Update the WCS keywords of a header after an affine transform of the first two axis
+     *  @details For every WCS of this datacube, the reference pixel r is moved to M*r + offset and the linear transformation matrix L,
+     *  PC or CD whichever is used by the header, becomes L*M^-1. A rotation given by CROTA2 is converted to the equivalent PC matrix.
+     *  @param out Header receiving the updated keywords
+     *  @param matrix Linear part {m11, m12, m21, m22} of the transform
+     *  @param offset Translation [pix]
+     */
+    void FITScube::AffineWCS(FITShdu& out, const std::array<double,4>& matrix, const std::pair<double,double>& offset) const
+    {
+        const double det = matrix[0]*matrix[3] - matrix[1]*matrix[2];
+        const std::array<double,4> inv = { matrix[3]/det, -matrix[1]/det, -matrix[2]/det, matrix[0]/det };
+
+        for(size_t w = 0; w < getNumberOfWCS(); w++)
+        {
+            const std::string suff = fwcs.getSuffix(w);
+
+            auto get = [&](const std::string& key, const double& def)
+            {
+                return hdu.Exists(key+suff) ? hdu.GetDoubleValueForKey(key+suff) : def;
+            };
+            auto exists = [&](const std::string& lin)
+            {
+                return hdu.Exists(lin+"1_1"+suff) || hdu.Exists(lin+"1_2"+suff) || hdu.Exists(lin+"2_1"+suff) || hdu.Exists(lin+"2_2"+suff);
+            };
+
+            const double r1 = get("CRPIX1",0.);
+            const double r2 = get("CRPIX2",0.);
+            out.ValueForKey("CRPIX1"+suff, matrix[0]*r1 + matrix[1]*r2 + offset.first,  "Pixel coordinate of reference point");
+            out.ValueForKey("CRPIX2"+suff, matrix[2]*r1 + matrix[3]*r2 + offset.second, "Pixel coordinate of reference point");
+
+            // Same precedence as wcslib: PC, then CD, then CROTA
+            std::string lin = "PC";
+            std::array<double,4> l = {1., 0., 0., 1.};
+
+            if(exists("PC"))
+                l = { get("PC1_1",1.), get("PC1_2",0.), get("PC2_1",0.), get("PC2_2",1.) };
+            else if(exists("CD"))
+            {
+                lin = "CD";
+                l = { get("CD1_1",0.), get("CD1_2",0.), get("CD2_1",0.), get("CD2_2",0.) };
+            }
+            else if(hdu.Exists("CROTA2"+suff))
+            {
+                const double rho = get("CROTA2",0.) * M_PI / 180.;
+                const double c1  = get("CDELT1",1.);
+                const double c2  = get("CDELT2",1.);
+                l = { std::cos(rho), -std::sin(rho)*c2/c1, std::sin(rho)*c1/c2, std::cos(rho) };
+            }
+
+            if(out.Exists("CROTA1"+suff))
+                out.DeleteKey("CROTA1"+suff);
+            if(out.Exists("CROTA2"+suff))
+                out.DeleteKey("CROTA2"+suff);
+
+            out.ValueForKey(lin+"1_1"+suff, l[0]*inv[0] + l[1]*inv[2], "Coordinate transformation matrix element");
+            out.ValueForKey(lin+"1_2"+suff, l[0]*inv[1] + l[1]*inv[3], "Coordinate transformation matrix element");
+            out.ValueForKey(lin+"2_1"+suff, l[2]*inv[0] + l[3]*inv[2], "Coordinate transformation matrix element");
+            out.ValueForKey(lin+"2_2"+suff, l[2]*inv[1] + l[3]*inv[3], "Coordinate transformation matrix element");
+        }
+    }
     
+    /**
+     *  @brief Copy the keywords of the header that describe neither the layout of the data nor a WCS
+     *  @details Used by the operations writing their output on a new grid, so that the other keywords of the source (OBJECT, EXPTIME,
+     *  DATE-OBS, ...) survive while the WCS of the output is written by the caller. The structural keywords (BITPIX, NAXISn, BSCALE, ...)
+     *  and the WCS keywords of every alternate description (CTYPEia, CRPIXja, PCi_ja, PVi_ma, LONPOLEa, SIP coefficients, ...) are skipped.
+     *  @param out Header receiving the keywords
+     */
+    void FITScube::CopyHeader(FITShdu& out) const
+    {
+        static const std::regex structural(R"(^(SIMPLE|XTENSION|BITPIX|NAXIS\d*|EXTEND|PCOUNT|GCOUNT|BSCALE|BZERO|BLANK|CHECKSUM|DATASUM|END)$)");
+        static const std::regex wcs(R"(^(WCSAXES|WCSNAME|(CTYPE|CRVAL|CRPIX|CDELT|CUNIT|CROTA|CRDER|CSYER|CNAME)\d+|(PC|CD|PV|PS)\d+_\d+|LONPOLE|LATPOLE|RADESYS|RADECSYS|EQUINOX|EPOCH|RESTFRQ|RESTFREQ|RESTWAV|SPECSYS|SSYSOBS|VELOSYS)[A-Z]?$|^(A|B|AP|BP)_(ORDER|DMAX|\d+_\d+)$)");
+
+        for(FITSDictionary::const_iterator it = hdu.begin(); it != hdu.end(); it++)
+        {
+            if(std::regex_match(it->first, structural) || std::regex_match(it->first, wcs))
+                continue;
+
+            out.ValueForKey(it->first,it->second.value(),it->second.type(),it->second.comment());
+        }
+    }
+
     /**
      *  @brief construct NAXIS size std::vector for n dimension
      *
@@ -215,7 +301,7 @@ class FITSmanager;
      * @details Copie constructor
      * @param cube: FITS data cube to be copied.
      */
-    FITScube::FITScube(const FITScube& cube):fwcs(cube.fwcs)
+    FITScube::FITScube(const FITScube& cube):fwcs(cube.fwcs),fgridStep(cube.fgridStep),fgridTolerance(cube.fgridTolerance)
     {
         if(mask.size() > 1)
             mask.~valarray<bool>();
@@ -472,6 +558,17 @@ class FITSmanager;
             throw WCSexception(WCSERR_NULL_POINTER,"FITScube","WorldCoordinates","No WCS at index "+std::to_string(wcsIndex)+" defined in this FITS image");
         }
 
+        // Once built, the interpolated grid serves the pixels of the image plane
+        if(pixel.size() == Naxis.size() && pixel.size() >= 2 && std::all_of(pixel.cbegin()+2, pixel.cend(), [](const double& p){return p == 0.;}))
+        {
+            if(const std::shared_ptr<const FITSwcsGrid> grid = WorldGrid(wcsIndex))
+            {
+                worldCoords wc(grid->NumberOfAxis());
+                if(grid->pixel2world(pixel[0], pixel[1], wc.data()))
+                    return wc;
+            }
+        }
+
         pixelVectors pxVec;
         pxVec.push_back(pixel);
         worldCoords wcs = fwcs.pixel2world(wcsIndex,pxVec)[0];
@@ -599,6 +696,16 @@ class FITSmanager;
             throw  WCSexception(WCSERR_NULL_POINTER,"FITScube","World2Pixel","No WCS at index "+std::to_string(wcsIndex)+" defined in this FITS image");
         }
         
+        if(coo.size() == 2 && Naxis.size() == 2)
+        {
+            if(const std::shared_ptr<const FITSwcsGrid> grid = WorldGrid(wcsIndex))
+            {
+                double x = 0., y = 0.;
+                if(grid->world2pixel(coo.data(), x, y))
+                    return pixelCoords({x, y});
+            }
+        }
+
         worldVectors VWCoo;
         VWCoo.push_back(coo);
         return fwcs.world2pixel(wcsIndex, VWCoo)[0];
@@ -649,6 +756,272 @@ class FITSmanager;
         return result;
     }
 
+    void FITScube::SetWorldGrid(const size_t& step, const double& tolerance)
+    {
+        if(!(tolerance > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","SetWorldGrid","tolerance must be strictly positive");
+
+        InvalidateWorldGrid();
+
+        std::lock_guard<std::mutex> lk(fgridLock);
+        fgridStep = step;
+        fgridTolerance = tolerance;
+    }
+
+    /**
+     * @details The exact conversions of a WCS are counted until they reach the number of exact evaluations needed by its grid (nodes,
+     * centres and middles of the edges of the cells), so that building the grid never costs more than twice what it saves. The grid is
+     * built outside of the lock, the other threads keep converting exactly meanwhile. A grid that can't be built, or without any cell
+     * served by interpolation, isn't tried again until the next invalidation.
+     * @return The grid of the WCS, nullptr while it isn't built or if it can't be used for this datacube
+     */
+    std::shared_ptr<const FITSwcsGrid> FITScube::WorldGrid(const int& wcsIndex) const
+    {
+        constexpr size_t unavailable = std::numeric_limits<size_t>::max();
+
+        if(Naxis.size() < 2 || wcsIndex < 0 || wcsIndex >= fwcs.getNumberOfWCS())
+            return nullptr;
+
+        for(size_t k = 2; k < Naxis.size(); k++)
+            if(Naxis[k] != 1)
+                return nullptr;
+
+        const size_t idx = static_cast<size_t>(wcsIndex);
+        size_t step = 0;
+        double tolerance = 0.;
+        {
+            std::lock_guard<std::mutex> lk(fgridLock);
+            if(fgridStep == 0)
+                return nullptr;
+
+            if(fgrids.size() <= idx)
+            {
+                fgrids.resize(getNumberOfWCS());
+                fgridCalls.resize(getNumberOfWCS(), 0);
+            }
+
+            if(fgrids[idx] != nullptr)
+                return fgrids[idx];
+
+            if(fgridCalls[idx] == unavailable)
+                return nullptr;
+
+            const size_t gx = (Naxis[0] + fgridStep - 2) / fgridStep + 2;
+            const size_t gy = (Naxis[1] + fgridStep - 2) / fgridStep + 2;
+            if(++fgridCalls[idx] < 4 * gx * gy)
+                return nullptr;
+
+            fgridCalls[idx] = unavailable;
+            step = fgridStep;
+            tolerance = fgridTolerance;
+        }
+
+        std::shared_ptr<const FITSwcsGrid> grid;
+        try
+        {
+            if(fwcs.getNumberOfAxis(idx) == Naxis.size())
+                grid = std::make_shared<const FITSwcsGrid>(fwcs, idx, Naxis[0], Naxis[1], step, tolerance);
+        }
+        catch(const std::exception&)
+        {
+            grid = nullptr;
+        }
+
+        if(grid == nullptr || grid->Empty())
+            return nullptr;
+
+        std::lock_guard<std::mutex> lk(fgridLock);
+        // Dropped by an invalidation while it was built
+        if(fgridCalls.size() <= idx || fgridCalls[idx] != unavailable)
+            return nullptr;
+
+        fgrids[idx] = grid;
+        return grid;
+    }
+
+    /**
+     * @details The window is processed row by row. Each row is converted to world coordinates with the target WCS,
+     * then to pixel coordinates of this datacube. Axis beyond the second one are set to the pixel 0 of the target grid.
+     * When wcslib rejects a point of the row, the row is converted again point by point so that only the faulty points are lost.
+     * @note The rows are split between concurrent tasks, which share both WCS (FITSwcs conversions may run concurrently).
+     */
+    void FITScube::ReprojectionMap(const FITSwcs& target, const std::pair<size_t,size_t>& origin, const std::pair<size_t,size_t>& shape,
+                                   std::vector<double>& xs, std::vector<double>& ys, const size_t& wcsIndex) const
+    {
+        const size_t nx = shape.first;
+        const size_t ny = shape.second;
+
+        if(fwcs.getNumberOfWCS() == 0)
+            throw WCSexception(WCSERR_NULL_POINTER,"FITScube","ReprojectionMap","No WCS defined in this FITS image");
+
+        if(wcsIndex >= getNumberOfWCS())
+            throw WCSexception(WCSERR_NULL_POINTER,"FITScube","ReprojectionMap","No WCS at index "+std::to_string(wcsIndex)+" defined in this FITS image");
+
+        if(target.getNumberOfWCS() == 0)
+            throw WCSexception(WCSERR_NULL_POINTER,"FITScube","ReprojectionMap","No WCS defined for the target grid");
+
+        const size_t naxis = fwcs.getNumberOfAxis(wcsIndex);
+        if(naxis < 2 || target.getNumberOfAxis(0) != naxis)
+            throw FITSexception(BAD_DIMEN,"FITScube","ReprojectionMap","target WCS has "+std::to_string(target.getNumberOfAxis(0))+" axis while image WCS has "+std::to_string(naxis));
+
+        xs.assign(nx*ny, std::numeric_limits<double>::quiet_NaN());
+        ys.assign(nx*ny, std::numeric_limits<double>::quiet_NaN());
+
+        detail::parallel_chunks(ny, nx*naxis*256, [&](size_t y0, size_t y1)
+        {
+            pixelVectors px(nx, pixelCoords(naxis, 0.));
+            std::vector<size_t> valid;
+            worldVectors wvalid;
+
+            for(size_t y = y0; y < y1; y++)
+            {
+                for(size_t x = 0; x < nx; x++)
+                {
+                    px[x][0] = static_cast<double>(origin.first  + x);
+                    px[x][1] = static_cast<double>(origin.second + y);
+                }
+
+                worldVectors wc = target.safePixel2world(0, px);
+
+                valid.clear();
+                wvalid.clear();
+                for(size_t x = 0; x < nx; x++)
+                {
+                    if(wc[x].size() < naxis)
+                        continue;
+
+                    valid.push_back(x);
+                    wvalid.push_back(std::move(wc[x]));
+                }
+
+                if(valid.empty())
+                    continue;
+
+                pixelVectors sp = fwcs.safeWorld2pixel(wcsIndex, wvalid);
+
+                for(size_t k = 0; k < valid.size(); k++)
+                {
+                    if(sp[k].size() < 2)
+                        continue;
+
+                    xs[y*nx + valid[k]] = sp[k][0];
+                    ys[y*nx + valid[k]] = sp[k][1];
+                }
+            }
+        });
+    }
+
+    size_t FITScube::ProjectCatalog(FITStable& catalog, const std::string& raColumn, const std::string& decColumn,
+                                    const std::string& xColumn, const std::string& yColumn, const std::string& flagColumn, const size_t& wcsIndex) const
+    {
+        if(fwcs.getNumberOfWCS() == 0)
+            throw WCSexception(WCSERR_NULL_POINTER,"FITScube","ProjectCatalog","No WCS defined in this FITS image");
+
+        if(wcsIndex >= getNumberOfWCS())
+            throw WCSexception(WCSERR_NULL_POINTER,"FITScube","ProjectCatalog","No WCS at index "+std::to_string(wcsIndex)+" defined in this FITS image");
+
+        const int lng = fwcs.getLongitudeAxis(wcsIndex);
+        const int lat = fwcs.getLatitudeAxis(wcsIndex);
+        if(lng < 0 || lat < 0)
+            throw WCSexception(WCSERR_BAD_PARAM,"FITScube","ProjectCatalog","WCS "+std::to_string(wcsIndex)+" has no celestial axes");
+
+        const size_t naxis = fwcs.getNumberOfAxis(wcsIndex);
+        if(naxis < 2 || Naxis.size() < 2)
+            throw FITSexception(BAD_DIMEN,"FITScube","ProjectCatalog","the image and its WCS need at least two axes");
+
+        const FITStable::clist columns = catalog.listColumns();
+        for(const std::string& name : {xColumn, yColumn, flagColumn})
+            if(std::any_of(columns.cbegin(), columns.cend(), [&name](const std::vector<std::string>& c){return !c.empty() && c[0] == name;}))
+                throw FITSexception(BAD_OPTION,"FITScube","ProjectCatalog","column "+name+" already exists in the catalogue");
+
+        // Celestial coordinates as double, read in place when the columns already are
+        std::vector<double> raBuffer, decBuffer;
+        auto coordinates = [&catalog](const std::string& name, std::vector<double>& buffer)->std::span<const double>
+        {
+            const std::type_index type = catalog.getColumn(name)->payloadType();
+            if(type == std::type_index(typeid(double)))
+                return catalog.column<double>(name).data();
+
+            if(type != std::type_index(typeid(float)))
+                throw FITSexception(BAD_TFORM_DTYPE,"FITScube","ProjectCatalog","column "+name+" must hold float or double scalars");
+
+            const std::vector<float>& values = catalog.column<float>(name).data();
+            buffer.resize(values.size());
+            parallel_for(0, values.size(), 65536, [&](size_t begin, size_t end)
+            {
+                for(size_t k = begin; k < end; k++)
+                    buffer[k] = static_cast<double>(values[k]);
+            });
+            return buffer;
+        };
+
+        const std::span<const double> ra  = coordinates(raColumn,  raBuffer);
+        const std::span<const double> dec = coordinates(decColumn, decBuffer);
+        if(ra.size() != dec.size())
+            throw FITSexception(BAD_DIMEN,"FITScube","ProjectCatalog","columns "+raColumn+" and "+decColumn+" have different sizes");
+
+        const size_t n = ra.size();
+
+        // The pixel coordinates are written in the storage of the new columns
+        auto x    = std::make_unique< FITScolumn<double> >(xColumn,    tdouble,  "pix");
+        auto y    = std::make_unique< FITScolumn<double> >(yColumn,    tdouble,  "pix");
+        auto flag = std::make_unique< FITScolumn<bool>   >(flagColumn, tlogical, "");
+        std::vector<double>& xs = x->values<double>();
+        std::vector<double>& ys = y->values<double>();
+        std::vector<bool>&   in = flag->values<bool>();
+        xs.resize(n);
+        ys.resize(n);
+        in.assign(n, false);
+
+        // Other world axes held at the first pixel, their pixel coordinates discarded
+        std::vector<std::vector<double>> extraWorld, extraPixel;
+        std::vector<std::span<const double>> world(naxis);
+        std::vector<std::span<double>>       pixel(naxis);
+        if(naxis > 2)
+        {
+            const worldCoords origin = fwcs.pixel2world(wcsIndex, pixelVectors(1, pixelCoords(naxis, 0.)))[0];
+            for(size_t a = 0; a < naxis; a++)
+                if(static_cast<int>(a) != lng && static_cast<int>(a) != lat)
+                {
+                    extraWorld.emplace_back(n, origin[a]);
+                    world[a] = extraWorld.back();
+                }
+            extraPixel.assign(naxis - 2, std::vector<double>(n));
+            for(size_t a = 2; a < naxis; a++)
+                pixel[a] = extraPixel[a-2];
+        }
+        world[lng] = ra;
+        world[lat] = dec;
+        pixel[0]   = xs;
+        pixel[1]   = ys;
+
+        if(n > 0)
+            fwcs.world2pixel(wcsIndex, world, pixel);
+
+        // Footprint of PixelIndex: nearest pixel inside the first two axes. The flags are packed in words, so that each task sets
+        // whole blocks of 4096 of them
+        constexpr size_t block = 4096;
+        const double nx = static_cast<double>(Naxis[0]) - 0.5;
+        const double ny = static_cast<double>(Naxis[1]) - 0.5;
+        const size_t inside = parallel_reduce(size_t{0}, (n + block - 1)/block, 16, size_t{0}, [&](size_t b0, size_t b1)
+        {
+            size_t count = 0;
+            for(size_t k = b0*block; k < std::min(n, b1*block); k++)
+            {
+                const bool ok = xs[k] >= -0.5 && xs[k] < nx && ys[k] >= -0.5 && ys[k] < ny;
+                in[k] = ok;
+                count += ok;
+            }
+            return count;
+        }, std::plus<size_t>());
+
+        catalog.InsertColumn(std::unique_ptr<FITSform>(std::move(x)));
+        catalog.InsertColumn(std::unique_ptr<FITSform>(std::move(y)));
+        catalog.InsertColumn(std::unique_ptr<FITSform>(std::move(flag)));
+
+        return inside;
+    }
+
     /**
      *  Get the pixel index in the 1D pixel array given the pixel coordinates on each dimension of the FITS datacube
      *  @param iPx: Pixel coordinates on each dimension of the FITS datacube
@@ -693,7 +1066,320 @@ class FITSmanager;
         
         return index;
     }
+
+    /**
+     *  @details The storage type is resolved once through Visit.
+     *  @param out: First nelem pixel values, resized to nelem
+     *  @param nelem: Number of values to copy
+     *  @return false if the image holds less than nelem pixels, out is then left untouched
+     */
+    bool FITScube::CopyAsDouble(std::vector<double>& out, const size_t& nelem) const
+    {
+        return Visit([&](const auto& arr)->bool
+        {
+            if(arr.size() < nelem)
+                return false;
+
+            out.resize(nelem);
+            for(size_t k = 0; k < nelem; k++)
+                out[k] = static_cast<double>(arr[k]);
+
+            return true;
+        });
+    }
     
+#pragma endregion
+#pragma region * Statistic
+
+    /**
+     *  @brief Copy the unmasked values to a buffer
+     *  @details The values are compacted by blocks processed concurrently: the kept values of each block are counted, then copied at the
+     *  offset of the block. NaN values are always skipped.
+     *  @param out: Unmasked values, resized to their number (its capacity is reused)
+     *  @param finiteOnly: Also skip the infinite values
+     *  @return Number of values copied
+     */
+    size_t FITScube::UnmaskedValues(std::vector<double>& out, const bool& finiteOnly) const
+    {
+        out.clear();
+
+        if(!data)
+            return 0;
+
+        Visit([&](const auto& arr)
+        {
+            constexpr size_t block = 65536;
+
+            const size_t n   = arr.size();
+            const auto*  ptr = (n > 0) ? &arr[0] : nullptr;
+            const bool*  msk = (mask.size() == n) ? raw_mask() : nullptr;
+
+            const size_t nblock = (n + block - 1) / block;
+            std::vector<size_t> offset(nblock + 1, 0);
+
+            auto keep = [=](const size_t& k)->bool
+            {
+                const double v = static_cast<double>(ptr[k]);
+                return !(msk != nullptr && msk[k]) && (finiteOnly ? std::isfinite(v) : !std::isnan(v));
+            };
+
+            detail::parallel_chunks(nblock, block, [&](size_t begin, size_t end)
+            {
+                for(size_t b = begin; b < end; b++)
+                {
+                    size_t c = 0;
+                    for(size_t k = b*block; k < std::min(n, (b+1)*block); k++)
+                        c += keep(k);
+                    offset[b+1] = c;
+                }
+            });
+
+            for(size_t b = 0; b < nblock; b++)
+                offset[b+1] += offset[b];
+
+            out.resize(offset[nblock]);
+            detail::parallel_chunks(nblock, block, [&](size_t begin, size_t end)
+            {
+                for(size_t b = begin; b < end; b++)
+                {
+                    double* o = out.data() + offset[b];
+                    for(size_t k = b*block; k < std::min(n, (b+1)*block); k++)
+                        if(keep(k))
+                            *o++ = static_cast<double>(ptr[k]);
+                }
+            });
+        });
+
+        return out.size();
+    }
+
+    /**
+     *  @details If the range is empty, the histogram spans the unmasked finite values of the cube.
+     */
+    FITShistogram FITScube::Histogram(const size_t& nbins, const std::pair<double,double>& range) const
+    {
+        return Visit([&](const auto& arr)
+        {
+            const size_t n   = arr.size();
+            const auto*  ptr = (n > 0) ? &arr[0] : nullptr;
+            const bool*  msk = (mask.size() == n) ? raw_mask() : nullptr;
+
+            std::pair<double,double> r = range;
+            if(!(r.first < r.second))
+            {
+                r = FITShistogram::Extent(ptr, msk, n);
+                if(!(r.first < r.second))
+                    r = {r.first - 0.5, r.first + 0.5};
+            }
+
+            FITShistogram h(nbins, r);
+            h.Fill(ptr, msk, n);
+
+            return h;
+        });
+    }
+
+    FITShistogram FITScube::ExactHistogram() const
+    {
+        return Visit([&](const auto& arr)->FITShistogram
+        {
+            using V = typename std::decay_t<decltype(arr)>::value_type;
+
+            if constexpr (std::is_integral_v<V> && sizeof(V) <= 2)
+            {
+                const size_t n = arr.size();
+                return FITShistogram::Exact((n > 0) ? &arr[0] : nullptr, (mask.size() == n) ? raw_mask() : nullptr, n);
+            }
+            else
+                throw FITSexception(BAD_OPTION,"FITScube","ExactHistogram","exact histograms require 8 or 16 bits integer pixels");
+        });
+    }
+
+    stat::QuantileSketch FITScube::Sketch(const uint16_t& k) const
+    {
+        return Visit([&](const auto& arr)
+        {
+            const size_t n = arr.size();
+            return stat::QuantileSketch::Build((n > 0) ? &arr[0] : nullptr, (mask.size() == n) ? raw_mask() : nullptr, n, k);
+        });
+    }
+
+    /**
+     *  @details The quantiles are linearly interpolated between the order statistics of the unmasked values (NaN values are ignored).
+     *  8 and 16 bits integer pixels are counted exactly and the order statistics are read from the cumulative counts. Other types are
+     *  copied once and all the quantiles are obtained from a single partition of the copy (stat::Quantiles).
+     */
+    std::vector<double> FITScube::GetQuantiles(const std::vector<double>& probs) const
+    {
+        for(const double& p : probs)
+            if(!(p >= 0. && p <= 1.))
+                throw FITSexception(BAD_OPTION,"FITScube","GetQuantiles","probabilities should be in the range [0,1]");
+
+        if(!data || probs.empty())
+            return std::vector<double>(probs.size(), 0.);
+
+        return Visit([&](const auto& arr)->std::vector<double>
+        {
+            using V = typename std::decay_t<decltype(arr)>::value_type;
+
+            if constexpr (std::is_integral_v<V> && sizeof(V) <= 2)
+            {
+                const size_t n = arr.size();
+                const FITShistogram h = FITShistogram::Exact((n > 0) ? &arr[0] : nullptr, (mask.size() == n) ? raw_mask() : nullptr, n);
+                const uint64_t count  = h.Entries();
+                if(count == 0)
+                    return std::vector<double>(probs.size(), 0.);
+
+                // Value of the order statistic of rank r, read from the cumulative counts
+                auto orderStatistic = [&](const uint64_t& r)->double
+                {
+                    uint64_t cumul = 0;
+                    for(size_t b = 0; b < h.NumberOfBins(); b++)
+                    {
+                        cumul += h[b];
+                        if(cumul > r)
+                            return h.BinCenter(b);
+                    }
+                    return h.BinCenter(h.NumberOfBins()-1);
+                };
+
+                std::vector<double> q;
+                q.reserve(probs.size());
+                for(const double& p : probs)
+                {
+                    const double   pos = p * static_cast<double>(count - 1);
+                    const uint64_t lo  = std::min(count - 1, static_cast<uint64_t>(pos));
+                    const double   f   = pos - static_cast<double>(lo);
+                    const double   vlo = orderStatistic(lo);
+
+                    q.push_back( (f > 0.) ? vlo + f * (orderStatistic(std::min(count - 1, lo + 1)) - vlo) : vlo );
+                }
+
+                return q;
+            }
+            else
+            {
+                std::vector<double> values;
+                if(UnmaskedValues(values, false) == 0)
+                    return std::vector<double>(probs.size(), 0.);
+
+                return stat::Quantiles(values, probs);
+            }
+        });
+    }
+
+    stat::ClippedStats FITScube::GetClippedStats(const double& kLow, const double& kHigh, const size_t& maxIter, const stat::clipCenter& center) const
+    {
+        std::vector<double> scratch;
+        return GetClippedStats(scratch, kLow, kHigh, maxIter, center);
+    }
+
+    /**
+     *  @details The unmasked finite values are copied once to the scratch buffer, which is then clipped in place (stat::SigmaClip).
+     *  Masked and non finite values are not counted as rejected.
+     */
+    stat::ClippedStats FITScube::GetClippedStats(std::vector<double>& scratch, const double& kLow, const double& kHigh, const size_t& maxIter, const stat::clipCenter& center) const
+    {
+        if(!(kLow > 0.) || !(kHigh > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","GetClippedStats","clipping thresholds should be strictly positive");
+
+        if(UnmaskedValues(scratch, true) == 0)
+            return stat::ClippedStats();
+
+        return stat::SigmaClip(scratch.data(), scratch.size(), kLow, kHigh, maxIter, center);
+    }
+
+    stat::RobustStats FITScube::GetRobustStats(const double& cLocation, const double& cScale) const
+    {
+        std::vector<double> scratch;
+        return GetRobustStats(scratch, cLocation, cScale);
+    }
+
+    /**
+     *  @details The unmasked finite values are copied once to the scratch buffer, in which all the selections are made
+     *  (stat::RobustStatistics).
+     */
+    stat::RobustStats FITScube::GetRobustStats(std::vector<double>& scratch, const double& cLocation, const double& cScale) const
+    {
+        if(!(cLocation > 0.) || !(cScale > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","GetRobustStats","biweight tuning constants should be strictly positive");
+
+        if(UnmaskedValues(scratch, true) == 0)
+            return stat::RobustStats();
+
+        return stat::RobustStatistics(scratch.data(), scratch.size(), cLocation, cScale);
+    }
+
+    double FITScube::GetMAD() const
+    {
+        std::vector<double> values;
+        if(UnmaskedValues(values, true) == 0)
+            return 0.;
+
+        return stat::MedianAbsoluteDeviation(values.data(), values.size());
+    }
+
+    double FITScube::GetBiweightLocation(const double& c) const
+    {
+        if(!(c > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","GetBiweightLocation","tuning constant should be strictly positive");
+
+        std::vector<double> values;
+        if(UnmaskedValues(values, true) == 0)
+            return 0.;
+
+        return stat::BiweightLocation(values.data(), values.size(), c);
+    }
+
+    double FITScube::GetBiweightScale(const double& c) const
+    {
+        if(!(c > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","GetBiweightScale","tuning constant should be strictly positive");
+
+        std::vector<double> values;
+        if(UnmaskedValues(values, true) == 0)
+            return 0.;
+
+        return stat::BiweightScale(values.data(), values.size(), c);
+    }
+
+    double FITScube::GetMode() const
+    {
+        std::vector<double> values;
+        if(UnmaskedValues(values, true) == 0)
+            return 0.;
+
+        return stat::Mode(values.data(), values.size());
+    }
+
+    /**
+     *  @details The unmasked pixels are reduced by stat::ComputeMoments, so that the result does not depend on the number of threads.
+     *  Unmasked NaN values are counted and propagate to the sums, as in the other statistics of the cube.
+     */
+    stat::Moments FITScube::GetMoments() const
+    {
+        std::lock_guard<std::mutex> lock(fmomentsLock);
+
+        if(fmoments)
+            return *fmoments;
+
+        if(!data)
+            return stat::Moments();
+
+        fmoments = Visit([&](const auto& arr)->stat::Moments
+        {
+            using V = typename std::decay_t<decltype(arr)>::value_type;
+
+            const size_t n   = arr.size();
+            const V*     ptr = (n > 0) ? &arr[0] : nullptr;
+            const bool*  msk = (mask.size() == n) ? raw_mask() : nullptr;
+
+            return stat::ComputeMoments(ptr, n, msk);
+        });
+
+        return *fmoments;
+    }
+
 #pragma endregion
 #pragma region * I/O
     
@@ -878,6 +1564,8 @@ class FITSmanager;
 
     void FITScube::MaskPixels(const std::vector<size_t>& _l)
     {
+        InvalidateMoments();
+
         for (size_t idx : _l)
         {
             if (idx < mask.size())
@@ -897,6 +1585,7 @@ class FITSmanager;
         if (_m.size() != mask.size())
             throw std::length_error("FITSimg::MaskPixels - mask size mismatch");
 
+        InvalidateMoments();
         mask |= _m;
     }
     
@@ -906,6 +1595,8 @@ class FITSmanager;
      */
     void FITScube::UnmaskPixels(const std::initializer_list<size_t>& _l)
     {
+        InvalidateMoments();
+
         for (size_t idx : _l)
         {
             if (idx < mask.size())
@@ -926,13 +1617,254 @@ class FITSmanager;
         if (_m.size() != mask.size())
             throw std::length_error("FITSimg::MaskPixels - mask size mismatch");
 
+        InvalidateMoments();
         mask &= (!_m) ;
     }
 
+    void FITScube::MorphMask(const FITSmorphology::operation& op, const FITSmorphology& element)
+    {
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+
+        if(nplane == 0 || mask.size() == 0)
+            return;
+
+        InvalidateMoments();
+
+        for(size_t offset = 0; offset + nplane <= mask.size(); offset += nplane)
+            element.Apply(op, &(mask[offset]), nx, ny);
+    }
+
+    void FITScube::FillMaskHoles()
+    {
+        const size_t nx     = Size(1);
+        const size_t ny     = (Naxis.size() > 1) ? Size(2) : 1;
+        const size_t nplane = nx*ny;
+
+        if(nplane == 0 || mask.size() == 0)
+            return;
+
+        InvalidateMoments();
+
+        for(size_t offset = 0; offset + nplane <= mask.size(); offset += nplane)
+            FITSmorphology::FillHoles(&(mask[offset]), nx, ny);
+    }
+
 #pragma endregion
 
 #pragma region * Data operation
 
+    std::shared_ptr<FITScube> FITScube::Shift(const double& dx, const double& dy, const FITSinterpolator::method& method) const
+    {
+        return AffineWarp({1., 0., 0., 1.}, {dx, dy}, method);
+    }
+
+    /**
+     *  @details The pixel (x,y) lands at R*((x,y) - center) + center, R being the counter-clockwise rotation matrix of angle.
+     */
+    std::shared_ptr<FITScube> FITScube::Rotate(const double& angle, const std::pair<double,double>& center, const FITSinterpolator::method& method) const
+    {
+        const double c = std::cos(angle * M_PI / 180.);
+        const double s = std::sin(angle * M_PI / 180.);
+
+        return AffineWarp({c, -s, s, c},
+                          {center.first  - c*center.first + s*center.second,
+                           center.second - s*center.first - c*center.second}, method);
+    }
+
+    std::shared_ptr<FITScube> FITScube::Rotate(const double& angle, const FITSinterpolator::method& method) const
+    {
+        const double cx = 0.5 * (static_cast<double>(Size(1)) - 1.);
+        const double cy = (GetDimension() > 1) ? 0.5 * (static_cast<double>(Size(2)) - 1.) : 0.;
+
+        return Rotate(angle, {cx, cy}, method);
+    }
+
+    /**
+     *  @details The values are addressed as (i,j,o), i running over the inner axes, j over the collapsed axis and o over the outer
+     *  axes. Work units gather a block of consecutive output pixels i for one o, so that each collapsed index j reads a contiguous row
+     *  of the block: sums, extrema and moments are accumulated row by row, and the median and clipped mean first transpose the block
+     *  into one contiguous sample per output pixel. The blocks are processed concurrently on the shared pool.
+     */
+    std::shared_ptr<FITScube> FITScube::Reduce(const size_t& axis, const reduction& op, const double& kappa, const size_t& maxIter) const
+    {
+        if(!data)
+            throw FITSexception(SHARED_NULPTR,"FITScube","Reduce","no data in memory");
+
+        if(Naxis.size() < 2)
+            throw FITSexception(BAD_DIMEN,"FITScube","Reduce","collapsing an axis requires at least two axes");
+
+        if(axis < 1 || axis > Naxis.size())
+            throw FITSexception(BAD_DIMEN,"FITScube","Reduce","axis should be in the range [1,"+std::to_string(Naxis.size())+"]");
+
+        if(op == reduction::clippedMean && !(kappa > 0.))
+            throw FITSexception(BAD_OPTION,"FITScube","Reduce","clipping threshold should be strictly positive");
+
+        size_t inner = 1, outer = 1;
+        std::vector<size_t> shape;
+        for(size_t i = 0; i < Naxis.size(); i++)
+        {
+            if(i + 1 < axis)
+                inner *= Naxis[i];
+            else if(i + 1 > axis)
+                outer *= Naxis[i];
+
+            if(i + 1 != axis)
+                shape.push_back(Naxis[i]);
+        }
+        const size_t len = Naxis[axis-1];
+
+        std::shared_ptr< FITSimg<double> > result = std::make_shared< FITSimg<double> >(shape);
+        FITScube& out = *result;
+
+        double* res = &(*result->GetData<double>())[0];
+        bool*   msk = &out.mask[0];
+
+        // Output pixels per block: the median and the clipped mean keep a sample of len values per pixel
+        const bool   sampled = (op == reduction::median || op == reduction::clippedMean);
+        const size_t width   = sampled ? std::clamp<size_t>(65536 / std::max<size_t>(1,len), 1, 256) : 256;
+        const size_t blocks  = (inner + width - 1) / width;
+
+        Visit([&](const auto& arr)
+        {
+            const bool* srcMask = (mask.size() == arr.size()) ? raw_mask() : nullptr;
+
+            parallel_for(0, outer*blocks, std::max<size_t>(1, 32768 / (width*len)), [&](size_t begin, size_t end)
+            {
+                std::vector<double> sum(width), aux(width), sample(sampled ? width*len : 0);
+                std::vector<size_t> count(width);
+
+                for(size_t u = begin; u < end; u++)
+                {
+                    const size_t o  = u / blocks;
+                    const size_t i0 = (u % blocks) * width;
+                    const size_t w  = std::min(width, inner - i0);
+
+                    std::fill(count.begin(), count.begin() + w, size_t{0});
+                    std::fill(sum.begin(), sum.begin() + w, 0.);
+                    if(op == reduction::min)
+                        std::fill(aux.begin(), aux.begin() + w,  std::numeric_limits<double>::infinity());
+                    else if(op == reduction::max)
+                        std::fill(aux.begin(), aux.begin() + w, -std::numeric_limits<double>::infinity());
+
+                    for(size_t j = 0; j < len; j++)
+                    {
+                        const size_t row = i0 + inner*(j + len*o);
+
+                        for(size_t i = 0; i < w; i++)
+                        {
+                            const double v = static_cast<double>(arr[row + i]);
+                            if((srcMask != nullptr && srcMask[row + i]) || std::isnan(v))
+                                continue;
+
+                            switch(op)
+                            {
+                                case reduction::min:
+                                    aux[i] = std::min(aux[i], v);
+                                    break;
+                                case reduction::max:
+                                    aux[i] = std::max(aux[i], v);
+                                    break;
+                                case reduction::median:
+                                case reduction::clippedMean:
+                                    sample[i*len + count[i]] = v;
+                                    break;
+                                default:
+                                    sum[i] += v;
+                                    break;
+                            }
+                            count[i]++;
+                        }
+                    }
+
+                    // Second pass of the standard deviation, on the deviations to the mean
+                    if(op == reduction::stddev)
+                    {
+                        std::fill(aux.begin(), aux.begin() + w, 0.);
+                        for(size_t j = 0; j < len; j++)
+                        {
+                            const size_t row = i0 + inner*(j + len*o);
+
+                            for(size_t i = 0; i < w; i++)
+                            {
+                                const double v = static_cast<double>(arr[row + i]);
+                                if((srcMask != nullptr && srcMask[row + i]) || std::isnan(v))
+                                    continue;
+
+                                const double d = v - sum[i] / static_cast<double>(count[i]);
+                                aux[i] += d*d;
+                            }
+                        }
+                    }
+
+                    for(size_t i = 0; i < w; i++)
+                    {
+                        const size_t k = i0 + i + inner*o;
+                        const size_t n = count[i];
+
+                        msk[k] = (n == 0);
+                        if(n == 0)
+                        {
+                            res[k] = 0.;
+                            continue;
+                        }
+
+                        switch(op)
+                        {
+                            case reduction::sum:
+                                res[k] = sum[i];
+                                break;
+                            case reduction::mean:
+                                res[k] = sum[i] / static_cast<double>(n);
+                                break;
+                            case reduction::min:
+                            case reduction::max:
+                                res[k] = aux[i];
+                                break;
+                            case reduction::stddev:
+                                res[k] = (n > 1) ? std::sqrt(aux[i] / static_cast<double>(n - 1)) : 0.;
+                                break;
+                            case reduction::median:
+                                res[k] = stat::Quantiles(&sample[i*len], n, {0.5}).front();
+                                break;
+                            case reduction::clippedMean:
+                                res[k] = stat::SigmaClip(&sample[i*len], n, kappa, kappa, maxIter).mean;
+                                break;
+                        }
+                    }
+                }
+            });
+        });
+
+        CopyHeader(out.HDU());
+
+        static const char* names[] = {"SUM", "MEAN", "MEDIAN", "MIN", "MAX", "STDDEV", "CLIPMEAN"};
+        out.HDU().ValueForKey("COLLAPSE",std::string(names[static_cast<int>(op)]),fChar,"Axis collapse method");
+        out.HDU().ValueForKey("COLLAXIS",static_cast<uint16_t>(axis),"Collapsed axis");
+        if(op == reduction::clippedMean)
+            out.HDU().ValueForKey("CLIPSIG",kappa,"Clipping threshold of the collapse [sigma]");
+        out.HDU().ValueForKey("DSF_VER",DSF::gGIT::version_short(),key_type::fChar,"DST framwork version library");
+
+        for(size_t k = 0; k < getNumberOfWCS(); k++)
+        {
+            try
+            {
+                const FITShdu wcs_hdu = fwcs.Collapse(k, axis).asFITShdu();
+                for(FITSDictionary::const_iterator it = wcs_hdu.begin(); it != wcs_hdu.end(); it++)
+                    out.HDU().ValueForKey(it->first,it->second.value(),it->second.type(),it->second.comment());
+            }
+            catch(WCSexception& e)
+            {
+                std::cerr<<"\033[33m[WARNING]\033[0m WCS #"<<k<<" couldn't be collapsed along axis "<<axis<<" and is not propagated."<<std::endl;
+                std::cerr<<"          Original exception message: "<<e.what()<<std::endl;
+            }
+        }
+        out.reLoadWCS();
+
+        return result;
+    }
+
 
 #pragma endregion
 #pragma endregion
@@ -0,0 +1,383 @@
+//
+//  FITSinterpolator.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <algorithm>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSinterpolator.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        constexpr size_t kMaxSupport = 6;   // Lanczos-3
+
+        inline double linear_weight(const double& t)
+        {
+            const double a = std::abs(t);
+            return (a < 1.) ? 1. - a : 0.;
+        }
+
+        /**
+         *  @brief Keys cubic convolution kernel with a = -0.5
+         */
+        inline double cubic_weight(const double& t)
+        {
+            constexpr double a = -0.5;
+            const double x = std::abs(t);
+
+            if(x <= 1.)
+                return ((a + 2.) * x - (a + 3.)) * x * x + 1.;
+            if(x < 2.)
+                return ((a * x - 5. * a) * x + 8. * a) * x - 4. * a;
+
+            return 0.;
+        }
+
+        inline double lanczos_weight(const double& t)
+        {
+            constexpr double a = 3.;
+            const double x = std::abs(t);
+
+            if(x < 1e-12)
+                return 1.;
+            if(x >= a)
+                return 0.;
+
+            const double px = M_PI * x;
+            return a * std::sin(px) * std::sin(px / a) / (px * px);
+        }
+
+        /**
+         *  @brief Weights of the n samples x0, ..., x0+n-1 around the coordinate x
+         *  @details For Lanczos, the sines of the n samples follow from the sines of the first one:
+         *  \f$\sin(\pi(u-a)) = (-1)^a\sin(\pi u)\f$ and \f$\sin(\pi(u-a)/3)\f$ by angle subtraction, so only three trigonometric calls are made per axis.
+         */
+        inline void tap_weights(const FITSinterpolator::method& m, const double& x, const size_t& n, long long& x0, double* w)
+        {
+            // x >= -0.5 here, so the truncation of x+1 is floor(x)+1 without a call to floor
+            x0 = static_cast<long long>(x + 1.) - static_cast<long long>(n/2);
+
+            // Distance to the first sample
+            const double u = x - static_cast<double>(x0);
+
+            switch(m)
+            {
+                case FITSinterpolator::method::bilinear:
+                    w[0] = 1. - u;
+                    w[1] = u;
+                    return;
+
+                case FITSinterpolator::method::bicubic:
+                    for(size_t a = 0; a < n; a++)
+                        w[a] = cubic_weight(u - static_cast<double>(a));
+                    return;
+
+                case FITSinterpolator::method::lanczos:
+                {
+                    static const double cosk[kMaxSupport] = {1., 0.5, -0.5, -1., -0.5, 0.5};
+                    static const double sink[kMaxSupport] = {0., 0.8660254037844386, 0.8660254037844386, 0., -0.8660254037844386, -0.8660254037844386};
+
+                    const double f = u - static_cast<double>(static_cast<long long>(u));
+                    if(f < 1e-12)
+                    {
+                        // On a sample: unit weight on the sample at distance u
+                        for(size_t a = 0; a < n; a++)
+                            w[a] = (std::abs(u - static_cast<double>(a)) < 0.5) ? 1. : 0.;
+                        return;
+                    }
+
+                    const double sp = std::sin(M_PI * u);
+                    const double st = std::sin(M_PI * u / 3.);
+                    const double ct = std::cos(M_PI * u / 3.);
+
+                    for(size_t a = 0; a < n; a++)
+                    {
+                        const double d  = u - static_cast<double>(a);
+                        const double s1 = (a & 1) ? -sp : sp;
+                        const double s3 = st * cosk[a] - ct * sink[a];
+                        w[a] = (std::abs(d) < 3.) ? 3. * s1 * s3 / (M_PI * M_PI * d * d) : 0.;
+                    }
+                    return;
+                }
+
+                default:
+                    return;
+            }
+        }
+    }
+
+#pragma region - FITSinterpolator class implementation
+#pragma region * ctor/dtor
+
+    FITSinterpolator::FITSinterpolator(const double* data, const bool* msk, const size_t& nx, const size_t& ny, const method& m):
+    fdata(data), fmask(msk), fnx(nx), fny(ny), fmethod(m)
+    {
+        if(fdata == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSinterpolator","FITSinterpolator","missing data");
+
+        if(fnx == 0 || fny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSinterpolator","FITSinterpolator","empty plane");
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    size_t FITSinterpolator::Support(const method& m)
+    {
+        switch(m)
+        {
+            case method::nearest:  return 1;
+            case method::bilinear: return 2;
+            case method::bicubic:  return 4;
+            case method::lanczos:  return kMaxSupport;
+        }
+
+        return 1;
+    }
+
+    std::string FITSinterpolator::Name(const method& m)
+    {
+        switch(m)
+        {
+            case method::nearest:  return "NEAREST";
+            case method::bilinear: return "BILINEAR";
+            case method::bicubic:  return "BICUBIC";
+            case method::lanczos:  return "LANCZOS3";
+        }
+
+        return "UNKNOWN";
+    }
+
+    double FITSinterpolator::Kernel(const method& m, const double& t)
+    {
+        switch(m)
+        {
+            case method::bilinear: return linear_weight(t);
+            case method::bicubic:  return cubic_weight(t);
+            case method::lanczos:  return lanczos_weight(t);
+            default:               return 0.;
+        }
+    }
+
+#pragma endregion
+#pragma region * Interpolation
+
+    bool FITSinterpolator::operator()(const double& x, const double& y, double& value) const
+    {
+        const double hx = static_cast<double>(fnx) - 0.5;
+        const double hy = static_cast<double>(fny) - 0.5;
+
+        // Also rejects NaN coordinates
+        if(!(x >= -0.5 && x <= hx && y >= -0.5 && y <= hy))
+            return false;
+
+        const long long lnx = static_cast<long long>(fnx);
+        const long long lny = static_cast<long long>(fny);
+
+        if(fmethod == method::nearest)
+        {
+            const long long i = std::clamp(static_cast<long long>(std::floor(x + 0.5)), 0LL, lnx - 1);
+            const long long j = std::clamp(static_cast<long long>(std::floor(y + 0.5)), 0LL, lny - 1);
+            const size_t k = static_cast<size_t>(j * lnx + i);
+
+            if((fmask != nullptr && fmask[k]) || !std::isfinite(fdata[k]))
+                return false;
+
+            value = fdata[k];
+            return true;
+        }
+
+        const size_t n = Support();
+
+        double wx[kMaxSupport];
+        double wy[kMaxSupport];
+        long long x0 = 0;
+        long long y0 = 0;
+
+        tap_weights(fmethod, x, n, x0, wx);
+        tap_weights(fmethod, y, n, y0, wy);
+
+        const long long ln = static_cast<long long>(n);
+
+        double sum   = 0.;
+        double wsum  = 0.;
+        double wabs  = 0.;
+        double wgood = 0.;
+
+        if(x0 >= 0 && y0 >= 0 && x0 + ln <= lnx && y0 + ln <= lny)
+        {
+            // Whole support inside the plane: no edge replication
+            const double* base = fdata + static_cast<size_t>(y0 * lnx + x0);
+            const bool*   mbase = (fmask != nullptr) ? fmask + static_cast<size_t>(y0 * lnx + x0) : nullptr;
+
+            if(mbase == nullptr)
+            {
+                // Separable sum without per-sample tests: a non finite sample makes the sum non finite and falls back to the checked loop
+                double sx = 0.;
+                double sy = 0.;
+                for(size_t a = 0; a < n; a++)
+                {
+                    sx += wx[a];
+                    sy += wy[a];
+                }
+
+                for(size_t b = 0; b < n; b++)
+                {
+                    const double* row = base + b*fnx;
+
+                    double rs = 0.;
+                    for(size_t a = 0; a < n; a++)
+                        rs += wx[a] * row[a];
+
+                    sum += wy[b] * rs;
+                }
+
+                if(std::isfinite(sum) && std::abs(sx * sy) > 1e-12)
+                {
+                    value = sum / (sx * sy);
+                    return true;
+                }
+
+                sum = 0.;
+            }
+
+            for(size_t b = 0; b < n; b++)
+            {
+                const double* row  = base + b*fnx;
+                const bool*   mrow = (mbase != nullptr) ? mbase + b*fnx : nullptr;
+
+                for(size_t a = 0; a < n; a++)
+                {
+                    const double w = wx[a] * wy[b];
+                    wabs += std::abs(w);
+
+                    if((mrow != nullptr && mrow[a]) || !std::isfinite(row[a]))
+                        continue;
+
+                    sum   += w * row[a];
+                    wsum  += w;
+                    wgood += std::abs(w);
+                }
+            }
+        }
+        else
+        {
+            long long ix[kMaxSupport];
+            long long iy[kMaxSupport];
+
+            for(size_t a = 0; a < n; a++)
+            {
+                ix[a] = std::clamp(x0 + static_cast<long long>(a), 0LL, lnx - 1);
+                iy[a] = std::clamp(y0 + static_cast<long long>(a), 0LL, lny - 1);
+            }
+
+            for(size_t b = 0; b < n; b++)
+            {
+                if(wy[b] == 0.)
+                    continue;
+
+                const size_t row = static_cast<size_t>(iy[b] * lnx);
+
+                for(size_t a = 0; a < n; a++)
+                {
+                    const double w = wx[a] * wy[b];
+                    if(w == 0.)
+                        continue;
+
+                    wabs += std::abs(w);
+
+                    const size_t k = row + static_cast<size_t>(ix[a]);
+                    if((fmask != nullptr && fmask[k]) || !std::isfinite(fdata[k]))
+                        continue;
+
+                    sum   += w * fdata[k];
+                    wsum  += w;
+                    wgood += std::abs(w);
+                }
+            }
+        }
+
+        if(wgood < 0.5 * wabs || std::abs(wsum) <= 1e-12)
+            return false;
+
+        value = sum / wsum;
+        return true;
+    }
+
+    void FITSinterpolator::Resample(const double* xs, const double* ys, const size_t& n, double* out, bool* omsk) const
+    {
+        if(xs == nullptr || ys == nullptr || out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSinterpolator","Resample","missing coordinates or output buffer");
+
+        const size_t s = Support();
+
+        detail::parallel_chunks(n, 4*s*s, [&](size_t begin, size_t end)
+        {
+            for(size_t k = begin; k < end; k++)
+            {
+                double v = 0.;
+                const bool ok = (*this)(xs[k], ys[k], v);
+
+                out[k] = ok ? v : 0.;
+                if(omsk != nullptr)
+                    omsk[k] = !ok;
+            }
+        });
+    }
+
+    void FITSinterpolator::Warp(const std::array<double,6>& c, const size_t& ox, const size_t& oy, double* out, bool* omsk) const
+    {
+        if(out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSinterpolator","Warp","missing output buffer");
+
+        constexpr size_t block = 64;
+
+        const size_t bx = (ox + block - 1) / block;
+        const size_t by = (oy + block - 1) / block;
+        const size_t s  = Support();
+
+        detail::parallel_chunks(bx*by, block*block*4*s*s, [&](size_t begin, size_t end)
+        {
+            for(size_t b = begin; b < end; b++)
+            {
+                const size_t i0 = (b % bx) * block;
+                const size_t j0 = (b / bx) * block;
+                const size_t i1 = std::min(ox, i0 + block);
+                const size_t j1 = std::min(oy, j0 + block);
+
+                for(size_t j = j0; j < j1; j++)
+                {
+                    const double dj = static_cast<double>(j);
+
+                    for(size_t i = i0; i < i1; i++)
+                    {
+                        const double di = static_cast<double>(i);
+                        const size_t k  = j*ox + i;
+
+                        double v = 0.;
+                        const bool ok = (*this)(c[0] + c[1]*di + c[2]*dj, c[3] + c[4]*di + c[5]*dj, v);
+
+                        out[k] = ok ? v : 0.;
+                        if(omsk != nullptr)
+                            omsk[k] = !ok;
+                    }
+                }
+            }
+        });
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -0,0 +1,496 @@
+//
+//  FITSkernel.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fitsio.h>
+
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_fft_complex.h>
+
+#include <DSTfits/FITSkernel.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        /**
+         *  @brief Smallest size >= n that only has 2, 3 and 5 as prime factors (fast mixed-radix FFT length)
+         */
+        size_t fast_fft_size(size_t n)
+        {
+            if(n < 2)
+                return 1;
+
+            for(;; ++n)
+            {
+                size_t m = n;
+                for(size_t p : {2, 3, 5})
+                    while(m % p == 0) m /= p;
+
+                if(m == 1)
+                    return n;
+            }
+        }
+
+        struct gsl_fft_deleter
+        {
+            void operator()(gsl_fft_complex_wavetable* p) const { if(p) gsl_fft_complex_wavetable_free(p); }
+            void operator()(gsl_fft_complex_workspace* p) const { if(p) gsl_fft_complex_workspace_free(p); }
+        };
+
+        /**
+         *  @brief In place 2D FFT of a px*py interleaved complex array
+         *  @details Rows then columns are transformed with the GSL mixed-radix FFT, each thread owning its wavetable and workspace. The inverse transform is normalized.
+         */
+        void fft2d(std::vector<double>& c, const size_t& px, const size_t& py, const bool& forward)
+        {
+            auto transform = [&](const size_t& n, const size_t& stride, const size_t& count, const size_t& step)
+            {
+                const size_t logn = static_cast<size_t>(std::log2(static_cast<double>(n))) + 1;
+
+                detail::parallel_chunks(count, 5 * n * logn, [&](size_t begin, size_t end)
+                {
+                    std::unique_ptr<gsl_fft_complex_wavetable, gsl_fft_deleter> wt(gsl_fft_complex_wavetable_alloc(n));
+                    std::unique_ptr<gsl_fft_complex_workspace, gsl_fft_deleter> ws(gsl_fft_complex_workspace_alloc(n));
+
+                    if(!wt || !ws)
+                        throw FITSexception(SHARED_NOMEM,"FITSkernel","ApplyFFT","unable to allocate GSL FFT workspace of length "+std::to_string(n));
+
+                    for(size_t k = begin; k < end; ++k)
+                    {
+                        double* line = c.data() + 2 * k * step;
+                        const int status = (forward) ? gsl_fft_complex_forward(line, stride, n, wt.get(), ws.get())
+                                                     : gsl_fft_complex_inverse(line, stride, n, wt.get(), ws.get());
+                        if(status != GSL_SUCCESS)
+                            throw FITSexception(BAD_OPTION,"FITSkernel","ApplyFFT",std::string("GSL FFT failed : ")+gsl_strerror(status));
+                    }
+                });
+            };
+
+            transform(px, 1 , py, px);   // rows    : contiguous, one per y
+            transform(py, px, px, 1 );   // columns : stride px, one per x
+        }
+    }
+
+#pragma region - FITSkernel class implementation
+#pragma region * ctor/dtor
+
+    FITSkernel::FITSkernel(const size_t& nx, const size_t& ny, const std::vector<double>& weights):fnx(nx),fny(ny),fweights(weights),fkx(),fky(),fname("CUSTOM")
+    {
+        CheckSize();
+
+        if(fweights.size() != fnx*fny)
+            throw FITSexception(BAD_DIMEN,"FITSkernel","ctor","expected "+std::to_string(fnx*fny)+" weights, got "+std::to_string(fweights.size()));
+    }
+
+    FITSkernel::FITSkernel(const std::vector<double>& kx, const std::vector<double>& ky):fnx(kx.size()),fny(ky.size()),fweights(kx.size()*ky.size()),fkx(kx),fky(ky),fname("CUSTOM")
+    {
+        CheckSize();
+
+        for(size_t j = 0; j < fny; j++)
+            for(size_t i = 0; i < fnx; i++)
+                fweights[j*fnx + i] = fky[j] * fkx[i];
+    }
+
+    /**
+     *  @brief Normalized separable Gaussian kernel
+     *  @param sigma_x: Standard deviation along the x axis [pixel]
+     *  @param sigma_y: Standard deviation along the y axis [pixel]
+     *  @param truncate: The kernel half size is ceil(truncate*sigma)
+     */
+    FITSkernel FITSkernel::Gaussian(const double& sigma_x, const double& sigma_y, const double& truncate)
+    {
+        if(!(sigma_x > 0.) || !(sigma_y > 0.))
+            throw FITSexception(BAD_OPTION,"FITSkernel","Gaussian","sigma should be strictly positive");
+
+        if(!(truncate > 0.))
+            throw FITSexception(BAD_OPTION,"FITSkernel","Gaussian","truncation radius should be strictly positive");
+
+        auto profile = [&](const double& sigma)
+        {
+            const size_t r = static_cast<size_t>(std::ceil(truncate * sigma));
+            std::vector<double> k(2*r + 1);
+
+            for(size_t i = 0; i < k.size(); i++)
+            {
+                const double d = (static_cast<double>(i) - static_cast<double>(r)) / sigma;
+                k[i] = std::exp(-0.5 * d * d);
+            }
+
+            const double s = std::accumulate(k.begin(), k.end(), 0.);
+            for(double& v : k) v /= s;
+
+            return k;
+        };
+
+        FITSkernel kernel(profile(sigma_x), profile(sigma_y));
+        kernel.SetName("GAUSSIAN");
+
+        return kernel;
+    }
+
+    /**
+     *  @brief Normalized separable box kernel
+     *  @param nx: Kernel size along the x axis (odd)
+     *  @param ny: Kernel size along the y axis (odd)
+     */
+    FITSkernel FITSkernel::Box(const size_t& nx, const size_t& ny)
+    {
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSkernel","Box","box size should be strictly positive");
+
+        FITSkernel kernel(std::vector<double>(nx, 1./static_cast<double>(nx)), std::vector<double>(ny, 1./static_cast<double>(ny)));
+        kernel.SetName("BOX");
+
+        return kernel;
+    }
+
+#pragma endregion
+#pragma region * protected member function
+
+    void FITSkernel::CheckSize() const
+    {
+        if(fnx == 0 || fny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSkernel","CheckSize","empty kernel");
+
+        if(fnx%2 == 0 || fny%2 == 0)
+            throw FITSexception(BAD_DIMEN,"FITSkernel","CheckSize","kernel size should be odd, got "+std::to_string(fnx)+"x"+std::to_string(fny));
+    }
+
+    /**
+     *  @brief Direct 2D convolution of the weighted data and of the validity map
+     *  @details Each output row accumulates the kernel rows one after the other, keeping the innermost loop contiguous.
+     */
+    void FITSkernel::ApplyDirect(const double* vw, const double* w, double* num, double* den, const size_t& nx, const size_t& ny) const
+    {
+        const long long rx = static_cast<long long>(fnx/2);
+        const long long ry = static_cast<long long>(fny/2);
+        const long long lnx = static_cast<long long>(nx);
+        const long long lny = static_cast<long long>(ny);
+
+        detail::parallel_chunks(ny, nx*fnx*fny, [&](size_t y0, size_t y1)
+        {
+            for(size_t y = y0; y < y1; y++)
+            {
+                double* on = num + y*nx;
+                double* od = den + y*nx;
+                std::fill(on, on + nx, 0.);
+                std::fill(od, od + nx, 0.);
+
+                for(size_t j = 0; j < fny; j++)
+                {
+                    const long long yy = static_cast<long long>(y) + ry - static_cast<long long>(j);
+                    if(yy < 0 || yy >= lny)
+                        continue;
+
+                    const double* rvw = vw + yy*lnx;
+                    const double* rw  = w  + yy*lnx;
+
+                    for(size_t i = 0; i < fnx; i++)
+                    {
+                        const double k = fweights[j*fnx + i];
+                        if(k == 0.)
+                            continue;
+
+                        // input column is x + s
+                        const long long s  = rx - static_cast<long long>(i);
+                        const long long x0 = std::max<long long>(0, -s);
+                        const long long x1 = std::min<long long>(lnx, lnx - s);
+
+                        for(long long x = x0; x < x1; x++)
+                        {
+                            on[x] += k * rvw[x + s];
+                            od[x] += k * rw [x + s];
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     *  @brief Separable convolution: one horizontal pass with the x profile followed by one vertical pass with the y profile
+     */
+    void FITSkernel::ApplySeparable(const double* vw, const double* w, double* num, double* den, const size_t& nx, const size_t& ny) const
+    {
+        const long long rx = static_cast<long long>(fnx/2);
+        const long long ry = static_cast<long long>(fny/2);
+        const long long lnx = static_cast<long long>(nx);
+        const long long lny = static_cast<long long>(ny);
+
+        std::vector<double> hn(nx*ny, 0.);
+        std::vector<double> hd(nx*ny, 0.);
+
+        detail::parallel_chunks(ny, nx*fnx, [&](size_t y0, size_t y1)
+        {
+            for(size_t y = y0; y < y1; y++)
+            {
+                const double* rvw = vw + y*nx;
+                const double* rw  = w  + y*nx;
+                double* on = hn.data() + y*nx;
+                double* od = hd.data() + y*nx;
+
+                for(size_t i = 0; i < fnx; i++)
+                {
+                    const double k = fkx[i];
+                    if(k == 0.)
+                        continue;
+
+                    const long long s  = rx - static_cast<long long>(i);
+                    const long long x0 = std::max<long long>(0, -s);
+                    const long long x1 = std::min<long long>(lnx, lnx - s);
+
+                    for(long long x = x0; x < x1; x++)
+                    {
+                        on[x] += k * rvw[x + s];
+                        od[x] += k * rw [x + s];
+                    }
+                }
+            }
+        });
+
+        detail::parallel_chunks(ny, nx*fny, [&](size_t y0, size_t y1)
+        {
+            for(size_t y = y0; y < y1; y++)
+            {
+                double* on = num + y*nx;
+                double* od = den + y*nx;
+                std::fill(on, on + nx, 0.);
+                std::fill(od, od + nx, 0.);
+
+                for(size_t j = 0; j < fny; j++)
+                {
+                    const double k = fky[j];
+                    const long long yy = static_cast<long long>(y) + ry - static_cast<long long>(j);
+                    if(k == 0. || yy < 0 || yy >= lny)
+                        continue;
+
+                    const double* rn = hn.data() + yy*lnx;
+                    const double* rd = hd.data() + yy*lnx;
+
+                    for(size_t x = 0; x < nx; x++)
+                    {
+                        on[x] += k * rn[x];
+                        od[x] += k * rd[x];
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     *  @brief FFT convolution
+     *  @details The weighted data and the validity map are packed as the real and imaginary parts of a single complex plane,
+     *  zero padded to a fast FFT length large enough to avoid wrap around. Since the kernel is real, the real and imaginary
+     *  parts of the inverse transform of the product are the convolutions of the data and of the validity map.
+     */
+    void FITSkernel::ApplyFFT(const double* vw, const double* w, double* num, double* den, const size_t& nx, const size_t& ny) const
+    {
+        const size_t px = fast_fft_size(nx + fnx - 1);
+        const size_t py = fast_fft_size(ny + fny - 1);
+        const size_t rx = fnx/2;
+        const size_t ry = fny/2;
+
+        std::vector<double> z(2*px*py, 0.);
+        std::vector<double> k(2*px*py, 0.);
+
+        for(size_t y = 0; y < ny; y++)
+            for(size_t x = 0; x < nx; x++)
+            {
+                z[2*(y*px + x)    ] = vw[y*nx + x];
+                z[2*(y*px + x) + 1] = w [y*nx + x];
+            }
+
+        // kernel centre at the origin
+        for(size_t j = 0; j < fny; j++)
+            for(size_t i = 0; i < fnx; i++)
+            {
+                const size_t xi = (i + px - rx) % px;
+                const size_t yj = (j + py - ry) % py;
+                k[2*(yj*px + xi)] = fweights[j*fnx + i];
+            }
+
+        fft2d(z, px, py, true);
+        fft2d(k, px, py, true);
+
+        detail::parallel_chunks(py, 6*px, [&](size_t y0, size_t y1)
+        {
+            for(size_t q = y0*px; q < y1*px; q++)
+            {
+                const double a = z[2*q], b = z[2*q+1];
+                const double c = k[2*q], d = k[2*q+1];
+                z[2*q  ] = a*c - b*d;
+                z[2*q+1] = a*d + b*c;
+            }
+        });
+
+        k.clear();
+        k.shrink_to_fit();
+
+        fft2d(z, px, py, false);
+
+        for(size_t y = 0; y < ny; y++)
+            for(size_t x = 0; x < nx; x++)
+            {
+                num[y*nx + x] = z[2*(y*px + x)    ];
+                den[y*nx + x] = z[2*(y*px + x) + 1];
+            }
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    double FITSkernel::Sum() const
+    {
+        return std::accumulate(fweights.begin(), fweights.end(), 0.);
+    }
+
+    double FITSkernel::operator()(const size_t& i, const size_t& j) const
+    {
+        if(i >= fnx || j >= fny)
+            throw std::out_of_range("FITSkernel::operator() - index out of range");
+
+        return fweights[j*fnx + i];
+    }
+
+    /**
+     *  @brief Algorithm used to apply this kernel on a nx*ny plane
+     *  @details With method::automatic, separable kernels use two 1D passes, other kernels use the direct sum unless the
+     *  estimated cost of the FFT path is lower.
+     *  @return The resolved algorithm, never method::automatic
+     */
+    FITSkernel::method FITSkernel::Resolve(const method& m, const size_t& nx, const size_t& ny) const
+    {
+        switch(m)
+        {
+            case method::direct:
+            case method::fft:
+                return m;
+
+            case method::separable:
+                if(!isSeparable())
+                    throw FITSexception(BAD_OPTION,"FITSkernel","Resolve","kernel "+fname+" is not separable");
+                return m;
+
+            case method::automatic:
+            default:
+            {
+                if(isSeparable())
+                    return method::separable;
+
+                const double nfft   = static_cast<double>(fast_fft_size(nx + fnx - 1) * fast_fft_size(ny + fny - 1));
+                const double direct = static_cast<double>(nx*ny) * static_cast<double>(fnx*fny);
+                const double fft    = 15. * nfft * std::log2(std::max(2., nfft));
+
+                return (direct > fft) ? method::fft : method::direct;
+            }
+        }
+    }
+
+#pragma endregion
+#pragma region * Modifier
+
+    void FITSkernel::Normalize()
+    {
+        const double s = Sum();
+
+        if(std::abs(s) <= std::numeric_limits<double>::epsilon())
+            throw FITSexception(BAD_OPTION,"FITSkernel","Normalize","kernel weights sum to zero");
+
+        for(double& v : fweights) v /= s;
+
+        if(isSeparable())
+        {
+            const double sx = std::accumulate(fkx.begin(), fkx.end(), 0.);
+            const double sy = std::accumulate(fky.begin(), fky.end(), 0.);
+            for(double& v : fkx) v /= sx;
+            for(double& v : fky) v /= sy;
+        }
+    }
+
+#pragma endregion
+#pragma region * Convolution
+
+    /**
+     *  @details Masked and non finite pixels get a null weight. When the kernel weights do not sum to zero, the result is the normalized
+     *  convolution \f$ S \cdot (K*(w\,v)) / (K*w) \f$ with \f$S\f$ the kernel sum, which equals the plain convolution away from masked pixels and image edges.
+     *  Masked pixels thus receive an estimate from their valid neighbours but stay flagged in the output mask. Pixels without any valid neighbour
+     *  under the kernel are set to 0 and masked. Kernels summing to zero (e.g. Laplacian) are applied without normalization, masked pixels counting as 0.
+     *  \c in / \c out and \c msk / \c omsk may point to the same buffers.
+     */
+    void FITSkernel::Apply(const double* in, const bool* msk, double* out, bool* omsk, const size_t& nx, const size_t& ny, const method& m) const
+    {
+        if(in == nullptr || out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSkernel","Apply","null input or output plane");
+
+        const size_t n = nx*ny;
+        if(n == 0)
+            return;
+
+        std::vector<double> vw(n), w(n);
+        for(size_t k = 0; k < n; k++)
+        {
+            const bool valid = (msk == nullptr || !msk[k]) && std::isfinite(in[k]);
+            w [k] = (valid) ? 1. : 0.;
+            vw[k] = (valid) ? in[k] : 0.;
+        }
+
+        std::vector<double> num(n), den(n);
+
+        switch(Resolve(m, nx, ny))
+        {
+            case method::separable:
+                ApplySeparable(vw.data(), w.data(), num.data(), den.data(), nx, ny);
+                break;
+            case method::fft:
+                ApplyFFT(vw.data(), w.data(), num.data(), den.data(), nx, ny);
+                break;
+            case method::direct:
+            default:
+                ApplyDirect(vw.data(), w.data(), num.data(), den.data(), nx, ny);
+                break;
+        }
+
+        const double ksum = Sum();
+        double kabs = 0.;
+        for(const double& v : fweights) kabs += std::abs(v);
+
+        const bool   normalized = std::abs(ksum) > std::numeric_limits<double>::epsilon() * kabs;
+        const double support    = 1e-9 * kabs;
+
+        for(size_t k = 0; k < n; k++)
+        {
+            const bool masked = (msk != nullptr && msk[k]);
+
+            if(!normalized)
+            {
+                out[k] = num[k];
+                if(omsk != nullptr) omsk[k] = masked;
+                continue;
+            }
+
+            const bool empty = std::abs(den[k]) <= support;
+            out[k] = (empty) ? 0. : ksum * num[k] / den[k];
+
+            if(omsk != nullptr) omsk[k] = masked || empty;
+        }
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -0,0 +1,530 @@
+//
+//  FITSmorphology.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <limits>
+#include <algorithm>
+#include <bit>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSmorphology.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        /**
+         *  @brief Valid bits of the last word of a packed row
+         */
+        inline uint64_t last_word_mask(const size_t& nx)
+        {
+            return (nx % 64 == 0) ? ~uint64_t{0} : (uint64_t{1} << (nx % 64)) - 1;
+        }
+
+        /**
+         *  @brief dst[x] = src[x-s] for the nw words of a packed row, columns shifted in from outside of the row are zero
+         *  @note src and dst may be the same row.
+         */
+        inline void shift_row(const uint64_t* src, uint64_t* dst, const size_t& nw, const long& s)
+        {
+            if(s >= 0)
+            {
+                const size_t q = static_cast<size_t>(s) / 64;
+                const unsigned r = static_cast<unsigned>(s % 64);
+
+                for(size_t i = nw; i-- > 0;)
+                {
+                    if(i < q)
+                    {
+                        dst[i] = 0;
+                        continue;
+                    }
+
+                    uint64_t v = src[i-q] << r;
+                    if(r != 0 && i > q)
+                        v |= src[i-q-1] >> (64 - r);
+
+                    dst[i] = v;
+                }
+            }
+            else
+            {
+                const size_t q = static_cast<size_t>(-s) / 64;
+                const unsigned r = static_cast<unsigned>((-s) % 64);
+
+                for(size_t i = 0; i < nw; i++)
+                {
+                    if(i + q >= nw)
+                    {
+                        dst[i] = 0;
+                        continue;
+                    }
+
+                    uint64_t v = src[i+q] >> r;
+                    if(r != 0 && i + q + 1 < nw)
+                        v |= src[i+q+1] << (64 - r);
+
+                    dst[i] = v;
+                }
+            }
+        }
+
+        /**
+         *  @brief acc |= OR of src shifted by start, start+dir, ..., start+dir*(width-1)
+         *  @details The shifts all go the same direction, so the columns pushed out of the row are never needed again
+         *  and the OR of width shifts is built by doubling with log2(width) shifts.
+         */
+        inline void spread_row(const uint64_t* src, uint64_t* acc, uint64_t* h, uint64_t* t, const size_t& nw,
+                               const long& start, const long& width, const long& dir)
+        {
+            shift_row(src, h, nw, start);
+
+            for(long c = 1; c < width;)
+            {
+                const long s = std::min(c, width - c);
+                shift_row(h, t, nw, dir * s);
+
+                for(size_t i = 0; i < nw; i++)
+                    h[i] |= t[i];
+
+                c += s;
+            }
+
+            for(size_t i = 0; i < nw; i++)
+                acc[i] |= h[i];
+        }
+
+        /**
+         *  @brief Column of the first set bit at or after x, nw*64 if none
+         */
+        inline size_t next_bit(const uint64_t* row, const size_t& nw, const size_t& x, const bool& inverted)
+        {
+            size_t i = x / 64;
+            if(i >= nw)
+                return nw * 64;
+
+            uint64_t w = (inverted ? ~row[i] : row[i]) & (~uint64_t{0} << (x % 64));
+
+            while(w == 0)
+            {
+                if(++i >= nw)
+                    return nw * 64;
+
+                w = inverted ? ~row[i] : row[i];
+            }
+
+            return i * 64 + static_cast<size_t>(std::countr_zero(w));
+        }
+
+        inline void set_bits(uint64_t* row, const size_t& x0, const size_t& x1)
+        {
+            for(size_t x = x0; x <= x1;)
+            {
+                const size_t i = x / 64;
+                const size_t b = x % 64;
+                const size_t n = std::min<size_t>(64 - b, x1 - x + 1);
+
+                row[i] |= ((n == 64) ? ~uint64_t{0} : ((uint64_t{1} << n) - 1)) << b;
+                x += n;
+            }
+        }
+
+        inline uint32_t find_root(std::vector<uint32_t>& parent, uint32_t i)
+        {
+            while(parent[i] != i)
+            {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+            }
+            return i;
+        }
+
+        void complement(const std::vector<uint64_t>& in, std::vector<uint64_t>& out, const size_t& nx, const size_t& ny)
+        {
+            const size_t   nw   = FITSmorphology::Words(nx);
+            const uint64_t last = last_word_mask(nx);
+
+            out.resize(in.size());
+
+            detail::parallel_chunks(ny, nw, [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; y++)
+                {
+                    for(size_t i = y*nw; i < (y+1)*nw; i++)
+                        out[i] = ~in[i];
+
+                    out[(y+1)*nw - 1] &= last;
+                }
+            });
+        }
+    }
+
+#pragma region - FITSmorphology class implementation
+#pragma region * ctor/dtor
+
+    FITSmorphology::FITSmorphology(const shape& s, const size_t& radius)
+    {
+        const size_t n = 2*radius + 1;
+        const long   r = static_cast<long>(radius);
+
+        std::vector<bool> footprint(n*n, false);
+
+        for(long dy = -r; dy <= r; dy++)
+            for(long dx = -r; dx <= r; dx++)
+            {
+                bool in = false;
+                switch(s)
+                {
+                    case shape::box:   in = true; break;
+                    case shape::cross: in = (dx == 0 || dy == 0); break;
+                    case shape::disk:  in = (dx*dx + dy*dy <= r*r); break;
+                }
+
+                footprint[static_cast<size_t>((dy + r) * static_cast<long>(n) + dx + r)] = in;
+            }
+
+        AddSpans(footprint, n, n);
+    }
+
+    FITSmorphology::FITSmorphology(const std::vector<bool>& footprint, const size_t& width, const size_t& height)
+    {
+        if(width % 2 == 0 || height % 2 == 0)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","FITSmorphology","footprint dimensions must be odd");
+
+        if(footprint.size() != width*height)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","FITSmorphology","footprint size mismatch");
+
+        AddSpans(footprint, width, height);
+    }
+
+    /**
+     *  @details Each row of the footprint is split in its runs of pixels, so that non convex elements are supported.
+     */
+    void FITSmorphology::AddSpans(const std::vector<bool>& footprint, const size_t& width, const size_t& height)
+    {
+        const long cx = static_cast<long>(width / 2);
+        const long cy = static_cast<long>(height / 2);
+
+        fspans.clear();
+
+        for(size_t j = 0; j < height; j++)
+            for(size_t i = 0; i < width; i++)
+            {
+                if(!footprint[j*width + i])
+                    continue;
+
+                const size_t i0 = i;
+                while(i + 1 < width && footprint[j*width + i + 1])
+                    i++;
+
+                fspans.push_back({static_cast<long>(j) - cy, static_cast<long>(i0) - cx, static_cast<long>(i) - cx});
+            }
+
+        if(fspans.empty())
+            throw FITSexception(BAD_OPTION,"FITSmorphology","FITSmorphology","empty structuring element");
+
+        std::sort(fspans.begin(), fspans.end(), [](const span& a, const span& b)
+        {
+            if(a.x0 != b.x0) return a.x0 < b.x0;
+            if(a.x1 != b.x1) return a.x1 < b.x1;
+            return a.dy < b.dy;
+        });
+    }
+
+#pragma endregion
+#pragma region * Accessor
+
+    size_t FITSmorphology::Area() const
+    {
+        size_t area = 0;
+        for(const span& s : fspans)
+            area += static_cast<size_t>(s.x1 - s.x0 + 1);
+
+        return area;
+    }
+
+#pragma endregion
+#pragma region * Packed masks
+
+    void FITSmorphology::Pack(const bool* in, const size_t& nx, const size_t& ny, std::vector<uint64_t>& out)
+    {
+        if(in == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSmorphology","Pack","missing mask");
+
+        const size_t nw = Words(nx);
+        out.assign(nw*ny, 0);
+
+        detail::parallel_chunks(ny, nx, [&](size_t begin, size_t end)
+        {
+            for(size_t y = begin; y < end; y++)
+            {
+                const bool* row = in + y*nx;
+
+                for(size_t i = 0; i < nw; i++)
+                {
+                    const size_t x0 = i*64;
+                    const size_t n  = std::min<size_t>(64, nx - x0);
+
+                    uint64_t w = 0;
+                    for(size_t b = 0; b < n; b++)
+                        w |= static_cast<uint64_t>(row[x0 + b]) << b;
+
+                    out[y*nw + i] = w;
+                }
+            }
+        });
+    }
+
+    void FITSmorphology::Unpack(const std::vector<uint64_t>& in, const size_t& nx, const size_t& ny, bool* out)
+    {
+        if(out == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSmorphology","Unpack","missing mask");
+
+        const size_t nw = Words(nx);
+        if(in.size() != nw*ny)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","Unpack","packed mask size mismatch");
+
+        detail::parallel_chunks(ny, nx, [&](size_t begin, size_t end)
+        {
+            for(size_t y = begin; y < end; y++)
+            {
+                bool* row = out + y*nx;
+
+                for(size_t i = 0; i < nw; i++)
+                {
+                    const size_t   x0 = i*64;
+                    const size_t   n  = std::min<size_t>(64, nx - x0);
+                    const uint64_t w  = in[y*nw + i];
+
+                    for(size_t b = 0; b < n; b++)
+                        row[x0 + b] = (w >> b) & 1;
+                }
+            }
+        });
+    }
+
+    /**
+     *  @details out(x,y) = OR over the element of in(x-dx, y-dy), or in(x+dx, y+dy) for the reflected element.
+     *  For each group of spans sharing the same extent, the horizontally spread rows are computed once for the whole plane
+     *  and ORed in the output rows at the row offsets of the group.
+     */
+    void FITSmorphology::Dilate(const std::vector<uint64_t>& in, std::vector<uint64_t>& out, const size_t& nx, const size_t& ny, const bool& reflect) const
+    {
+        const size_t   nw   = Words(nx);
+        const uint64_t last = last_word_mask(nx);
+        const long     lny  = static_cast<long>(ny);
+
+        out.assign(nw*ny, 0);
+        std::vector<uint64_t> spread(nw*ny);
+
+        for(size_t g = 0; g < fspans.size();)
+        {
+            size_t gEnd = g + 1;
+            while(gEnd < fspans.size() && fspans[gEnd].x0 == fspans[g].x0 && fspans[gEnd].x1 == fspans[g].x1)
+                gEnd++;
+
+            const long a = reflect ? -fspans[g].x1 : fspans[g].x0;
+            const long b = reflect ? -fspans[g].x0 : fspans[g].x1;
+
+            size_t steps = 1;
+            while((1L << steps) < b - a + 1)
+                steps++;
+
+            detail::parallel_chunks(ny, 2*nw*steps, [&](size_t begin, size_t end)
+            {
+                std::vector<uint64_t> h(nw);
+                std::vector<uint64_t> t(nw);
+
+                for(size_t y = begin; y < end; y++)
+                {
+                    const uint64_t* src = in.data() + y*nw;
+                    uint64_t*       acc = spread.data() + y*nw;
+
+                    std::fill(acc, acc + nw, 0);
+
+                    // Non negative shifts and negative shifts are spread separately
+                    if(b >= 0)
+                    {
+                        const long lo = std::max(a, 0L);
+                        spread_row(src, acc, h.data(), t.data(), nw, lo, b - lo + 1, 1);
+                    }
+                    if(a < 0)
+                    {
+                        const long hi = std::min(b, -1L);
+                        spread_row(src, acc, h.data(), t.data(), nw, hi, hi - a + 1, -1);
+                    }
+
+                    acc[nw - 1] &= last;
+                }
+            });
+
+            detail::parallel_chunks(ny, nw*(gEnd - g), [&](size_t begin, size_t end)
+            {
+                for(size_t y = begin; y < end; y++)
+                {
+                    uint64_t* dst = out.data() + y*nw;
+
+                    for(size_t k = g; k < gEnd; k++)
+                    {
+                        const long yy = static_cast<long>(y) + (reflect ? fspans[k].dy : -fspans[k].dy);
+                        if(yy < 0 || yy >= lny)
+                            continue;
+
+                        const uint64_t* src = spread.data() + static_cast<size_t>(yy)*nw;
+                        for(size_t i = 0; i < nw; i++)
+                            dst[i] |= src[i];
+                    }
+                }
+            });
+
+            g = gEnd;
+        }
+    }
+
+    void FITSmorphology::Apply(const operation& op, const std::vector<uint64_t>& in, std::vector<uint64_t>& out, const size_t& nx, const size_t& ny) const
+    {
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","Apply","empty plane");
+
+        if(in.size() != Words(nx)*ny)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","Apply","packed mask size mismatch");
+
+        std::vector<uint64_t> tmp;
+
+        auto erode = [&](const std::vector<uint64_t>& src, std::vector<uint64_t>& dst)
+        {
+            std::vector<uint64_t> inv;
+            complement(src, inv, nx, ny);
+            Dilate(inv, dst, nx, ny, true);
+            complement(dst, dst, nx, ny);
+        };
+
+        switch(op)
+        {
+            case operation::dilate:
+                Dilate(in, out, nx, ny, false);
+                break;
+
+            case operation::erode:
+                erode(in, out);
+                break;
+
+            case operation::open:
+                erode(in, tmp);
+                Dilate(tmp, out, nx, ny, false);
+                break;
+
+            case operation::close:
+                Dilate(in, tmp, nx, ny, false);
+                erode(tmp, out);
+                break;
+        }
+    }
+
+    /**
+     *  @details The unmasked runs are merged with the overlapping runs of the previous row, and a set of runs is flagged as soon as
+     *  one of its runs touches the border of the plane. The runs of the sets which are not flagged are then masked.
+     */
+    void FITSmorphology::FillHoles(std::vector<uint64_t>& bits, const size_t& nx, const size_t& ny)
+    {
+        if(nx == 0 || ny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","FillHoles","empty plane");
+
+        const size_t nw = Words(nx);
+        if(bits.size() != nw*ny)
+            throw FITSexception(BAD_DIMEN,"FITSmorphology","FillHoles","packed mask size mismatch");
+
+        struct run {size_t y, x0, x1;};
+
+        std::vector<run>      runs;
+        std::vector<uint32_t> parent;
+        std::vector<bool>     border;
+
+        size_t prev = 0;
+        for(size_t y = 0; y < ny; y++)
+        {
+            const uint64_t* row  = bits.data() + y*nw;
+            const size_t    curr = runs.size();
+
+            for(size_t x = next_bit(row, nw, 0, true); x < nx; x = next_bit(row, nw, x, true))
+            {
+                const size_t e = std::min(nx, next_bit(row, nw, x, false));
+
+                if(runs.size() >= std::numeric_limits<uint32_t>::max())
+                    throw FITSexception(MEMORY_ALLOCATION,"FITSmorphology","FillHoles","too many unmasked runs");
+
+                runs.push_back({y, x, e - 1});
+                parent.push_back(static_cast<uint32_t>(runs.size() - 1));
+                border.push_back(y == 0 || y == ny - 1 || x == 0 || e == nx);
+
+                x = e;
+            }
+
+            // 4-connectivity: runs of consecutive rows are connected if their columns overlap
+            size_t a = prev;
+            size_t b = curr;
+            while(a < curr && b < runs.size())
+            {
+                if(runs[a].x0 <= runs[b].x1 && runs[b].x0 <= runs[a].x1)
+                {
+                    uint32_t ra = find_root(parent, static_cast<uint32_t>(a));
+                    uint32_t rb = find_root(parent, static_cast<uint32_t>(b));
+
+                    if(ra != rb)
+                    {
+                        if(rb < ra)
+                            std::swap(ra, rb);
+
+                        parent[rb] = ra;
+                        border[ra] = border[ra] || border[rb];
+                    }
+                }
+
+                if(runs[a].x1 < runs[b].x1)
+                    a++;
+                else
+                    b++;
+            }
+
+            prev = curr;
+        }
+
+        for(size_t k = 0; k < runs.size(); k++)
+            if(!border[find_root(parent, static_cast<uint32_t>(k))])
+                set_bits(bits.data() + runs[k].y*nw, runs[k].x0, runs[k].x1);
+    }
+
+#pragma endregion
+#pragma region * Masks
+
+    void FITSmorphology::Apply(const operation& op, bool* msk, const size_t& nx, const size_t& ny) const
+    {
+        std::vector<uint64_t> in;
+        std::vector<uint64_t> out;
+
+        Pack(msk, nx, ny, in);
+        Apply(op, in, out, nx, ny);
+        Unpack(out, nx, ny, msk);
+    }
+
+    void FITSmorphology::FillHoles(bool* msk, const size_t& nx, const size_t& ny)
+    {
+        std::vector<uint64_t> bits;
+
+        Pack(msk, nx, ny, bits);
+        FillHoles(bits, nx, ny);
+        Unpack(bits, nx, ny, msk);
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -0,0 +1,268 @@
+//
+//  FITSmosaic.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSmosaic.h>
+#include <DSTfits/FITSimg.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+#pragma region - FITSmosaic class implementation
+#pragma region * ctor/dtor
+
+    FITSmosaic::FITSmosaic(const FITSwcs& target, const std::pair<size_t,size_t>& shape, const FITSinterpolator::method& method, const size_t& tile):
+    fwcs(), fnx(shape.first), fny(shape.second), ftile(tile), fmethod(method), fsum(), fweight(), fninput(0)
+    {
+        if(target.getNumberOfWCS() == 0)
+            throw WCSexception(WCSERR_NULL_POINTER,"FITSmosaic","FITSmosaic","No WCS defined for the target grid");
+
+        if(fnx == 0 || fny == 0)
+            throw FITSexception(BAD_DIMEN,"FITSmosaic","FITSmosaic","empty target grid");
+
+        if(ftile == 0)
+            throw FITSexception(BAD_OPTION,"FITSmosaic","FITSmosaic","tile size should be strictly positive");
+
+        FITSwcs tmp(target, 0);
+        FITSwcs::swap(fwcs, tmp);
+
+        fsum.assign(fnx*fny, 0.);
+        fweight.assign(fnx*fny, 0.);
+    }
+
+#pragma endregion
+#pragma region * Protected member function
+
+    /**
+     *  @details The boundary of the input is sampled every few pixels and projected on the target grid. The bounding box of the projected
+     *  boundary, padded by the interpolation support, is returned as (origin, shape). If part of the boundary can't be projected
+     *  (e.g. beyond the horizon of the target projection) the whole target grid is returned.
+     */
+    std::pair<std::pair<size_t,size_t>,std::pair<size_t,size_t>> FITSmosaic::Footprint(const FITScube& img, const size_t& wcsIndex) const
+    {
+        const std::pair<std::pair<size_t,size_t>,std::pair<size_t,size_t>> all  = {{0,0},{fnx,fny}};
+        const std::pair<std::pair<size_t,size_t>,std::pair<size_t,size_t>> none = {{0,0},{0,0}};
+
+        const size_t naxis = img.getWCS().getNumberOfAxis(wcsIndex);
+        const double nx = static_cast<double>(img.Size(1));
+        const double ny = static_cast<double>(img.Size(2));
+
+        const size_t nstep = 32;
+        pixelVectors px;
+        px.reserve(4*(nstep+1));
+        for(size_t s = 0; s <= nstep; s++)
+        {
+            const double f = static_cast<double>(s)/static_cast<double>(nstep);
+            const double x = -0.5 + f*nx;
+            const double y = -0.5 + f*ny;
+
+            for(const auto& xy : {std::pair<double,double>(x,-0.5), std::pair<double,double>(x,ny-0.5),
+                                  std::pair<double,double>(-0.5,y), std::pair<double,double>(nx-0.5,y)})
+            {
+                pixelCoords p(naxis, 0.);
+                p[0] = xy.first;
+                p[1] = xy.second;
+                px.push_back(std::move(p));
+            }
+        }
+
+        worldVectors wc = img.getWCS().safePixel2world(wcsIndex, px);
+        for(const auto& w : wc)
+            if(w.size() < naxis)
+                return all;
+
+        if(fwcs.getNumberOfAxis(0) != naxis)
+            throw FITSexception(BAD_DIMEN,"FITSmosaic","Footprint","target WCS has "+std::to_string(fwcs.getNumberOfAxis(0))+" axis while image WCS has "+std::to_string(naxis));
+
+        pixelVectors op = fwcs.safeWorld2pixel(0, wc);
+
+        double xmin =  std::numeric_limits<double>::infinity(), ymin =  std::numeric_limits<double>::infinity();
+        double xmax = -std::numeric_limits<double>::infinity(), ymax = -std::numeric_limits<double>::infinity();
+        for(const auto& p : op)
+        {
+            if(p.size() < 2 || !std::isfinite(p[0]) || !std::isfinite(p[1]))
+                return all;
+
+            xmin = std::min(xmin, p[0]); xmax = std::max(xmax, p[0]);
+            ymin = std::min(ymin, p[1]); ymax = std::max(ymax, p[1]);
+        }
+
+        const double pad = static_cast<double>(FITSinterpolator::Support(fmethod)/2 + 1);
+        xmin = std::floor(xmin - pad); xmax = std::ceil(xmax + pad);
+        ymin = std::floor(ymin - pad); ymax = std::ceil(ymax + pad);
+
+        if(xmax < 0. || ymax < 0. || xmin > static_cast<double>(fnx-1) || ymin > static_cast<double>(fny-1))
+            return none;
+
+        const size_t x0 = static_cast<size_t>(std::max(0., xmin));
+        const size_t y0 = static_cast<size_t>(std::max(0., ymin));
+        const size_t x1 = static_cast<size_t>(std::min(static_cast<double>(fnx-1), xmax));
+        const size_t y1 = static_cast<size_t>(std::min(static_cast<double>(fny-1), ymax));
+
+        return {{x0,y0},{x1-x0+1,y1-y0+1}};
+    }
+
+    size_t FITSmosaic::Accumulate(const FITScube& img, const FITScube* weightMap, const double& weight, const size_t& wcsIndex)
+    {
+        if(img.GetDimension() < 2)
+            throw FITSexception(BAD_DIMEN,"FITSmosaic","Add","input image should have at least 2 axis");
+
+        if(img.getNumberOfWCS() <= wcsIndex)
+            throw WCSexception(WCSERR_NULL_POINTER,"FITSmosaic","Add","No WCS at index "+std::to_string(wcsIndex)+" defined in the input image");
+
+        const size_t nx     = img.Size(1);
+        const size_t ny     = img.Size(2);
+        const size_t nplane = nx*ny;
+
+        if(weightMap != nullptr && (weightMap->Size(1) != nx || weightMap->Size(2) != ny))
+            throw FITSexception(BAD_DIMEN,"FITSmosaic","Add","weight map and image shapes differ");
+
+        const auto fp = Footprint(img, wcsIndex);
+        if(fp.second.first == 0 || fp.second.second == 0)
+            return 0;
+
+        std::vector<double> plane;
+        if(!img.CopyAsDouble(plane, nplane))
+            throw FITSexception(SHARED_NULPTR,"FITSmosaic","Add","missing data");
+
+        std::vector<double> wplane;
+        if(weightMap != nullptr && !weightMap->CopyAsDouble(wplane, nplane))
+            throw FITSexception(SHARED_NULPTR,"FITSmosaic","Add","missing weight map data");
+
+        const FITSinterpolator interp(plane.data(), img.raw_mask(), nx, ny, fmethod);
+
+        // weights are resampled with a positive kernel
+        std::unique_ptr<FITSinterpolator> winterp;
+        if(weightMap != nullptr)
+            winterp = std::make_unique<FITSinterpolator>(wplane.data(), weightMap->raw_mask(), nx, ny, FITSinterpolator::method::bilinear);
+
+        std::vector<double> xs, ys;
+        std::vector<double> val(ftile*ftile), wgt(weightMap != nullptr ? ftile*ftile : 0);
+        std::unique_ptr<bool[]> vmsk(new bool[ftile*ftile]);
+        std::unique_ptr<bool[]> wmsk(new bool[ftile*ftile]);
+
+        const size_t xend = fp.first.first  + fp.second.first;
+        const size_t yend = fp.first.second + fp.second.second;
+
+        size_t touched = 0;
+
+        for(size_t ty = fp.first.second; ty < yend; ty += ftile)
+        for(size_t tx = fp.first.first;  tx < xend; tx += ftile)
+        {
+            const size_t tw = std::min(ftile, xend - tx);
+            const size_t th = std::min(ftile, yend - ty);
+            const size_t n  = tw*th;
+
+            img.ReprojectionMap(fwcs, {tx,ty}, {tw,th}, xs, ys, wcsIndex);
+
+            interp.Resample(xs.data(), ys.data(), n, val.data(), vmsk.get());
+            if(winterp)
+                winterp->Resample(xs.data(), ys.data(), n, wgt.data(), wmsk.get());
+
+            for(size_t k = 0; k < n; k++)
+            {
+                if(vmsk[k])
+                    continue;
+
+                const double w = (winterp) ? (wmsk[k] ? 0. : wgt[k]) : weight;
+                if(!(w > 0.) || !std::isfinite(w))
+                    continue;
+
+                const size_t idx = (ty + k/tw)*fnx + tx + k%tw;
+                fsum[idx]    += w*val[k];
+                fweight[idx] += w;
+                touched++;
+            }
+        }
+
+        if(touched > 0)
+            fninput++;
+
+        return touched;
+    }
+
+    std::shared_ptr<FITScube> FITSmosaic::MakeImage(const std::vector<double>& values, const std::string& content) const
+    {
+        std::shared_ptr< FITSimg<float> > img = std::make_shared< FITSimg<float> >(std::vector<size_t>{fnx,fny});
+
+        std::valarray<float>* arr = img->GetData<float>();
+        if(arr == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITSmosaic","MakeImage","missing data");
+
+        for(size_t k = 0; k < values.size(); k++)
+            (*arr)[k] = static_cast<float>(values[k]);
+
+        FITShdu wcs_hdu = fwcs.asFITShdu(0);
+        for(FITSDictionary::const_iterator it = wcs_hdu.begin(); it != wcs_hdu.end(); it++)
+            img->HDU().ValueForKey(it->first,it->second.value(),it->second.type(),it->second.comment());
+
+        img->HDU().ValueForKey("EXTNAME",content,fChar,"Mosaic content");
+        img->HDU().ValueForKey("NCOMBINE",static_cast<uint64_t>(fninput),"Number of co-added images");
+        img->HDU().ValueForKey("MOSAIC",FITSinterpolator::Name(fmethod),fChar,"Mosaic interpolation kernel");
+        img->reLoadWCS();
+
+        return img;
+    }
+
+#pragma endregion
+#pragma region * Co-addition
+
+    size_t FITSmosaic::Add(const FITScube& img, const double& weight, const size_t& wcsIndex)
+    {
+        if(!(weight > 0.) || !std::isfinite(weight))
+            throw FITSexception(BAD_OPTION,"FITSmosaic","Add","weight should be strictly positive");
+
+        return Accumulate(img, nullptr, weight, wcsIndex);
+    }
+
+    size_t FITSmosaic::Add(const FITScube& img, const FITScube& weightMap, const size_t& wcsIndex)
+    {
+        return Accumulate(img, &weightMap, 0., wcsIndex);
+    }
+
+    void FITSmosaic::Reset()
+    {
+        std::fill(fsum.begin(), fsum.end(), 0.);
+        std::fill(fweight.begin(), fweight.end(), 0.);
+        fninput = 0;
+    }
+
+    std::shared_ptr<FITScube> FITSmosaic::Science() const
+    {
+        std::vector<double> mean(fnx*fny, 0.);
+        std::valarray<bool>  empty(false, fnx*fny);
+
+        for(size_t k = 0; k < mean.size(); k++)
+        {
+            if(fweight[k] > 0.)
+                mean[k] = fsum[k]/fweight[k];
+            else
+                empty[k] = true;
+        }
+
+        std::shared_ptr<FITScube> img = MakeImage(mean, "SCIENCE");
+        img->MaskPixels(empty);
+
+        return img;
+    }
+
+    std::shared_ptr<FITScube> FITSmosaic::Weight() const
+    {
+        return MakeImage(fweight, "WEIGHT");
+    }
+
+#pragma endregion
+#pragma endregion
+}
@@ -0,0 +1,209 @@
+//
+//  FITSparallel.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cstdlib>
+#include <string>
+
+#include <DSTfits/FITSparallel.h>
+
+namespace DSL
+{
+    namespace
+    {
+        thread_local size_t workerIndex = static_cast<size_t>(-1);     // Queue of the calling worker, -1 for the other threads
+        thread_local const ThreadPool* workerPool = nullptr;           // Pool of the calling worker
+
+        size_t default_threads()
+        {
+            if(const char* env = std::getenv("DSL_NUM_THREADS"))
+            {
+                try
+                {
+                    const long n = std::stol(env);
+                    if(n > 0)
+                        return static_cast<size_t>(n);
+                }
+                catch(...)
+                {}
+            }
+
+            return std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+    }
+
+#pragma region - ThreadPool class implementation
+#pragma region * ctor/dtor
+
+    ThreadPool::ThreadPool():
+    fpending(0), fnext(0), fstop(false)
+    {
+        Start(default_threads());
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Stop();
+    }
+
+    ThreadPool& ThreadPool::Instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+#pragma endregion
+#pragma region * Workers
+
+    void ThreadPool::Start(const size_t& nthreads)
+    {
+        const size_t nworkers = std::max<size_t>(1, nthreads) - 1;
+
+        fstop = false;
+        fqueues.clear();
+        for(size_t w = 0; w < nworkers; w++)
+            fqueues.emplace_back(std::make_unique<Queue>());
+
+        fworkers.reserve(nworkers);
+        for(size_t w = 0; w < nworkers; w++)
+            fworkers.emplace_back(&ThreadPool::Work, this, w);
+    }
+
+    /**
+     *  @details The workers drain their queues before leaving.
+     */
+    void ThreadPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk(fsleep);
+            fstop = true;
+        }
+        fwake.notify_all();
+
+        for(std::thread& t : fworkers)
+            if(t.joinable())
+                t.join();
+
+        fworkers.clear();
+    }
+
+    void ThreadPool::SetNumberOfThreads(const size_t& nthreads)
+    {
+        std::lock_guard<std::mutex> lk(fconfig);
+
+        const size_t n = (nthreads > 0) ? nthreads : std::max<size_t>(1, std::thread::hardware_concurrency());
+        if(n == NumberOfThreads())
+            return;
+
+        Stop();
+        Start(n);
+    }
+
+    bool ThreadPool::Pop(const size_t& index, Task& task)
+    {
+        const size_t nq = fqueues.size();
+        if(nq == 0 || fpending.load() == 0)
+            return false;
+
+        // Own queue, newest task first
+        if(index < nq)
+        {
+            Queue& q = *fqueues[index];
+            std::lock_guard<std::mutex> lk(q.lock);
+            if(!q.tasks.empty())
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                fpending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        // Steal the oldest task of another queue
+        const size_t first = (index < nq) ? index + 1 : 0;
+        for(size_t k = 0; k < nq; k++)
+        {
+            Queue& q = *fqueues[(first + k) % nq];
+            std::lock_guard<std::mutex> lk(q.lock);
+            if(!q.tasks.empty())
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                fpending.fetch_sub(1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void ThreadPool::Work(const size_t& index)
+    {
+        workerIndex = index;
+        workerPool  = this;
+
+        Task task;
+        while(true)
+        {
+            if(Pop(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lk(fsleep);
+            if(fstop && fpending.load() == 0)
+                break;
+
+            fwake.wait(lk, [this]{ return fstop || fpending.load() > 0; });
+        }
+    }
+
+    /**
+     *  @details Without workers, the task runs immediately on the calling thread.
+     */
+    void ThreadPool::Submit(Task task)
+    {
+        const size_t nq = fqueues.size();
+        if(nq == 0 || fworkers.empty())
+        {
+            task();
+            return;
+        }
+
+        const size_t index = (workerPool == this && workerIndex < nq) ? workerIndex : fnext.fetch_add(1) % nq;
+
+        // Counted before being queued, so that the count never goes below the number of queued tasks
+        {
+            std::lock_guard<std::mutex> lk(fsleep);
+            fpending.fetch_add(1);
+        }
+
+        {
+            Queue& q = *fqueues[index];
+            std::lock_guard<std::mutex> lk(q.lock);
+            q.tasks.push_back(std::move(task));
+        }
+        fwake.notify_one();
+    }
+
+    bool ThreadPool::RunPendingTask()
+    {
+        Task task;
+        if(!Pop((workerPool == this) ? workerIndex : static_cast<size_t>(-1), task))
+            return false;
+
+        task();
+        return true;
+    }
+
+#pragma endregion
+#pragma endregion
+}
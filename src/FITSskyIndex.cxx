@@ -0,0 +1,555 @@
+//
+//  FITSskyIndex.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <array>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSskyIndex.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        constexpr double kD2R = M_PI/180.;
+        constexpr double kR2D = 180./M_PI;
+        constexpr int    kMaxOrder = 29;
+
+        using vec3 = std::array<double,3>;
+
+        inline vec3 toVector(const double& ra, const double& dec)
+        {
+            const double c = std::cos(dec*kD2R);
+            return {c*std::cos(ra*kD2R), c*std::sin(ra*kD2R), std::sin(dec*kD2R)};
+        }
+
+        inline double dot(const vec3& a, const vec3& b) {return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];}
+
+        inline vec3 cross(const vec3& a, const vec3& b)
+        {
+            return {a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]};
+        }
+
+        inline double angle(const vec3& a, const vec3& b)
+        {
+            const vec3 c = cross(a, b);
+            return std::atan2(std::sqrt(dot(c, c)), dot(a, b));
+        }
+
+        inline uint64_t numberOfPixels(const int& order) {return uint64_t(12) << (2*order);}
+
+        /// Bits of v moved to the even bits of the result
+        inline uint64_t spread(uint64_t v)
+        {
+            v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+            v = (v | (v <<  8)) & 0x00FF00FF00FF00FFull;
+            v = (v | (v <<  4)) & 0x0F0F0F0F0F0F0F0Full;
+            v = (v | (v <<  2)) & 0x3333333333333333ull;
+            v = (v | (v <<  1)) & 0x5555555555555555ull;
+            return v;
+        }
+
+        /// Even bits of v packed in the low bits of the result
+        inline uint64_t compress(uint64_t v)
+        {
+            v &= 0x5555555555555555ull;
+            v = (v | (v >>  1)) & 0x3333333333333333ull;
+            v = (v | (v >>  2)) & 0x0F0F0F0F0F0F0F0Full;
+            v = (v | (v >>  4)) & 0x00FF00FF00FF00FFull;
+            v = (v | (v >>  8)) & 0x0000FFFF0000FFFFull;
+            v = (v | (v >> 16)) & 0x00000000FFFFFFFFull;
+            return v;
+        }
+
+        inline uint64_t xyf2nest(const int& order, const uint64_t& ix, const uint64_t& iy, const uint64_t& face)
+        {
+            return (face << (2*order)) + spread(ix) + (spread(iy) << 1);
+        }
+
+        void checkOrder(const int& order, const char* function)
+        {
+            if(order < 0 || order > kMaxOrder)
+                throw FITSexception(BAD_OPTION,"FITSskyIndex",function,"HEALPix order must be between 0 and "+std::to_string(kMaxOrder));
+        }
+
+        /**
+         *  @brief Longitudes or latitudes of a table column, read in place
+         */
+        class positions
+        {
+        private:
+            const std::vector<double>* fd = nullptr;
+            const std::vector<float>*  ff = nullptr;
+
+        public:
+            positions(const FITStable& table, const std::string& name)
+            {
+                const std::type_index type = table.getColumn(name)->payloadType();
+                if(type == std::type_index(typeid(double)))
+                    fd = &table.column<double>(name).data();
+                else if(type == std::type_index(typeid(float)))
+                    ff = &table.column<float>(name).data();
+                else
+                    throw FITSexception(BAD_TFORM_DTYPE,"FITSskyIndex","positions","column "+name+" must hold float or double scalars");
+            }
+
+            inline size_t size() const {return fd ? fd->size() : ff->size();}
+            inline double operator[](const size_t& k) const {return fd ? (*fd)[k] : static_cast<double>((*ff)[k]);}
+        };
+    }
+
+#pragma region - FITSskyIndex HEALPix
+
+    /**
+     *  @details Same algorithm as ang2pix_nest of the HEALPix library. The pixels of the polar caps are computed from cos(dec) close to
+     *  the poles, to keep their precision at high orders.
+     *  @return Pixel number, 12*4^order for an undefined position
+     */
+    uint64_t FITSskyIndex::Ang2Pix(const int& order, const double& ra, const double& dec)
+    {
+        checkOrder(order, "Ang2Pix");
+
+        if(!std::isfinite(ra) || !std::isfinite(dec) || std::abs(dec) > 90.)
+            return numberOfPixels(order);
+
+        const uint64_t nside = uint64_t(1) << order;
+        const double   z     = std::sin(dec*kD2R);
+        const double   za    = std::abs(z);
+
+        double tt = std::fmod(ra/90., 4.);
+        if(tt < 0.)
+            tt += 4.;
+
+        if(za <= 2./3.)
+        {
+            // Equatorial region
+            const double   t1  = static_cast<double>(nside)*(0.5 + tt);
+            const double   t2  = static_cast<double>(nside)*(0.75*z);
+            const uint64_t jp  = static_cast<uint64_t>(t1 - t2);      // Ascending edge line
+            const uint64_t jm  = static_cast<uint64_t>(t1 + t2);      // Descending edge line
+            const uint64_t ifp = jp >> order;
+            const uint64_t ifm = jm >> order;
+            const uint64_t face = (ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8));
+
+            return xyf2nest(order, jm & (nside - 1), nside - (jp & (nside - 1)) - 1, face);
+        }
+
+        // Polar caps
+        const uint64_t ntt = std::min<uint64_t>(3, static_cast<uint64_t>(tt));
+        const double   tp  = tt - static_cast<double>(ntt);
+        const double   tmp = (za < 0.99) ? static_cast<double>(nside)*std::sqrt(3.*(1. - za))
+                                         : static_cast<double>(nside)*std::cos(dec*kD2R)/std::sqrt((1. + za)/3.);
+
+        const uint64_t jp = std::min(nside - 1, static_cast<uint64_t>(tp*tmp));
+        const uint64_t jm = std::min(nside - 1, static_cast<uint64_t>((1. - tp)*tmp));
+
+        return (z >= 0.) ? xyf2nest(order, nside - jm - 1, nside - jp - 1, ntt) : xyf2nest(order, jp, jm, ntt + 8);
+    }
+
+    /**
+     *  @details Same algorithm as pix2ang_nest of the HEALPix library.
+     */
+    void FITSskyIndex::Pix2Ang(const int& order, const uint64_t& pixel, double& ra, double& dec)
+    {
+        checkOrder(order, "Pix2Ang");
+
+        if(pixel >= numberOfPixels(order))
+            throw FITSexception(BAD_OPTION,"FITSskyIndex","Pix2Ang","pixel "+std::to_string(pixel)+" out of range for order "+std::to_string(order));
+
+        static constexpr int64_t jrll[12] = {2,2,2,2,3,3,3,3,4,4,4,4};
+        static constexpr int64_t jpll[12] = {1,3,5,7,0,2,4,6,1,3,5,7};
+
+        const int64_t  nside = int64_t(1) << order;
+        const int64_t  nl4   = 4*nside;
+        const double   fact2 = 4./static_cast<double>(numberOfPixels(order));
+        const double   fact1 = static_cast<double>(2*nside)*fact2;
+
+        const uint64_t face = pixel >> (2*order);
+        const uint64_t ipf  = pixel & ((uint64_t(1) << (2*order)) - 1);
+        const int64_t  ix   = static_cast<int64_t>(compress(ipf));
+        const int64_t  iy   = static_cast<int64_t>(compress(ipf >> 1));
+        const int64_t  jr   = (jrll[face] << order) - ix - iy - 1;
+
+        int64_t nr     = nside;
+        int64_t kshift = 0;
+        double  z = 0., sth = 0.;
+        if(jr < nside)
+        {
+            nr = jr;
+            const double tmp = static_cast<double>(nr*nr)*fact2;
+            z   = 1. - tmp;
+            sth = std::sqrt(tmp*(2. - tmp));
+        }
+        else if(jr > 3*nside)
+        {
+            nr = nl4 - jr;
+            const double tmp = static_cast<double>(nr*nr)*fact2;
+            z   = tmp - 1.;
+            sth = std::sqrt(tmp*(2. - tmp));
+        }
+        else
+        {
+            kshift = (jr - nside) & 1;
+            z   = static_cast<double>(2*nside - jr)*fact1;
+            sth = std::sqrt((1. - z)*(1. + z));
+        }
+
+        int64_t jp = (jpll[face]*nr + ix - iy + 1 + kshift)/2;
+        if(jp > nl4) jp -= nl4;
+        if(jp < 1)   jp += nl4;
+
+        ra  = (static_cast<double>(jp) - 0.5*static_cast<double>(kshift + 1))*(90./static_cast<double>(nr));
+        dec = std::atan2(z, sth)*kR2D;
+    }
+
+    /**
+     *  @details Same bound as max_pixrad of the HEALPix library: distance between the centre of an equatorial pixel at z = 2/3 and the
+     *  corner of a polar pixel.
+     */
+    double FITSskyIndex::MaxPixelRadius(const int& order)
+    {
+        checkOrder(order, "MaxPixelRadius");
+
+        const double nside = static_cast<double>(uint64_t(1) << order);
+        auto zphi = [](const double& z, const double& phi)->vec3
+        {
+            const double sth = std::sqrt((1. - z)*(1. + z));
+            return {sth*std::cos(phi), sth*std::sin(phi), z};
+        };
+
+        double t1 = 1. - 1./nside;
+        t1 *= t1;
+        return angle(zphi(2./3., M_PI/(4.*nside)), zphi(1. - t1/3., 0.));
+    }
+
+#pragma endregion
+#pragma region - FITSskyIndex ctor
+
+    FITSskyIndex::FITSskyIndex(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const int& order):
+    ftable(&table), fra(raColumn), fdec(decColumn), forder(order), fentries(), fvalid(0)
+    {
+        checkOrder(order, "FITSskyIndex");
+
+        const positions ra (table, raColumn);
+        const positions dec(table, decColumn);
+        if(ra.size() != dec.size())
+            throw FITSexception(BAD_DIMEN,"FITSskyIndex","FITSskyIndex","columns "+raColumn+" and "+decColumn+" have different sizes");
+
+        std::vector<uint64_t> pixels(ra.size());
+        parallel_for(0, pixels.size(), 16384, [&](size_t begin, size_t end)
+        {
+            for(size_t k = begin; k < end; k++)
+                pixels[k] = Ang2Pix(order, ra[k], dec[k]);
+        });
+
+        Sort(pixels);
+    }
+
+    FITSskyIndex::FITSskyIndex(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const int& order, const std::vector<uint64_t>& pixels):
+    ftable(&table), fra(raColumn), fdec(decColumn), forder(order), fentries(), fvalid(0)
+    {
+        checkOrder(order, "FromColumn");
+
+        const positions ra (table, raColumn);
+        const positions dec(table, decColumn);
+        if(ra.size() != pixels.size() || dec.size() != pixels.size())
+            throw FITSexception(BAD_DIMEN,"FITSskyIndex","FromColumn","the companion column and the coordinate columns have different sizes");
+
+        Sort(pixels);
+    }
+
+    FITSskyIndex FITSskyIndex::FromColumn(const FITStable& table, const std::string& raColumn, const std::string& decColumn, const std::string& column)
+    {
+        if(!table.HDU().Exists("HPXORDER"))
+            throw FITSexception(BAD_OPTION,"FITSskyIndex","FromColumn","no HPXORDER keyword in the table header");
+
+        const int order = static_cast<int>(table.HDU().GetInt32ValueForKey("HPXORDER"));
+        checkOrder(order, "FromColumn");
+
+        const std::vector<int64_t>& saved = table.column<int64_t>(column).data();
+        const uint64_t npix = numberOfPixels(order);
+
+        std::vector<uint64_t> pixels(saved.size());
+        parallel_for(0, saved.size(), 65536, [&](size_t begin, size_t end)
+        {
+            for(size_t k = begin; k < end; k++)
+                pixels[k] = (saved[k] < 0 || static_cast<uint64_t>(saved[k]) >= npix) ? npix : static_cast<uint64_t>(saved[k]);
+        });
+
+        return FITSskyIndex(table, raColumn, decColumn, order, pixels);
+    }
+
+#pragma endregion
+#pragma region - FITSskyIndex protected member function
+
+    /**
+     *  @brief Sort the rows by pixel
+     *  @details The rows are first distributed, chunk by chunk in parallel, into buckets of consecutive pixels given by the high bits of
+     *  the pixel numbers (at most 2^16 buckets), then the buckets are sorted independently. Rows of a same pixel keep the table order.
+     */
+    void FITSskyIndex::Sort(const std::vector<uint64_t>& pixels)
+    {
+        const size_t   n    = pixels.size();
+        const uint64_t npix = numberOfPixels(forder);
+
+        const int    bits   = std::bit_width(npix);
+        const int    shift  = std::max(0, bits - 16);
+        const size_t nb     = static_cast<size_t>(npix >> shift) + 1;
+        const size_t chunks = std::clamp<size_t>(n/65536, 1, 4*GetNumberOfThreads());
+
+        auto chunkBegin = [&](const size_t& c){return c*n/chunks;};
+
+        // Number of rows per chunk and per bucket
+        std::vector<size_t> offsets(chunks*nb, 0);
+        parallel_for(0, chunks, 1, [&](size_t c0, size_t c1)
+        {
+            for(size_t c = c0; c < c1; c++)
+                for(size_t k = chunkBegin(c); k < chunkBegin(c+1); k++)
+                    offsets[c*nb + (pixels[k] >> shift)]++;
+        });
+
+        // First position of each chunk in each bucket
+        std::vector<size_t> buckets(nb + 1, 0);
+        size_t position = 0;
+        for(size_t b = 0; b < nb; b++)
+        {
+            buckets[b] = position;
+            for(size_t c = 0; c < chunks; c++)
+            {
+                const size_t count = offsets[c*nb + b];
+                offsets[c*nb + b] = position;
+                position += count;
+            }
+        }
+        buckets[nb] = position;
+
+        fentries.resize(n);
+        parallel_for(0, chunks, 1, [&](size_t c0, size_t c1)
+        {
+            for(size_t c = c0; c < c1; c++)
+                for(size_t k = chunkBegin(c); k < chunkBegin(c+1); k++)
+                    fentries[offsets[c*nb + (pixels[k] >> shift)]++] = entry{pixels[k], k};
+        });
+
+        parallel_for(0, nb, 64, [&](size_t b0, size_t b1)
+        {
+            for(size_t b = b0; b < b1; b++)
+                std::stable_sort(fentries.begin() + static_cast<std::ptrdiff_t>(buckets[b]), fentries.begin() + static_cast<std::ptrdiff_t>(buckets[b+1]),
+                                 [](const entry& a, const entry& c){return a.pixel < c.pixel;});
+        });
+
+        fvalid = static_cast<size_t>(std::lower_bound(fentries.begin(), fentries.end(), npix, [](const entry& e, const uint64_t& p){return e.pixel < p;}) - fentries.begin());
+    }
+
+    /**
+     *  @brief Range of fentries holding the rows of a pixel of a given order
+     */
+    std::pair<size_t,size_t> FITSskyIndex::Rows(const int& order, const uint64_t& pixel) const
+    {
+        const int shift = 2*(forder - order);
+        const auto less = [](const entry& e, const uint64_t& p){return e.pixel < p;};
+        const auto end  = fentries.begin() + static_cast<std::ptrdiff_t>(fvalid);
+
+        const auto lo = std::lower_bound(fentries.begin(), end, pixel << shift, less);
+        const auto hi = std::lower_bound(lo, end, (pixel + 1) << shift, less);
+        return {static_cast<size_t>(lo - fentries.begin()), static_cast<size_t>(hi - fentries.begin())};
+    }
+
+    /**
+     *  @brief Descend the HEALPix hierarchy
+     *  @param inside: bool(const vec3&), test of the position of a row
+     *  @param classify: int(const vec3& centre, const double& radius), -1 if a disc is outside of the region, 1 if it is inside, else 0
+     */
+    template<typename Inside, typename Classify>
+    RowSet FITSskyIndex::Query(Inside&& inside, Classify&& classify) const
+    {
+        if(ftable->nrows() != fentries.size())
+            throw FITSexception(BAD_DIMEN,"FITSskyIndex","Query","the table has "+std::to_string(ftable->nrows())+" rows while "+std::to_string(fentries.size())+" were indexed");
+
+        const positions ra (*ftable, fra);
+        const positions dec(*ftable, fdec);
+
+        std::vector<double> radius(static_cast<size_t>(forder) + 1);
+        for(int o = 0; o <= forder; o++)
+            radius[static_cast<size_t>(o)] = MaxPixelRadius(o);
+
+        std::vector<size_t> rows;
+        std::vector<std::pair<int,uint64_t>> pending;
+        for(uint64_t p = 12; p-- > 0; )
+            pending.emplace_back(0, p);
+
+        while(!pending.empty())
+        {
+            const auto [order, pixel] = pending.back();
+            pending.pop_back();
+
+            const std::pair<size_t,size_t> range = Rows(order, pixel);
+            if(range.first == range.second)
+                continue;
+
+            double cra = 0., cdec = 0.;
+            Pix2Ang(order, pixel, cra, cdec);
+            const int state = classify(toVector(cra, cdec), radius[static_cast<size_t>(order)]);
+
+            if(state < 0)
+                continue;
+
+            if(state > 0)
+            {
+                for(size_t k = range.first; k < range.second; k++)
+                    rows.push_back(fentries[k].row);
+            }
+            else if(order == forder)
+            {
+                for(size_t k = range.first; k < range.second; k++)
+                {
+                    const size_t row = fentries[k].row;
+                    if(inside(toVector(ra[row], dec[row])))
+                        rows.push_back(row);
+                }
+            }
+            else
+            {
+                for(uint64_t child = 4; child-- > 0; )
+                    pending.emplace_back(order + 1, 4*pixel + child);
+            }
+        }
+
+        return RowSet(std::move(rows));
+    }
+
+#pragma endregion
+#pragma region - FITSskyIndex query
+
+    RowSet FITSskyIndex::Cone(const double& ra, const double& dec, const double& radius) const
+    {
+        if(!std::isfinite(ra) || !std::isfinite(dec) || !(radius >= 0.))
+            throw FITSexception(BAD_OPTION,"FITSskyIndex","Cone","undefined centre or negative radius");
+
+        const vec3   centre = toVector(ra, dec);
+        const double r      = std::min(radius, 180.)*kD2R;
+        const double chord2 = 4.*std::pow(std::sin(0.5*r), 2);      // Squared chord of the radius, accurate for small cones
+
+        return Query([&](const vec3& v)
+                     {
+                         const double dx = v[0] - centre[0], dy = v[1] - centre[1], dz = v[2] - centre[2];
+                         return dx*dx + dy*dy + dz*dz <= chord2;
+                     },
+                     [&](const vec3& c, const double& pixelRadius)
+                     {
+                         const double a = angle(c, centre);
+                         if(a > r + pixelRadius)
+                             return -1;
+                         return (a + pixelRadius <= r) ? 1 : 0;
+                     });
+    }
+
+    /**
+     *  @details The inner side of each edge is given by the normal of its great circle; a pixel is pruned when its disc lies beyond one
+     *  edge and taken as a whole when it lies within all of them.
+     */
+    RowSet FITSskyIndex::Polygon(const std::vector<std::pair<double,double>>& vertices) const
+    {
+        const size_t n = vertices.size();
+        if(n < 3)
+            throw FITSexception(BAD_OPTION,"FITSskyIndex","Polygon","a polygon needs at least 3 vertices");
+
+        std::vector<vec3> v(n), normals(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            if(!std::isfinite(vertices[i].first) || !std::isfinite(vertices[i].second))
+                throw FITSexception(BAD_OPTION,"FITSskyIndex","Polygon","undefined vertex");
+            v[i] = toVector(vertices[i].first, vertices[i].second);
+        }
+
+        for(size_t i = 0; i < n; i++)
+        {
+            normals[i] = cross(v[i], v[(i+1)%n]);
+            const double norm = std::sqrt(dot(normals[i], normals[i]));
+            if(!(norm > 0.))
+                throw FITSexception(BAD_OPTION,"FITSskyIndex","Polygon","degenerate edge");
+            for(double& x : normals[i])
+                x /= norm;
+        }
+
+        // Orientation and convexity: every vertex on the same side of every edge
+        double sign = 0.;
+        for(size_t i = 0; i < n; i++)
+            for(size_t j = 0; j < n; j++)
+            {
+                if(j == i || j == (i+1)%n)
+                    continue;
+
+                const double d = dot(normals[i], v[j]);
+                if(sign == 0.)
+                    sign = (d > 0.) ? 1. : -1.;
+                if(d*sign <= 0.)
+                    throw FITSexception(BAD_OPTION,"FITSskyIndex","Polygon","the polygon must be convex");
+            }
+
+        for(vec3& normal : normals)
+            for(double& x : normal)
+                x *= sign;
+
+        return Query([&](const vec3& p)
+                     {
+                         for(const vec3& normal : normals)
+                             if(dot(normal, p) < 0.)
+                                 return false;
+                         return true;
+                     },
+                     [&](const vec3& c, const double& pixelRadius)
+                     {
+                         const double s = std::sin(pixelRadius);
+                         int state = 1;
+                         for(const vec3& normal : normals)
+                         {
+                             const double d = dot(normal, c);
+                             if(d < -s)
+                                 return -1;
+                             if(d < s)
+                                 state = 0;
+                         }
+                         return state;
+                     });
+    }
+
+#pragma endregion
+#pragma region - FITSskyIndex persistence
+
+    void FITSskyIndex::Save(FITStable& table, const std::string& column) const
+    {
+        const FITStable::clist columns = table.listColumns();
+        if(std::any_of(columns.cbegin(), columns.cend(), [&column](const std::vector<std::string>& c){return !c.empty() && c[0] == column;}))
+            throw FITSexception(BAD_OPTION,"FITSskyIndex","Save","column "+column+" already exists in the table");
+
+        auto col = std::make_unique< FITScolumn<int64_t> >(column, tlonglong, "");
+        std::vector<int64_t>& pixels = col->values<int64_t>();
+        pixels.assign(fentries.size(), -1);
+
+        parallel_for(0, fvalid, 65536, [&](size_t begin, size_t end)
+        {
+            for(size_t k = begin; k < end; k++)
+                pixels[fentries[k].row] = static_cast<int64_t>(fentries[k].pixel);
+        });
+
+        table.InsertColumn(std::unique_ptr<FITSform>(std::move(col)));
+        table.HDU().ValueForKey("HPXORDER", static_cast<int32_t>(forder), "HEALPix NESTED order of "+column);
+    }
+
+#pragma endregion
+}
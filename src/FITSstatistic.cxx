@@ -7,13 +7,824 @@
 
 
 #include <FITSstatistic.h>
+#include <FITSparallel.h>
+#include <FITShistogram.h>
 #include <cmath>
 #include <stdexcept>
+#include <algorithm>
 
 namespace DSL
 {
     namespace stat
     {
+        namespace
+        {
+            /**
+             *  @brief Place the order statistics of ranks [rbegin,rend) at their position in [first,last)
+             *  @param offset: Rank of *first
+             */
+            void multi_select(double* first, double* last, const size_t* rbegin, const size_t* rend, size_t offset)
+            {
+                while(rbegin < rend && first < last)
+                {
+                    if(last - first <= 32)
+                    {
+                        std::sort(first, last);
+                        return;
+                    }
+
+                    const size_t* mid = rbegin + (rend - rbegin) / 2;
+                    double*       nth = first + (*mid - offset);
+
+                    std::nth_element(first, nth, last);
+                    multi_select(first, nth, rbegin, mid, offset);
+
+                    first  = nth + 1;
+                    offset = *mid + 1;
+                    rbegin = mid + 1;
+                }
+            }
+
+            using valueWeight = std::pair<double,double>;
+
+            /**
+             *  @brief Weighted quantile request: target cumulated weight and group of equal values whose weight segment contains it
+             */
+            struct weightTarget
+            {
+                double t;           //!< Target cumulated weight
+                size_t index;       //!< Index of the request
+                size_t first;       //!< First position of the group
+                size_t last;        //!< Past the end position of the group
+                double before;      //!< Cumulated weight of the values below the group
+                double weight;      //!< Weight of the group
+            };
+
+            /**
+             *  @brief Place the groups of equal values whose weight segments contain the targets [tb,te), sorted by t, at their position in [first,last)
+             *  @details Ranges are split in values below, equal to and above their median value, so that equal values are never split
+             *  between two ranges. The values put at their sorted position are flagged in final.
+             *  @param W0: Cumulated weight of the values before first
+             */
+            void weighted_select(valueWeight* base, size_t first, size_t last, double W0, weightTarget* tb, weightTarget* te, std::vector<char>& final)
+            {
+                auto byValue = [](const valueWeight& a, const valueWeight& b){return a.first < b.first;};
+
+                auto assign = [](weightTarget* t, const size_t& g0, const size_t& g1, const double& before, const double& weight)
+                {
+                    t->first  = g0;
+                    t->last   = g1;
+                    t->before = before;
+                    t->weight = weight;
+                };
+
+                while(tb < te && first < last)
+                {
+                    if(last - first <= 32)
+                    {
+                        std::sort(base + first, base + last, byValue);
+                        std::fill(final.begin() + first, final.begin() + last, 1);
+
+                        double S = W0;
+                        for(size_t g0 = first; g0 < last && tb < te;)
+                        {
+                            size_t g1 = g0;
+                            double w  = 0.;
+                            for(; g1 < last && base[g1].first == base[g0].first; g1++)
+                                w += base[g1].second;
+
+                            // The last group takes the targets left by the rounding of the cumulated weights
+                            for(; tb < te && (tb->t < S + w || g1 == last); ++tb)
+                                assign(tb, g0, g1, S, w);
+
+                            S += w;
+                            g0 = g1;
+                        }
+                        return;
+                    }
+
+                    const size_t mid = first + (last - first) / 2;
+                    std::nth_element(base + first, base + mid, base + last, byValue);
+
+                    const double pivot = base[mid].first;
+                    const size_t g0 = static_cast<size_t>(std::partition(base + first, base + mid, [pivot](const valueWeight& x){return x.first < pivot;}) - base);
+                    const size_t g1 = static_cast<size_t>(std::partition(base + mid, base + last, [pivot](const valueWeight& x){return x.first == pivot;}) - base);
+                    std::fill(final.begin() + g0, final.begin() + g1, 1);
+
+                    double Wg0 = W0;
+                    for(size_t k = first; k < g0; k++)
+                        Wg0 += base[k].second;
+
+                    double w = 0.;
+                    for(size_t k = g0; k < g1; k++)
+                        w += base[k].second;
+
+                    weightTarget* tl = tb;
+                    while(tl < te && tl->t < Wg0)
+                        ++tl;
+                    weighted_select(base, first, g0, W0, tb, tl, final);
+
+                    weightTarget* tm = tl;
+                    for(; tm < te && (tm->t < Wg0 + w || g1 == last); ++tm)
+                        assign(tm, g0, g1, Wg0, w);
+
+                    tb    = tm;
+                    W0    = Wg0 + w;
+                    first = g1;
+                }
+            }
+
+            /**
+             *  @brief Value and weight of the group of equal values next to [g0,g1), below if step < 0, above otherwise
+             *  @details Consecutive ranges of the partition hold strictly ordered values: the neighbour group is either the adjacent run of
+             *  a range put at its sorted position or the extremum of an unsorted range, all its values lying in this range.
+             *  @return false if there is no such group
+             */
+            bool neighbour_group(const valueWeight* base, const size_t& m, const std::vector<char>& final, const size_t& g0, const size_t& g1, const int& step, double& value, double& weight)
+            {
+                if((step < 0 && g0 == 0) || (step > 0 && g1 == m))
+                    return false;
+
+                size_t k = (step < 0) ? g0 - 1 : g1;
+                const bool sorted = final[k];
+
+                value  = base[k].first;
+                weight = 0.;
+
+                while(true)
+                {
+                    const double v = base[k].first;
+
+                    if(sorted)
+                    {
+                        if(!final[k] || v != value)
+                            break;
+                        weight += base[k].second;
+                    }
+                    else
+                    {
+                        if(final[k])
+                            break;
+                        if((step < 0) ? v > value : v < value)
+                        {
+                            value  = v;
+                            weight = 0.;
+                        }
+                        if(v == value)
+                            weight += base[k].second;
+                    }
+
+                    if((step < 0 && k == 0) || (step > 0 && k + 1 == m))
+                        break;
+                    k = (step < 0) ? k - 1 : k + 1;
+                }
+
+                return true;
+            }
+
+            /**
+             *  @brief Replace the values by their deviations to a center
+             */
+            void deviate(double* values, const size_t& n, const double& center)
+            {
+                parallel_for(0, n, 32768, [values, center](size_t begin, size_t end)
+                {
+                    for(size_t k = begin; k < end; k++)
+                        values[k] -= center;
+                });
+            }
+
+            /**
+             *  @brief Median of the absolute values, by selection, the values being reordered
+             *  @details Interpolated as in Quantiles: the mean of the two central order statistics for an even number of values.
+             */
+            double abs_median(double* values, const size_t& n)
+            {
+                auto absLess = [](const double& a, const double& b){return std::abs(a) < std::abs(b);};
+
+                const size_t hi = n / 2;
+                std::nth_element(values, values + hi, values + n, absLess);
+                if(n % 2 == 1)
+                    return std::abs(values[hi]);
+
+                return 0.5 * (std::abs(*std::max_element(values, values + hi, absLess)) + std::abs(values[hi]));
+            }
+
+            /**
+             *  @brief Numerator and denominator of the biweight location, given the deviations to the median
+             */
+            std::pair<double,double> biweight_location_sums(const double* dev, const size_t& n, const double& cmad)
+            {
+                return parallel_reduce(size_t{0}, n, 32768, std::pair<double,double>(0.,0.), [dev, cmad](size_t begin, size_t end)
+                {
+                    double num = 0., den = 0.;
+                    for(size_t k = begin; k < end; k++)
+                    {
+                        const double u = dev[k] / cmad;
+                        if(std::abs(u) < 1.)
+                        {
+                            const double w = (1. - u*u) * (1. - u*u);
+                            num += dev[k] * w;
+                            den += w;
+                        }
+                    }
+                    return std::pair<double,double>(num, den);
+                },
+                [](const std::pair<double,double>& a, const std::pair<double,double>& b){return std::pair<double,double>(a.first + b.first, a.second + b.second);});
+            }
+
+            /**
+             *  @brief Numerator and denominator of the biweight midvariance, given the deviations to the median
+             */
+            std::pair<double,double> biweight_scale_sums(const double* dev, const size_t& n, const double& cmad)
+            {
+                return parallel_reduce(size_t{0}, n, 32768, std::pair<double,double>(0.,0.), [dev, cmad](size_t begin, size_t end)
+                {
+                    double num = 0., den = 0.;
+                    for(size_t k = begin; k < end; k++)
+                    {
+                        const double u2 = (dev[k] / cmad) * (dev[k] / cmad);
+                        if(u2 < 1.)
+                        {
+                            const double a = 1. - u2;
+                            num += dev[k] * dev[k] * a*a*a*a;
+                            den += a * (1. - 5.*u2);
+                        }
+                    }
+                    return std::pair<double,double>(num, den);
+                },
+                [](const std::pair<double,double>& a, const std::pair<double,double>& b){return std::pair<double,double>(a.first + b.first, a.second + b.second);});
+            }
+
+            double biweight_scale(const double* dev, const size_t& n, const double& mad, const double& c)
+            {
+                if(!(mad > 0.))
+                    return 0.;
+
+                const std::pair<double,double> s = biweight_scale_sums(dev, n, c*mad);
+                return std::sqrt(static_cast<double>(n) * s.first) / std::abs(s.second);
+            }
+
+            /**
+             *  @brief Histogram mode of the values, the median being read from the same selection
+             *  @see Mode
+             */
+            double histogram_mode(double* values, const size_t& n, double& median)
+            {
+                const bool integral = parallel_reduce(size_t{0}, n, 32768, true, [values](size_t begin, size_t end)
+                {
+                    for(size_t k = begin; k < end; k++)
+                        if(values[k] != std::floor(values[k]))
+                            return false;
+                    return true;
+                },
+                [](const bool& a, const bool& b){return a && b;});
+
+                const std::vector<double> q = Quantiles(values, n, {0.25, 0.5, 0.75});
+                median = q[1];
+
+                const double iqr = q[2] - q[0];
+                if(!(iqr > 0.))
+                    return median;
+
+                double width = 2. * iqr / std::cbrt(static_cast<double>(n));
+                double low   = q[0] - 2.*iqr;
+                if(integral)
+                {
+                    width = std::max(1., std::ceil(width));
+                    low   = std::floor(low) - 0.5;
+                }
+
+                const size_t nbins = std::clamp<size_t>(static_cast<size_t>(std::ceil((q[2] + 2.*iqr - low) / width)), 3, 65536);
+
+                FITShistogram h(nbins, {low, low + static_cast<double>(nbins)*width});
+                h.Fill(values, nullptr, n);
+                width = h.BinWidth();
+
+                // Single values per bin: the most frequent value
+                if(integral && width == 1.)
+                    return h.Mode();
+
+                // Epanechnikov smoothing of half width IQR n^(-1/7), the bandwidth scaling of mode estimates
+                const double bandwidth = iqr * std::pow(static_cast<double>(n), -1./7.);
+                const long   r = std::max(1L, std::lround(bandwidth / width));
+
+                std::vector<double> s(nbins, 0.);
+                for(long b = 0; b < static_cast<long>(nbins); b++)
+                    for(long j = std::max(-r, -b); j <= r && b + j < static_cast<long>(nbins); j++)
+                    {
+                        const double x = static_cast<double>(j) / static_cast<double>(r + 1);
+                        s[b] += (1. - x*x) * static_cast<double>(h[static_cast<size_t>(b + j)]);
+                    }
+
+                const size_t peak = static_cast<size_t>(std::max_element(s.begin(), s.end()) - s.begin());
+                double mode = h.BinCenter(peak);
+
+                if(peak > 0 && peak + 1 < nbins)
+                {
+                    const double curvature = s[peak-1] - 2.*s[peak] + s[peak+1];
+                    if(curvature < 0.)
+                        mode += 0.5 * width * (s[peak-1] - s[peak+1]) / curvature;
+                }
+
+                return mode;
+            }
+        }
+
+        std::vector<double> Quantiles(double* values, const size_t& n, const std::vector<double>& probs)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            std::vector<size_t> ranks;
+            ranks.reserve(2*probs.size());
+
+            for(const double& p : probs)
+            {
+                if(!(p >= 0. && p <= 1.))
+                    throw std::invalid_argument("Quantile probabilities should be in the range [0,1]");
+
+                const double pos = p * static_cast<double>(n - 1);
+                const size_t lo  = std::min(n - 1, static_cast<size_t>(pos));
+                ranks.push_back(lo);
+                ranks.push_back(std::min(n - 1, lo + 1));
+            }
+
+            std::sort(ranks.begin(), ranks.end());
+            ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+
+            multi_select(values, values + n, ranks.data(), ranks.data() + ranks.size(), 0);
+
+            std::vector<double> q;
+            q.reserve(probs.size());
+
+            for(const double& p : probs)
+            {
+                const double pos = p * static_cast<double>(n - 1);
+                const size_t lo  = std::min(n - 1, static_cast<size_t>(pos));
+                const size_t hi  = std::min(n - 1, lo + 1);
+                const double f   = pos - static_cast<double>(lo);
+
+                q.push_back( (f > 0.) ? values[lo] + f * (values[hi] - values[lo]) : values[lo] );
+            }
+
+            return q;
+        }
+
+        /**
+         *  @details The values and weights are copied once, the null weights and NaN values being dropped.
+         */
+        std::vector<double> WeightedQuantiles(const double* values, const double* weights, const size_t& n, const std::vector<double>& probs)
+        {
+            for(const double& p : probs)
+                if(!(p >= 0. && p <= 1.))
+                    throw std::invalid_argument("Quantile probabilities should be in the range [0,1]");
+
+            std::vector<valueWeight> vw;
+            vw.reserve(n);
+
+            double W = 0.;
+            for(size_t k = 0; k < n; k++)
+            {
+                if(!(weights[k] >= 0.) || !std::isfinite(weights[k]))
+                    throw std::invalid_argument("Weights should be positive and finite");
+
+                if(weights[k] > 0. && !std::isnan(values[k]))
+                {
+                    vw.emplace_back(values[k], weights[k]);
+                    W += weights[k];
+                }
+            }
+
+            if (vw.empty())
+                throw std::invalid_argument("Empty data array");
+
+            const size_t m = vw.size();
+
+            std::vector<weightTarget> targets(probs.size());
+            for(size_t i = 0; i < probs.size(); i++)
+                targets[i] = weightTarget{probs[i] * W, i, 0, 0, 0., 0.};
+
+            std::sort(targets.begin(), targets.end(), [](const weightTarget& a, const weightTarget& b){return a.t < b.t;});
+
+            std::vector<char> final(m, 0);
+            weighted_select(vw.data(), 0, m, 0., targets.data(), targets.data() + targets.size(), final);
+
+            std::vector<double> q(probs.size(), 0.);
+
+            for(const weightTarget& tg : targets)
+            {
+                const double x = vw[tg.first].first;
+                const double c = tg.before + 0.5*tg.weight;
+
+                double xn = x;
+                double wn = 0.;
+                double cn = c;
+
+                if(tg.t < c && neighbour_group(vw.data(), m, final, tg.first, tg.last, -1, xn, wn))
+                    cn = tg.before - 0.5*wn;
+                else if(tg.t > c && neighbour_group(vw.data(), m, final, tg.first, tg.last, 1, xn, wn))
+                    cn = tg.before + tg.weight + 0.5*wn;
+
+                q[tg.index] = (cn != c) ? x + (tg.t - c) / (cn - c) * (xn - x) : x;
+            }
+
+            return q;
+        }
+
+        Moments& Moments::operator+=(const Moments& o)
+        {
+            if(o.count == 0)
+                return *this;
+
+            if(count == 0)
+            {
+                *this = o;
+                return *this;
+            }
+
+            const double na = static_cast<double>(count);
+            const double nb = static_cast<double>(o.count);
+            const double n  = na + nb;
+            const double d  = o.mean - mean;
+            const double d2 = d*d;
+
+            M4 += o.M4 + d2*d2*na*nb*(na*na - na*nb + nb*nb)/(n*n*n) + 6.*d2*(na*na*o.M2 + nb*nb*M2)/(n*n) + 4.*d*(na*o.M3 - nb*M3)/n;
+            M3 += o.M3 + d2*d*na*nb*(na - nb)/(n*n) + 3.*d*(na*o.M2 - nb*M2)/n;
+            M2 += o.M2 + d2*na*nb/n;
+
+            mean  += d*nb/n;
+            sum   += o.sum;
+            count += o.count;
+            min    = std::min(min, o.min);
+            max    = std::max(max, o.max);
+
+            return *this;
+        }
+
+        double Moments::Mean() const
+        {
+            return (count > 0) ? sum / static_cast<double>(count) : 0.;
+        }
+
+        double Moments::QuadraticMean() const
+        {
+            return (count > 0) ? std::sqrt(M2 / static_cast<double>(count) + mean*mean) : 0.;
+        }
+
+        double Moments::Variance() const
+        {
+            return (count > 1) ? M2 / static_cast<double>(count - 1) : 0.;
+        }
+
+        double Moments::StdDev() const
+        {
+            return std::sqrt(Variance());
+        }
+
+        double Moments::RMSE() const
+        {
+            return (count > 0) ? std::sqrt(M2 / static_cast<double>(count)) : 0.;
+        }
+
+        double Moments::Skewness() const
+        {
+            const double var = Variance();
+            if(count < 3 || !(var > 0.))
+                return 0.;
+
+            return (M3 / static_cast<double>(count)) / (var * std::sqrt(var));
+        }
+
+        double Moments::Kurtosis() const
+        {
+            const double var = Variance();
+            if(count < 4 || !(var > 0.))
+                return 0.;
+
+            const double n = static_cast<double>(count);
+
+            return (n*(n+1.)*M4) / ((n-1.)*(n-2.)*(n-3.)*var*var) - (3.*(n-1.)*(n-1.)) / ((n-2.)*(n-3.));
+        }
+
+        ClippedStats SigmaClip(double* values, const size_t& n, const double& kLow, const double& kHigh, const size_t& maxIter, const clipCenter& center)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            if(!(kLow > 0.) || !(kHigh > 0.))
+                throw std::invalid_argument("Clipping thresholds should be strictly positive");
+
+            ClippedStats cs;
+
+            size_t  kept = n;
+            Moments m    = ComputeMoments(values, kept);
+            bool    medianKnown = false;
+
+            while(cs.iterations < maxIter && kept > 0)
+            {
+                const double c  = (center == clipCenter::median) ? Quantiles(values, kept, {0.5}).front() : m.Mean();
+                const double s  = m.StdDev();
+                const double lo = c - kLow*s;
+                const double hi = c + kHigh*s;
+
+                const size_t nkept = static_cast<size_t>(std::partition(values, values + kept, [lo,hi](const double& x){return x >= lo && x <= hi;}) - values);
+                cs.iterations++;
+
+                if(nkept == kept)
+                {
+                    // The center of a pass rejecting no value is the median of the kept values
+                    medianKnown = (center == clipCenter::median);
+                    cs.median   = c;
+                    break;
+                }
+
+                kept = nkept;
+                m    = ComputeMoments(values, kept);
+            }
+
+            cs.count    = kept;
+            cs.rejected = n - kept;
+
+            if(kept > 0)
+            {
+                cs.mean   = m.Mean();
+                cs.stddev = m.StdDev();
+                if(!medianKnown)
+                    cs.median = Quantiles(values, kept, {0.5}).front();
+            }
+
+            return cs;
+        }
+
+        double MedianAbsoluteDeviation(double* values, const size_t& n)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            deviate(values, n, Quantiles(values, n, {0.5}).front());
+            return abs_median(values, n);
+        }
+
+        double BiweightLocation(double* values, const size_t& n, const double& c)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            if(!(c > 0.))
+                throw std::invalid_argument("Biweight tuning constant should be strictly positive");
+
+            const double median = Quantiles(values, n, {0.5}).front();
+            deviate(values, n, median);
+
+            const double mad = abs_median(values, n);
+            if(!(mad > 0.))
+                return median;
+
+            const std::pair<double,double> s = biweight_location_sums(values, n, c*mad);
+            return median + s.first / s.second;
+        }
+
+        double BiweightScale(double* values, const size_t& n, const double& c)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            if(!(c > 0.))
+                throw std::invalid_argument("Biweight tuning constant should be strictly positive");
+
+            deviate(values, n, Quantiles(values, n, {0.5}).front());
+            return biweight_scale(values, n, abs_median(values, n), c);
+        }
+
+        double Mode(double* values, const size_t& n)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            double median;
+            return histogram_mode(values, n, median);
+        }
+
+        RobustStats RobustStatistics(double* values, const size_t& n, const double& cLocation, const double& cScale)
+        {
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            if(!(cLocation > 0.) || !(cScale > 0.))
+                throw std::invalid_argument("Biweight tuning constants should be strictly positive");
+
+            RobustStats rs;
+            rs.count = n;
+            rs.mode  = histogram_mode(values, n, rs.median);
+
+            deviate(values, n, rs.median);
+            rs.mad = abs_median(values, n);
+
+            rs.location = rs.median;
+            if(rs.mad > 0.)
+            {
+                const std::pair<double,double> s = biweight_location_sums(values, n, cLocation*rs.mad);
+                rs.location += s.first / s.second;
+            }
+            rs.scale = biweight_scale(values, n, rs.mad, cScale);
+
+            return rs;
+        }
+
+
+        QuantileSketch::QuantileSketch(const uint16_t& k, const uint64_t& seed):
+        fk(k), fcount(0), fstate(seed), fmin(std::numeric_limits<double>::quiet_NaN()), fmax(std::numeric_limits<double>::quiet_NaN()),
+        fretained(0), fcapacity(k), flevels(1), fcapacities(1, k)
+        {
+            if(k < 8)
+                throw std::invalid_argument("Sketch capacity k should be at least 8");
+
+            if(fstate == 0)
+                fstate = 0x9E3779B97F4A7C15ULL;
+        }
+
+        void QuantileSketch::SetCapacities()
+        {
+            fcapacities.resize(flevels.size());
+            fcapacity = 0;
+
+            for(size_t h = 0; h < flevels.size(); h++)
+            {
+                const double depth = static_cast<double>(flevels.size() - 1 - h);
+                fcapacities[h] = std::max<size_t>(8, static_cast<size_t>(std::ceil(static_cast<double>(fk) * std::pow(2./3., depth))));
+                fcapacity     += fcapacities[h];
+            }
+        }
+
+        /**
+         *  @details The value left over by an odd sized level stays in place, keeping the total weight exact.
+         */
+        void QuantileSketch::Compress()
+        {
+            while(fretained > fcapacity)
+            {
+                size_t h = 0;
+                while(h + 1 < flevels.size() && flevels[h].size() < fcapacities[h])
+                    h++;
+
+                if(h + 1 == flevels.size())
+                {
+                    flevels.emplace_back();
+                    SetCapacities();
+                }
+
+                std::vector<double>& level = flevels[h];
+                std::vector<double>& upper = flevels[h+1];
+                std::sort(level.begin(), level.end());
+
+                // xorshift64 coin for the offset of the promoted values
+                fstate ^= fstate << 13;
+                fstate ^= fstate >> 7;
+                fstate ^= fstate << 17;
+
+                const size_t odd    = level.size() & 1;
+                const size_t offset = static_cast<size_t>(fstate & 1);
+
+                for(size_t i = odd + offset; i < level.size(); i += 2)
+                    upper.push_back(level[i]);
+
+                fretained -= (level.size() - odd) / 2;
+                level.resize(odd);
+            }
+        }
+
+        void QuantileSketch::Update(const double& v)
+        {
+            if(std::isnan(v))
+                return;
+
+            if(fcount == 0)
+                fmin = fmax = v;
+            else
+            {
+                fmin = std::min(fmin, v);
+                fmax = std::max(fmax, v);
+            }
+
+            fcount++;
+            fretained++;
+            flevels.front().push_back(v);
+
+            if(fretained > fcapacity)
+                Compress();
+        }
+
+        QuantileSketch& QuantileSketch::operator+=(const QuantileSketch& o)
+        {
+            if(o.fk != fk)
+                throw std::invalid_argument("Sketches should have the same capacity k to be merged");
+
+            if(o.fcount == 0)
+                return *this;
+
+            if(fcount == 0)
+            {
+                fmin = o.fmin;
+                fmax = o.fmax;
+            }
+            else
+            {
+                fmin = std::min(fmin, o.fmin);
+                fmax = std::max(fmax, o.fmax);
+            }
+
+            if(o.flevels.size() > flevels.size())
+                flevels.resize(o.flevels.size());
+
+            for(size_t h = 0; h < o.flevels.size(); h++)
+                flevels[h].insert(flevels[h].end(), o.flevels[h].begin(), o.flevels[h].end());
+
+            fcount    += o.fcount;
+            fretained += o.fretained;
+
+            SetCapacities();
+            Compress();
+
+            return *this;
+        }
+
+        /**
+         *  @details Single-sided rank error at 99% confidence, as fitted on the KLL sketches of the Apache DataSketches library.
+         */
+        double QuantileSketch::NormalizedRankError() const
+        {
+            return 2.296 / std::pow(static_cast<double>(fk), 0.9723);
+        }
+
+        std::vector<std::pair<double,uint64_t>> QuantileSketch::Sorted() const
+        {
+            std::vector<std::pair<double,uint64_t>> items;
+            items.reserve(fretained);
+
+            for(size_t h = 0; h < flevels.size(); h++)
+                for(const double& v : flevels[h])
+                    items.emplace_back(v, uint64_t{1} << h);
+
+            std::sort(items.begin(), items.end(), [](const auto& a, const auto& b){return a.first < b.first;});
+
+            uint64_t cumul = 0;
+            for(auto& it : items)
+            {
+                cumul    += it.second;
+                it.second = cumul;
+            }
+
+            return items;
+        }
+
+        double QuantileSketch::Rank(const double& v) const
+        {
+            if(fcount == 0)
+                throw std::invalid_argument("Empty sketch");
+
+            uint64_t below = 0;
+            for(size_t h = 0; h < flevels.size(); h++)
+                for(const double& x : flevels[h])
+                    if(x <= v)
+                        below += uint64_t{1} << h;
+
+            return static_cast<double>(below) / static_cast<double>(fcount);
+        }
+
+        double QuantileSketch::Quantile(const double& p) const
+        {
+            return Quantiles({p}).front();
+        }
+
+        std::vector<double> QuantileSketch::Quantiles(const std::vector<double>& probs) const
+        {
+            if(fcount == 0)
+                throw std::invalid_argument("Empty sketch");
+
+            for(const double& p : probs)
+                if(!(p >= 0. && p <= 1.))
+                    throw std::invalid_argument("Quantile probabilities should be in the range [0,1]");
+
+            const std::vector<std::pair<double,uint64_t>> items = Sorted();
+
+            std::vector<double> q(probs.size(), 0.);
+            for(size_t i = 0; i < probs.size(); i++)
+            {
+                if(probs[i] <= 0.)
+                    q[i] = fmin;
+                else if(probs[i] >= 1.)
+                    q[i] = fmax;
+                else
+                {
+                    const double target = probs[i] * static_cast<double>(fcount);
+                    auto it = std::lower_bound(items.begin(), items.end(), target, [](const auto& a, const double& t){return static_cast<double>(a.second) < t;});
+                    q[i] = (it != items.end()) ? it->first : fmax;
+                }
+            }
+
+            return q;
+        }
 
         std::size_t Percentil::lower_bound(const double& v) const
         {
@@ -31,43 +842,9 @@ namespace DSL
             return left; // index of first element >= v (may be val.size())
         }
 
-        // helper: sequential sum for a range
-        double Percentil::partial_sum(const std::valarray<double>& v, size_t start, size_t end)
-        {
-            std::valarray<double> s = v[std::slice(start, end - start,1)];
-            return s.sum();
-        }
-
         void Percentil::Summation()
         {
-            // parallel summation
-            unsigned int hw_threads = std::thread::hardware_concurrency();
-            unsigned int nthreads = (hw_threads == 0) ? 1 : hw_threads;
-            if (static_cast<size_t>(nthreads) > val.size()) nthreads = static_cast<unsigned int>(val.size());
-            
-            if (nthreads <= 1 or val.size()/nthreads < 1)
-            {
-                sum = val.sum();
-                return;
-            }   
-
-            const size_t chunk = (val.size() + nthreads - 1) / nthreads;
-            std::vector< std::future<double> > futs;
-            futs.reserve(nthreads);
-            for (unsigned int ti = 0; ti < nthreads; ++ti)
-            {
-                const size_t start = ti * chunk;
-                const size_t end = std::min(val.size(), start + chunk);
-                if (start >= end) continue;
-
-                // capture pointer and bounds by value
-                futs.emplace_back(std::async(std::launch::async,
-                    [this, start, end]() {
-                        return Percentil::partial_sum(this->val, start, end);
-                    }));
-            }
-            sum = 0.0;
-            for (auto &f : futs) sum += f.get();
+            sum = (val.size() > 0) ? val.sum() : 0.;
         }
 
         // from uint16_t valarray
@@ -260,9 +1037,7 @@ namespace DSL
 
         // proper move constructor
         Percentil::Percentil(const Percentil& other) noexcept : val(other.val), fpp(other.fpp), sum(other.sum)
-        {
-            Summation();
-        }
+        {}
 
         Percentil::~Percentil() {}
 
@@ -319,6 +1094,34 @@ namespace DSL
             return pos / (n - 1);
         }
 
+        double Percentil::Value(const double& pp) const
+        {
+            const std::size_t n = val.size();
+            if (n == 0)
+                throw std::invalid_argument("Empty data array");
+
+            if(!(pp >= 0. && pp <= 1.))
+                throw std::invalid_argument("Percentile should be in the range [0,1]");
+
+            const double pos = pp * static_cast<double>(n - 1);
+            const size_t lo  = std::min(n - 1, static_cast<size_t>(pos));
+            const size_t hi  = std::min(n - 1, lo + 1);
+            const double f   = pos - static_cast<double>(lo);
+
+            return (f > 0.) ? val[lo] + f * (val[hi] - val[lo]) : val[lo];
+        }
+
+        std::vector<double> Percentil::Values(const std::vector<double>& pps) const
+        {
+            std::vector<double> out;
+            out.reserve(pps.size());
+
+            for(const double& pp : pps)
+                out.push_back(Value(pp));
+
+            return out;
+        }
+
         double Percentil::Up() const { return 4; }
 
     } // namespace stat
@@ -2633,6 +2633,25 @@ namespace DSL
         fcolumns.push_back(col->clone());
 
     }
+
+    /**
+     @brief Append a new column into the FITS file
+     @details Same as the shared pointer version, but the column is moved into the table instead of copied, which avoids a copy of its
+     rows for the large columns filled in place.
+
+     @param col The column that will be inserted into the table.
+     */
+    void FITStable::InsertColumn( std::unique_ptr<FITSform> col )
+    {
+        if(col == nullptr)
+            throw FITSexception(SHARED_NULPTR,"FITStable","InsertColumn","No column to insert.");
+
+        if(fcolumns.size() > 0 && fcolumns.front()->size() > 0 && col->size() != fcolumns.front()->size())
+            throw FITSexception(BAD_DIMEN,"FITStable","InsertColumn","The number of rows in the new column does not match the number of rows in the table.");
+
+        col->setPosition(fcolumns.size()+1);
+        fcolumns.push_back(std::move(col));
+    }
     
 #pragma endregion
 #pragma region 2- Inseting value to an existing column
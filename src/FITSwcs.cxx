@@ -12,12 +12,20 @@
 #include <thread>
 #include <iostream>
 #include <sstream>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
 
 #include <fitsio.h>
 
 #include <DSTfits/FITSwcs.h>
 #include <DSTfits/FITShdu.h>
 #include <DSTfits/FITSexception.h>
+#include <DSTfits/FITSparallel.h>
 
 #include <wcslib/wcserr.h>
 #include <wcslib/wcsfix.h>
@@ -26,13 +34,476 @@
 
 namespace DSL
 {
+#pragma region - FITSwcs copy pool
+
+    /**
+     *  @brief Deep copies of the WCS structures, one per concurrent conversion
+     *  @details WCSLIB keeps scratch arrays in the wcsprm structures (e.g. for the distortions), so that a structure can't be used by two
+     *  threads at once. Each chunk of a bulk conversion leases a copy, made by wcssub at first use and returned to the pool at the end
+     *  of the chunk. Clear() drops the copies after a change of the original structures; the copies leased at that time are freed
+     *  when they are returned.
+     */
+    struct FITSwcs::wcsCopies
+    {
+        struct deleter
+        {
+            void operator()(struct wcsprm* p) const {if(!p) return; wcsfree(p); delete p;}
+        };
+        using copy = std::unique_ptr<struct wcsprm, deleter>;
+
+        /**
+         *  @brief Closed-form evaluation of the linear WCS and of the plain TAN and SIN projections
+         *  @details Built from a set wcsprm when no WCSLIB feature beyond a linear transform is involved: no distortion nor lookup
+         *  table, linear non-celestial axes and a celestial pair, if any, projected by TAN or by SIN without PV. The pixel coordinates
+         *  are mapped to intermediate world coordinates by the PC/CD matrix derived by WCSLIB. The projection and the spherical rotation
+         *  of WCSLIB (prjx2s, sphx2s and their inverses) then reduce to the rotation of the direction (x, y, w) of the point in the
+         *  native frame, with w = r0 for TAN and w = sqrt(r0^2 - x^2 - y^2) for SIN, which costs two atan2 per point instead of the
+         *  trigonometry on the native coordinates. Points are processed by blocks of contiguous arrays, one per axis, so that the
+         *  linear stages are vectorised by the compiler. Longitudes are normalised as WCSLIB does.
+         */
+        struct closedForm
+        {
+            static constexpr size_t block = 256;    //!< Points per block
+
+            size_t naxis  = 0;
+            int    lng    = -1;                     //!< Celestial axes, -1 for a linear WCS
+            int    lat    = -1;
+            bool   gnomonic = true;                 //!< TAN, otherwise SIN
+            double r0     = 0;                      //!< Radius of the generating sphere [deg]
+            double lngp   = 0;                      //!< Celestial longitude of the native pole [deg]
+            double sinp   = 0, cosp = 0;            //!< sin and cos of the celestial latitude of the native pole
+            double sinphi = 0, cosphi = 0;          //!< sin and cos of the native longitude of the celestial pole
+            std::vector<double> crpix, crval, piximg, imgpix;
+
+            static std::shared_ptr<const closedForm> Build(const struct wcsprm* wcs);
+
+            size_t Convert(const bool& toWorld, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status) const;
+            size_t pixel2world(const size_t& b0, const size_t& m, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status, double* img) const;
+            size_t world2pixel(const size_t& b0, const size_t& m, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status, double* img) const;
+            size_t Flag(const size_t& b0, const size_t& m, std::span<const std::span<double>> out, std::span<int> status) const;
+        };
+
+        std::mutex lock;
+        std::mutex original;                        //!< Guard of the original structures for the WCSLIB calls that may write to them
+        uint64_t generation = 0;                    //!< Incremented by Clear()
+        std::vector<std::vector<copy>> idle;        //!< Copies not in use, per WCS index
+        std::vector<std::shared_ptr<const closedForm>> fast;     //!< Closed-form transforms, per WCS index
+        std::vector<uint8_t> fastChecked;                        //!< 1 once the eligibility of a WCS index is known
+
+        /**
+         *  @brief Copy of a WCS structure leased for the lifetime of the object
+         */
+        class lease
+        {
+        private:
+            wcsCopies& fpool;
+            size_t fidx;
+            uint64_t fgen;
+            copy fcopy;
+
+        public:
+            lease(wcsCopies& pool, const struct wcsprm* src, const size_t& idx):
+            fpool(pool), fidx(idx), fgen(0), fcopy()
+            {
+                {
+                    std::lock_guard<std::mutex> lk(fpool.lock);
+                    fgen = fpool.generation;
+                    if(fidx < fpool.idle.size() && !fpool.idle[fidx].empty())
+                    {
+                        fcopy = std::move(fpool.idle[fidx].back());
+                        fpool.idle[fidx].pop_back();
+                        return;
+                    }
+                }
+
+                fcopy.reset(new wcsprm);
+                fcopy->flag = -1;
+                {
+                    std::lock_guard<std::mutex> lk(fpool.original);
+                    if(wcssub(1, src, 0x0, 0x0, fcopy.get()))
+                        throw WCSexception(WCSERR_MEMORY,"FITSwcs","wcsCopies","wcssub failed");
+                }
+
+                if(const int status = wcsset(fcopy.get()))
+                    throw WCSexception(status,"FITSwcs","wcsCopies","wcsset failed on the copy");
+            }
+
+            ~lease()
+            {
+                std::lock_guard<std::mutex> lk(fpool.lock);
+                if(fgen != fpool.generation)
+                    return;
+
+                if(fpool.idle.size() <= fidx)
+                    fpool.idle.resize(fidx + 1);
+                fpool.idle[fidx].push_back(std::move(fcopy));
+            }
+
+            inline struct wcsprm* get() const {return fcopy.get();}
+        };
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            generation++;
+            idle.clear();
+            fast.clear();
+            fastChecked.clear();
+        }
+
+        /**
+         *  @brief Closed-form transform of src, nullptr if it requires WCSLIB
+         */
+        std::shared_ptr<const closedForm> Fast(const struct wcsprm* src, const size_t& idx)
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            if(fastChecked.size() <= idx)
+            {
+                fastChecked.resize(idx + 1, 0);
+                fast.resize(idx + 1);
+            }
+
+            if(!fastChecked[idx])
+            {
+                fast[idx]        = closedForm::Build(src);
+                fastChecked[idx] = 1;
+            }
+
+            return fast[idx];
+        }
+
+        /**
+         *  @brief Convert n points from in to out, by chunks processed concurrently on copies of src
+         *  @return Number of invalid points
+         */
+        size_t Convert(const bool& toWorld, const struct wcsprm* src, const size_t& idx,
+                       std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status)
+        {
+            if(const std::shared_ptr<const closedForm> cf = Fast(src, idx))
+                return cf->Convert(toWorld, in, out, status);
+
+            constexpr size_t batch = 1024;      // Points per WCSLIB call, interleaved in buffers kept in cache
+
+            const size_t n     = in[0].size();
+            const size_t naxis = in.size();
+            std::atomic<size_t> invalid{0};
+
+            parallel_for(0, n, 4*batch, [&](size_t begin, size_t end)
+            {
+                lease wcs(*this, src, idx);
+
+                std::vector<double> incrd(batch*naxis), imgcrd(batch*naxis), outcrd(batch*naxis), phi(batch), theta(batch);
+                std::vector<int>    stat(batch);
+                size_t bad = 0;
+
+                for(size_t b0 = begin; b0 < end; b0 += batch)
+                {
+                    const size_t m = std::min(batch, end - b0);
+
+                    for(size_t a = 0; a < naxis; a++)
+                        for(size_t i = 0; i < m; i++)
+                            incrd[i*naxis + a] = in[a][b0 + i];
+
+                    const int rc = toWorld ? wcsp2s(wcs.get(), static_cast<int>(m), static_cast<int>(naxis), incrd.data(), imgcrd.data(), phi.data(), theta.data(), outcrd.data(), stat.data())
+                                           : wcss2p(wcs.get(), static_cast<int>(m), static_cast<int>(naxis), incrd.data(), phi.data(), theta.data(), imgcrd.data(), outcrd.data(), stat.data());
+
+                    // Invalid points are flagged in stat, any other error is fatal
+                    if(rc && rc != (toWorld ? WCSERR_BAD_PIX : WCSERR_BAD_WORLD))
+                        throw WCSexception(rc,"FITSwcs",toWorld ? "pixel2world" : "world2pixel",wcs_errmsg[rc]);
+
+                    for(size_t a = 0; a < naxis; a++)
+                        for(size_t i = 0; i < m; i++)
+                            out[a][b0 + i] = stat[i] ? std::numeric_limits<double>::quiet_NaN() : outcrd[i*naxis + a];
+
+                    for(size_t i = 0; i < m; i++)
+                    {
+                        bad += (stat[i] != 0);
+                        if(!status.empty())
+                            status[b0 + i] = stat[i];
+                    }
+                }
+
+                invalid += bad;
+            });
+
+            return invalid.load();
+        }
+    };
+
+    namespace
+    {
+        constexpr double wcsD2R = M_PI/180.;
+        constexpr double wcsR2D = 180./M_PI;
+
+        /// sin and cos of an angle in degrees, exact at the multiples of 90 deg as in WCSLIB
+        void sincosd(const double& angle, double& s, double& c)
+        {
+            if(std::fmod(angle, 90.) == 0.)
+            {
+                static constexpr double sq[4] = {0., 1., 0., -1.};
+                const long q = ((std::lround(angle/90.) % 4) + 4) % 4;
+                s = sq[q];
+                c = sq[(q + 1) % 4];
+                return;
+            }
+
+            s = std::sin(angle*wcsD2R);
+            c = std::cos(angle*wcsD2R);
+        }
+    }
+
+    std::shared_ptr<const FITSwcs::wcsCopies::closedForm> FITSwcs::wcsCopies::closedForm::Build(const struct wcsprm* wcs)
+    {
+        if(wcs == nullptr || wcs->naxis < 1 || wcs->types == nullptr)
+            return nullptr;
+
+        if(wcs->lin.dispre != nullptr || wcs->lin.disseq != nullptr || wcs->ntab != 0 || wcs->cubeface != -1)
+            return nullptr;
+
+        auto cf = std::make_shared<closedForm>();
+        cf->naxis = static_cast<size_t>(wcs->naxis);
+        cf->lng   = wcs->lng;
+        cf->lat   = wcs->lat;
+
+        for(int i = 0; i < wcs->naxis; i++)
+        {
+            if(i == wcs->lng || i == wcs->lat)
+                continue;
+
+            if((wcs->types[i]/100)%10 != 0)     // Non-linear spectral, logarithmic, tabular or quantised axis
+                return nullptr;
+        }
+
+        if((cf->lng < 0) != (cf->lat < 0))
+            return nullptr;
+
+        if(cf->lng >= 0)
+        {
+            const struct celprm& cel = wcs->cel;
+            if(cel.offset || cel.phi0 != 0. || cel.theta0 != 90.)
+                return nullptr;
+
+            if(std::strncmp(cel.prj.code, "TAN", 3) == 0)
+                cf->gnomonic = true;
+            else if(std::strncmp(cel.prj.code, "SIN", 3) == 0 && cel.prj.pv[1] == 0. && cel.prj.pv[2] == 0.)
+                cf->gnomonic = false;
+            else
+                return nullptr;
+
+            cf->r0   = cel.prj.r0;
+            cf->lngp = cel.euler[0];
+            cf->sinp = cel.euler[3];
+            cf->cosp = cel.euler[4];
+            sincosd(cel.euler[2], cf->sinphi, cf->cosphi);
+        }
+
+        const size_t n = cf->naxis;
+        cf->crpix.assign(wcs->lin.crpix, wcs->lin.crpix + n);
+        cf->crval.assign(wcs->crval, wcs->crval + n);
+
+        if(wcs->lin.unity || wcs->lin.piximg == nullptr || wcs->lin.imgpix == nullptr)
+        {
+            cf->piximg.assign(n*n, 0.);
+            cf->imgpix.assign(n*n, 0.);
+            for(size_t i = 0; i < n; i++)
+            {
+                cf->piximg[i*n + i] = wcs->lin.cdelt[i];
+                cf->imgpix[i*n + i] = 1./wcs->lin.cdelt[i];
+            }
+        }
+        else
+        {
+            cf->piximg.assign(wcs->lin.piximg, wcs->lin.piximg + n*n);
+            cf->imgpix.assign(wcs->lin.imgpix, wcs->lin.imgpix + n*n);
+        }
+
+        return cf;
+    }
+
+    /**
+     *  @details Points are converted by blocks of contiguous arrays on the shared thread pool. The status of an invalid point flags
+     *  its celestial axes, as WCSLIB does.
+     */
+    size_t FITSwcs::wcsCopies::closedForm::Convert(const bool& toWorld, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status) const
+    {
+        std::atomic<size_t> invalid{0};
+        parallel_for(0, in[0].size(), 16*block, [&](size_t begin, size_t end)
+        {
+            std::vector<double> img(naxis*block);
+            size_t bad = 0;
+
+            for(size_t b0 = begin; b0 < end; b0 += block)
+            {
+                const size_t m = std::min(block, end - b0);
+                bad += toWorld ? pixel2world(b0, m, in, out, status, img.data()) : world2pixel(b0, m, in, out, status, img.data());
+            }
+
+            invalid += bad;
+        });
+
+        return invalid.load();
+    }
+
+    size_t FITSwcs::wcsCopies::closedForm::pixel2world(const size_t& b0, const size_t& m, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status, double* img) const
+    {
+        // Intermediate world coordinates
+        for(size_t i = 0; i < naxis; i++)
+        {
+            double* x = img + i*block;
+            std::fill(x, x + m, 0.);
+            for(size_t j = 0; j < naxis; j++)
+            {
+                const double  a = piximg[i*naxis + j];
+                const double  c = crpix[j];
+                const double* p = in[j].data() + b0;
+                if(a != 0.)
+                    for(size_t k = 0; k < m; k++)
+                        x[k] += a*(p[k] - c);
+            }
+        }
+
+        for(size_t i = 0; i < naxis; i++)
+        {
+            if(static_cast<int>(i) == lng || static_cast<int>(i) == lat)
+                continue;
+
+            const double* x = img + i*block;
+            double*       w = out[i].data() + b0;
+            for(size_t k = 0; k < m; k++)
+                w[k] = x[k] + crval[i];
+        }
+
+        if(lng >= 0)
+        {
+            const double* x = img + lng*block;
+            const double* y = img + lat*block;
+            double*       a = out[lng].data() + b0;
+            double*       d = out[lat].data() + b0;
+            const double r02 = r0*r0;
+
+            for(size_t k = 0; k < m; k++)
+            {
+                // Direction of the point in the native frame, rotated to the celestial frame
+                const double u = x[k]*cosphi + y[k]*sinphi;
+                const double v = x[k]*sinphi - y[k]*cosphi;
+                const double w = gnomonic ? r0 : std::sqrt(r02 - x[k]*x[k] - y[k]*y[k]);
+                const double X = w*cosp - v*sinp;
+
+                double lon = lngp + std::atan2(-u, X)*wcsR2D;
+                if(lngp >= 0.) {if(lon < 0.) lon += 360.;}
+                else           {if(lon > 0.) lon -= 360.;}
+                if(lon > 360.)       lon -= 360.;
+                else if(lon < -360.) lon += 360.;
+
+                a[k] = lon;
+                d[k] = std::atan2(w*sinp + v*cosp, std::sqrt(u*u + X*X))*wcsR2D;
+            }
+        }
+
+        return Flag(b0, m, out, status);
+    }
+
+    size_t FITSwcs::wcsCopies::closedForm::world2pixel(const size_t& b0, const size_t& m, std::span<const std::span<const double>> in, std::span<const std::span<double>> out, std::span<int> status, double* img) const
+    {
+        // Intermediate world coordinates
+        for(size_t i = 0; i < naxis; i++)
+        {
+            if(static_cast<int>(i) == lng || static_cast<int>(i) == lat)
+                continue;
+
+            const double* w = in[i].data() + b0;
+            double*       x = img + i*block;
+            for(size_t k = 0; k < m; k++)
+                x[k] = w[k] - crval[i];
+        }
+
+        if(lng >= 0)
+        {
+            const double* a = in[lng].data() + b0;
+            const double* d = in[lat].data() + b0;
+            double*       x = img + lng*block;
+            double*       y = img + lat*block;
+
+            for(size_t k = 0; k < m; k++)
+            {
+                // Direction of the point in the celestial frame, rotated to the native frame
+                const double dl = (a[k] - lngp)*wcsD2R;
+                const double sd = std::sin(d[k]*wcsD2R), cd = std::cos(d[k]*wcsD2R);
+                const double cl = std::cos(dl);
+                const double X  = sd*cosp - cd*sinp*cl;
+                const double Y  = -cd*std::sin(dl);
+                const double Z  = sd*sinp + cd*cosp*cl;
+
+                const bool ok = gnomonic ? Z > 0. : Z >= 0.;
+                const double s = !ok ? std::numeric_limits<double>::quiet_NaN() : (gnomonic ? r0/Z : r0);
+                x[k] = s*(Y*cosphi + X*sinphi);
+                y[k] = s*(Y*sinphi - X*cosphi);
+            }
+        }
+
+        for(size_t i = 0; i < naxis; i++)
+        {
+            double* p = out[i].data() + b0;
+            std::fill(p, p + m, crpix[i]);
+            for(size_t j = 0; j < naxis; j++)
+            {
+                const double  c = imgpix[i*naxis + j];
+                const double* x = img + j*block;
+                if(c != 0.)
+                    for(size_t k = 0; k < m; k++)
+                        p[k] += c*x[k];
+            }
+        }
+
+        return Flag(b0, m, out, status);
+    }
+
+    /**
+     *  @brief Set the points of a block with a non-finite coordinate to NaN and flag them in status
+     *  @return Number of invalid points
+     */
+    size_t FITSwcs::wcsCopies::closedForm::Flag(const size_t& b0, const size_t& m, std::span<const std::span<double>> out, std::span<int> status) const
+    {
+        const int flag = lng >= 0 ? (1 << lng) | (1 << lat) : 1;
+        size_t bad = 0;
+
+        for(size_t k = 0; k < m; k++)
+        {
+            bool ok = true;
+            for(size_t i = 0; i < naxis; i++)
+                ok &= std::isfinite(out[i][b0 + k]);
+
+            if(!ok)
+            {
+                bad++;
+                for(size_t i = 0; i < naxis; i++)
+                    out[i][b0 + k] = std::numeric_limits<double>::quiet_NaN();
+            }
+
+            if(!status.empty())
+                status[b0 + k] = ok ? 0 : flag;
+        }
+
+        return bad;
+    }
+
+#pragma endregion
 #pragma region - FITSwcs member function implementation
 
 #pragma region * protected member function
 
+        std::shared_ptr<FITSwcs::wcsCopies> FITSwcs::copies() const
+        {
+            if(!fcopies)
+                throw WCSexception(WCSERR_NULL_POINTER,"FITSwcs","copies","no WCS defined");
+
+            return fcopies;
+        }
+
         void FITSwcs::initFromString(const std::string& header, const int& relax, const int& ctrl)
         {
             fwcs.reset();
+            fcopies.reset();
             fnwcs      = 0;
             fwcs_status= WCSERR_UNSET;
             
@@ -151,6 +622,7 @@ namespace DSL
 
                 int nw = fnwcs;
                 fwcs = std::shared_ptr<struct wcsprm>( _wcs, [nw](struct wcsprm* p){if(!p) return; int cnt = nw; struct wcsprm* tmp = p;wcsvfree(&cnt,&tmp);} );
+                fcopies = std::make_shared<wcsCopies>();
                 fwcs_status = 0;
             }
             else
@@ -233,7 +705,7 @@ namespace DSL
             initFromImg(fptr, relax, ctrl);
         }
 
-        FITSwcs::FITSwcs(const FITSwcs& other):fwcs(other.fwcs), fwcs_status(other.fwcs_status), fnwcs(other.fnwcs)
+        FITSwcs::FITSwcs(const FITSwcs& other):fwcs(other.fwcs), fwcs_status(other.fwcs_status), fnwcs(other.fnwcs), fcopies(other.fcopies)
         { }
 
         FITSwcs::FITSwcs(const FITSwcs& other, const size_t& idx):fwcs(), fwcs_status(WCSERR_UNSET), fnwcs(0)
@@ -253,7 +725,13 @@ namespace DSL
             
             struct wcsprm* _wcs = new wcsprm;
             _wcs->flag=-1;
-            if ( wcssub(1, &(other.fwcs.get()[idx]),0x0,0x0, _wcs) )
+            int sub_status = 0;
+            {
+                const std::shared_ptr<wcsCopies> pool = other.copies();
+                std::lock_guard<std::mutex> lk(pool->original);
+                sub_status = wcssub(1, &(other.fwcs.get()[idx]),0x0,0x0, _wcs);
+            }
+            if ( sub_status )
             {
                 fwcs_status = WCSERR_UNSET;
                 throw WCSexception(fwcs_status,"FITSwcs","Copy Constructor","wcsdup failed");
@@ -269,6 +747,7 @@ namespace DSL
             }
 
             fwcs = std::shared_ptr<struct wcsprm>( _wcs, [](struct wcsprm* p){if(!p) return; struct wcsprm* tmp = p;wcsfree(tmp);} );
+            fcopies     = std::make_shared<wcsCopies>();
             fnwcs       = 1;
         }
 
@@ -443,6 +922,7 @@ namespace DSL
             swap(first.fwcs, second.fwcs);
             swap(first.fwcs_status, second.fwcs_status);
             swap(first.fnwcs, second.fnwcs);
+            swap(first.fcopies, second.fcopies);
 
             for(int k =0; k < first.fnwcs; k++)
                 first.fwcs_status = wcsset(&(first.fwcs.get()[k]));
@@ -478,6 +958,52 @@ namespace DSL
             return static_cast<size_t>(fwcs.get()[wcsIndex].naxis);
         }
 
+        /**
+         * @brief Get the index of the celestial longitude axis for a given WCS index
+         * 
+         * @param wcsIndex World Coordinate System index
+         * @return int Index of the longitude axis, starting at 0, or -1 if the WCS has no celestial axes
+         */
+        int FITSwcs::getLongitudeAxis(const size_t& wcsIndex) const
+        {
+            if(fwcs == nullptr)
+            {
+                std::string errmsg = wcs_errmsg[WCSERR_UNSET];
+                throw WCSexception(WCSERR_UNSET,"FITSwcs","getLongitudeAxis",errmsg);
+            }
+
+            if(wcsIndex >= static_cast<size_t>(fnwcs))
+            {
+                std::string errmsg = wcs_errmsg[WCSERR_UNSET];
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","getLongitudeAxis",errmsg);
+            }
+
+            return fwcs.get()[wcsIndex].lng;
+        }
+
+        /**
+         * @brief Get the index of the celestial latitude axis for a given WCS index
+         * 
+         * @param wcsIndex World Coordinate System index
+         * @return int Index of the latitude axis, starting at 0, or -1 if the WCS has no celestial axes
+         */
+        int FITSwcs::getLatitudeAxis(const size_t& wcsIndex) const
+        {
+            if(fwcs == nullptr)
+            {
+                std::string errmsg = wcs_errmsg[WCSERR_UNSET];
+                throw WCSexception(WCSERR_UNSET,"FITSwcs","getLatitudeAxis",errmsg);
+            }
+
+            if(wcsIndex >= static_cast<size_t>(fnwcs))
+            {
+                std::string errmsg = wcs_errmsg[WCSERR_UNSET];
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","getLatitudeAxis",errmsg);
+            }
+
+            return fwcs.get()[wcsIndex].lat;
+        }
+
         const std::string FITSwcs::getSuffix(const size_t& wcsIndex) const
         {
             if(fwcs == nullptr)
@@ -702,6 +1228,67 @@ namespace DSL
 #pragma endregion
 #pragma region * Conversion
 
+        FITSwcs FITSwcs::Collapse(const size_t& wcsIndex, const size_t& axis) const
+        {
+            if(fwcs == nullptr || wcsIndex >= static_cast<size_t>(fnwcs))
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","Collapse","WCS index out of range");
+
+            struct wcsprm* src = &(fwcs.get()[wcsIndex]);
+            if(axis < 1 || axis > static_cast<size_t>(src->naxis))
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","Collapse","axis "+std::to_string(axis)+" out of range");
+
+            std::vector<int> axes;
+            for(int i = 1; i <= src->naxis; i++)
+                if(static_cast<size_t>(i) != axis)
+                    axes.push_back(i);
+            int nsub = static_cast<int>(axes.size());
+
+            struct wcsprm* _wcs = new wcsprm;
+            _wcs->flag = -1;
+            int sub_status = 0;
+            {
+                const std::shared_ptr<wcsCopies> pool = copies();
+                std::lock_guard<std::mutex> lk(pool->original);
+                sub_status = wcssub(1, src, &nsub, axes.data(), _wcs);
+            }
+            if(sub_status)
+            {
+                wcsfree(_wcs);
+                delete _wcs;
+                throw WCSexception(WCSERR_BAD_SUBIMAGE,"FITSwcs","Collapse","wcssub failed");
+            }
+
+            // Collapsing one axis of the celestial pair: the other one is kept as a linear axis
+            const int removed = static_cast<int>(axis) - 1;
+            if(src->lng >= 0 && src->lat >= 0 && (removed == src->lng || removed == src->lat))
+            {
+                const int kept = (removed == src->lng) ? src->lat : src->lng;
+                const int r    = (kept > removed) ? kept - 1 : kept;
+
+                std::string type(_wcs->ctype[r], strnlen(_wcs->ctype[r], 4));
+                type.erase(type.find_last_not_of("- ") + 1);
+                std::snprintf(_wcs->ctype[r], 72, "%s", type.c_str());
+
+                int npv = 0;
+                for(int k = 0; k < _wcs->npv; k++)
+                    if(_wcs->pv[k].i != r + 1)
+                        _wcs->pv[npv++] = _wcs->pv[k];
+                _wcs->npv  = npv;
+                _wcs->flag = 0;
+            }
+
+            FITSwcs out;
+            out.fwcs        = std::shared_ptr<struct wcsprm>( _wcs, [](struct wcsprm* p){if(!p) return; wcsfree(p); delete p;} );
+            out.fcopies     = std::make_shared<wcsCopies>();
+            out.fnwcs       = 1;
+            out.fwcs_status = wcsset(_wcs);
+
+            if(out.fwcs_status)
+                throw WCSexception(out.fwcs_status,"FITSwcs","Collapse","wcsset failed on the collapsed WCS");
+
+            return out;
+        }
+
         void FITSwcs::changeCelestialCorrds(const size_t& wcsIndex,
                 const worldCoords& newRefPole,
                 const double& oldLon,
@@ -765,6 +1352,7 @@ namespace DSL
             }
 
             fwcs.get()[wcsIndex].flag = 0; // force recalculation of derived parameters
+            copies()->Clear();
             
 
             if(( fwcs_status=wcsset( &fwcs.get()[wcsIndex] ) ))
@@ -854,18 +1442,22 @@ namespace DSL
             std::vector<double> world_vec (static_cast<size_t>(ncoord) * static_cast<size_t>(nelem));
             std::vector<int>    stat_vec  (static_cast<size_t>(ncoord));
 
-            if( (fwcs_status = wcsp2s(&fwcs.get()[wcsIndex],
-                                      ncoord,
-                                      nelem,
-                                      pixC.data(),
-                                      imgcrd_vec.data(),
-                                      phi_vec.data(),
-                                      theta_vec.data(),
-                                      world_vec.data(),
-                                      stat_vec.data())) )
+            // WCSLIB writes to its structure while converting: the conversion runs on a copy owned by this call
+            const std::shared_ptr<wcsCopies> pool = copies();
+            const wcsCopies::lease wcs(*pool, &fwcs.get()[wcsIndex], wcsIndex);
+
+            if( const int status = wcsp2s(wcs.get(),
+                                          ncoord,
+                                          nelem,
+                                          pixC.data(),
+                                          imgcrd_vec.data(),
+                                          phi_vec.data(),
+                                          theta_vec.data(),
+                                          world_vec.data(),
+                                          stat_vec.data()) )
             {
-                std::string errmsg = wcs_errmsg[fwcs_status];
-                throw WCSexception(fwcs_status,"FITSwcs","pixel2world",errmsg);
+                std::string errmsg = wcs_errmsg[status];
+                throw WCSexception(status,"FITSwcs","pixel2world",errmsg);
             }
 
             // Build output per point: read world elements at world_vec[i*nelem + axis]
@@ -945,21 +1537,24 @@ namespace DSL
             std::vector<double> pixel_vec (static_cast<size_t>(ncoord) * static_cast<size_t>(nelem));
             std::vector<int>    stat_vec  (static_cast<size_t>(ncoord)); // <-- FIXED: one status per point
 
+            // WCSLIB writes to its structure while converting: the conversion runs on a copy owned by this call
+            const std::shared_ptr<wcsCopies> pool = copies();
+            const wcsCopies::lease wcs(*pool, &fwcs.get()[wcsIndex], wcsIndex);
+
             // Correct arg order for wcss2p:
             // wcss2p(wcs, ncoord, nelem, world, imgcrd, phi, theta, pixcrd, stat)
-            wcserr_enable(1);
-            if( (fwcs_status = wcss2p(&fwcs.get()[wcsIndex],
-                                      ncoord,
-                                      nelem,
-                                      worldC.data(),
-                                      phi_vec.data(),
-                                      theta_vec.data(),
-                                      imgcrd_vec.data(),
-                                      pixel_vec.data(),
-                                      stat_vec.data())) )
+            if( const int status = wcss2p(wcs.get(),
+                                          ncoord,
+                                          nelem,
+                                          worldC.data(),
+                                          phi_vec.data(),
+                                          theta_vec.data(),
+                                          imgcrd_vec.data(),
+                                          pixel_vec.data(),
+                                          stat_vec.data()) )
             {
-                std::string errmsg = wcs_errmsg[fwcs_status];
-                throw WCSexception(fwcs_status,"FITSwcs","world2pixel",errmsg);
+                std::string errmsg = wcs_errmsg[status];
+                throw WCSexception(status,"FITSwcs","world2pixel",errmsg);
             }
 
             // Build output per point: read pixel elements at pixel_vec[i*nelem + axis]
@@ -978,6 +1573,119 @@ namespace DSL
             return pv;
         }
 
+        /**
+         * @details When WCSLIB rejects the whole list, the points are converted again one by one so that only the faulty points are lost.
+         */
+        worldVectors FITSwcs::safePixel2world(const size_t& wcsIndex, const pixelVectors& px) const
+        {
+            try
+            {
+                return pixel2world(wcsIndex, px);
+            }
+            catch(WCSexception&)
+            {
+                worldVectors wc(px.size());
+                for(size_t k = 0; k < px.size(); k++)
+                {
+                    try { wc[k] = pixel2world(wcsIndex, pixelVectors(1, px[k]))[0]; }
+                    catch(WCSexception&) {}
+                }
+                return wc;
+            }
+        }
+
+        /**
+         * @details When WCSLIB rejects the whole list, the points are converted again one by one so that only the faulty points are lost.
+         */
+        pixelVectors FITSwcs::safeWorld2pixel(const size_t& wcsIndex, const worldVectors& wc) const
+        {
+            try
+            {
+                return world2pixel(wcsIndex, wc);
+            }
+            catch(WCSexception&)
+            {
+                pixelVectors px(wc.size());
+                for(size_t k = 0; k < wc.size(); k++)
+                {
+                    try { px[k] = world2pixel(wcsIndex, worldVectors(1, wc[k]))[0]; }
+                    catch(WCSexception&) {}
+                }
+                return px;
+            }
+        }
+
+        /**
+         * @details The spans are checked before any conversion: one span per axis of the WCS, all of the same size.
+         */
+        size_t FITSwcs::pixel2world(const size_t& wcsIndex, std::span<const std::span<const double>> pixel, std::span<const std::span<double>> world, std::span<int> status) const
+        {
+            if(fwcs == nullptr)
+                throw WCSexception(WCSERR_UNSET,"FITSwcs","pixel2world",wcs_errmsg[WCSERR_UNSET]);
+
+            if(wcsIndex >= static_cast<size_t>(fnwcs))
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","pixel2world",wcs_errmsg[WCSERR_BAD_PARAM]);
+
+            const struct wcsprm* src = &(fwcs.get()[wcsIndex]);
+            const size_t naxis = static_cast<size_t>(src->naxis);
+            if(pixel.size() != naxis || world.size() != naxis)
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","pixel2world","expected one coordinate span per axis ("+std::to_string(naxis)+")");
+
+            const size_t n = pixel[0].size();
+            for(size_t a = 0; a < naxis; a++)
+                if(pixel[a].size() != n || world[a].size() != n)
+                    throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","pixel2world","coordinate spans of different sizes");
+
+            if(!status.empty() && status.size() != n)
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","pixel2world","status span size doesn't match the number of points");
+
+            if(n == 0)
+                return 0;
+
+            return copies()->Convert(true, src, wcsIndex, pixel, world, status);
+        }
+
+        size_t FITSwcs::pixel2world(const size_t& wcsIndex, std::span<const double> x, std::span<const double> y, std::span<double> lon, std::span<double> lat, std::span<int> status) const
+        {
+            const std::span<const double> pixel[2] = {x, y};
+            const std::span<double>       world[2] = {lon, lat};
+            return pixel2world(wcsIndex, pixel, world, status);
+        }
+
+        size_t FITSwcs::world2pixel(const size_t& wcsIndex, std::span<const std::span<const double>> world, std::span<const std::span<double>> pixel, std::span<int> status) const
+        {
+            if(fwcs == nullptr)
+                throw WCSexception(WCSERR_UNSET,"FITSwcs","world2pixel",wcs_errmsg[WCSERR_UNSET]);
+
+            if(wcsIndex >= static_cast<size_t>(fnwcs))
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","world2pixel",wcs_errmsg[WCSERR_BAD_PARAM]);
+
+            const struct wcsprm* src = &(fwcs.get()[wcsIndex]);
+            const size_t naxis = static_cast<size_t>(src->naxis);
+            if(world.size() != naxis || pixel.size() != naxis)
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","world2pixel","expected one coordinate span per axis ("+std::to_string(naxis)+")");
+
+            const size_t n = world[0].size();
+            for(size_t a = 0; a < naxis; a++)
+                if(world[a].size() != n || pixel[a].size() != n)
+                    throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","world2pixel","coordinate spans of different sizes");
+
+            if(!status.empty() && status.size() != n)
+                throw WCSexception(WCSERR_BAD_PARAM,"FITSwcs","world2pixel","status span size doesn't match the number of points");
+
+            if(n == 0)
+                return 0;
+
+            return copies()->Convert(false, src, wcsIndex, world, pixel, status);
+        }
+
+        size_t FITSwcs::world2pixel(const size_t& wcsIndex, std::span<const double> lon, std::span<const double> lat, std::span<double> x, std::span<double> y, std::span<int> status) const
+        {
+            const std::span<const double> world[2] = {lon, lat};
+            const std::span<double>       pixel[2] = {x, y};
+            return world2pixel(wcsIndex, world, pixel, status);
+        }
+
         std::string FITSwcs::asString(const int& wcsIndex) const
         {
             if(fwcs == nullptr)
@@ -994,7 +1702,6 @@ namespace DSL
 
             
             int nkeyrec = 0;
-            fwcs_status = 0;
 
             if(wcsIndex < 0)
             {
@@ -1006,12 +1713,17 @@ namespace DSL
             }
 
             char* header = nullptr;
-            fwcs_status = wcshdo(WCSHDO_all,&fwcs.get()[wcsIndex],&nkeyrec,&header);
+            int status = 0;
+            {
+                const std::shared_ptr<wcsCopies> pool = copies();
+                std::lock_guard<std::mutex> lk(pool->original);
+                status = wcshdo(WCSHDO_all,&fwcs.get()[wcsIndex],&nkeyrec,&header);
+            }
                 
-            if (fwcs_status > 0)
+            if (status > 0)
             {
-                std::string errmsg = wcs_errmsg[fwcs_status];
-                throw WCSexception(fwcs_status,"FITSwcs","asHeader",errmsg);
+                std::string errmsg = wcs_errmsg[status];
+                throw WCSexception(status,"FITSwcs","asHeader",errmsg);
             }
 
             std::string shdr(header);
@@ -1051,6 +1763,9 @@ namespace DSL
                     return;
                 }
 
+                const std::shared_ptr<wcsCopies> pool = copies();
+                std::lock_guard<std::mutex> lk(pool->original);
+
                 wcserr_enable(1);
                 wcstrim(&(fwcs.get()[wcsIndex]));
                 wcsprt(&(fwcs.get()[wcsIndex]));
@@ -0,0 +1,339 @@
+//
+//  FITSwcsGrid.cxx
+//
+//  Created by GILLARD William
+//  Centre de Physic des Particules de Marseille
+//  Licensed under CC BY-NC 4.0
+//  You may share and adapt this code with attribution,
+//  but not for commercial purposes.
+//  Licence text: https://creativecommons.org/licenses/by-nc/4.0/
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <span>
+
+#include <fitsio.h>
+
+#include <DSTfits/FITSwcsGrid.h>
+#include <DSTfits/FITSparallel.h>
+#include <DSTfits/FITSexception.h>
+
+namespace DSL
+{
+    namespace
+    {
+        constexpr size_t kMaxIterations = 20;     // Newton iterations of world2pixel
+        constexpr double kConvergence   = 1e-9;   // [pix]
+
+        /**
+         *  @brief Longitude difference in [-180,180)
+         */
+        inline double wrap_difference(const double& d)
+        {
+            return d - 360. * std::floor((d + 180.) / 360.);
+        }
+
+        /**
+         *  @brief Longitude in [0,360) if the reference is positive, in (-360,0] otherwise, as WCSLIB normalizes its longitudes
+         */
+        inline double wrap_like(const double& lon, const double& ref)
+        {
+            if(ref >= 0.)
+                return lon - 360. * std::floor(lon / 360.);
+
+            return lon - 360. * std::ceil(lon / 360.);
+        }
+    }
+
+#pragma region - FITSwcsGrid member function implementation
+#pragma region * Protected member function
+    /**
+     *  @details Bilinear interpolation in the cell (i,j) at the fractional position (u,v). The Jacobian, if requested, holds the
+     *  derivatives of each world axis along the first then the second pixel axis [world unit/pix].
+     */
+    void FITSwcsGrid::Interpolate(const size_t& i, const size_t& j, const double& u, const double& v, double* world, double* jacobian) const
+    {
+        const double* n00 = fworld.data() + (j * fgx + i) * fnaxis;
+        const double* n10 = n00 + fnaxis;
+        const double* n01 = n00 + fgx * fnaxis;
+        const double* n11 = n01 + fnaxis;
+        const double  s   = static_cast<double>(fstep);
+
+        for(size_t a = 0; a < fnaxis; a++)
+        {
+            const double c00 = n00[a];
+            double c10 = n10[a], c01 = n01[a], c11 = n11[a];
+
+            if(static_cast<int>(a) == flng)
+            {
+                c10 = c00 + wrap_difference(c10 - c00);
+                c01 = c00 + wrap_difference(c01 - c00);
+                c11 = c00 + wrap_difference(c11 - c00);
+            }
+
+            const double value = c00 + u * (c10 - c00) + v * (c01 - c00) + u * v * (c11 - c10 - c01 + c00);
+            world[a] = (static_cast<int>(a) == flng) ? wrap_like(value, c00) : value;
+
+            if(jacobian != nullptr)
+            {
+                jacobian[2*a]   = ((1. - v) * (c10 - c00) + v * (c11 - c01)) / s;
+                jacobian[2*a+1] = ((1. - u) * (c01 - c00) + u * (c11 - c10)) / s;
+            }
+        }
+    }
+
+    /**
+     *  @details The world coordinate error is converted to a pixel displacement by least squares on the Jacobian of the cell.
+     *  A residual that no displacement explains, on an axis that barely moves across the cell, is rejected as well.
+     *  The scratch buffer holds 4*fnaxis values.
+     *  @return The error in pixels, infinite if the cell can't be interpolated
+     */
+    double FITSwcsGrid::PixelError(const size_t& i, const size_t& j, const double& u, const double& v, const double* exact, double* scratch) const
+    {
+        constexpr double inf = std::numeric_limits<double>::infinity();
+
+        double* world = scratch;
+        double* diff  = scratch + fnaxis;
+        double* jac   = scratch + 2 * fnaxis;
+        Interpolate(i, j, u, v, world, jac);
+
+        double a00 = 0., a01 = 0., a11 = 0., b0 = 0., b1 = 0.;
+        for(size_t a = 0; a < fnaxis; a++)
+        {
+            if(!std::isfinite(exact[a]) || !std::isfinite(world[a]))
+                return inf;
+
+            diff[a] = world[a] - exact[a];
+            if(static_cast<int>(a) == flng)
+                diff[a] = wrap_difference(diff[a]);
+
+            a00 += jac[2*a]   * jac[2*a];
+            a01 += jac[2*a]   * jac[2*a+1];
+            a11 += jac[2*a+1] * jac[2*a+1];
+            b0  += jac[2*a]   * diff[a];
+            b1  += jac[2*a+1] * diff[a];
+        }
+
+        const double det = a00 * a11 - a01 * a01;
+        if(!(det > 1e-12 * (a00 + a11) * (a00 + a11)))
+            return inf;
+
+        const double dx = ( a11 * b0 - a01 * b1) / det;
+        const double dy = (-a01 * b0 + a00 * b1) / det;
+
+        for(size_t a = 0; a < fnaxis; a++)
+        {
+            const double residual = diff[a] - jac[2*a] * dx - jac[2*a+1] * dy;
+            if(std::abs(residual) > ftolerance * (std::abs(jac[2*a]) + std::abs(jac[2*a+1])) + 1e-12 * (1. + std::abs(exact[a])))
+                return inf;
+        }
+
+        return std::hypot(dx, dy);
+    }
+
+#pragma endregion
+#pragma region * ctor/dtor
+    /**
+     *  @details The nodes and the check points are converted by the structure of arrays FITSwcs::pixel2world, in parallel. The
+     *  cells are then checked concurrently, row by row, at their centre and at the middle of their four edges.
+     */
+    FITSwcsGrid::FITSwcsGrid(const FITSwcs& wcs, const size_t& wcsIndex, const size_t& nx, const size_t& ny, const size_t& step, const double& tolerance):
+    fnaxis(0), flng(-1), fstep(step), fgx(0), fgy(0), ftolerance(tolerance), fmaxError(0.), fexact(0), fseed(-1)
+    {
+        if(step == 0 || !(tolerance > 0.))
+            throw FITSexception(BAD_OPTION,"FITSwcsGrid","ctor","step and tolerance must be strictly positive");
+
+        fnaxis = wcs.getNumberOfAxis(wcsIndex);
+        if(fnaxis < 2 || nx == 0 || ny == 0)
+            throw WCSexception(WCSERR_BAD_PARAM,"FITSwcsGrid","ctor","the grid needs a WCS and an image of two axes at least");
+
+        flng = wcs.getLongitudeAxis(wcsIndex);
+
+        fgx = std::max<size_t>(2, (nx + step - 2) / step + 1);
+        fgy = std::max<size_t>(2, (ny + step - 2) / step + 1);
+
+        const size_t ncx = fgx - 1, ncy = fgy - 1;
+        const size_t nnodes  = fgx * fgy;
+        const size_t ncells  = ncx * ncy;
+        const size_t nhedges = ncx * fgy;   // middles of the edges along the first axis
+        const size_t nvedges = fgx * ncy;   // middles of the edges along the second axis
+        const size_t npoints = nnodes + ncells + nhedges + nvedges;
+
+        const size_t oc = nnodes, oh = oc + ncells, ov = oh + nhedges;
+        const double s  = static_cast<double>(step);
+
+        std::vector<std::vector<double>> pixel(fnaxis, std::vector<double>(npoints, 0.));
+        std::vector<std::vector<double>> world(fnaxis, std::vector<double>(npoints));
+
+        for(size_t j = 0; j < fgy; j++)
+            for(size_t i = 0; i < fgx; i++)
+            {
+                const double x = static_cast<double>(i) * s, y = static_cast<double>(j) * s;
+
+                pixel[0][j * fgx + i] = x;
+                pixel[1][j * fgx + i] = y;
+
+                if(i < ncx && j < ncy)
+                {
+                    pixel[0][oc + j * ncx + i] = x + 0.5 * s;
+                    pixel[1][oc + j * ncx + i] = y + 0.5 * s;
+                }
+                if(i < ncx)
+                {
+                    pixel[0][oh + j * ncx + i] = x + 0.5 * s;
+                    pixel[1][oh + j * ncx + i] = y;
+                }
+                if(j < ncy)
+                {
+                    pixel[0][ov + j * fgx + i] = x;
+                    pixel[1][ov + j * fgx + i] = y + 0.5 * s;
+                }
+            }
+
+        std::vector<std::span<const double>> pspan(pixel.begin(), pixel.end());
+        std::vector<std::span<double>>       wspan(world.begin(), world.end());
+        wcs.pixel2world(wcsIndex, pspan, wspan);
+
+        fworld.resize(nnodes * fnaxis);
+        for(size_t k = 0; k < nnodes; k++)
+            for(size_t a = 0; a < fnaxis; a++)
+                fworld[k * fnaxis + a] = world[a][k];
+
+        std::vector<double> error(ncells, 0.);
+        parallel_for(0, ncy, 1, [&](const size_t& jb, const size_t& je)
+        {
+            std::vector<double> exact(fnaxis), scratch(4 * fnaxis);
+            auto check = [&](const size_t& i, const size_t& j, const size_t& k, const double& u, const double& v)
+            {
+                for(size_t a = 0; a < fnaxis; a++)
+                    exact[a] = world[a][k];
+
+                double& e = error[j * ncx + i];
+                e = std::max(e, PixelError(i, j, u, v, exact.data(), scratch.data()));
+            };
+
+            for(size_t j = jb; j < je; j++)
+                for(size_t i = 0; i < ncx; i++)
+                {
+                    check(i, j, oc + j * ncx + i,       0.5, 0.5);
+                    check(i, j, oh + j * ncx + i,       0.5, 0. );
+                    check(i, j, oh + (j + 1) * ncx + i, 0.5, 1. );
+                    check(i, j, ov + j * fgx + i,       0.,  0.5);
+                    check(i, j, ov + j * fgx + i + 1,   1.,  0.5);
+                }
+        });
+
+        fcells.resize(ncells);
+        double best = std::numeric_limits<double>::infinity();
+        for(size_t j = 0; j < ncy; j++)
+            for(size_t i = 0; i < ncx; i++)
+            {
+                const double e = error[j * ncx + i];
+                fcells[j * ncx + i] = (e <= ftolerance) ? 1 : 0;
+
+                if(!fcells[j * ncx + i])
+                {
+                    fexact++;
+                    continue;
+                }
+
+                fmaxError = std::max(fmaxError, e);
+
+                // The inversion starts from the accepted cell closest to the centre of the grid
+                const double di = static_cast<double>(i) - 0.5 * static_cast<double>(ncx - 1);
+                const double dj = static_cast<double>(j) - 0.5 * static_cast<double>(ncy - 1);
+                if(di * di + dj * dj < best)
+                {
+                    best  = di * di + dj * dj;
+                    fseed = static_cast<long long>(j * ncx + i);
+                }
+            }
+    }
+
+#pragma endregion
+#pragma region * Conversion
+    bool FITSwcsGrid::pixel2world(const double& x, const double& y, double* world) const
+    {
+        const double s  = static_cast<double>(fstep);
+        const double xs = x / s, ys = y / s;
+        const double xmax = static_cast<double>(fgx - 1), ymax = static_cast<double>(fgy - 1);
+
+        // Also rejects NaN
+        if(!(xs >= 0. && xs <= xmax && ys >= 0. && ys <= ymax))
+            return false;
+
+        const size_t i = std::min(static_cast<size_t>(xs), fgx - 2);
+        const size_t j = std::min(static_cast<size_t>(ys), fgy - 2);
+        if(!fcells[j * (fgx - 1) + i])
+            return false;
+
+        Interpolate(i, j, xs - static_cast<double>(i), ys - static_cast<double>(j), world);
+        return true;
+    }
+
+    /**
+     *  @details The first guess follows from the Jacobian at the centre of the seed cell; each iteration then solves the 2x2 system
+     *  of the Jacobian of the cell that holds the current position, brought back on the grid if it stepped out of it.
+     */
+    bool FITSwcsGrid::world2pixel(const double* world, double& x, double& y) const
+    {
+        if(fnaxis != 2 || fseed < 0 || !std::isfinite(world[0]) || !std::isfinite(world[1]))
+            return false;
+
+        const size_t ncx = fgx - 1;
+        const double s   = static_cast<double>(fstep);
+        const double xmax = static_cast<double>(fgx - 1), ymax = static_cast<double>(fgy - 1);
+
+        size_t i = static_cast<size_t>(fseed) % ncx;
+        size_t j = static_cast<size_t>(fseed) / ncx;
+        double px = (static_cast<double>(i) + 0.5) * s;
+        double py = (static_cast<double>(j) + 0.5) * s;
+
+        double w[2], jac[4];
+        for(size_t it = 0; it <= kMaxIterations; it++)
+        {
+            // The iterations may step out of the grid on the way to a position close to its edges
+            const double xs = std::clamp(px / s, 0., xmax);
+            const double ys = std::clamp(py / s, 0., ymax);
+            px = xs * s;
+            py = ys * s;
+
+            i = std::min(static_cast<size_t>(xs), fgx - 2);
+            j = std::min(static_cast<size_t>(ys), fgy - 2);
+            if(!fcells[j * ncx + i])
+                return false;
+
+            Interpolate(i, j, xs - static_cast<double>(i), ys - static_cast<double>(j), w, jac);
+
+            double d0 = world[0] - w[0], d1 = world[1] - w[1];
+            if(flng == 0) d0 = wrap_difference(d0);
+            if(flng == 1) d1 = wrap_difference(d1);
+
+            const double det = jac[0] * jac[3] - jac[1] * jac[2];
+            if(det == 0. || !std::isfinite(det))
+                return false;
+
+            const double dx = ( jac[3] * d0 - jac[1] * d1) / det;
+            const double dy = (-jac[2] * d0 + jac[0] * d1) / det;
+            px += dx;
+            py += dy;
+
+            if(std::abs(dx) < kConvergence && std::abs(dy) < kConvergence)
+            {
+                // Positions on the edges of the grid may come out of it by the interpolation error
+                if(!(px >= -ftolerance && px <= xmax * s + ftolerance && py >= -ftolerance && py <= ymax * s + ftolerance))
+                    return false;
+
+                x = px;
+                y = py;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+#pragma endregion
+#pragma endregion
+}
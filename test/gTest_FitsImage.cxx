@@ -2278,3 +2278,87 @@ TEST(FITSimgCast, Cast_UINT32_to_UINT16_clamping)
                 EXPECT_LE((*cdata)[k], U16_MAX);
         }
 }
+
+TEST(FITSimgCast, Cast_DOUBLE_to_INT16_rounding)
+{
+        verbose = verboseLevel::VERBOSE_NONE;
+
+        FITSimg<double> src(2, {4, 2});
+        auto sdata = src.GetData<double>();
+        ASSERT_NE(sdata, nullptr);
+
+        // 0.49999999999999994 is the double just below 0.5: adding 0.5 to it would round to 1
+        const double   in[]       = {1.5, -0.49999999999999994, 0.49999999999999994, -2.5, 40000., -40000., std::numeric_limits<double>::quiet_NaN(), 32767.4};
+        const int16_t  expected[] = {2, 0, 0, -3, 32767, -32768, 0, 32767};
+        const bool     overflow[] = {false, false, false, false, true, true, true, false};
+
+        for (size_t k = 0; k < src.Nelements(); ++k)
+                (*sdata)[k] = in[k];
+
+        // Overflows are masked by default
+        std::shared_ptr<FITScube> masked = src.cast<int16_t>();
+        ASSERT_NE(masked, nullptr);
+        auto mdata = masked->GetData<int16_t>();
+        ASSERT_NE(mdata, nullptr);
+
+        // Values are saturated whatever the masking option
+        std::shared_ptr<FITScube> unmasked = src.cast<int16_t>(false);
+        ASSERT_NE(unmasked, nullptr);
+        auto udata = unmasked->GetData<int16_t>();
+        ASSERT_NE(udata, nullptr);
+
+        for (size_t k = 0; k < src.Nelements(); ++k)
+        {
+                EXPECT_EQ((*mdata)[k], expected[k]) << "pixel " << k;
+                EXPECT_EQ((*udata)[k], expected[k]) << "pixel " << k;
+                EXPECT_EQ(masked->Masked(k), overflow[k]) << "pixel " << k;
+                EXPECT_FALSE(unmasked->Masked(k)) << "pixel " << k;
+        }
+}
+
+TEST(FITSimgVisit, MixedTypeOperatorsAndGenericKernel)
+{
+        verbose = verboseLevel::VERBOSE_NONE;
+
+        FITSimg<float>   a(2, {3, 2});
+        FITSimg<int16_t> b(2, {3, 2});
+
+        auto adata = a.GetData<float>();
+        auto bdata = b.GetData<int16_t>();
+        ASSERT_NE(adata, nullptr);
+        ASSERT_NE(bdata, nullptr);
+
+        for (size_t k = 0; k < a.Nelements(); ++k)
+        {
+                (*adata)[k] = 1.5f;
+                (*bdata)[k] = static_cast<int16_t>(k);
+        }
+        b.MaskPixel(4);
+
+        // Generic kernel instantiated for the storage type of b
+        const FITScube& cb = b;
+        const double sum = cb.Visit([](const auto& arr)
+        {
+                double s = 0.;
+                for (size_t k = 0; k < arr.size(); ++k)
+                        s += static_cast<double>(arr[k]);
+                return s;
+        });
+        EXPECT_DOUBLE_EQ(sum, 15.);
+
+        a += cb;
+        for (size_t k = 0; k < a.Nelements(); ++k)
+        {
+                // Masked pixels are left unchanged
+                EXPECT_FLOAT_EQ((*adata)[k], (k == 4) ? 1.5f : 1.5f + static_cast<float>(k));
+                EXPECT_EQ(a.Masked(k), k == 4) << "pixel " << k;
+        }
+
+        // Division masks the null divisor
+        a /= cb;
+        EXPECT_TRUE(a.Masked(0));
+        EXPECT_FLOAT_EQ((*adata)[2], 3.5f / 2.f);
+
+        FITSimg<int16_t> c(2, {2, 2});
+        EXPECT_THROW(a -= static_cast<const FITScube&>(c), FITSexception);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <DSTfits/FITShdu.h>
 #include <DSTfits/FITSimg.h>
+#include <DSTfits/FITSmosaic.h>
 #include <DSTfits/FITSexception.h>
 #include <DSTfits/FITSmanager.h>
 #include <DSTfits/DSF_version.h>
@@ -14,6 +15,8 @@
 #include <type_traits>
 #include <cmath>
 #include <filesystem>
+#include <random>
+#include <algorithm>
 
 using namespace DSL;
 
@@ -245,3 +248,1304 @@ TEST(FITSimgOverlay, SizeT)      { runOverlayTestsForType<size_t>(); }
 #endif
 TEST(FITSimgOverlay, Float)      { runOverlayTestsForType<float>(); }
 TEST(FITSimgOverlay, Double)     { runOverlayTestsForType<double>(); }
+
+// ---------------------------------------------------------------------------
+// Convolution
+// ---------------------------------------------------------------------------
+
+TEST(FITSimgConvolve, ConstantImageIsPreservedWithMask)
+{
+    FITSimg<float> img(std::vector<size_t>{32,24});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(5.f, k);
+
+    img.MaskPixel(std::vector<size_t>{10,10});
+    img.MaskPixel(std::vector<size_t>{0,0});
+
+    // same Gaussian weights, once as a separable kernel and once as a plain 2D kernel
+    const FITSkernel sep = FITSkernel::Gaussian(1.2);
+    const FITSkernel full(sep.Nx(), sep.Ny(), sep.Weights());
+
+    auto check = [&](const std::shared_ptr<FITScube>& res, const char* what)
+    {
+        const ::testing::ScopedTrace trace(__FILE__, __LINE__, what);
+        const auto* out = res->GetData<float>();
+        ASSERT_NE(out, nullptr);
+        ASSERT_EQ(out->size(), img.Nelements());
+        for(size_t i = 0; i < out->size(); ++i)
+            EXPECT_NEAR((*out)[i], 5.f, 1e-4) << "pixel " << i;
+
+        // masked pixels are filled from their neighbours but stay masked
+        EXPECT_TRUE (res->Masked(std::vector<size_t>{10,10}));
+        EXPECT_TRUE (res->Masked(std::vector<size_t>{0,0}));
+        EXPECT_FALSE(res->Masked(std::vector<size_t>{11,10}));
+    };
+
+    check(img.Convolve(sep,  FITSkernel::method::separable), "separable");
+    check(img.Convolve(full, FITSkernel::method::direct),    "direct");
+    check(img.Convolve(full, FITSkernel::method::fft),       "fft");
+}
+
+TEST(FITSimgConvolve, DirectAndFFTAgree)
+{
+    FITSimg<double> img(std::vector<size_t>{40,30,2});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(std::sin(0.37*static_cast<double>(k)) + 0.01*static_cast<double>(k%17), k);
+    img.MaskPixels(std::vector<size_t>{5, 77, 1300, 2001});
+
+    std::vector<double> w(9*7);
+    for(size_t k = 0; k < w.size(); ++k)
+        w[k] = 1. + static_cast<double>((k*7)%5);
+    FITSkernel k(9,7,w);
+
+    auto a = img.Convolve(k, FITSkernel::method::direct);
+    auto b = img.Convolve(k, FITSkernel::method::fft);
+
+    const auto* da = a->GetData<double>();
+    const auto* db = b->GetData<double>();
+    ASSERT_NE(da, nullptr);
+    ASSERT_NE(db, nullptr);
+    ASSERT_EQ(da->size(), img.Nelements());
+
+    for(size_t i = 0; i < da->size(); ++i)
+    {
+        EXPECT_NEAR((*da)[i], (*db)[i], 1e-9) << "pixel " << i;
+        EXPECT_EQ(a->Masked(i), b->Masked(i)) << "pixel " << i;
+    }
+}
+
+TEST(FITSimgConvolve, BoxOnIntegerImage)
+{
+    FITSimg<uint16_t> img(std::vector<size_t>{9,9});
+    img.SetPixelValue(static_cast<uint16_t>(900), std::vector<size_t>{4,4});
+
+    auto res = img.Convolve(FITSkernel::Box(3));
+    EXPECT_EQ(res->UShortValueAtPixel({4,4}), 100);
+    EXPECT_EQ(res->UShortValueAtPixel({3,5}), 100);
+    EXPECT_EQ(res->UShortValueAtPixel({2,4}), 0);
+    EXPECT_EQ(res->HDU().GetValueForKey("CONVKERN"), "BOX");
+}
+
+TEST(FITSimgConvolve, InvalidKernel)
+{
+    EXPECT_THROW(FITSkernel(2,3,std::vector<double>(6,1.)), FITSexception);
+    EXPECT_THROW(FITSkernel(3,3,std::vector<double>(8,1.)), FITSexception);
+    EXPECT_THROW(FITSkernel::Gaussian(0.), FITSexception);
+    EXPECT_THROW(FITSkernel(3,3,std::vector<double>(9,1.)).Resolve(FITSkernel::method::separable,10,10), FITSexception);
+}
+
+// ---------------------------------------------------------------------------
+// Reprojection
+// ---------------------------------------------------------------------------
+
+// Celestial TAN projection, 1 arcsec pixels centred on (150,2) deg
+static void setTanWcs(FITShdu& h, const double& crpix1, const double& crpix2)
+{
+    h.ValueForKey("CTYPE1", "RA---TAN", fChar, "");
+    h.ValueForKey("CTYPE2", "DEC--TAN", fChar, "");
+    h.ValueForKey("CRPIX1", crpix1, "");
+    h.ValueForKey("CRPIX2", crpix2, "");
+    h.ValueForKey("CRVAL1", 150., "");
+    h.ValueForKey("CRVAL2", 2., "");
+    h.ValueForKey("CDELT1", -1./3600., "");
+    h.ValueForKey("CDELT2",  1./3600., "");
+}
+
+TEST(FITSimgReproject, IdentityGridPreservesData)
+{
+    FITSimg<double> img(std::vector<size_t>{24,20});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(3.*static_cast<double>(k%24) + 2.*static_cast<double>(k/24), k);
+    setTanWcs(img.HDU(), 12., 10.);
+    img.reLoadWCS();
+
+    for(auto m : {FITSinterpolator::method::nearest, FITSinterpolator::method::bilinear, FITSinterpolator::method::bicubic})
+    {
+        const ::testing::ScopedTrace trace(__FILE__, __LINE__, FITSinterpolator::Name(m));
+        auto res = img.Reproject(img.getWCS(), {24,20}, m);
+        ASSERT_EQ(res->Nelements(), img.Nelements());
+
+        const auto* in  = img.GetData<double>();
+        const auto* out = res->GetData<double>();
+        ASSERT_NE(out, nullptr);
+        for(size_t i = 0; i < out->size(); ++i)
+        {
+            EXPECT_NEAR((*out)[i], (*in)[i], 1e-6) << "pixel " << i;
+            EXPECT_FALSE(res->Masked(i)) << "pixel " << i;
+        }
+        EXPECT_EQ(res->HDU().GetValueForKey("REPROJ"), FITSinterpolator::Name(m));
+    }
+}
+
+TEST(FITSimgReproject, ShiftedGridInterpolatesAndMasks)
+{
+    FITSimg<double> img(std::vector<size_t>{30,16,2});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+    {
+        const size_t x = k%30, y = (k/30)%16, z = k/480;
+        img.SetPixelValue(3.*static_cast<double>(x) + 2.*static_cast<double>(y) + 100.*static_cast<double>(z), k);
+    }
+    setTanWcs(img.HDU(), 15., 8.);
+    img.HDU().ValueForKey("CTYPE3", "FREQ", fChar, "");
+    img.HDU().ValueForKey("CRPIX3", 1., "");
+    img.HDU().ValueForKey("CRVAL3", 1.4e9, "");
+    img.HDU().ValueForKey("CDELT3", 1.e6, "");
+    img.HDU().ValueForKey("OBJECT", "NGC 3115", fChar, "Target");
+    img.HDU().ValueForKey("EXPTIME", 120., "Exposure time");
+    img.reLoadWCS();
+
+    // output pixel (i,j) sits on input pixel (i-2.5,j)
+    FITShdu target;
+    target.ValueForKey("NAXIS", 3);
+    setTanWcs(target, 17.5, 8.);
+    target.ValueForKey("CTYPE3", "FREQ", fChar, "");
+    target.ValueForKey("CRPIX3", 1., "");
+    target.ValueForKey("CRVAL3", 1.4e9, "");
+    target.ValueForKey("CDELT3", 1.e6, "");
+
+    auto res = img.Reproject(FITSwcs(target), {20,16}, FITSinterpolator::method::bilinear);
+    ASSERT_EQ(res->Size(1), 20u);
+    ASSERT_EQ(res->Size(2), 16u);
+    ASSERT_EQ(res->Size(3), 2u);
+
+    for(size_t z = 0; z < 2; ++z)
+    for(size_t j = 0; j < 16; ++j)
+    for(size_t i = 0; i < 20; ++i)
+    {
+        const std::vector<size_t> px{i,j,z};
+        if(i < 2)
+        {
+            EXPECT_TRUE(res->Masked(px)) << i << "," << j << "," << z;
+            continue;
+        }
+        EXPECT_FALSE(res->Masked(px)) << i << "," << j << "," << z;
+        EXPECT_NEAR(res->DoubleValueAtPixel({i,j,z}), 3.*(static_cast<double>(i)-2.5) + 2.*static_cast<double>(j) + 100.*static_cast<double>(z), 1e-6);
+    }
+
+    EXPECT_NEAR(res->getWCS().CRPIX(0,1), 17.5, 1e-12);
+
+    // The other keywords of the source header are kept, the WCS is the target one
+    EXPECT_EQ(res->HDU().GetValueForKey("OBJECT"), "NGC 3115");
+    EXPECT_DOUBLE_EQ(res->HDU().GetDoubleValueForKey("EXPTIME"), 120.);
+    EXPECT_NEAR(res->HDU().GetDoubleValueForKey("CRPIX1"), 17.5, 1e-12);
+    EXPECT_EQ(res->HDU().GetInt32ValueForKey("NAXIS1"), 20);
+}
+
+TEST(FITSimgReproject, InvalidInput)
+{
+    FITSimg<int16_t> img(std::vector<size_t>{8,8});
+    FITShdu target;
+    setTanWcs(target, 4., 4.);
+
+    // no WCS on the image
+    EXPECT_THROW(img.Reproject(FITSwcs(target), {8,8}), WCSexception);
+
+    setTanWcs(img.HDU(), 4., 4.);
+    img.reLoadWCS();
+    EXPECT_THROW(img.Reproject(FITSwcs(target), {0,8}), FITSexception);
+    EXPECT_THROW(img.Reproject(FITSwcs(target), {8,8}, FITSinterpolator::method::nearest, 1), WCSexception);
+}
+
+// ---------------------------------------------------------------------------
+// Mosaic
+// ---------------------------------------------------------------------------
+
+// 20x20 constant image whose pixel p lands on pixel p+offset of a target grid with CRPIX1 = 20
+static FITSimg<float> makeMosaicInput(const float& value, const double& offset)
+{
+    FITSimg<float> img(std::vector<size_t>{20,20});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(value, k);
+    setTanWcs(img.HDU(), 20. - offset, 10.);
+    img.reLoadWCS();
+    return img;
+}
+
+TEST(FITSmosaic, WeightedCoaddition)
+{
+    FITShdu target;
+    setTanWcs(target, 20., 10.);
+    FITSmosaic mosaic(FITSwcs(target), {40,20}, FITSinterpolator::method::bilinear, 16);
+
+    EXPECT_EQ(mosaic.Add(makeMosaicInput(2.f,  0.), 1.), 400u);
+    EXPECT_EQ(mosaic.Add(makeMosaicInput(4.f, 10.), 3.), 400u);
+    EXPECT_EQ(mosaic.Add(makeMosaicInput(9.f, 200.), 1.), 0u);     // off the target grid
+    EXPECT_EQ(mosaic.NumberOfInputs(), 2u);
+
+    auto sci = mosaic.Science();
+    auto wgt = mosaic.Weight();
+    ASSERT_EQ(sci->Nelements(), 800u);
+    EXPECT_EQ(sci->HDU().GetValueForKey("EXTNAME"), "SCIENCE");
+
+    for(size_t j = 0; j < 20; ++j)
+    for(size_t i = 0; i < 40; ++i)
+    {
+        const std::vector<size_t> px{i,j};
+        const float w = wgt->FloatValueAtPixel({i,j});
+        if(i < 10)      { EXPECT_NEAR(sci->FloatValueAtPixel({i,j}), 2.f,  1e-5); EXPECT_FLOAT_EQ(w, 1.f); }
+        else if(i < 20) { EXPECT_NEAR(sci->FloatValueAtPixel({i,j}), 3.5f, 1e-5); EXPECT_FLOAT_EQ(w, 4.f); }
+        else if(i < 30) { EXPECT_NEAR(sci->FloatValueAtPixel({i,j}), 4.f,  1e-5); EXPECT_FLOAT_EQ(w, 3.f); }
+        else            { EXPECT_TRUE(sci->Masked(px)); EXPECT_FLOAT_EQ(w, 0.f); }
+    }
+
+    mosaic.Reset();
+    EXPECT_EQ(mosaic.NumberOfInputs(), 0u);
+    EXPECT_TRUE(mosaic.Science()->Masked(std::vector<size_t>{0,0}));
+}
+
+TEST(FITSmosaic, WeightMapAndMask)
+{
+    FITShdu target;
+    setTanWcs(target, 20., 10.);
+    FITSmosaic mosaic(FITSwcs(target), {40,20});
+
+    FITSimg<float> a = makeMosaicInput(2.f, 0.);
+    FITSimg<float> b = makeMosaicInput(6.f, 0.);
+    b.MaskPixel(std::vector<size_t>{5,5});
+
+    FITSimg<double> wmap(std::vector<size_t>{20,20});
+    for(size_t k = 0; k < wmap.Nelements(); ++k)
+        wmap.SetPixelValue(1., k);
+
+    mosaic.Add(a, 1.);
+    mosaic.Add(b, wmap);
+
+    auto sci = mosaic.Science();
+    EXPECT_NEAR(sci->FloatValueAtPixel({3,3}), 4.f, 1e-5);
+    EXPECT_NEAR(sci->FloatValueAtPixel({5,5}), 2.f, 1e-5);    // masked in b, only a contributes
+
+    EXPECT_THROW(mosaic.Add(a, 0.), FITSexception);
+    EXPECT_THROW(mosaic.Add(a, FITSimg<double>(std::vector<size_t>{10,10})), FITSexception);
+}
+
+// ---------------------------------------------------------------------------
+// Background
+// ---------------------------------------------------------------------------
+
+TEST(FITSimgBackground, GradientIsRecoveredAndSubtracted)
+{
+    FITSimg<float> img(std::vector<size_t>{256,192});
+    std::mt19937 gen(42);
+    std::normal_distribution<double> noise(0., 4.);
+
+    auto sky = [](size_t x, size_t y){ return 200. + 0.05*static_cast<double>(x) - 0.03*static_cast<double>(y); };
+
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(static_cast<float>(sky(k%256, k/256) + noise(gen)), k);
+
+    // a few bright sources that the clipping should reject
+    for(size_t s = 0; s < 40; ++s)
+        img.SetPixelValue(5000.f, std::vector<size_t>{(s*37)%256, (s*53)%192});
+
+    FITSbackground bkg(32, 32, 3, FITSbackground::estimator::mode);
+    auto map = img.Background(bkg);
+    EXPECT_EQ(bkg.CellsX(), 8u);
+    EXPECT_EQ(bkg.CellsY(), 6u);
+    EXPECT_NEAR(bkg.GlobalRMS(), 4., 0.3);
+
+    for(size_t y = 16; y < 176; y += 7)
+    for(size_t x = 16; x < 240; x += 7)
+        EXPECT_NEAR(map->FloatValueAtPixel({x,y}), sky(x,y), 1.) << x << "," << y;
+
+    img.SubtractBackground(bkg);
+    EXPECT_NEAR(img.HDU().GetDoubleValueForKey("SKYLEVEL"), 200. + 0.05*128. - 0.03*96., 2.);
+    EXPECT_NEAR(img.GetMedian(), 0., 0.5);
+}
+
+TEST(FITSimgBackground, MaskedPixelsAreIgnored)
+{
+    FITSimg<uint16_t> img(std::vector<size_t>{64,64});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(static_cast<uint16_t>(10 + (k%3)), k);
+
+    // a masked 20x20 block of hot pixels
+    std::vector<size_t> hot;
+    for(size_t y = 20; y < 40; ++y)
+    for(size_t x = 20; x < 40; ++x)
+    {
+        img.SetPixelValue(static_cast<uint16_t>(1000), std::vector<size_t>{x,y});
+        hot.push_back(y*64 + x);
+    }
+    img.MaskPixels(hot);
+
+    FITSbackground bkg(16, 16, 1, FITSbackground::estimator::median);
+    auto map = img.Background(bkg);
+    for(size_t k = 0; k < map->Nelements(); ++k)
+        EXPECT_NEAR(map->UShortValueAtPixel(k), 11, 1) << "pixel " << k;
+}
+
+TEST(FITSimgBackground, InvalidParameters)
+{
+    EXPECT_THROW(FITSbackground(0, 32), FITSexception);
+    EXPECT_THROW(FITSbackground(32, 32, 2), FITSexception);
+    EXPECT_THROW(FITSbackground(32, 32, 3, FITSbackground::estimator::mode, 0.), FITSexception);
+    EXPECT_THROW(FITSbackground().GlobalBackground(), FITSexception);
+}
+
+// ---------------------------
+// Source detection tests
+// ---------------------------
+
+template<typename C>
+static const std::vector<C>& columnValues(const std::shared_ptr<FITStable>& table, const std::string& name)
+{
+    auto* col = dynamic_cast<FITScolumn<C>*>(table->getColumn(name).get());
+    if(col == nullptr)
+        throw std::runtime_error("missing column " + name);
+    return col->template values<C>();
+}
+
+static void addBlob(FITSimg<double>& img, const size_t& nx, const double& cx, const double& cy, const double& amp)
+{
+    for(long dy = -3; dy <= 3; ++dy)
+    for(long dx = -3; dx <= 3; ++dx)
+    {
+        const size_t x = static_cast<size_t>(std::lround(cx) + dx);
+        const size_t y = static_cast<size_t>(std::lround(cy) + dy);
+        const double r2 = (static_cast<double>(x)-cx)*(static_cast<double>(x)-cx) + (static_cast<double>(y)-cy)*(static_cast<double>(y)-cy);
+        const size_t k = y*nx + x;
+        img.SetPixelValue(img.DoubleValueAtPixel(k) + amp*std::exp(-r2/2.), k);
+    }
+}
+
+TEST(FITSimgDetection, SegmentsAreMeasured)
+{
+    FITSimg<double> img(std::vector<size_t>{128,96});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(0., k);
+
+    addBlob(img, 128, 20., 30., 100.);
+    addBlob(img, 128, 90., 15., 50.);
+    addBlob(img, 128, 64., 70., 80.);
+
+    // Isolated speck smaller than the minimum area
+    img.SetPixelValue(40., std::vector<size_t>{110,80});
+    img.SetPixelValue(40., std::vector<size_t>{111,80});
+
+    // Stripes of 8 rows: the third blob spans a stripe boundary
+    FITSdetection det(5., 5, true, 8);
+    auto table = img.Detect(det, 0., 1.);
+
+    ASSERT_EQ(table->nrows(), 3u);
+    EXPECT_EQ(det.NumberOfSegments(), 3u);
+    EXPECT_DOUBLE_EQ(table->HDU().GetDoubleValueForKey("DETSIG"), 5.);
+
+    // Raster order of the first pixel
+    const auto& x    = columnValues<double>(table, "X");
+    const auto& y    = columnValues<double>(table, "Y");
+    const auto& peak = columnValues<double>(table, "PEAK");
+    const auto& xmin = columnValues<int32_t>(table, "XMIN");
+    const auto& xmax = columnValues<int32_t>(table, "XMAX");
+    const auto& npix = columnValues<int32_t>(table, "NPIX");
+    const auto& num  = columnValues<int32_t>(table, "NUMBER");
+
+    EXPECT_NEAR(x[0], 90., 1e-6);  EXPECT_NEAR(y[0], 15., 1e-6);
+    EXPECT_NEAR(x[1], 20., 1e-6);  EXPECT_NEAR(y[1], 30., 1e-6);
+    EXPECT_NEAR(x[2], 64., 1e-6);  EXPECT_NEAR(y[2], 70., 1e-6);
+    EXPECT_DOUBLE_EQ(peak[1], 100.);
+    EXPECT_EQ(num[2], 3);
+
+    // 100*exp(-r2/2) > 5 for r2 < 5.99: 21 pixels
+    EXPECT_EQ(npix[1], 21);
+    EXPECT_EQ(xmin[1], 18);
+    EXPECT_EQ(xmax[1], 22);
+
+    // The segmentation map covers exactly the kept segments
+    std::vector<uint32_t> seg(128*96);
+    det.Segmentation(seg.data());
+    size_t painted = 0;
+    for(const auto& s : seg)
+        painted += (s > 0);
+    EXPECT_EQ(painted, static_cast<size_t>(npix[0] + npix[1] + npix[2]));
+    EXPECT_EQ(seg[30*128 + 20], 2u);
+    EXPECT_EQ(seg[80*128 + 110], 0u);
+}
+
+TEST(FITSimgDetection, ConnectivityAndMask)
+{
+    // Diagonal chain of 6 pixels: one segment with 8 connectivity, none with 4 connectivity
+    FITSimg<double> img(std::vector<size_t>{32,32});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(0., k);
+    for(size_t k = 0; k < 6; ++k)
+        img.SetPixelValue(10., std::vector<size_t>{5+k, 3+k});
+
+    FITSdetection det8(3., 5, true, 2);
+    FITSdetection det4(3., 5, false, 2);
+    EXPECT_EQ(img.Detect(det8, 0., 1.)->nrows(), 1u);
+    EXPECT_EQ(img.Detect(det4, 0., 1.)->nrows(), 0u);
+    EXPECT_EQ(det8.Segments()[0].npix, 6u);
+    EXPECT_EQ(det8.Segments()[0].ymin, 3u);
+    EXPECT_EQ(det8.Segments()[0].ymax, 8u);
+
+    // Masking the middle of the chain splits it in two segments below the minimum area
+    img.MaskPixels(std::vector<size_t>{5*32 + 7});
+    EXPECT_EQ(img.Detect(det8, 0., 1.)->nrows(), 0u);
+}
+
+TEST(FITSimgDetection, BackgroundMap)
+{
+    FITSimg<float> img(std::vector<size_t>{256,256});
+    std::mt19937 gen(7);
+    std::normal_distribution<double> noise(0., 2.);
+
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(static_cast<float>(300. + 0.1*static_cast<double>(k%256) + noise(gen)), k);
+
+    const std::vector<std::pair<size_t,size_t>> sources = {{40,40}, {200,60}, {128,128}, {70,210}};
+    for(const auto& s : sources)
+    for(long dy = -2; dy <= 2; ++dy)
+    for(long dx = -2; dx <= 2; ++dx)
+    {
+        const size_t k = (s.second + dy)*256 + s.first + dx;
+        img.SetPixelValue(static_cast<float>(img.FloatValueAtPixel(k) + 200.*std::exp(-0.5*static_cast<double>(dx*dx + dy*dy))), k);
+    }
+
+    FITSbackground bkg(32, 32, 3);
+    FITSdetection  det(5., 5);
+    auto table = img.Detect(det, bkg);
+
+    ASSERT_EQ(table->nrows(), sources.size());
+    EXPECT_EQ(table->HDU().GetValueForKey("BKGMESH"), "32x32");
+
+    const auto& x = columnValues<double>(table, "X");
+    const auto& y = columnValues<double>(table, "Y");
+    EXPECT_NEAR(x[0],  40., 0.2); EXPECT_NEAR(y[0],  40., 0.2);
+    EXPECT_NEAR(x[1], 200., 0.2); EXPECT_NEAR(y[1],  60., 0.2);
+    EXPECT_NEAR(x[2], 128., 0.2); EXPECT_NEAR(y[2], 128., 0.2);
+    EXPECT_NEAR(x[3],  70., 0.2); EXPECT_NEAR(y[3], 210., 0.2);
+}
+
+TEST(FITSimgDetection, InvalidParameters)
+{
+    EXPECT_THROW(FITSdetection(-1.), FITSexception);
+    EXPECT_THROW(FITSdetection(3., 5, true, 0), FITSexception);
+
+    FITSdetection det;
+    std::vector<double> plane(16, 0.);
+    EXPECT_THROW(det.Detect(plane.data(), nullptr, 4, 4, 0., -1.), FITSexception);
+    EXPECT_THROW(det.Detect(nullptr, nullptr, 4, 4, 0., 1.), FITSexception);
+    EXPECT_THROW(det.Detect(plane.data(), nullptr, 0, 4, 0., 1.), FITSexception);
+}
+
+// ---------------------------
+// Geometric transform tests
+// ---------------------------
+
+TEST(FITSimgWarp, ShiftInterpolatesAndMasks)
+{
+    FITSimg<double> img(std::vector<size_t>{32,24,2});
+    auto ramp = [](const double& x, const double& y, const size_t& z){ return 2. + 0.5*x - 0.25*y + 10.*static_cast<double>(z); };
+
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(ramp(static_cast<double>(k%32), static_cast<double>((k/32)%24), k/768), k);
+    setTanWcs(img.HDU(), 15., 12.);
+    img.reLoadWCS();
+
+    auto res = img.Shift(2.5, -1.25, FITSinterpolator::method::bicubic);
+    ASSERT_EQ(res->Nelements(), img.Nelements());
+    EXPECT_EQ(res->HDU().GetValueForKey("WARP"), "BICUBIC");
+
+    for(size_t z = 0; z < 2; ++z)
+    for(size_t j = 0; j < 24; ++j)
+    for(size_t i = 0; i < 32; ++i)
+    {
+        const std::vector<size_t> px{i,j,z};
+        if(i < 2 || j > 22)
+        {
+            EXPECT_TRUE(res->Masked(px)) << i << "," << j << "," << z;
+            continue;
+        }
+
+        EXPECT_FALSE(res->Masked(px)) << i << "," << j << "," << z;
+        if(i >= 5 && i <= 27 && j >= 1 && j <= 18)
+        {
+            EXPECT_NEAR(res->DoubleValueAtPixel({i,j,z}), ramp(static_cast<double>(i)-2.5, static_cast<double>(j)+1.25, z), 1e-9) << i << "," << j << "," << z;
+        }
+    }
+
+    EXPECT_NEAR(res->getWCS().CRPIX(0,1), 17.5, 1e-12);
+    EXPECT_NEAR(res->getWCS().CRPIX(0,2), 10.75, 1e-12);
+}
+
+TEST(FITSimgWarp, RotateQuarterTurn)
+{
+    FITSimg<int32_t> img(std::vector<size_t>{33,33});
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        img.SetPixelValue(static_cast<int32_t>(k), k);
+    setTanWcs(img.HDU(), 17., 17.);
+    img.reLoadWCS();
+
+    // Counter-clockwise around pixel (16,16): the pixel (x,y) lands at (32-y,x)
+    auto res = img.Rotate(90., FITSinterpolator::method::nearest);
+
+    for(size_t j = 0; j < 33; ++j)
+    for(size_t i = 0; i < 33; ++i)
+    {
+        EXPECT_FALSE(res->Masked(std::vector<size_t>{i,j})) << i << "," << j;
+        EXPECT_EQ(res->DoubleValueAtPixel({i,j}), img.DoubleValueAtPixel({j,32-i})) << i << "," << j;
+    }
+
+    EXPECT_NEAR(res->HDU().GetDoubleValueForKey("PC1_1"),  0., 1e-12);
+    EXPECT_NEAR(res->HDU().GetDoubleValueForKey("PC1_2"),  1., 1e-12);
+    EXPECT_NEAR(res->HDU().GetDoubleValueForKey("PC2_1"), -1., 1e-12);
+    EXPECT_NEAR(res->HDU().GetDoubleValueForKey("PC2_2"),  0., 1e-12);
+
+    // The sky does not move with the pixels
+    const worldCoords before = img.WorldCoordinates(pixelCoords{5., 9.});
+    const worldCoords after  = res->WorldCoordinates(pixelCoords{23., 5.});
+    ASSERT_EQ(before.size(), after.size());
+    for(size_t k = 0; k < before.size(); ++k)
+        EXPECT_NEAR(before[k], after[k], 1e-9);
+}
+
+TEST(FITSimgWarp, InvalidTransform)
+{
+    FITSimg<float> img(std::vector<size_t>{8,8});
+    EXPECT_THROW(img.AffineWarp({1., 2., 2., 4.}, {0., 0.}), FITSexception);
+    EXPECT_THROW(img.Shift(std::numeric_limits<double>::quiet_NaN(), 0.), FITSexception);
+
+    FITSimg<float> line(std::vector<size_t>{8});
+    EXPECT_THROW(line.Shift(1., 0.), FITSexception);
+}
+
+// ---------------- Mask morphology ----------------
+
+static size_t countMasked(const FITScube& img)
+{
+    size_t n = 0;
+    for(size_t k = 0; k < img.Nelements(); ++k)
+        n += img.Masked(k) ? 1 : 0;
+    return n;
+}
+
+TEST(FITSimgMorphology, DilateErodeAcrossWords)
+{
+    // 80 columns: rows span two 64 bits words
+    FITSimg<float> img(std::vector<size_t>{80,20,2});
+    img.MaskPixel(std::vector<size_t>{63,10,0});
+
+    img.DilateMask(FITSmorphology(FITSmorphology::shape::box, 2));
+    EXPECT_EQ(countMasked(img), 25u);
+    for(size_t j = 8; j <= 12; ++j)
+    for(size_t i = 61; i <= 65; ++i)
+        EXPECT_TRUE(img.Masked(std::vector<size_t>{i,j,0})) << i << "," << j;
+    EXPECT_FALSE(img.Masked(std::vector<size_t>{63,10,1}));
+
+    img.ErodeMask(FITSmorphology(FITSmorphology::shape::box, 2));
+    EXPECT_EQ(countMasked(img), 1u);
+    EXPECT_TRUE(img.Masked(std::vector<size_t>{63,10,0}));
+
+    img.DilateMask(FITSmorphology(FITSmorphology::shape::disk, 2));
+    EXPECT_EQ(countMasked(img), 13u);
+    EXPECT_TRUE(img.Masked(std::vector<size_t>{65,10,0}));
+    EXPECT_FALSE(img.Masked(std::vector<size_t>{65,11,0}));
+
+    // The borders of the plane do not erode the mask
+    FITSimg<float> corner(std::vector<size_t>{80,20});
+    for(size_t j = 0; j < 3; ++j)
+    for(size_t i = 0; i < 3; ++i)
+        corner.MaskPixel(std::vector<size_t>{i,j});
+
+    corner.ErodeMask(FITSmorphology(FITSmorphology::shape::box, 1));
+    EXPECT_EQ(countMasked(corner), 4u);
+    EXPECT_TRUE(corner.Masked(std::vector<size_t>{1,1}));
+    EXPECT_FALSE(corner.Masked(std::vector<size_t>{2,1}));
+}
+
+TEST(FITSimgMorphology, OpenCloseAndFillHoles)
+{
+    FITSimg<float> img(std::vector<size_t>{100,30});
+
+    // 5x5 block and an isolated pixel: the opening only keeps the block
+    for(size_t j = 5; j < 10; ++j)
+    for(size_t i = 5; i < 10; ++i)
+        img.MaskPixel(std::vector<size_t>{i,j});
+    img.MaskPixel(std::vector<size_t>{20,20});
+
+    img.OpenMask(FITSmorphology(FITSmorphology::shape::box, 1));
+    EXPECT_EQ(countMasked(img), 25u);
+    EXPECT_FALSE(img.Masked(std::vector<size_t>{20,20}));
+
+    // One pixel gap in a horizontal line is closed
+    FITSimg<float> line(std::vector<size_t>{100,30});
+    for(size_t i = 30; i < 90; ++i)
+        if(i != 70)
+            line.MaskPixel(std::vector<size_t>{i,15});
+
+    line.CloseMask(FITSmorphology(FITSmorphology::shape::box, 1));
+    EXPECT_EQ(countMasked(line), 60u);
+    EXPECT_TRUE(line.Masked(std::vector<size_t>{70,15}));
+
+    // A closed ring is filled, a ring opened to the border is not
+    FITSimg<float> rings(std::vector<size_t>{100,30});
+    for(size_t j = 10; j < 20; ++j)
+    for(size_t i = 60; i < 70; ++i)
+        if(i == 60 || i == 69 || j == 10 || j == 19)
+            rings.MaskPixel(std::vector<size_t>{i,j});
+    for(size_t j = 0; j < 6; ++j)
+    for(size_t i = 0; i < 6; ++i)
+        if((i == 5 || j == 5) && i != 0)
+            rings.MaskPixel(std::vector<size_t>{i,j});
+
+    const size_t before = countMasked(rings);
+    rings.FillMaskHoles();
+    EXPECT_EQ(countMasked(rings), before + 64u);
+    EXPECT_TRUE(rings.Masked(std::vector<size_t>{64,14}));
+    EXPECT_FALSE(rings.Masked(std::vector<size_t>{2,2}));
+}
+
+TEST(FITSimgMorphology, InvalidElement)
+{
+    EXPECT_THROW(FITSmorphology(std::vector<bool>(4, true), 2, 2), FITSexception);
+    EXPECT_THROW(FITSmorphology(std::vector<bool>(9, false), 3, 3), FITSexception);
+    EXPECT_THROW(FITSmorphology(std::vector<bool>(8, true), 3, 3), FITSexception);
+
+    FITSmorphology disk(FITSmorphology::shape::disk, 3);
+    EXPECT_EQ(disk.Area(), 29u);
+    EXPECT_EQ(disk.NumberOfSpans(), 7u);
+}
+
+// ---------------- CCD calibration ----------------
+
+TEST(FITSimgCalibration, FusedBiasDarkFlat)
+{
+    const size_t nx = 16, ny = 8;
+
+    FITSimg<float> bias(std::vector<size_t>{nx,ny});
+    FITSimg<double> dark(std::vector<size_t>{nx,ny});
+    FITSimg<float> flat(std::vector<size_t>{nx,ny});
+    FITSimg<uint8_t> bpm(std::vector<size_t>{nx,ny});
+    FITSimg<uint16_t> raw(std::vector<size_t>{nx,ny,2});
+
+    bias.HDU().ValueForKey("EXTNAME",std::string("BIAS"),fChar,"");
+    dark.HDU().ValueForKey("EXPTIME",20.,"Exposure time");
+    raw.HDU().ValueForKey("EXPTIME",10.,"Exposure time");
+
+    for(size_t k = 0; k < nx*ny; ++k)
+    {
+        bias.SetPixelValue(static_cast<float>(100 + k%7), k);
+        dark.SetPixelValue(40., k);
+        flat.SetPixelValue((k%4 == 0) ? 4.f : 2.f, k);
+        raw.SetPixelValue(static_cast<uint16_t>(1000 + 3*k), k);
+        raw.SetPixelValue(static_cast<uint16_t>(2000 + k), nx*ny + k);
+    }
+    flat.SetPixelValue(0.f, 5);
+    bpm.SetPixelValue(static_cast<uint8_t>(1), 9);
+    raw.MaskPixel(std::vector<size_t>{3,2,1});
+
+    FITScalibration cal;
+    cal.SetBias(bias);
+    cal.SetDark(dark);
+    cal.SetFlat(flat);
+    cal.SetBadPixels(bpm, "bpm.fits");
+
+    EXPECT_DOUBLE_EQ(cal.DarkTime(), 20.);
+    EXPECT_DOUBLE_EQ(cal.FlatNorm(), 2.);
+    EXPECT_EQ(cal.NumberOfBadPixels(), 2u);
+
+    auto res = raw.Calibrate(cal);
+    ASSERT_EQ(res->Nelements(), raw.Nelements());
+    EXPECT_EQ(res->GetBitPerPixel(), -32);
+    EXPECT_EQ(res->HDU().GetValueForKey("CALBIAS"), "BIAS");
+    EXPECT_EQ(res->HDU().GetValueForKey("CALDARK"), "MASTER");
+    EXPECT_EQ(res->HDU().GetValueForKey("CALBPM"), "bpm.fits");
+    EXPECT_DOUBLE_EQ(res->HDU().GetDoubleValueForKey("DARKSCAL"), 0.5);
+    EXPECT_DOUBLE_EQ(res->HDU().GetDoubleValueForKey("FLATNORM"), 2.);
+
+    for(size_t z = 0; z < 2; ++z)
+    for(size_t k = 0; k < nx*ny; ++k)
+    {
+        const size_t i = z*nx*ny + k;
+        if(k == 5 || k == 9 || i == nx*ny + 2*nx + 3)
+        {
+            EXPECT_TRUE(res->Masked(i)) << i;
+            continue;
+        }
+
+        const double rawv = (z == 0) ? 1000. + 3.*k : 2000. + k;
+        const double expected = (rawv - (100. + k%7) - 2.*10.) / (((k%4 == 0) ? 4. : 2.) / 2.);
+
+        EXPECT_FALSE(res->Masked(i)) << i;
+        EXPECT_NEAR(res->DoubleValueAtPixel(i), expected, 1e-3) << i;
+    }
+
+    // The same calibration is reused with an explicit exposure time
+    auto res5 = raw.Calibrate(cal, 5.);
+    EXPECT_DOUBLE_EQ(res5->HDU().GetDoubleValueForKey("DARKSCAL"), 0.25);
+    EXPECT_NEAR(res5->DoubleValueAtPixel(1), (1003. - 101. - 10.) / 1., 1e-3);
+}
+
+TEST(FITSimgCalibration, InvalidMasters)
+{
+    FITScalibration cal;
+    FITSimg<float> raw(std::vector<size_t>{8,8});
+    EXPECT_THROW(raw.Calibrate(cal, 1.), FITSexception);
+
+    FITSimg<float> dark(std::vector<size_t>{8,8});
+    EXPECT_THROW(cal.SetDark(dark), FITSexception);
+    cal.SetDark(dark, 30.);
+    EXPECT_THROW(raw.Calibrate(cal), FITSexception);
+
+    FITSimg<float> other(std::vector<size_t>{8,4});
+    EXPECT_THROW(cal.SetBias(other), FITSexception);
+    EXPECT_THROW(other.Calibrate(cal, 1.), FITSexception);
+
+    FITSimg<float> flat(std::vector<size_t>{8,8});
+    EXPECT_THROW(cal.SetFlat(flat), FITSexception);
+}
+
+TEST(FITSimgHistogram, ExactAndBinnedCounts)
+{
+    FITSimg<uint16_t> img(std::vector<size_t>{64,64});
+    std::valarray<uint16_t>* data = img.GetData<uint16_t>();
+    ASSERT_NE(data, nullptr);
+
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = static_cast<uint16_t>(k % 1000);
+
+    std::vector<size_t> masked;
+    for(size_t k = 0; k < data->size(); k += 13)
+        masked.push_back(k);
+    img.MaskPixels(masked);
+
+    std::vector<uint64_t> exact(65536, 0);
+    std::vector<uint64_t> binned(10, 0);
+    for(size_t k = 0; k < data->size(); ++k)
+    {
+        if(img.Masked(k))
+            continue;
+        exact[(*data)[k]]++;
+        binned[(*data)[k] / 100]++;
+    }
+
+    FITShistogram e = img.ExactHistogram();
+    ASSERT_EQ(e.NumberOfBins(), 65536u);
+    EXPECT_DOUBLE_EQ(e.BinCenter(7), 7.);
+    EXPECT_EQ(e.Counts(), exact);
+
+    FITShistogram h = img.Histogram(10, {0., 1000.});
+    EXPECT_EQ(h.Counts(), binned);
+    EXPECT_EQ(h.Underflow(), 0u);
+    EXPECT_EQ(h.Overflow(), 0u);
+}
+
+TEST(FITSimgHistogram, FloatRangeAndMode)
+{
+    FITSimg<float> img(std::vector<size_t>{32,32});
+    std::valarray<float>* data = img.GetData<float>();
+    ASSERT_NE(data, nullptr);
+
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = (k % 4 == 0) ? 5.25f : static_cast<float>(k % 10);
+    (*data)[1] = std::numeric_limits<float>::quiet_NaN();
+
+    // Default range spans the finite values, NaN is ignored
+    FITShistogram h = img.Histogram(9);
+    EXPECT_DOUBLE_EQ(h.Low(), 0.);
+    EXPECT_DOUBLE_EQ(h.High(), 9.);
+    EXPECT_EQ(h.Entries(), data->size() - 1);
+    EXPECT_DOUBLE_EQ(h.Mode(), 5.5);
+
+    EXPECT_THROW(img.ExactHistogram(), FITSexception);
+    EXPECT_THROW(img.Histogram(0), FITSexception);
+}
+
+namespace
+{
+    // Reference quantiles from a full sort
+    std::vector<double> sortedQuantiles(std::vector<double> v, const std::vector<double>& probs)
+    {
+        std::sort(v.begin(), v.end());
+        std::vector<double> q;
+        for(const double& p : probs)
+        {
+            const double pos = p * static_cast<double>(v.size() - 1);
+            const size_t lo  = static_cast<size_t>(pos);
+            const size_t hi  = std::min(v.size() - 1, lo + 1);
+            q.push_back(v[lo] + (pos - static_cast<double>(lo)) * (v[hi] - v[lo]));
+        }
+        return q;
+    }
+}
+
+TEST(FITSimgQuantiles, SelectionMatchesSort)
+{
+    FITSimg<float> img(std::vector<size_t>{50,40});
+    std::valarray<float>* data = img.GetData<float>();
+    ASSERT_NE(data, nullptr);
+
+    std::mt19937 gen(7);
+    std::normal_distribution<float> gauss(100.f, 15.f);
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = gauss(gen);
+    (*data)[3] = std::numeric_limits<float>::quiet_NaN();
+    img.MaskPixels(std::vector<size_t>{0, 10, 20, 30});
+
+    std::vector<double> ref;
+    for(size_t k = 0; k < data->size(); ++k)
+        if(!img.Masked(k) && !std::isnan((*data)[k]))
+            ref.push_back((*data)[k]);
+
+    const std::vector<double> probs = {0.05, 0.5, 0.25, 0.95, 0.75, 0., 1.};
+    const std::vector<double> expected = sortedQuantiles(ref, probs);
+    const std::vector<double> q = img.GetQuantiles(probs);
+
+    ASSERT_EQ(q.size(), probs.size());
+    for(size_t i = 0; i < probs.size(); ++i)
+        EXPECT_NEAR(q[i], expected[i], 1e-9) << "p = " << probs[i];
+
+    EXPECT_NEAR(img.GetMedian(), expected[1], 1e-9);
+    EXPECT_THROW(img.GetQuantiles({1.5}), FITSexception);
+}
+
+TEST(FITSimgQuantiles, CountingPathForSmallIntegers)
+{
+    FITSimg<int16_t> img(std::vector<size_t>{37,23});
+    std::valarray<int16_t>* data = img.GetData<int16_t>();
+    ASSERT_NE(data, nullptr);
+
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int> uni(-300, 300);
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = static_cast<int16_t>(uni(gen));
+    img.MaskPixels(std::vector<size_t>{1, 2, 3});
+
+    std::vector<double> ref;
+    for(size_t k = 0; k < data->size(); ++k)
+        if(!img.Masked(k))
+            ref.push_back((*data)[k]);
+
+    const std::vector<double> probs = {0.01, 0.1, 0.333, 0.5, 0.9, 0.99};
+    const std::vector<double> expected = sortedQuantiles(ref, probs);
+    const std::vector<double> q = img.GetQuantiles(probs);
+
+    ASSERT_EQ(q.size(), probs.size());
+    for(size_t i = 0; i < probs.size(); ++i)
+        EXPECT_NEAR(q[i], expected[i], 1e-9) << "p = " << probs[i];
+}
+
+TEST(FITSimgMoments, FusedPassMatchesTwoPass)
+{
+    FITSimg<float> img(std::vector<size_t>{301,77});
+    std::valarray<float>* data = img.GetData<float>();
+    ASSERT_NE(data, nullptr);
+
+    std::mt19937 gen(5);
+    std::gamma_distribution<float> gamma(2.f, 3.f);
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = 500.f + gamma(gen);
+    img.MaskPixels(std::vector<size_t>{0, 4096, 8191, 12000});
+
+    double n = 0., sum = 0., vmin = 1e30, vmax = -1e30;
+    for(size_t k = 0; k < data->size(); ++k)
+        if(!img.Masked(k))
+        {
+            n   += 1.;
+            sum += (*data)[k];
+            vmin = std::min(vmin, static_cast<double>((*data)[k]));
+            vmax = std::max(vmax, static_cast<double>((*data)[k]));
+        }
+
+    const double mean = sum / n;
+    double m2 = 0., m3 = 0., m4 = 0.;
+    for(size_t k = 0; k < data->size(); ++k)
+        if(!img.Masked(k))
+        {
+            const double d = (*data)[k] - mean;
+            m2 += d*d;
+            m3 += d*d*d;
+            m4 += d*d*d*d;
+        }
+
+    const double var = m2 / (n - 1.);
+    const stat::Moments m = img.GetMoments();
+
+    EXPECT_EQ(m.count, static_cast<size_t>(n));
+    EXPECT_NEAR(m.sum, sum, 1e-9 * std::abs(sum));
+    EXPECT_NEAR(m.Mean(), mean, 1e-12 * mean);
+    EXPECT_NEAR(m.Variance(), var, 1e-10 * var);
+    EXPECT_NEAR(m.Skewness(), (m3 / n) / (var * std::sqrt(var)), 1e-9);
+    EXPECT_NEAR(m.Kurtosis(), n*(n+1.)*m4 / ((n-1.)*(n-2.)*(n-3.)*var*var) - 3.*(n-1.)*(n-1.)/((n-2.)*(n-3.)), 1e-9);
+    EXPECT_DOUBLE_EQ(m.min, vmin);
+    EXPECT_DOUBLE_EQ(m.max, vmax);
+
+    EXPECT_DOUBLE_EQ(img.GetMean(), m.Mean());
+    EXPECT_DOUBLE_EQ(img.GetStdDev(), m.StdDev());
+}
+
+TEST(FITSimgMoments, CacheIsClearedByModifiers)
+{
+    FITSimg<int32_t> img(std::vector<size_t>{10,10});
+    std::valarray<int32_t>* data = img.GetData<int32_t>();
+    ASSERT_NE(data, nullptr);
+
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = static_cast<int32_t>(k);
+
+    EXPECT_DOUBLE_EQ(img.GetMean(), 49.5);
+
+    img += 10;
+    EXPECT_DOUBLE_EQ(img.GetMean(), 59.5);
+
+    img.MaskPixels(std::vector<size_t>{99});
+    EXPECT_DOUBLE_EQ(img.GetMaximum(), 108.);
+
+    img.UnmaskPixels({99});
+    img.SetPixelValue(static_cast<int32_t>(1000), static_cast<size_t>(99));
+    EXPECT_DOUBLE_EQ(img.GetMaximum(), 1000.);
+
+    // Writes through a pointer held across the computation of the moments need an explicit invalidation
+    (*data)[0] = -5;
+    img.InvalidateMoments();
+    EXPECT_DOUBLE_EQ(img.GetMinimum(), -5.);
+}
+
+TEST(FITSimgClippedStats, RejectsOutliers)
+{
+    FITSimg<float> img(std::vector<size_t>{128,128});
+    std::valarray<float>* data = img.GetData<float>();
+    ASSERT_NE(data, nullptr);
+
+    std::mt19937 gen(17);
+    std::normal_distribution<float> gauss(200.f, 4.f);
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = gauss(gen);
+
+    // Bright outliers, a masked hot pixel and a NaN which are neither kept nor rejected
+    for(size_t k = 0; k < data->size(); k += 97)
+        (*data)[k] = 5000.f;
+    (*data)[1] = 1e9f;
+    img.MaskPixels(std::vector<size_t>{1});
+    (*data)[2] = std::numeric_limits<float>::quiet_NaN();
+
+    for(const stat::clipCenter center : {stat::clipCenter::median, stat::clipCenter::mean})
+    {
+        const stat::ClippedStats cs = img.GetClippedStats(3., 3., 10, center);
+
+        EXPECT_EQ(cs.count + cs.rejected, data->size() - 2);
+        EXPECT_GE(cs.rejected, (data->size() + 96) / 97);
+        EXPECT_GE(cs.iterations, 2u);
+        EXPECT_NEAR(cs.mean,   200., 0.2);
+        EXPECT_NEAR(cs.median, 200., 0.2);
+        EXPECT_NEAR(cs.stddev,   4., 0.2);
+    }
+
+    // Single pass: only the pixels out of the first window are rejected
+    std::vector<double> scratch;
+    const stat::ClippedStats once = img.GetClippedStats(scratch, 3., 3., 1);
+    EXPECT_EQ(once.iterations, 1u);
+    EXPECT_EQ(scratch.size(), data->size() - 2);
+    EXPECT_EQ(once.count + once.rejected, scratch.size());
+
+    EXPECT_THROW(img.GetClippedStats(0., 3.), FITSexception);
+}
+
+TEST(FITSimgSketch, MergedImagesQuantiles)
+{
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+    FITSimg<float> a(std::vector<size_t>{512,512});
+    FITSimg<float> b(std::vector<size_t>{512,512});
+    std::valarray<float>* da = a.GetData<float>();
+    std::valarray<float>* db = b.GetData<float>();
+    ASSERT_NE(da, nullptr);
+    ASSERT_NE(db, nullptr);
+
+    for(size_t k = 0; k < da->size(); ++k)
+    {
+        (*da)[k] = uniform(gen);
+        (*db)[k] = 1.f + uniform(gen);
+    }
+
+    // Masked and NaN pixels are not counted
+    (*da)[0] = 1e9f;
+    a.MaskPixels(std::vector<size_t>{0});
+    (*db)[0] = std::numeric_limits<float>::quiet_NaN();
+
+    stat::QuantileSketch s = a.Sketch();
+    EXPECT_EQ(s.Count(), da->size() - 1);
+    EXPECT_LT(s.Retained(), 1000u);
+
+    s += b.Sketch();
+    EXPECT_EQ(s.Count(), da->size() + db->size() - 2);
+    EXPECT_LT(s.Max(), 2.f);
+
+    // Values uniform on [0,2]: the quantile of p is close to 2p, within the rank error of the sketch
+    const double eps = s.NormalizedRankError();
+    const std::vector<double> q = s.Quantiles({0.1, 0.5, 0.9});
+    EXPECT_NEAR(q[0], 0.2, 2.*eps*2.);
+    EXPECT_NEAR(q[1], 1.0, 2.*eps*2.);
+    EXPECT_NEAR(q[2], 1.8, 2.*eps*2.);
+    EXPECT_NEAR(s.Rank(1.), 0.5, 2.*eps);
+}
+
+TEST(FITSimgReduce, CollapseAlongEachAxis)
+{
+    // Cube of 4x3x5 pixels with value x + 10y + 100z
+    FITSimg<float> cube(std::vector<size_t>{4,3,5});
+    for(size_t k = 0; k < cube.Nelements(); ++k)
+        cube.SetPixelValue(static_cast<float>(k%4 + 10*((k/4)%3) + 100*(k/12)), k);
+    cube.HDU().ValueForKey("OBJECT", "NGC 3115", fChar, "Target");
+
+    auto sum = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(3, FITScube::reduction::sum));
+    ASSERT_NE(sum, nullptr);
+    ASSERT_EQ(sum->GetDimension(), 2u);
+    EXPECT_EQ(sum->Size(1), 4u);
+    EXPECT_EQ(sum->Size(2), 3u);
+    const auto* s = sum->GetData<double>();
+    for(size_t k = 0; k < s->size(); ++k)
+        EXPECT_DOUBLE_EQ((*s)[k], 5.*static_cast<double>(k%4 + 10*(k/4)) + 1000.) << "pixel " << k;
+    EXPECT_EQ(sum->HDU().GetValueForKey("COLLAPSE"), "SUM");
+    EXPECT_EQ(sum->HDU().GetValueForKey("OBJECT"), "NGC 3115");
+
+    auto mean = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(1, FITScube::reduction::mean));
+    ASSERT_NE(mean, nullptr);
+    EXPECT_EQ(mean->Size(1), 3u);
+    EXPECT_EQ(mean->Size(2), 5u);
+    const auto* m = mean->GetData<double>();
+    for(size_t k = 0; k < m->size(); ++k)
+        EXPECT_DOUBLE_EQ((*m)[k], 1.5 + 10.*static_cast<double>(k%3) + 100.*static_cast<double>(k/3)) << "pixel " << k;
+
+    auto median = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(2, FITScube::reduction::median));
+    auto minv   = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(2, FITScube::reduction::min));
+    auto maxv   = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(2, FITScube::reduction::max));
+    auto stdv   = std::dynamic_pointer_cast< FITSimg<double> >(cube.Reduce(2, FITScube::reduction::stddev));
+    for(size_t k = 0; k < 20; ++k)
+    {
+        const double base = static_cast<double>(k%4 + 100*(k/4));
+        EXPECT_DOUBLE_EQ((*median->GetData<double>())[k], base + 10.) << "pixel " << k;
+        EXPECT_DOUBLE_EQ((*minv->GetData<double>())[k], base)         << "pixel " << k;
+        EXPECT_DOUBLE_EQ((*maxv->GetData<double>())[k], base + 20.)   << "pixel " << k;
+        EXPECT_NEAR((*stdv->GetData<double>())[k], 10., 1e-9)         << "pixel " << k;
+    }
+
+    // A fully masked line gives a masked null pixel, a single outlier is rejected by the clipped mean
+    FITSimg<float> spectra(std::vector<size_t>{2,50});
+    for(size_t k = 0; k < spectra.Nelements(); ++k)
+        spectra.SetPixelValue(static_cast<float>(1 + (k/2)%2), k);
+    std::vector<size_t> masked;
+    for(size_t z = 0; z < 50; ++z)
+        masked.push_back(2*z + 1);
+    spectra.MaskPixels(masked);
+    spectra.SetPixelValue(1000.f, 20);
+
+    auto clipped = std::dynamic_pointer_cast< FITSimg<double> >(spectra.Reduce(2, FITScube::reduction::clippedMean, 3.));
+    ASSERT_NE(clipped, nullptr);
+    EXPECT_NEAR((*clipped->GetData<double>())[0], (24.*1. + 25.*2.) / 49., 1e-9);
+    EXPECT_FALSE(clipped->Masked(0));
+    EXPECT_DOUBLE_EQ((*clipped->GetData<double>())[1], 0.);
+    EXPECT_TRUE(clipped->Masked(1));
+
+    EXPECT_THROW(cube.Reduce(0, FITScube::reduction::sum), FITSexception);
+    EXPECT_THROW(cube.Reduce(4, FITScube::reduction::sum), FITSexception);
+    EXPECT_THROW(cube.Reduce(3, FITScube::reduction::clippedMean, 0.), FITSexception);
+}
+
+TEST(FITSimgReduce, CollapsesTheWCS)
+{
+    // RA/DEC/FREQ cube of 4x3x5 pixels
+    FITSimg<float> cube(std::vector<size_t>{4,3,5});
+    for(size_t k = 0; k < cube.Nelements(); ++k)
+        cube.SetPixelValue(1.f, k);
+    setTanWcs(cube.HDU(), 2., 1.);
+    cube.HDU().ValueForKey("CTYPE3", "FREQ", fChar, "");
+    cube.HDU().ValueForKey("CUNIT3", "Hz", fChar, "");
+    cube.HDU().ValueForKey("CRPIX3", 1., "");
+    cube.HDU().ValueForKey("CRVAL3", 1.4e9, "");
+    cube.HDU().ValueForKey("CDELT3", 1.e6, "");
+    cube.reLoadWCS();
+    cube.SetWorldGrid(0);
+
+    // Moment-0 map: the celestial axes are unchanged
+    auto map = cube.Reduce(3, FITScube::reduction::sum);
+    ASSERT_EQ(map->getNumberOfWCS(), 1u);
+    ASSERT_EQ(map->getWCS().getNumberOfAxis(0), 2u);
+    map->SetWorldGrid(0);
+    for(double y : {0., 1., 2.})
+    for(double x : {0., 1.5, 3.})
+    {
+        const worldCoords src = cube.WorldCoordinates(pixelCoords{x, y, 0.});
+        const worldCoords res = map->WorldCoordinates(pixelCoords{x, y});
+        ASSERT_EQ(res.size(), 2u);
+        EXPECT_NEAR(res[0], src[0], 1e-10) << x << "," << y;
+        EXPECT_NEAR(res[1], src[1], 1e-10) << x << "," << y;
+    }
+
+    // Profile along DEC and FREQ: the latitude is kept as a linear axis through the reference pixel of the removed RA axis
+    auto profile = cube.Reduce(1, FITScube::reduction::mean);
+    ASSERT_EQ(profile->getNumberOfWCS(), 1u);
+    ASSERT_EQ(profile->getWCS().getNumberOfAxis(0), 2u);
+    EXPECT_EQ(profile->getWCS().CTYPE(0)[0], "DEC");
+    profile->SetWorldGrid(0);
+    for(double z : {0., 2., 4.})
+    for(double y : {0., 1., 2.})
+    {
+        const worldCoords src = cube.WorldCoordinates(pixelCoords{2., y, z});
+        const worldCoords res = profile->WorldCoordinates(pixelCoords{y, z});
+        ASSERT_EQ(res.size(), 2u);
+        EXPECT_NEAR(res[0], src[1], 1e-9) << y << "," << z;
+        EXPECT_NEAR(res[1], src[2], 1e-3) << y << "," << z;
+    }
+}
+
+TEST(FITSimgRobustStats, IgnoresMaskedAndOutliers)
+{
+    std::mt19937 gen(31);
+    std::normal_distribution<float> noise(100.f, 5.f);
+
+    FITSimg<float> img(std::vector<size_t>{256,256});
+    std::valarray<float>* data = img.GetData<float>();
+    ASSERT_NE(data, nullptr);
+    for(size_t k = 0; k < data->size(); ++k)
+        (*data)[k] = noise(gen);
+
+    // Cosmic rays and a masked saturated column
+    for(size_t k = 0; k < data->size(); k += 50)
+        (*data)[k] = 5e4f;
+    std::vector<size_t> column;
+    for(size_t y = 0; y < 256; ++y)
+    {
+        (*data)[y*256 + 7] = 6.5e4f;
+        column.push_back(y*256 + 7);
+    }
+    img.MaskPixels(column);
+    (*data)[1] = std::numeric_limits<float>::quiet_NaN();
+
+    std::vector<double> scratch;
+    const stat::RobustStats rs = img.GetRobustStats(scratch);
+    EXPECT_EQ(rs.count, data->size() - 256 - 1);
+    EXPECT_EQ(scratch.size(), rs.count);
+    EXPECT_NEAR(rs.median,       100., 0.2);
+    EXPECT_NEAR(1.4826*rs.mad,     5., 0.2);
+    EXPECT_NEAR(rs.location,     100., 0.1);
+    EXPECT_NEAR(rs.scale,          5., 0.1);
+    EXPECT_NEAR(rs.mode,         100., 0.5);
+
+    EXPECT_DOUBLE_EQ(img.GetMAD(), rs.mad);
+    EXPECT_NEAR(img.GetBiweightLocation(), rs.location, 1e-9);
+    EXPECT_NEAR(img.GetBiweightScale(), rs.scale, 1e-9);
+    EXPECT_DOUBLE_EQ(img.GetMode(), rs.mode);
+
+    EXPECT_THROW(img.GetRobustStats(0., 9.), FITSexception);
+    EXPECT_THROW(img.GetBiweightScale(-1.), FITSexception);
+}
+
+TEST(FITSimgWorldGrid, MatchesExactTransformAndFollowsReload)
+{
+    // 1 arcsec pixels around RA = 0: the field straddles the longitude cut
+    FITSimg<float> img(std::vector<size_t>{300,200});
+    setTanWcs(img.HDU(), 150., 100.);
+    img.HDU().ValueForKey("CRVAL1", 0.01, "");
+    img.HDU().ValueForKey("CRVAL2", 45., "");
+    img.reLoadWCS();
+
+    const size_t n = img.Nelements();
+    std::vector<double> x(n), y(n), ra(n), dec(n);
+    for(size_t k = 0; k < n; ++k)
+    {
+        x[k] = static_cast<double>(k%300);
+        y[k] = static_cast<double>(k/300);
+    }
+    ASSERT_EQ(img.getWCS().pixel2world(0, x, y, ra, dec), 0u);
+
+    // The grid is built during the first pass; both passes stay within the tolerance of the exact transform
+    const double tolerance = 1e-4 / 3600.;
+    for(size_t pass = 0; pass < 2; ++pass)
+        for(size_t k = 0; k < n; k += (pass == 0) ? 1 : 37)
+        {
+            const worldCoords wc = img.WorldCoordinates(k);
+            ASSERT_EQ(wc.size(), 2u);
+            ASSERT_NEAR(std::remainder(wc[0] - ra[k], 360.) * std::cos(dec[k] * M_PI / 180.), 0., tolerance) << k;
+            ASSERT_NEAR(wc[1], dec[k], tolerance) << k;
+            EXPECT_GE(wc[0], 0.);
+            EXPECT_LT(wc[0], 360.);
+
+            const pixelCoords px = img.World2Pixel(wc);
+            ASSERT_EQ(px.size(), 2u);
+            EXPECT_NEAR(px[0], x[k], 1e-3) << k;
+            EXPECT_NEAR(px[1], y[k], 1e-3) << k;
+        }
+
+    // A reloaded WCS drops the grid
+    img.HDU().ValueForKey("CRVAL2", 46., "");
+    img.reLoadWCS();
+    ASSERT_EQ(img.getWCS().pixel2world(0, x, y, ra, dec), 0u);
+    for(size_t k = 0; k < n; k += 101)
+    {
+        const worldCoords wc = img.WorldCoordinates(k);
+        EXPECT_NEAR(wc[1], dec[k], tolerance) << k;
+    }
+
+    // Without grid the conversions are exact
+    img.SetWorldGrid(0);
+    for(size_t k = 0; k < n; k += 101)
+    {
+        const worldCoords wc = img.WorldCoordinates(k);
+        EXPECT_DOUBLE_EQ(wc[0], ra[k]) << k;
+        EXPECT_DOUBLE_EQ(wc[1], dec[k]) << k;
+    }
+    EXPECT_THROW(img.SetWorldGrid(8, 0.), FITSexception);
+}
+
+TEST(FITSimgProjectCatalog, MatchesWorld2PixelAndFlagsFootprint)
+{
+    FITSimg<float> img(std::vector<size_t>{300,200});
+    setTanWcs(img.HDU(), 150., 100.);
+    img.reLoadWCS();
+    img.SetWorldGrid(0);
+
+    // Sources on a lattice extending 50 pixels beyond every edge, plus an undefined position
+    FITScolumn<double> raCol ("RA",  tdouble, "deg");
+    FITScolumn<float>  decCol("DEC", tfloat,  "deg");
+    std::vector<double> xs, ys;
+    for(double y = -50.25; y < 250.; y += 7.5)
+        for(double x = -50.75; x < 350.; x += 6.5)
+        {
+            const worldCoords wc = img.WorldCoordinates(pixelCoords({x, y}));
+            raCol .push_back(wc[0]);
+            decCol.push_back(static_cast<float>(wc[1]));
+            xs.push_back(x);
+            ys.push_back(y);
+        }
+    raCol .push_back(std::numeric_limits<double>::quiet_NaN());
+    decCol.push_back(2.f);
+
+    FITStable catalog("CATALOG");
+    catalog.InsertColumn(std::make_shared< FITScolumn<double> >(raCol));
+    catalog.InsertColumn(std::make_shared< FITScolumn<float>  >(decCol));
+
+    const size_t inside = img.ProjectCatalog(catalog, "RA", "DEC");
+    ASSERT_EQ(catalog.ncols(), 5u);
+
+    const std::vector<double>& px = catalog.column<double>("X_IMAGE").data();
+    const std::vector<double>& py = catalog.column<double>("Y_IMAGE").data();
+    const std::vector<bool>&   in = catalog.column<bool>("IN_IMAGE").data();
+    ASSERT_EQ(px.size(), xs.size() + 1);
+    ASSERT_EQ(in.size(), xs.size() + 1);
+
+    // Same pixels as World2Pixel on the stored coordinates, the float declinations limiting the agreement with the lattice
+    size_t expected = 0;
+    for(size_t k = 0; k < xs.size(); k++)
+    {
+        const pixelCoords ref = img.World2Pixel(worldCoords({catalog.column<double>("RA").data()[k], static_cast<double>(catalog.column<float>("DEC").data()[k])}));
+        ASSERT_NEAR(px[k], ref[0], 1e-6) << k;
+        ASSERT_NEAR(py[k], ref[1], 1e-6) << k;
+        EXPECT_NEAR(py[k], ys[k], 0.05) << k;
+
+        const bool footprint = ref[0] >= -0.5 && ref[0] < 299.5 && ref[1] >= -0.5 && ref[1] < 199.5;
+        EXPECT_EQ(in[k], footprint) << k;
+        expected += footprint;
+    }
+    EXPECT_EQ(inside, expected);
+    EXPECT_GT(inside, 0u);
+    EXPECT_LT(inside, xs.size());
+
+    EXPECT_TRUE(std::isnan(px.back()));
+    EXPECT_FALSE(in.back());
+
+    // The new columns are not overwritten
+    EXPECT_THROW(img.ProjectCatalog(catalog, "RA", "DEC"), FITSexception);
+    EXPECT_THROW(img.ProjectCatalog(catalog, "RA", "DEC2000", "X2", "Y2", "IN2"), std::out_of_range);
+}
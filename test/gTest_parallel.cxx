@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <DSTfits/FITSparallel.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace DSL;
+
+#pragma region - Parallel loops
+
+TEST(ThreadPool, ParallelForVisitsEachItemOnce)
+{
+    std::vector<int> hits(1000000, 0);
+    parallel_for(0, hits.size(), 1000, [&](size_t begin, size_t end)
+    {
+        for(size_t k = begin; k < end; k++)
+            hits[k]++;
+    });
+
+    for(const int& h : hits)
+        ASSERT_EQ(h, 1);
+}
+
+TEST(ThreadPool, NestedLoopsComplete)
+{
+    std::atomic<size_t> total{0};
+    parallel_for(0, 64, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+            parallel_for(0, 1000, 10, [&](size_t b, size_t e){ total += e - b; });
+    });
+
+    EXPECT_EQ(total.load(), 64u*1000u);
+}
+
+TEST(ThreadPool, ReduceIsOrdered)
+{
+    const size_t n = 1000000;
+    auto sum = [](size_t begin, size_t end)
+    {
+        double s = 0.;
+        for(size_t k = begin; k < end; k++)
+            s += 1. / static_cast<double>(k + 1);
+        return s;
+    };
+
+    const double serial = sum(0, n);
+    const double par    = parallel_reduce(size_t{0}, n, 1000, 0., sum, [](double a, double b){ return a + b; });
+    EXPECT_NEAR(par, serial, 1e-9);
+    EXPECT_DOUBLE_EQ(parallel_reduce(size_t{0}, size_t{0}, 1, 3., sum, [](double a, double b){ return a + b; }), 3.);
+}
+
+TEST(ThreadPool, ExceptionsAreRethrown)
+{
+    EXPECT_THROW(parallel_for(0, 1000, 1, [](size_t begin, size_t)
+    {
+        if(begin > 500)
+            throw std::runtime_error("chunk failure");
+    }), std::runtime_error);
+
+    // The pool is still usable
+    std::atomic<size_t> n{0};
+    parallel_for(0, 100, 1, [&](size_t b, size_t e){ n += e - b; });
+    EXPECT_EQ(n.load(), 100u);
+}
+
+TEST(ThreadPool, CancelledLoopsSkipPendingChunks)
+{
+    CancelToken token;
+    token.Cancel();
+
+    bool ran = false;
+    parallel_for(0, 1000, 1, [&](size_t, size_t){ ran = true; }, &token);
+    EXPECT_FALSE(ran);
+
+    // Large range with a small grain, so that the loop is split in the maximum number of chunks
+    const size_t initial = GetNumberOfThreads();
+    SetNumberOfThreads(8);
+
+    const size_t n         = 1000000;
+    const size_t scheduled = detail::loop_chunks(n, 1, 4*GetNumberOfThreads());
+    ASSERT_EQ(scheduled, 32u);
+
+    token.Reset();
+    std::atomic<size_t> chunks{0};
+    std::atomic<size_t> items{0};
+    parallel_for(0, n, 1, [&](size_t b, size_t e)
+    {
+        token.Cancel();
+        chunks++;
+        items += e - b;
+    }, &token);
+
+    // Each thread starts at most one chunk before it sees the cancellation of its own chunk
+    EXPECT_GE(chunks.load(), 1u);
+    EXPECT_LE(chunks.load(), GetNumberOfThreads());
+    EXPECT_LE(chunks.load(), scheduled/4);
+    EXPECT_LE(items.load(), n/4);
+
+    SetNumberOfThreads(initial);
+}
+
+TEST(ThreadPool, ConfigurableThreadCount)
+{
+    const size_t initial = GetNumberOfThreads();
+
+    SetNumberOfThreads(3);
+    EXPECT_EQ(GetNumberOfThreads(), 3u);
+
+    // Loops submitted from several external threads share the same workers
+    std::atomic<size_t> total{0};
+    std::vector<std::thread> callers;
+    for(int t = 0; t < 4; t++)
+        callers.emplace_back([&]{ parallel_for(0, 100000, 100, [&](size_t b, size_t e){ total += e - b; }); });
+    for(std::thread& t : callers)
+        t.join();
+    EXPECT_EQ(total.load(), 400000u);
+
+    SetNumberOfThreads(1);
+    EXPECT_EQ(GetNumberOfThreads(), 1u);
+    size_t serial = 0;
+    parallel_for(0, 1000, 1, [&](size_t b, size_t e){ serial += e - b; });
+    EXPECT_EQ(serial, 1000u);
+
+    SetNumberOfThreads(initial);
+}
+
+#pragma endregion
@@ -1,9 +1,11 @@
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <valarray>
 #include <cstdint>
 #include <random>
+#include <future>
 
 #include <Minuit2/MnSimplex.h>
 
@@ -619,4 +621,207 @@ TEST(PercentilTest, FloatParallelEval)
     EXPECT_NEAR(p.Eval(min84.UserState().Params()[0]), 0.84, 0.05);
 }
 
-#pragma endregion
\ No newline at end of file
+#pragma endregion
+#pragma region exact percentiles
+
+TEST(PercentilTest, ValueByInterpolation)
+{
+	std::valarray<double> v{-2.0, -4.0, -1.0, -3.0};
+	Percentil p(v);
+
+	EXPECT_DOUBLE_EQ(p.Value(), -2.5);
+	EXPECT_DOUBLE_EQ(p.Value(0.25), -3.25);
+	EXPECT_DOUBLE_EQ(p.Value(0.75), -1.75);
+	EXPECT_DOUBLE_EQ(p.Value(0.), -4.);
+	EXPECT_DOUBLE_EQ(p.Value(1.), -1.);
+
+	const std::vector<double> q = p.Values({0.75, 0.25});
+	ASSERT_EQ(q.size(), 2u);
+	EXPECT_DOUBLE_EQ(q[0], -1.75);
+	EXPECT_DOUBLE_EQ(q[1], -3.25);
+
+	EXPECT_THROW(p.Value(1.5), std::invalid_argument);
+}
+
+TEST(PercentilTest, PercentilesMatchSortedValues)
+{
+	std::mt19937 gen(7);
+	std::normal_distribution<float> dist(0.f, 1.f);
+
+	std::vector<float> v(10001);
+	for(float& x : v)
+		x = dist(gen);
+
+	std::vector<float> sorted(v);
+	std::sort(sorted.begin(), sorted.end());
+
+	const std::vector<double> q = DSL::stat::Percentiles(v, {0.5, 0.1, 0.9});
+	ASSERT_EQ(q.size(), 3u);
+	EXPECT_DOUBLE_EQ(q[0], sorted[5000]);
+	EXPECT_DOUBLE_EQ(q[1], sorted[1000]);
+	EXPECT_DOUBLE_EQ(q[2], sorted[9000]);
+
+	// input left untouched
+	EXPECT_NE(v, sorted);
+}
+
+TEST(PercentilTest, WeightedPercentiles)
+{
+	// unit weights give the usual median
+	std::vector<double> v{5., 1., 4., 2.};
+	std::vector<double> w(4, 1.);
+	EXPECT_DOUBLE_EQ(DSL::stat::Percentiles(v, w, {0.5})[0], 3.);
+
+	// middle points of the weight segments at 0.5, 2 and 3.5 out of 4
+	std::vector<double> x{10., 30., 20.};
+	std::vector<double> wx{1., 1., 2.};
+	const std::vector<double> q = DSL::stat::Percentiles(x, wx, {0.5, 0.3125, 0., 1.});
+	EXPECT_DOUBLE_EQ(q[0], 20.);
+	EXPECT_DOUBLE_EQ(q[1], 15.);
+	EXPECT_DOUBLE_EQ(q[2], 10.);
+	EXPECT_DOUBLE_EQ(q[3], 30.);
+
+	// equal values are merged
+	std::vector<double> t{1., 2., 2., 3.};
+	std::vector<double> wt{1., 0.5, 0.5, 1.};
+	EXPECT_DOUBLE_EQ(DSL::stat::Percentiles(t, wt, {0.5})[0], 2.);
+
+	std::vector<double> neg{-1.};
+	std::vector<double> one{1.};
+	EXPECT_THROW(DSL::stat::Percentiles(one, neg, {0.5}), std::invalid_argument);
+}
+
+#pragma endregion
+
+#pragma region quantile sketch
+
+TEST(QuantileSketchTest, RankErrorWithinBound)
+{
+	std::mt19937 gen(11);
+	std::normal_distribution<double> dist(0., 1.);
+
+	std::vector<double> v(1000000);
+	for(double& x : v)
+		x = dist(gen);
+
+	const DSL::stat::QuantileSketch s = DSL::stat::QuantileSketch::Build(v.data(), nullptr, v.size());
+	EXPECT_EQ(s.Count(), v.size());
+	EXPECT_LT(s.Retained(), 3u*s.K());
+
+	std::vector<double> sorted(v);
+	std::sort(sorted.begin(), sorted.end());
+	EXPECT_DOUBLE_EQ(s.Quantile(0.), sorted.front());
+	EXPECT_DOUBLE_EQ(s.Quantile(1.), sorted.back());
+
+	for(const double p : {0.01, 0.16, 0.5, 0.84, 0.99})
+	{
+		const double q    = s.Quantile(p);
+		const double rank = static_cast<double>(std::upper_bound(sorted.begin(), sorted.end(), q) - sorted.begin()) / static_cast<double>(v.size());
+		EXPECT_NEAR(rank, p, s.NormalizedRankError());
+	}
+}
+
+TEST(QuantileSketchTest, MergeMatchesSingleSketch)
+{
+	std::mt19937 gen(5);
+	std::uniform_real_distribution<double> dist(0., 1.);
+
+	DSL::stat::QuantileSketch merged;
+	for(uint64_t f = 0; f < 20; f++)
+	{
+		DSL::stat::QuantileSketch part(200, f + 1);
+		for(size_t k = 0; k < 50000; k++)
+			part.Update(dist(gen));
+		merged += part;
+	}
+
+	EXPECT_EQ(merged.Count(), 1000000u);
+	EXPECT_NEAR(merged.Quantile(0.5), 0.5, merged.NormalizedRankError());
+	EXPECT_NEAR(merged.Rank(0.25), 0.25, merged.NormalizedRankError());
+
+	DSL::stat::QuantileSketch other(100);
+	EXPECT_THROW(merged += other, std::invalid_argument);
+	EXPECT_THROW(DSL::stat::QuantileSketch().Quantile(0.5), std::invalid_argument);
+}
+
+#pragma endregion
+#pragma region robust estimators
+
+TEST(RobustTest, MedianAbsoluteDeviation)
+{
+	std::vector<double> odd{1., 2., 3., 4., 100.};
+	EXPECT_DOUBLE_EQ(DSL::stat::MedianAbsoluteDeviation(odd.data(), odd.size()), 1.);
+
+	std::vector<double> even{4., 1., 3., 2.};
+	EXPECT_DOUBLE_EQ(DSL::stat::MedianAbsoluteDeviation(even.data(), even.size()), 1.);
+
+	// The values are replaced by their deviations to the median
+	std::sort(even.begin(), even.end());
+	EXPECT_DOUBLE_EQ(even.front(), -1.5);
+	EXPECT_DOUBLE_EQ(even.back(), 1.5);
+
+	EXPECT_THROW(DSL::stat::MedianAbsoluteDeviation(odd.data(), 0), std::invalid_argument);
+}
+
+TEST(RobustTest, GaussianWithOutliers)
+{
+	std::mt19937 gen(5);
+	std::normal_distribution<double> dist(10., 2.);
+
+	std::vector<double> v(200000);
+	for(double& x : v)
+		x = dist(gen);
+	for(size_t k = 0; k < v.size(); k += 100)
+		v[k] = 1000.;
+
+	std::vector<double> w(v);
+	const DSL::stat::RobustStats rs = DSL::stat::RobustStatistics(w.data(), w.size());
+	EXPECT_EQ(rs.count, v.size());
+	EXPECT_NEAR(rs.median, 10., 0.05);
+	EXPECT_NEAR(1.4826*rs.mad, 2., 0.05);
+	EXPECT_NEAR(rs.location, 10., 0.03);
+	EXPECT_NEAR(rs.scale, 2., 0.05);
+	EXPECT_NEAR(rs.mode, 10., 0.2);
+
+	// The single estimators agree with the combined one, up to the order of the sums
+	w = v;
+	EXPECT_DOUBLE_EQ(DSL::stat::MedianAbsoluteDeviation(w.data(), w.size()), rs.mad);
+	w = v;
+	EXPECT_NEAR(DSL::stat::BiweightLocation(w.data(), w.size()), rs.location, 1e-12);
+	w = v;
+	EXPECT_NEAR(DSL::stat::BiweightScale(w.data(), w.size()), rs.scale, 1e-12);
+	w = v;
+	EXPECT_DOUBLE_EQ(DSL::stat::Mode(w.data(), w.size()), rs.mode);
+
+	w = v;
+	EXPECT_THROW(DSL::stat::BiweightLocation(w.data(), w.size(), 0.), std::invalid_argument);
+}
+
+TEST(RobustTest, ModeOfSkewedAndIntegerValues)
+{
+	std::mt19937 gen(7);
+
+	// Gamma distribution of shape 3 and scale 1: mode 2, median 2.67, mean 3
+	std::gamma_distribution<double> gamma(3., 1.);
+	std::vector<double> g(1000000);
+	for(double& x : g)
+		x = gamma(gen);
+	EXPECT_NEAR(DSL::stat::Mode(g.data(), g.size()), 2., 0.1);
+
+	// Integer counts are binned on whole values
+	std::poisson_distribution<int> poisson(7.3);
+	std::vector<double> p(100000);
+	for(double& x : p)
+		x = poisson(gen);
+	EXPECT_DOUBLE_EQ(DSL::stat::Mode(p.data(), p.size()), 7.);
+
+	// Null dispersion
+	std::vector<double> c{5., 5., 5., 5., 5., 1., 9.};
+	const DSL::stat::RobustStats rs = DSL::stat::RobustStatistics(c.data(), c.size());
+	EXPECT_DOUBLE_EQ(rs.mad, 0.);
+	EXPECT_DOUBLE_EQ(rs.location, 5.);
+	EXPECT_DOUBLE_EQ(rs.scale, 0.);
+	EXPECT_DOUBLE_EQ(rs.mode, 5.);
+}
+
+#pragma endregion
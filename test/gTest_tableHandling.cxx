@@ -1,11 +1,14 @@
 #include <gtest/gtest.h>
 #include <DSTfits/FITStable.h>
+#include <DSTfits/FITSskyIndex.h>
 #include <memory>
 #include <vector>
 #include <algorithm>
 #include <tuple>
 #include <random>
 #include <thread>
+#include <array>
+#include <cmath>
 
 
 using namespace DSL;
@@ -1068,4 +1071,183 @@ TEST(RowIteratorTest, ModifyMultipleColumnsPerRow)
         EXPECT_DOUBLE_EQ(original.column<double>("COL_DOUBLE").data()[idx] - 1.0,
                          it.at<double>("COL_DOUBLE"));
     }
-}
\ No newline at end of file
+}
+TEST(ColumnViewTest, HistogramOfSelection)
+{
+    FITStable table = CreateSampleTable();
+
+    FITShistogram all = table.column<int32_t>("COL_INT").histogram(4, {-10., 10.});
+    EXPECT_EQ((std::vector<uint64_t>{0,3,4,2}), all.Counts());
+    EXPECT_EQ(1u, all.Underflow());
+    EXPECT_EQ(2u, all.Overflow());
+
+    RowSet positives = table.select<int32_t>("COL_INT").gt(0).build();
+    FITShistogram sel = table.column<int32_t>("COL_INT").on(positives).histogram(4, {-10., 10.});
+    EXPECT_EQ((std::vector<uint64_t>{0,0,3,2}), sel.Counts());
+    EXPECT_EQ(0u, sel.Underflow());
+    EXPECT_EQ(2u, sel.Overflow());
+
+    // Default range spans the values
+    FITShistogram dbl = table.column<double>("COL_DOUBLE").histogram(10);
+    EXPECT_DOUBLE_EQ(-3.3, dbl.Low());
+    EXPECT_DOUBLE_EQ(42.0, dbl.High());
+    EXPECT_EQ(12u, dbl.Entries());
+    EXPECT_EQ(1u, dbl[9]);
+}
+TEST(ColumnViewTest, SketchOfSelection)
+{
+    FITStable table = CreateSampleTable();
+
+    // Selection smaller than the sketch capacity: quantiles are exact order statistics
+    RowSet positives = table.select<int32_t>("COL_INT").gt(0).build();
+    stat::QuantileSketch sel = table.column<int32_t>("COL_INT").on(positives).sketch();
+    EXPECT_EQ(7u, sel.Count());
+    EXPECT_DOUBLE_EQ(3., sel.Min());
+    EXPECT_DOUBLE_EQ(28., sel.Max());
+    EXPECT_DOUBLE_EQ(9., sel.Quantile(0.5));
+
+    // Sketches of several columns or files merge
+    stat::QuantileSketch all = table.column<double>("COL_DOUBLE").sketch();
+    all += sel;
+    EXPECT_EQ(19u, all.Count());
+    EXPECT_DOUBLE_EQ(-3.3, all.Min());
+    EXPECT_DOUBLE_EQ(42., all.Max());
+}
+
+TEST(ColumnViewTest, RobustEstimatesOfSelection)
+{
+    FITStable table = CreateSampleTable();
+
+    // 3 3 4 9 10 12 28: median 9, absolute deviations 6 6 5 0 1 3 19
+    RowSet positives = table.select<int32_t>("COL_INT").gt(0).build();
+    auto view = table.column<int32_t>("COL_INT").on(positives);
+    EXPECT_DOUBLE_EQ(5., view.mad());
+
+    std::vector<double> scratch;
+    const stat::RobustStats rs = view.robust(scratch);
+    EXPECT_EQ(7u, rs.count);
+    EXPECT_DOUBLE_EQ(9., rs.median);
+    EXPECT_DOUBLE_EQ(5., rs.mad);
+    EXPECT_NEAR(view.biweightLocation(), rs.location, 1e-12);
+    EXPECT_NEAR(view.biweightScale(), rs.scale, 1e-12);
+    EXPECT_DOUBLE_EQ(view.mode(), rs.mode);
+
+    // The outlier 28 is downweighted by the biweight
+    EXPECT_LT(rs.location, 9.);
+    EXPECT_GT(rs.location, 5.);
+
+    // Whole column of doubles: 42 is downweighted
+    const double loc = table.column<double>("COL_DOUBLE").biweightLocation();
+    EXPECT_LT(loc, table.column<double>("COL_DOUBLE").mean());
+
+    RowSet none = table.select<int32_t>("COL_INT").gt(100).build();
+    EXPECT_THROW(table.column<int32_t>("COL_INT").on(none).mad(), std::logic_error);
+    EXPECT_THROW(table.column<std::string>("COL_STR").mode(), std::logic_error);
+}
+
+TEST(SkyIndexTest, HealpixPixels)
+{
+    // Base pixels: (0,0) is on the corner of pixels 0, 4 and 5 -> 4; the poles are in pixels 0 and 8
+    EXPECT_EQ(4u, FITSskyIndex::Ang2Pix(0, 0., 0.));
+    EXPECT_EQ(0u, FITSskyIndex::Ang2Pix(0, 0., 90.));
+    EXPECT_EQ(8u, FITSskyIndex::Ang2Pix(0, 0., -90.));
+    EXPECT_EQ(12u << 6, FITSskyIndex::Ang2Pix(3, std::nan(""), 0.));
+
+    // Centres map back to their pixel, and the pixels of a coarser order hold the finer ones
+    for(int order : {0, 1, 4, 12, 29})
+    {
+        for(uint64_t pixel : {uint64_t(0), (uint64_t(12) << (2*order))/3, (uint64_t(12) << (2*order)) - 1})
+        {
+            double ra = 0., dec = 0.;
+            FITSskyIndex::Pix2Ang(order, pixel, ra, dec);
+            EXPECT_EQ(pixel, FITSskyIndex::Ang2Pix(order, ra, dec));
+            if(order > 0)
+            {
+                EXPECT_EQ(pixel >> 2, FITSskyIndex::Ang2Pix(order - 1, ra, dec));
+            }
+        }
+    }
+
+    EXPECT_THROW(FITSskyIndex::Ang2Pix(30, 0., 0.), FITSexception);
+    double ra = 0., dec = 0.;
+    EXPECT_THROW(FITSskyIndex::Pix2Ang(0, 12, ra, dec), FITSexception);
+}
+
+TEST(SkyIndexTest, ConePolygonAndCompanionColumn)
+{
+    const size_t n = 20000;
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+
+    auto ra  = std::make_shared<FITScolumn<double>>("RA", tdouble, "deg", 1);
+    auto dec = std::make_shared<FITScolumn<float>>("DEC", tfloat, "deg", 2);
+    for(size_t k = 0; k < n; k++)
+    {
+        ra->push_back((k == 3) ? std::nan("") : 360.*uniform(rng));
+        dec->push_back(static_cast<float>(std::asin(2.*uniform(rng) - 1.)*180./M_PI));
+    }
+
+    FITStable table;
+    table.InsertColumn(ra);
+    table.InsertColumn(dec);
+
+    auto unitVector = [](const double& a, const double& d)
+    {
+        const double k = M_PI/180.;
+        return std::array<double,3>{std::cos(d*k)*std::cos(a*k), std::cos(d*k)*std::sin(a*k), std::sin(d*k)};
+    };
+    auto dot = [](const std::array<double,3>& a, const std::array<double,3>& b){return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];};
+
+    const std::vector<double>& vra  = table.column<double>("RA").data();
+    const std::vector<float>&  vdec = table.column<float>("DEC").data();
+
+    FITSskyIndex index(table, "RA", "DEC", 6);
+    EXPECT_EQ(n, index.size());
+    EXPECT_EQ(n - 1, index.NumberOfIndexedRows());
+    EXPECT_TRUE(std::is_sorted(index.Entries().begin(), index.Entries().end(),
+                               [](const FITSskyIndex::entry& a, const FITSskyIndex::entry& b){return a.pixel < b.pixel;}));
+
+    // Cones against a brute force selection
+    for(const std::array<double,3>& cone : {std::array<double,3>{10., 20., 5.}, std::array<double,3>{200., -89., 3.}, std::array<double,3>{359.9, 0., 0.7}})
+    {
+        const std::array<double,3> centre = unitVector(cone[0], cone[1]);
+        const double cosRadius = std::cos(cone[2]*M_PI/180.);
+
+        std::vector<size_t> expected;
+        for(size_t k = 0; k < n; k++)
+            if(std::isfinite(vra[k]) && dot(unitVector(vra[k], vdec[k]), centre) >= cosRadius)
+                expected.push_back(k);
+
+        EXPECT_EQ(expected, index.Cone(cone[0], cone[1], cone[2]).indices());
+    }
+
+    // Quadrilateral crossing RA = 0, given clockwise
+    const std::vector<std::pair<double,double>> vertices = {{-8., -6.}, {-8., 6.}, {8., 6.}, {8., -6.}};
+    std::vector<std::array<double,3>> normals;
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        const std::array<double,3> a = unitVector(vertices[i].first, vertices[i].second);
+        const std::array<double,3> b = unitVector(vertices[(i+1)%vertices.size()].first, vertices[(i+1)%vertices.size()].second);
+        normals.push_back({b[1]*a[2] - b[2]*a[1], b[2]*a[0] - b[0]*a[2], b[0]*a[1] - b[1]*a[0]});
+    }
+
+    std::vector<size_t> expected;
+    for(size_t k = 0; k < n; k++)
+        if(std::isfinite(vra[k]) && std::all_of(normals.begin(), normals.end(), [&](const std::array<double,3>& normal){return dot(normal, unitVector(vra[k], vdec[k])) >= 0.;}))
+            expected.push_back(k);
+
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(expected, index.Polygon(vertices).indices());
+    EXPECT_THROW(index.Polygon({{0., 0.}, {10., 0.}, {2., 2.}, {0., 10.}}), FITSexception);
+
+    // Companion column
+    index.Save(table);
+    EXPECT_EQ(6, table.HDU().GetInt32ValueForKey("HPXORDER"));
+    EXPECT_EQ(-1, table.column<int64_t>("HPX_NEST").data()[3]);
+    EXPECT_THROW(index.Save(table), FITSexception);
+
+    FITSskyIndex reloaded = FITSskyIndex::FromColumn(table, "RA", "DEC");
+    EXPECT_EQ(6, reloaded.Order());
+    EXPECT_EQ(index.NumberOfIndexedRows(), reloaded.NumberOfIndexedRows());
+    EXPECT_EQ(index.Cone(10., 20., 5.).indices(), reloaded.Cone(10., 20., 5.).indices());
+}
@@ -13,6 +13,7 @@
 #include <type_traits>
 #include <cmath>
 #include <filesystem>
+#include <thread>
 
 using namespace DSL;
 
@@ -708,3 +709,253 @@ TEST(FITS_wcs, swapWCS)
     EXPECT_NEAR(wcs2.CRVAL(1,1), 80.5671666667,1e-7);
     EXPECT_NEAR(wcs2.CRVAL(1,2), -14.953,1e-7);
 }
+
+TEST(FITS_wcs, bulkConversion)
+{
+    verbose = verboseLevel::VERBOSE_NONE;
+
+    FITSwcs wcs(buildFakeHDU());
+    ASSERT_EQ(wcs.getStatus(), WCSERR_SUCCESS);
+    FITSwcs shared(wcs);
+
+    // 100x100 pixels of 3 planes, one buffer per axis
+    const size_t n = 100*100*3;
+    std::vector<double> px(n), py(n), pz(n), wx(n), wy(n), wz(n), bx(n), by(n), bz(n);
+    for(size_t k = 0; k < n; k++)
+    {
+        px[k] = static_cast<double>(k%100 + 1);
+        py[k] = static_cast<double>((k/100)%100 + 1);
+        pz[k] = static_cast<double>(k/10000 + 1);
+    }
+
+    const std::span<const double> pixel[3] = {px, py, pz};
+    const std::span<double>       world[3] = {wx, wy, wz};
+    std::vector<int> status(n, -1);
+    EXPECT_EQ(wcs.pixel2world(0, pixel, world, status), 0u);
+
+    // Same results as the point by point conversion
+    for(size_t k = 0; k < n; k += 997)
+    {
+        const worldVectors ref = wcs.pixel2world(0, pixelVectors({{px[k], py[k], pz[k]}}));
+        EXPECT_EQ(status[k], 0);
+        EXPECT_NEAR(wx[k], ref[0][0], 1e-12);
+        EXPECT_NEAR(wy[k], ref[0][1], 1e-12);
+        EXPECT_NEAR(wz[k], ref[0][2], 1e-9);
+
+        const worldVectors safe = wcs.safePixel2world(0, pixelVectors({{px[k], py[k], pz[k]}}));
+        ASSERT_EQ(safe.size(), 1u);
+        EXPECT_EQ(safe[0], ref[0]);
+        EXPECT_NEAR(wcs.safeWorld2pixel(0, safe)[0][0], px[k], 1e-6);
+    }
+
+    const std::span<const double> back[3] = {wx, wy, wz};
+    const std::span<double>       pback[3] = {bx, by, bz};
+    EXPECT_EQ(wcs.world2pixel(0, back, pback), 0u);
+    for(size_t k = 0; k < n; k++)
+    {
+        ASSERT_NEAR(bx[k], px[k], 1e-6);
+        ASSERT_NEAR(by[k], py[k], 1e-6);
+        ASSERT_NEAR(bz[k], pz[k], 1e-6);
+    }
+
+    // The copies used by the bulk conversion follow the changes of the WCS, also in the objects sharing it
+    std::vector<double> sx(n), sy(n), sz(n);
+    const std::span<double> sworld[3] = {sx, sy, sz};
+    EXPECT_EQ(shared.pixel2world(0, pixel, sworld), 0u);
+
+    wcs.changeCelestialCorrds(0,{123.0,27.4},192.25,std::make_pair(std::string("GLON"),std::string("GLAT")),"G");
+    EXPECT_EQ(wcs.pixel2world(0, pixel, world), 0u);
+    const worldVectors gal = wcs.pixel2world(0, pixelVectors({{px[0], py[0], pz[0]}}));
+    EXPECT_NEAR(wx[0], gal[0][0], 1e-12);
+    EXPECT_NEAR(wy[0], gal[0][1], 1e-12);
+
+    EXPECT_EQ(shared.pixel2world(0, pixel, sworld), 0u);
+    EXPECT_NEAR(sx[0], gal[0][0], 1e-12);
+    EXPECT_NEAR(sy[0], gal[0][1], 1e-12);
+
+    const std::span<const double> twoAxes[2] = {px, py};
+    EXPECT_THROW(wcs.pixel2world(0, twoAxes, world), WCSexception);
+    EXPECT_THROW(wcs.pixel2world(1, pixel, world), WCSexception);
+}
+
+TEST(FITS_wcs, interpolatedGrid)
+{
+    verbose = verboseLevel::VERBOSE_NONE;
+
+    FITSwcs wcs(buildFakeHDU());
+    ASSERT_EQ(wcs.getStatus(), WCSERR_SUCCESS);
+
+    // 100x100 pixels of the first plane, nodes every 8 pixels
+    FITSwcsGrid grid(wcs, 0, 100, 100);
+    EXPECT_EQ(grid.NumberOfAxis(), 3u);
+    EXPECT_EQ(grid.NumberOfCells(), 13u*13u);
+    EXPECT_EQ(grid.NumberOfExactCells(), 0u);
+    EXPECT_LE(grid.MaxError(), grid.Tolerance());
+
+    // Positions away from the nodes and from the check points
+    pixelVectors px;
+    for(size_t j = 0; j < 100; j += 3)
+        for(size_t i = 0; i < 100; i += 7)
+            px.push_back({static_cast<double>(i) + 0.3, static_cast<double>(j) + 0.6, 0.});
+
+    const worldVectors exact = wcs.pixel2world(0, px);
+    const double tolerance = grid.Tolerance() / 3600.;    // 1 arcsec pixels
+    double w[3];
+    for(size_t k = 0; k < px.size(); k++)
+    {
+        ASSERT_TRUE(grid.pixel2world(px[k][0], px[k][1], w));
+        EXPECT_NEAR(std::remainder(w[0] - exact[k][0], 360.) * std::cos(exact[k][1] * M_PI / 180.), 0., tolerance) << k;
+        EXPECT_NEAR(w[1], exact[k][1], tolerance) << k;
+        EXPECT_NEAR(w[2], exact[k][2], 1e-9 * std::abs(exact[k][2])) << k;
+    }
+
+    // Outside of the grid the caller falls back to the exact transform
+    EXPECT_FALSE(grid.pixel2world(-1., 5., w));
+    EXPECT_FALSE(grid.pixel2world(5., 200., w));
+    EXPECT_FALSE(grid.pixel2world(std::numeric_limits<double>::quiet_NaN(), 5., w));
+
+    // No inversion with a spectral axis
+    double x = 0., y = 0.;
+    EXPECT_FALSE(grid.world2pixel(exact[0].data(), x, y));
+
+    EXPECT_THROW(FITSwcsGrid(wcs, 0, 100, 100, 0), FITSexception);
+    EXPECT_THROW(FITSwcsGrid(wcs, 1, 100, 100), WCSexception);
+}
+
+TEST(FITS_wcs, concurrentReaders)
+{
+    verbose = verboseLevel::VERBOSE_NONE;
+
+    const FITSwcs wcs(buildFakeHDU());
+    ASSERT_EQ(wcs.getStatus(), WCSERR_SUCCESS);
+
+    pixelVectors px;
+    for(size_t k = 0; k < 500; k++)
+        px.push_back({static_cast<double>(k%50 + 1), static_cast<double>(k/50 + 1), static_cast<double>(k%7 + 1)});
+
+    const worldVectors ref = wcs.pixel2world(0, px);
+    const std::string header = wcs.asString(0);
+
+    // Every thread converts point by point on the same object
+    std::vector<std::thread> workers;
+    std::vector<size_t> errors(8, 0);
+    for(size_t t = 0; t < errors.size(); t++)
+        workers.emplace_back([&, t]()
+        {
+            for(size_t k = t; k < px.size(); k += 3)
+            {
+                const worldVectors wc = wcs.pixel2world(0, pixelVectors(1, px[k]));
+                const pixelVectors back = wcs.world2pixel(0, wc);
+                for(size_t a = 0; a < 3; a++)
+                    if(wc[0][a] != ref[k][a] || std::abs(back[0][a] - px[k][a]) > 1e-6)
+                        errors[t]++;
+            }
+            if(wcs.asString(0) != header)
+                errors[t]++;
+        });
+
+    for(auto& w : workers)
+        w.join();
+
+    for(size_t t = 0; t < errors.size(); t++)
+        EXPECT_EQ(errors[t], 0u) << "thread " << t;
+
+    EXPECT_EQ(wcs.getStatus(), WCSERR_SUCCESS);
+}
+
+FITShdu buildProjectionHDU(const std::string& projection)
+{
+    FITSDictionary fakeHdu;
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("SIMPLE"),FITSkeyword("T","file does conform to FITS standard")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("BITPIX"),FITSkeyword("-32","number of bits per data pixel")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("NAXIS"),FITSkeyword("3","number of data axes")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("NAXIS1"),FITSkeyword("200","length of data axis 1")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("NAXIS2"),FITSkeyword("200","length of data axis 2")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("NAXIS3"),FITSkeyword("4","length of data axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CTYPE1"),FITSkeyword("RA---"+projection,"coordinate type for axis 1")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CTYPE2"),FITSkeyword("DEC--"+projection,"coordinate type for axis 2")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CTYPE3"),FITSkeyword("FREQ","coordinate type for axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CUNIT3"),FITSkeyword("Hz","units for axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRPIX1"),FITSkeyword("100.5","reference pixel for axis 1")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRPIX2"),FITSkeyword("80.25","reference pixel for axis 2")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRPIX3"),FITSkeyword("1.0","reference pixel for axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRVAL1"),FITSkeyword("359.5","reference value for axis 1")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRVAL2"),FITSkeyword("-62.3","reference value for axis 2")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CRVAL3"),FITSkeyword("1.4204e9","reference value for axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CDELT1"),FITSkeyword("-0.05","pixel scale for axis 1")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CDELT2"),FITSkeyword("0.05","pixel scale for axis 2")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("CDELT3"),FITSkeyword("1.0e6","pixel scale for axis 3")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("PC1_1"),FITSkeyword("0.9205048535","coordinate transformation matrix")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("PC1_2"),FITSkeyword("-0.3907311285","coordinate transformation matrix")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("PC2_1"),FITSkeyword("0.3907311285","coordinate transformation matrix")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("PC2_2"),FITSkeyword("0.9205048535","coordinate transformation matrix")));
+    fakeHdu.insert(std::pair<key_code,FITSkeyword>(std::string("LONPOLE"),FITSkeyword("165.0","native longitude of the celestial pole")));
+
+    FITShdu hdu(fakeHdu);
+
+    return hdu;
+}
+
+TEST(FITS_wcs, closedFormProjection)
+{
+    verbose = verboseLevel::VERBOSE_NONE;
+
+    for(const std::string projection : {"TAN", "SIN"})
+    {
+        FITSwcs wcs(buildProjectionHDU(projection));
+        ASSERT_EQ(wcs.getStatus(), WCSERR_SUCCESS) << projection;
+
+        // 200x200 pixels of 4 planes, and one point beyond the horizon of SIN (95 deg from the reference point)
+        std::vector<double> px, py, pz;
+        for(size_t k = 0; k < 200*200*4; k += 7)
+        {
+            px.push_back(static_cast<double>(k%200) + 0.25);
+            py.push_back(static_cast<double>((k/200)%200) + 0.75);
+            pz.push_back(static_cast<double>(k/40000 + 1));
+        }
+        px.push_back(2000.5);
+        py.push_back(80.25);
+        pz.push_back(1.);
+
+        const size_t n = px.size();
+        std::vector<double> wx(n), wy(n), wz(n), bx(n), by(n), bz(n);
+        std::vector<int> status(n, -1);
+        const std::span<const double> pixel[3] = {px, py, pz};
+        const std::span<double>       world[3] = {wx, wy, wz};
+        EXPECT_EQ(wcs.pixel2world(0, pixel, world, status), projection == "SIN" ? 1u : 0u) << projection;
+
+        // Same results as WCSLIB, point by point
+        for(size_t k = 0; k + 1 < n; k++)
+        {
+            const worldVectors ref = wcs.pixel2world(0, pixelVectors({{px[k], py[k], pz[k]}}));
+            ASSERT_EQ(status[k], 0) << projection << " " << k;
+            ASSERT_NEAR(wx[k], ref[0][0], 1e-10) << projection << " " << k;
+            ASSERT_NEAR(wy[k], ref[0][1], 1e-10) << projection << " " << k;
+            ASSERT_NEAR(wz[k], ref[0][2], 1e-6) << projection << " " << k;
+        }
+
+        if(projection == "SIN")
+        {
+            EXPECT_NE(status[n-1], 0);
+            EXPECT_TRUE(std::isnan(wx[n-1]) && std::isnan(wy[n-1]) && std::isnan(wz[n-1]));
+        }
+        else
+            EXPECT_EQ(status[n-1], 0);
+
+        // Round trip, and a position on the far side of the sky
+        wx[n-1] = 179.5;
+        wy[n-1] = 62.3;
+        wz[n-1] = 1.4204e9;
+        const std::span<const double> back[3]  = {wx, wy, wz};
+        const std::span<double>       pback[3] = {bx, by, bz};
+        EXPECT_EQ(wcs.world2pixel(0, back, pback, status), 1u) << projection;
+        for(size_t k = 0; k + 1 < n; k++)
+        {
+            ASSERT_NEAR(bx[k], px[k], 1e-8) << projection << " " << k;
+            ASSERT_NEAR(by[k], py[k], 1e-8) << projection << " " << k;
+            ASSERT_NEAR(bz[k], pz[k], 1e-8) << projection << " " << k;
+        }
+        EXPECT_NE(status[n-1], 0);
+        EXPECT_TRUE(std::isnan(bx[n-1]) && std::isnan(by[n-1]));
+    }
+}